@@ -210,6 +210,9 @@ void loop() {
     // run fusion routine according to loops_per_fuse_counter_
     sensor_fusion->RunFusion();
 
+    // save an improved magnetic calibration or the filter state queued by RunFusion(), if any
+    sensor_fusion->ServiceCalibrationStore();
+
     //create and send Toolbox format packet if fusion has produced new data
     //This call is optional - if you don't want Toolbox packets, omit it
 //    sensor_fusion->ProduceToolboxOutput();
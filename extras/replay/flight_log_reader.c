@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file flight_log_reader.c
+    \brief Reads flight recorder logs on a PC without copying them.
+    See flight_log_reader.h.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flight_log_reader.h"
+#include "control.h"
+
+#define BLOCK_PAYLOAD_SIZE  (FR_BLOCK_SIZE - sizeof(FlightBlockHeader))
+
+// CRC16() a byte at a time, which on a PC is several times faster than the
+// bit at a time loop of the device. Filled in by FlightLogOpen().
+static uint16_t sCRCTable[256];
+
+static void InitCRCTable(void)
+{
+    uint8_t iByte;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        iByte = (uint8_t) i;
+        sCRCTable[i] = CRC16(&iByte, 1, 0);
+    }
+} // end InitCRCTable()
+
+static uint16_t BlockCRC(const uint8_t *pData, uint16_t iLength)
+{
+    uint16_t iCRC = 0xFFFF;
+    uint16_t i;
+
+    for (i = 0; i < iLength; i++)
+        iCRC = (uint16_t) ((iCRC << 8) ^ sCRCTable[(iCRC >> 8) ^ pData[i]]);
+    return iCRC;
+} // end BlockCRC()
+
+static const FlightBlockHeader *BlockAt(const FlightLog *pLog, uint32_t iBlock)
+{
+    return (const FlightBlockHeader *) (pLog->pBase + (size_t) iBlock * FR_BLOCK_SIZE);
+} // end BlockAt()
+
+static const uint8_t *BlockPayload(const FlightBlockHeader *pHeader)
+{
+    return (const uint8_t *) (pHeader + 1);
+} // end BlockPayload()
+
+// magic, version, type and length plausible. The CRC is checked when the block is read.
+static bool ValidHeader(const FlightBlockHeader *pHeader)
+{
+    return (pHeader->iMagic == FR_BLOCK_MAGIC) && (pHeader->iVersion == FR_FORMAT_VERSION) &&
+           ((pHeader->iType == FR_BLOCK_DATA) || (pHeader->iType == FR_BLOCK_INDEX)) &&
+           (pHeader->iUsed <= BLOCK_PAYLOAD_SIZE);
+} // end ValidHeader()
+
+static void AddEntry(FlightLog *pLog, const FlightBlockHeader *pBlock, uint64_t iFirstTime,
+                     uint32_t iFirstCycle, uint32_t iBoot)
+{
+    FlightLogEntry *pEntry = &pLog->pIndex[pLog->iNumBlocks++];
+
+    pEntry->pBlock = pBlock;
+    pEntry->iFirstTime = iFirstTime;
+    pEntry->iFirstCycle = iFirstCycle;
+    pEntry->iBoot = iBoot;
+} // end AddEntry()
+
+// If block iFirst + FR_INDEX_INTERVAL is the index block of the FR_INDEX_INTERVAL
+// blocks from iFirst, list them from it without reading them. The sequence
+// numbers of the entries must run up to the index block without a gap, which
+// fails if the device lost a write or the file was not concatenated in order.
+static bool ListFromIndex(FlightLog *pLog, uint32_t iFirst)
+{
+    const FlightBlockHeader *pHeader = BlockAt(pLog, iFirst + FR_INDEX_INTERVAL);
+    FlightIndexEntry entry;
+    int i;
+
+    if (!ValidHeader(pHeader) || (pHeader->iType != FR_BLOCK_INDEX) ||
+        (pHeader->iUsed != FR_INDEX_INTERVAL * sizeof(FlightIndexEntry)) ||
+        (BlockCRC(BlockPayload(pHeader), pHeader->iUsed) != pHeader->iCRC)) return false;
+    for (i = 0; i < FR_INDEX_INTERVAL; i++) {
+        memcpy(&entry, BlockPayload(pHeader) + i * sizeof(FlightIndexEntry), sizeof(entry));
+        if (entry.iSequence != pHeader->iSequence - FR_INDEX_INTERVAL + i) return false;
+    }
+    for (i = 0; i < FR_INDEX_INTERVAL; i++) {
+        memcpy(&entry, BlockPayload(pHeader) + i * sizeof(FlightIndexEntry), sizeof(entry));
+        AddEntry(pLog, BlockAt(pLog, iFirst + i), entry.iFirstTime, entry.iFirstCycle, entry.iBoot);
+    }
+    return true;
+} // end ListFromIndex()
+
+bool FlightLogOpen(FlightLog *pLog, const char *sPath)
+{
+    const FlightBlockHeader *pHeader;
+    const FlightRecord *pRecord;
+    struct stat st;
+    void *pMap;
+    uint32_t iBlocks;
+    uint32_t i;
+    int fd;
+
+    memset(pLog, 0, sizeof(FlightLog));
+    if (sCRCTable[1] == 0) InitCRCTable();      // before any worker reads a log
+    fd = open(sPath, O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        fprintf(stderr, "%s: %s\n", sPath, strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    iBlocks = (uint32_t) (st.st_size / FR_BLOCK_SIZE);
+    if (iBlocks == 0) {
+        fprintf(stderr, "%s: no flight recorder blocks\n", sPath);
+        close(fd);
+        return false;
+    }
+    pLog->iSize = (size_t) iBlocks * FR_BLOCK_SIZE;
+    pMap = mmap(NULL, pLog->iSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);      // the mapping keeps the file open
+    if (pMap == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", sPath, strerror(errno));
+        return false;
+    }
+    pLog->pBase = (const uint8_t *) pMap;
+    pLog->pIndex = (FlightLogEntry *) malloc(iBlocks * sizeof(FlightLogEntry));
+    if (pLog->pIndex == NULL) {
+        fprintf(stderr, "%s: out of memory\n", sPath);
+        FlightLogClose(pLog);
+        return false;
+    }
+
+    // only the index blocks are read where possible, so don't read ahead
+    madvise(pMap, pLog->iSize, MADV_RANDOM);
+    for (i = 0; i < iBlocks; ) {
+        if ((i + FR_INDEX_INTERVAL < iBlocks) && ListFromIndex(pLog, i)) {
+            i += FR_INDEX_INTERVAL + 1;
+            continue;
+        }
+        // e.g. a partial group at the end of a segment, listed from the block headers
+        pHeader = BlockAt(pLog, i++);
+        if (!ValidHeader(pHeader)) pLog->iSkippedBlocks++;
+        else if (pHeader->iType == FR_BLOCK_DATA)
+            AddEntry(pLog, pHeader, pHeader->iFirstTime, pHeader->iFirstCycle, pHeader->iBoot);
+    }
+    madvise(pMap, pLog->iSize, MADV_SEQUENTIAL);
+
+    // every data block starts with the sensitivities
+    if (pLog->iNumBlocks > 0) {
+        pHeader = pLog->pIndex[0].pBlock;
+        pRecord = (const FlightRecord *) BlockPayload(pHeader);
+        if ((pHeader->iUsed >= sizeof(FlightRecord) + sizeof(FlightSensitivity)) &&
+            (pRecord->iType == FR_REC_SENSITIVITY))
+            memcpy(&pLog->sensitivity, FlightLogPayload(pRecord), sizeof(FlightSensitivity));
+    }
+    return true;
+} // end FlightLogOpen()
+
+void FlightLogClose(FlightLog *pLog)
+{
+    if (pLog->pBase) munmap((void *) pLog->pBase, pLog->iSize);
+    free(pLog->pIndex);
+    memset(pLog, 0, sizeof(FlightLog));
+} // end FlightLogClose()
+
+// Start reading block pCursor->iBlock, or the first block after it passing its CRC.
+// Returns false at the end of the log.
+static bool EnterBlock(FlightLogCursor *pCursor)
+{
+    const FlightLog *pLog = pCursor->pLog;
+    const FlightBlockHeader *pHeader;
+
+    for (; pCursor->iBlock < pLog->iNumBlocks; pCursor->iBlock++) {
+        pHeader = pLog->pIndex[pCursor->iBlock].pBlock;
+        if (BlockCRC(BlockPayload(pHeader), pHeader->iUsed) == pHeader->iCRC) {
+            pCursor->pNext = BlockPayload(pHeader);
+            pCursor->pEnd = pCursor->pNext + pHeader->iUsed;
+            pCursor->iDroppedCycles += pHeader->iDropped;
+            return true;
+        }
+        pCursor->iBadBlocks++;
+    }
+    pCursor->pNext = pCursor->pEnd = NULL;
+    return false;
+} // end EnterBlock()
+
+void FlightLogCursorInit(FlightLogCursor *pCursor, const FlightLog *pLog, uint32_t iBlock)
+{
+    memset(pCursor, 0, sizeof(FlightLogCursor));
+    pCursor->pLog = pLog;
+    pCursor->iBlock = iBlock;
+    EnterBlock(pCursor);
+} // end FlightLogCursorInit()
+
+const FlightRecord *FlightLogNextRecord(FlightLogCursor *pCursor)
+{
+    const FlightRecord *pRecord;
+
+    for (;;) {
+        if (pCursor->pNext && (pCursor->pNext + sizeof(FlightRecord) <= pCursor->pEnd)) {
+            pRecord = (const FlightRecord *) pCursor->pNext;
+            if (pCursor->pNext + sizeof(FlightRecord) + pRecord->iLength <= pCursor->pEnd) {
+                pCursor->pNext += sizeof(FlightRecord) + pRecord->iLength;
+                return pRecord;
+            }
+            // a record overrunning its block is not trusted, nor the rest of the block
+        }
+        if (pCursor->iBlock >= pCursor->pLog->iNumBlocks) return NULL;
+        pCursor->iBlock++;
+        if (!EnterBlock(pCursor)) return NULL;
+    }
+} // end FlightLogNextRecord()
+
+// Advance to the next FR_REC_CYCLE record without reading it. Returns false at the end of the log.
+static bool SkipToCycle(FlightLogCursor *pCursor)
+{
+    FlightLogCursor ahead = *pCursor;
+    const FlightRecord *pRecord;
+
+    while ((pRecord = FlightLogNextRecord(&ahead)) != NULL) {
+        if (pRecord->iType == FR_REC_CYCLE) return true;
+        *pCursor = ahead;
+    }
+    *pCursor = ahead;
+    return false;
+} // end SkipToCycle()
+
+// time of an FR_REC_CYCLE record. The payload is only 4 byte aligned.
+static uint64_t CycleTime(const FlightRecord *pRecord)
+{
+    FlightCycle cycle;
+
+    memcpy(&cycle, FlightLogPayload(pRecord), sizeof(cycle));
+    return cycle.iTime;
+} // end CycleTime()
+
+bool FlightLogSeek(FlightLogCursor *pCursor, const FlightLog *pLog, uint32_t iBoot, uint64_t iTime)
+{
+    FlightLogCursor ahead;
+    const FlightLogEntry *pEntry;
+    const FlightRecord *pRecord;
+    uint32_t iLow = 0;
+    uint32_t iHigh = pLog->iNumBlocks;
+    uint32_t iMid;
+
+    // last block starting at or before the time, power ups being in file order
+    while (iLow < iHigh) {
+        iMid = iLow + (iHigh - iLow) / 2;
+        pEntry = &pLog->pIndex[iMid];
+        if ((pEntry->iBoot < iBoot) || ((pEntry->iBoot == iBoot) && (pEntry->iFirstTime <= iTime)))
+            iLow = iMid + 1;
+        else
+            iHigh = iMid;
+    }
+    FlightLogCursorInit(pCursor, pLog, iLow ? iLow - 1 : 0);
+
+    while (SkipToCycle(pCursor)) {
+        ahead = *pCursor;
+        pRecord = FlightLogNextRecord(&ahead);
+        pEntry = &pLog->pIndex[ahead.iBlock];
+        if (pEntry->iBoot > iBoot) break;
+        if ((pEntry->iBoot == iBoot) && (CycleTime(pRecord) >= iTime)) return true;
+        *pCursor = ahead;
+    }
+    FlightLogCursorInit(pCursor, pLog, pLog->iNumBlocks);
+    return false;
+} // end FlightLogSeek()
+
+// fReadCycle of a ReplaySource fed from a log. The cursor is left at the next
+// FR_REC_CYCLE record, so the end of the log is known before the next read.
+static void ReplayCycle(ReplaySource *pSource, struct PhysicalSensor *pSensor)
+{
+    FlightLogCursor *pCursor = (FlightLogCursor *) pSource->pReader;
+    FlightLogCursor ahead;
+    const FlightRecord *pRecord;
+    const FlightSample *pSamples;
+    uint8_t iType;
+    int i;
+
+    FlightLogNextRecord(pCursor);       // the FR_REC_CYCLE record
+    for (;;) {
+        ahead = *pCursor;
+        pRecord = FlightLogNextRecord(&ahead);
+        if ((pRecord == NULL) || (pRecord->iType == FR_REC_CYCLE)) break;
+        *pCursor = ahead;
+        switch (pRecord->iType) {
+            case FR_REC_ACCEL: iType = REPLAY_ACCEL; break;
+            case FR_REC_MAG:   iType = REPLAY_MAG; break;
+            case FR_REC_GYRO:  iType = REPLAY_GYRO; break;
+            default:           continue;
+        }
+        // a count the record is too short for is not trusted
+        if (pRecord->iCount * sizeof(FlightSample) > pRecord->iLength) continue;
+        pSamples = FlightLogSamples(pRecord);
+        for (i = 0; i < pRecord->iCount; i++) ReplayAddSample(pSensor, iType, pSamples[i]);
+    }
+    pSource->bExhausted = !SkipToCycle(pCursor);
+} // end ReplayCycle()
+
+void FlightLogReplay(ReplaySource *pSource, FlightLogCursor *pCursor)
+{
+    const FlightSensitivity *pSensitivity = &pCursor->pLog->sensitivity;
+
+    ReplaySourceInit(pSource, NULL, 0);
+    if (pSensitivity->iCountsPerg) pSource->iCountsPerg = pSensitivity->iCountsPerg;
+    if (pSensitivity->iCountsPeruT) pSource->iCountsPeruT = pSensitivity->iCountsPeruT;
+    if (pSensitivity->iCountsPerDegPerSec) pSource->iCountsPerDegPerSec = pSensitivity->iCountsPerDegPerSec;
+    pSource->fReadCycle = ReplayCycle;
+    pSource->pReader = pCursor;
+    pSource->bExhausted = !SkipToCycle(pCursor);
+} // end FlightLogReplay()
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file flight_log_reader.h
+    \brief Reads flight recorder logs on a PC without copying them
+
+    A log is mapped into memory with mmap() and never copied or converted.
+    The records handed out by FlightLogNextRecord() point into the mapping,
+    so the samples of a gigabyte recording are read straight from the page
+    cache. See flight_recorder.h for the log format.
+
+    A log file is one segment file copied off the device, or several copied
+    segments concatenated in order of their names with cat. FlightLogOpen()
+    lists the data blocks of the file in pIndex, taking them from the index
+    blocks written by the device where it can, so that only about one block
+    in FR_INDEX_INTERVAL is read while opening. FlightLogSeek() then finds a time by a binary
+    search of that list.
+
+    Times restart from 0 at each power up of the device, so a position in the
+    log is given by the power-up count iBoot together with the time.
+
+    FlightLogReplay() makes a ReplaySource of driver_replay.h read its cycles
+    from a cursor, so a log replays through the unchanged readSensors() path
+    with the samples going to addToFifo() as read from the ICs.
+*/
+
+#ifndef FLIGHT_LOG_READER_H
+#define FLIGHT_LOG_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensor_fusion.h"
+#include "flight_recorder.h"
+#include "driver_replay.h"
+
+/// One data block of the log
+typedef struct FlightLogEntry {
+    const FlightBlockHeader *pBlock;    ///< block in the mapping
+    uint64_t iFirstTime;                ///< time of the first cycle in the block (us)
+    uint32_t iFirstCycle;               ///< loop counter of the first cycle in the block
+    uint32_t iBoot;                     ///< power-up count of the device
+} FlightLogEntry;
+
+/// A mapped log file and the list of its data blocks
+typedef struct FlightLog {
+    const uint8_t *pBase;               ///< start of the mapping
+    size_t iSize;                       ///< bytes mapped, whole blocks only
+    FlightLogEntry *pIndex;             ///< data blocks in file order
+    uint32_t iNumBlocks;                ///< entries in pIndex
+    uint32_t iSkippedBlocks;            ///< blocks without a valid header, not listed
+    FlightSensitivity sensitivity;      ///< from the first data block
+} FlightLog;
+
+/// Position reached in a log. Several cursors may read one FlightLog at once.
+typedef struct FlightLogCursor {
+    const FlightLog *pLog;
+    uint32_t iBlock;                    ///< entry of pLog->pIndex being read
+    const uint8_t *pNext;               ///< next record of the block
+    const uint8_t *pEnd;                ///< end of the used part of the block
+    uint32_t iBadBlocks;                ///< blocks passed over because their CRC failed
+    uint32_t iDroppedCycles;            ///< cycles the device lost, in the blocks read so far
+} FlightLogCursor;
+
+/// X, Y and Z of one raw sample
+typedef int16_t FlightSample[3];
+
+/// Map the log file sPath and list its data blocks. Returns false if it cannot be read.
+bool FlightLogOpen(FlightLog *pLog, const char *sPath);
+
+/// Unmap the log. Cursors and records of the log may no longer be used.
+void FlightLogClose(FlightLog *pLog);
+
+/// Place pCursor at the start of data block iBlock of pLog
+void FlightLogCursorInit(FlightLogCursor *pCursor, const FlightLog *pLog, uint32_t iBlock);
+
+/// Next record, or NULL at the end of the log. Blocks failing their CRC are passed over.
+const FlightRecord *FlightLogNextRecord(FlightLogCursor *pCursor);
+
+/// Place pCursor at the first cycle of power up iBoot at or after iTime (us).
+/// Returns false, leaving the cursor at the end of the log, if there is none.
+bool FlightLogSeek(FlightLogCursor *pCursor, const FlightLog *pLog, uint32_t iBoot, uint64_t iTime);
+
+/// Feed pSource from pCursor, one FR_REC_CYCLE and the samples following it per Replay_Read()
+void FlightLogReplay(ReplaySource *pSource, FlightLogCursor *pCursor);
+
+/// Payload following a record
+static inline const void *FlightLogPayload(const FlightRecord *pRecord)
+{
+    return (const void *) (pRecord + 1);
+}
+
+/// Samples of an FR_REC_ACCEL, FR_REC_MAG or FR_REC_GYRO record, iCount of them
+static inline const FlightSample *FlightLogSamples(const FlightRecord *pRecord)
+{
+    return (const FlightSample *) (pRecord + 1);
+}
+
+#endif // FLIGHT_LOG_READER_H
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file Arduino.h
+    \brief The few Arduino functions the fusion library uses, for building it on a PC
+
+    board.h, status.c and hal_timer.c include <Arduino.h> for the LED pins and
+    micros(). The replay runner puts this directory first on the include path
+    so those files compile unchanged on Linux. LED calls do nothing.
+*/
+
+#ifndef REPLAY_HOST_ARDUINO_H
+#define REPLAY_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HIGH    0x1
+#define LOW     0x0
+#define INPUT   0x0
+#define OUTPUT  0x1
+
+static inline void pinMode(uint8_t pin, uint8_t mode) { (void) pin; (void) mode; }
+static inline void digitalWrite(uint8_t pin, uint8_t val) { (void) pin; (void) val; }
+
+// monotonic microsecond clock, wrapping like the Arduino one
+static inline unsigned long micros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ((uint64_t) ts.tv_sec * 1000000U + (uint64_t) ts.tv_nsec / 1000U);
+}
+
+static inline void delay(unsigned long ms)
+{
+    struct timespec ts = { (time_t) (ms / 1000U), (long) ((ms % 1000U) * 1000000U) };
+    nanosleep(&ts, NULL);
+}
+
+#endif // REPLAY_HOST_ARDUINO_H
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file replay_platform.c
+    \brief Host stand-ins for the hardware functions of the fusion library
+
+    The replay runner builds the C files of src/sensor_fusion on a PC. In place
+    of hal_i2c.cc and calibration_storage.cc, which need the Arduino Wire and
+    EEPROM libraries, the bus always reports success and there is no stored
+    calibration, so each replay starts from the default calibrations exactly as
+    a freshly erased board would.
+*/
+
+#include "sensor_fusion.h"
+#include "hal_i2c.h"
+#include "calibration_storage.h"
+
+bool I2CInitialize(int pin_sda, int pin_scl)
+{
+    (void) pin_sda;
+    (void) pin_scl;
+    return true;
+} // end I2CInitialize()
+
+bool GetMagCalibrationFromNVM(float *cal_values)
+{
+    (void) cal_values;
+    return false;
+} // end GetMagCalibrationFromNVM()
+
+bool GetGyroCalibrationFromNVM(float *cal_values)
+{
+    (void) cal_values;
+    return false;
+} // end GetGyroCalibrationFromNVM()
+
+bool GetAccelCalibrationFromNVM(float *cal_values)
+{
+    (void) cal_values;
+    return false;
+} // end GetAccelCalibrationFromNVM()
+
+bool GetWarmStartFromNVM(struct WarmStart9DOF *state)
+{
+    (void) state;
+    return false;
+} // end GetWarmStartFromNVM()
+
+void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg) { (void) sfg; }
+void SaveGyroCalibrationToNVM(SensorFusionGlobals *sfg) { (void) sfg; }
+void SaveAccelCalibrationToNVM(SensorFusionGlobals *sfg) { (void) sfg; }
+void SaveWarmStartToNVM(SensorFusionGlobals *sfg) { (void) sfg; }
+void SavePendingCalibrationsToNVM(SensorFusionGlobals *sfg) { (void) sfg; }
+void EraseMagCalibrationFromNVM(void) {}
+void EraseGyroCalibrationFromNVM(void) {}
+void EraseAccelCalibrationFromNVM(void) {}
+void EraseWarmStartFromNVM(void) {}
@@ -0,0 +1,803 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file replay_runner.c
+    \brief Replays recorded sensor sessions through the fusion library on a PC
+
+    Every recording named on the command line, or found with a .rec or .frl
+    extension in a directory named on the command line, is replayed by its own
+    fusion instance through readSensors(), conditionSensorReadings() and runFusion(),
+    with driver_replay.c standing in for the sensor ICs. Sessions are shared
+    out to a pool of worker threads. Each worker owns a queue of sessions and,
+    once its own queue is empty, steals from the far end of the queues of the
+    other workers, so a few long recordings do not hold up the whole batch.
+
+    For each recording <name>.rec the orientation of every fusion cycle is
+    written to <name>.csv in the output directory, and one line of statistics
+    per recording goes to summary.csv there. See README.md for the recording
+    format and build command. Flight recorder logs (.frl) are mapped into
+    memory by flight_log_reader.c and replayed from the mapping.
+
+    With -p the filter constants of FusionTuning are swept over a grid of
+    values instead. Every recording is replayed once per grid point, each
+    replay being one job for the worker pool, and the orientation is compared
+    with the reference orientations stored in the recordings. sweep.csv then
+    lists the orientation error and fusion CPU time of each grid point.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sensor_fusion.h"
+#include "control.h"
+#include "fusion.h"
+#include "status.h"
+#include "driver_replay.h"
+#include "flight_log_reader.h"
+
+#define REPLAY_EXTENSION    ".rec"
+#define FLIGHT_LOG_EXTENSION ".frl"
+#define MAX_PATH_LEN        1024
+#define MAX_LINE_LEN        256
+#define MAX_SWEEP_VALUES    64      ///< values per swept parameter
+
+/// Reference orientation of one fusion cycle
+typedef struct Reference {
+    uint32_t iCycle;                ///< cycle, counting from 0
+    Quaternion q;                   ///< true orientation, same axes as the fusion output
+} Reference;
+
+/// One recording, loaded once and only read by the workers
+typedef struct Session {
+    char sPath[MAX_PATH_LEN];       ///< recording file
+    char sName[MAX_PATH_LEN];       ///< file name without directory or extension
+    off_t iSize;                    ///< file size, larger sessions are queued first
+    bool bLoaded;                   ///< false if the recording could not be read
+    bool bFlightLog;                ///< .frl flight recorder log rather than a .rec recording
+    ReplaySource source;            ///< samples and sensitivities, copied by each job
+    FlightLog log;                  ///< mapped flight recorder log, read by a cursor per job
+    Reference *pRefs;               ///< reference orientations in cycle order
+    long iNumRefs;
+} Session;
+
+/// Results of replaying one recording with one tuning
+typedef struct Job {
+    int iSession;                   ///< index into the session table
+    int iPoint;                     ///< index into the tuning grid
+    int8_t iResult;                 ///< 0 if replayed, -1 if the recording could not be read
+    uint32_t iCycles;               ///< fusion cycles replayed
+    double fFusionMicros;           ///< thread CPU time in conditionSensorReadings() and runFusion() (us)
+    double fMaxCycleMicros;         ///< longest single fusion cycle (us)
+    int32_t iFirstMagCalCycle;      ///< first cycle with a valid magnetic calibration, -1 if none
+    int32_t iValidMagCal;           ///< solver of the final magnetic calibration
+    float fFitErrorpc;              ///< final magnetic calibration fit error (%)
+    float fB;                       ///< final geomagnetic field strength (uT)
+    uint32_t iErrorCycles;          ///< cycles compared with a reference orientation
+    double fSumSqErrorDeg;          ///< sum of squared orientation errors (deg^2)
+    double fMaxErrorDeg;            ///< largest orientation error (deg)
+} Job;
+
+/// A FusionTuning field that can be swept with -p
+typedef struct TuningParam {
+    const char *sName;
+    size_t iOffset;                 ///< offset of the float in FusionTuning
+} TuningParam;
+
+static const TuningParam sTuningParams[] = {
+    { "lpf_1dof_p",  offsetof(FusionTuning, fLPFSecs_1DOF_P_BASIC) },
+    { "lpf_3dof_g",  offsetof(FusionTuning, fLPFSecs_3DOF_G_BASIC) },
+    { "lpf_3dof_b",  offsetof(FusionTuning, fLPFSecs_3DOF_B_BASIC) },
+    { "lpf_6dof_gb", offsetof(FusionTuning, fLPFSecs_6DOF_GB_BASIC) },
+    { "qvy_6dof",    offsetof(FusionTuning, fQvY_6DOF_GY_KALMAN) },
+    { "qvg_6dof",    offsetof(FusionTuning, fQvG_6DOF_GY_KALMAN) },
+    { "qwb_6dof",    offsetof(FusionTuning, fQwb_6DOF_GY_KALMAN) },
+    { "qvy_9dof",    offsetof(FusionTuning, fQvY_9DOF_GBY_KALMAN) },
+    { "qvg_9dof",    offsetof(FusionTuning, fQvG_9DOF_GBY_KALMAN) },
+    { "qvb_9dof",    offsetof(FusionTuning, fQvB_9DOF_GBY_KALMAN) },
+    { "qwb_9dof",    offsetof(FusionTuning, fQwb_9DOF_GBY_KALMAN) },
+};
+#define NUM_TUNING_PARAMS   ((int) (sizeof(sTuningParams) / sizeof(sTuningParams[0])))
+
+/// One swept parameter and its values
+typedef struct Sweep {
+    const TuningParam *pParam;
+    float fValues[MAX_SWEEP_VALUES];
+    int iNumValues;
+} Sweep;
+
+/// Jobs waiting for one worker. The owner takes from iHead, thieves from iTail.
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    int *piJob;                     ///< indices into the job table
+    int iHead;                      ///< next job for the owner
+    int iTail;                      ///< one past the last job
+} WorkQueue;
+
+/// State shared by all workers
+typedef struct Pool {
+    const Session *pSessions;
+    Job *pJobs;
+    const Sweep *pSweeps;           ///< swept parameters, the first varying slowest
+    int iNumSweeps;
+    int iNumPoints;                 ///< number of tuning grid points
+    uint32_t iWarmupCycles;         ///< cycles left out of the error statistics
+    WorkQueue *pQueues;
+    int iWorkers;
+    const char *sOutDir;
+} Pool;
+
+/// Argument of each worker thread
+typedef struct Worker {
+    Pool *pPool;
+    int iIndex;
+} Worker;
+
+// thread CPU time in microseconds, unaffected by the other workers
+static double ThreadMicros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+} // end ThreadMicros()
+
+// Append a reference orientation for cycle iCycle. Returns false if out of memory.
+static bool AddReference(Session *pSession, long *piCapacity, uint32_t iCycle, const float fq[4])
+{
+    Reference *pGrown;
+
+    if (pSession->iNumRefs == *piCapacity) {
+        *piCapacity = *piCapacity ? 2 * *piCapacity : 1024;
+        pGrown = (Reference *) realloc(pSession->pRefs, *piCapacity * sizeof(Reference));
+        if (pGrown == NULL) return false;
+        pSession->pRefs = pGrown;
+    }
+    pSession->pRefs[pSession->iNumRefs].iCycle = iCycle;
+    pSession->pRefs[pSession->iNumRefs].q.q0 = fq[0];
+    pSession->pRefs[pSession->iNumRefs].q.q1 = fq[1];
+    pSession->pRefs[pSession->iNumRefs].q.q2 = fq[2];
+    pSession->pRefs[pSession->iNumRefs].q.q3 = fq[3];
+    pSession->iNumRefs++;
+    return true;
+} // end AddReference()
+
+// Read a recording into newly allocated sample and reference arrays of the
+// session. Returns false if the file cannot be read or a line is malformed.
+static bool LoadRecording(Session *pSession)
+{
+    const char *sPath = pSession->sPath;
+    ReplaySource *pSource = &pSession->source;
+    FILE *fp;
+    char sLine[MAX_LINE_LEN];
+    char cType;
+    int iValues[3];
+    float fq[4];
+    int iFields;
+    long iCount = 0;
+    long iCapacity = 4096;
+    long iRefCapacity = 0;
+    long iLine = 0;
+    uint32_t iCycle = 0;
+    ReplaySample *pSamples;
+    ReplaySample *pGrown;
+
+    ReplaySourceInit(pSource, NULL, 0);
+    pSession->pRefs = NULL;
+    pSession->iNumRefs = 0;
+
+    fp = fopen(sPath, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", sPath, strerror(errno));
+        return false;
+    }
+    pSamples = (ReplaySample *) malloc(iCapacity * sizeof(ReplaySample));
+
+    while (pSamples && fgets(sLine, sizeof(sLine), fp)) {
+        iLine++;
+        iFields = sscanf(sLine, " %c %d %d %d", &cType, &iValues[0], &iValues[1], &iValues[2]);
+        if ((iFields <= 0) || (cType == '#')) continue;     // blank line or comment
+
+        // sensitivities apply to the whole recording and are not stored as samples
+        if (cType == 'S') {
+            if (iFields != 4) break;
+            pSource->iCountsPerg = (int16_t) iValues[0];
+            pSource->iCountsPeruT = (int16_t) iValues[1];
+            pSource->iCountsPerDegPerSec = (int16_t) iValues[2];
+            continue;
+        }
+
+        // reference orientation of the cycle being read
+        if (cType == 'R') {
+            if ((sscanf(sLine, " %c %f %f %f %f", &cType, &fq[0], &fq[1], &fq[2], &fq[3]) != 5) ||
+                !AddReference(pSession, &iRefCapacity, iCycle, fq)) break;
+            continue;
+        }
+
+        if (iCount == iCapacity) {
+            iCapacity *= 2;
+            pGrown = (ReplaySample *) realloc(pSamples, iCapacity * sizeof(ReplaySample));
+            if (pGrown == NULL) {
+                free(pSamples);
+                pSamples = NULL;
+                break;
+            }
+            pSamples = pGrown;
+        }
+        switch (cType) {
+            case 'A': pSamples[iCount].iType = REPLAY_ACCEL; break;
+            case 'M': pSamples[iCount].iType = REPLAY_MAG; break;
+            case 'G': pSamples[iCount].iType = REPLAY_GYRO; break;
+            case 'E': pSamples[iCount].iType = REPLAY_END_CYCLE; iCycle++; break;
+            default:  iFields = -1; break;
+        }
+        if ((iFields != 4) && !((cType == 'E') && (iFields == 1))) break;
+        if (cType != 'E') {
+            pSamples[iCount].iSample[CHX] = (int16_t) iValues[0];
+            pSamples[iCount].iSample[CHY] = (int16_t) iValues[1];
+            pSamples[iCount].iSample[CHZ] = (int16_t) iValues[2];
+        }
+        iCount++;
+    }
+
+    if (pSamples && !feof(fp)) {
+        fprintf(stderr, "%s:%ld: malformed line\n", sPath, iLine);
+        free(pSamples);
+        pSamples = NULL;
+    }
+    fclose(fp);
+    if (pSamples == NULL) {
+        free(pSession->pRefs);
+        pSession->pRefs = NULL;
+        pSession->iNumRefs = 0;
+        return false;
+    }
+    pSource->pSamples = pSamples;
+    pSource->iNumSamples = (uint32_t) iCount;
+    return true;
+} // end LoadRecording()
+
+// orientation computed by the most complete algorithm in this build
+static void GetOrientation(SensorFusionGlobals *sfg, Quaternion *pq, float *pfPhi, float *pfThe, float *pfRho)
+{
+#if F_9DOF_GBY_KALMAN
+    *pq = sfg->SV_9DOF_GBY_KALMAN.fqPl;
+    *pfPhi = sfg->SV_9DOF_GBY_KALMAN.fPhiPl;
+    *pfThe = sfg->SV_9DOF_GBY_KALMAN.fThePl;
+    *pfRho = sfg->SV_9DOF_GBY_KALMAN.fRhoPl;
+#elif F_6DOF_GY_KALMAN
+    *pq = sfg->SV_6DOF_GY_KALMAN.fqPl;
+    *pfPhi = sfg->SV_6DOF_GY_KALMAN.fPhiPl;
+    *pfThe = sfg->SV_6DOF_GY_KALMAN.fThePl;
+    *pfRho = sfg->SV_6DOF_GY_KALMAN.fRhoPl;
+#elif F_6DOF_GB_BASIC
+    *pq = sfg->SV_6DOF_GB_BASIC.fLPq;
+    *pfPhi = sfg->SV_6DOF_GB_BASIC.fLPPhi;
+    *pfThe = sfg->SV_6DOF_GB_BASIC.fLPThe;
+    *pfRho = sfg->SV_6DOF_GB_BASIC.fLPRho;
+#elif F_3DOF_Y_BASIC
+    *pq = sfg->SV_3DOF_Y_BASIC.fq;
+    *pfPhi = sfg->SV_3DOF_Y_BASIC.fPhi;
+    *pfThe = sfg->SV_3DOF_Y_BASIC.fThe;
+    *pfRho = sfg->SV_3DOF_Y_BASIC.fRho;
+#elif F_3DOF_B_BASIC
+    *pq = sfg->SV_3DOF_B_BASIC.fLPq;
+    *pfPhi = sfg->SV_3DOF_B_BASIC.fLPPhi;
+    *pfThe = sfg->SV_3DOF_B_BASIC.fLPThe;
+    *pfRho = sfg->SV_3DOF_B_BASIC.fLPRho;
+#elif F_3DOF_G_BASIC
+    *pq = sfg->SV_3DOF_G_BASIC.fLPq;
+    *pfPhi = sfg->SV_3DOF_G_BASIC.fLPPhi;
+    *pfThe = sfg->SV_3DOF_G_BASIC.fLPThe;
+    *pfRho = sfg->SV_3DOF_G_BASIC.fLPRho;
+#else
+    pq->q0 = 1.0F;
+    pq->q1 = pq->q2 = pq->q3 = 0.0F;
+    *pfPhi = *pfThe = *pfRho = 0.0F;
+#endif
+} // end GetOrientation()
+
+// angle of the rotation between two orientations (deg)
+static double OrientationErrorDeg(const Quaternion *pq, const Quaternion *pqRef)
+{
+    double fDot;
+
+    fDot = fabs((double) pq->q0 * pqRef->q0 + (double) pq->q1 * pqRef->q1 +
+                (double) pq->q2 * pqRef->q2 + (double) pq->q3 * pqRef->q3);
+    if (fDot > 1.0) fDot = 1.0;
+    return 2.0 * acos(fDot) * 180.0 / M_PI;
+} // end OrientationErrorDeg()
+
+// FusionTuning of one grid point: the defaults with the swept fields replaced
+static void GetGridTuning(const Pool *pPool, int iPoint, FusionTuning *pTuning)
+{
+    int i;
+
+    fInitializeFusionTuning(pTuning);
+    for (i = pPool->iNumSweeps - 1; i >= 0; i--) {
+        const Sweep *pSweep = &pPool->pSweeps[i];
+        *(float *) ((char *) pTuning + pSweep->pParam->iOffset) = pSweep->fValues[iPoint % pSweep->iNumValues];
+        iPoint /= pSweep->iNumValues;
+    }
+} // end GetGridTuning()
+
+// Replay one recording with a fusion instance of its own. The main loop
+// mirrors SensorFusion::ReadSensors() and SensorFusion::RunFusion(). The
+// per cycle orientation is only written when there is no sweep.
+static void RunJob(const Pool *pPool, Job *pJob)
+{
+    const Session *pSession = &pPool->pSessions[pJob->iSession];
+    SensorFusionGlobals *sfg;
+    StatusSubsystem *pStatus;
+    ControlSubsystem *pControl;
+    struct PhysicalSensor *pSensor;
+    ReplaySource source;
+    FlightLogCursor cursor;
+    FusionTuning tuning;
+    const Reference *pRef = pSession->pRefs;
+    const Reference *pRefEnd = pSession->pRefs + pSession->iNumRefs;
+    char sOutPath[2 * MAX_PATH_LEN];
+    FILE *fp = NULL;
+    Quaternion fq;
+    float fPhi, fThe, fRho;
+    double fStart, fElapsed, fError;
+
+    pJob->iResult = -1;
+    if (!pSession->bLoaded) return;
+    if (pSession->bFlightLog) {
+        FlightLogCursorInit(&cursor, &pSession->log, 0);
+        FlightLogReplay(&source, &cursor);
+    } else {
+        source = pSession->source;  // own read position, shared samples
+    }
+
+    if (pPool->iNumSweeps == 0) {
+        snprintf(sOutPath, sizeof(sOutPath), "%s/%s.csv", pPool->sOutDir, pSession->sName);
+        fp = fopen(sOutPath, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "%s: %s\n", sOutPath, strerror(errno));
+            return;
+        }
+    }
+
+    sfg = (SensorFusionGlobals *) calloc(1, sizeof(SensorFusionGlobals));
+    pStatus = (StatusSubsystem *) calloc(1, sizeof(StatusSubsystem));
+    pControl = (ControlSubsystem *) calloc(1, sizeof(ControlSubsystem));
+    pSensor = (struct PhysicalSensor *) calloc(1, sizeof(struct PhysicalSensor));
+    if (!sfg || !pStatus || !pControl || !pSensor) {
+        fprintf(stderr, "%s: out of memory\n", pSession->sPath);
+    } else {
+        initializeStatusSubsystem(pStatus);
+        initSensorFusionGlobals(sfg, pStatus, pControl);
+        GetGridTuning(pPool, pJob->iPoint, &tuning);
+        fSetFusionTuning(sfg, &tuning);
+        sfg->installSensor(sfg, pSensor, 0, 1, NULL, Replay_Init, Replay_Read);
+        ReplayAttach(pSensor, &source);
+        sfg->initializeFusionEngine(sfg, -1, -1);
+
+        pJob->iCycles = 0;
+        pJob->fFusionMicros = 0.0;
+        pJob->fMaxCycleMicros = 0.0;
+        pJob->iFirstMagCalCycle = -1;
+        pJob->iErrorCycles = 0;
+        pJob->fSumSqErrorDeg = 0.0;
+        pJob->fMaxErrorDeg = 0.0;
+        if (fp) fprintf(fp, "cycle,q0,q1,q2,q3,roll,pitch,compass\n");
+        while (!ReplayFinished(&source)) {
+            sfg->readSensors(sfg, 1);
+
+            fStart = ThreadMicros();
+            sfg->conditionSensorReadings(sfg);
+            sfg->runFusion(sfg);
+            fElapsed = ThreadMicros() - fStart;
+
+            sfg->loopcounter++;
+            if (0 == sfg->loopcounter % 4) sfg->updateStatus(sfg);
+            sfg->queueStatus(sfg, NORMAL);
+
+            pJob->fFusionMicros += fElapsed;
+            if (fElapsed > pJob->fMaxCycleMicros) pJob->fMaxCycleMicros = fElapsed;
+#if F_USING_MAG
+            if ((pJob->iFirstMagCalCycle < 0) && sfg->MagCal.iValidMagCal)
+                pJob->iFirstMagCalCycle = (int32_t) pJob->iCycles;
+#endif
+            GetOrientation(sfg, &fq, &fPhi, &fThe, &fRho);
+            if (fp) fprintf(fp, "%u,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f\n", pJob->iCycles,
+                            fq.q0, fq.q1, fq.q2, fq.q3, fPhi, fThe, fRho);
+
+            while ((pRef < pRefEnd) && (pRef->iCycle < pJob->iCycles)) pRef++;
+            if ((pRef < pRefEnd) && (pRef->iCycle == pJob->iCycles) &&
+                (pJob->iCycles >= pPool->iWarmupCycles)) {
+                fError = OrientationErrorDeg(&fq, &pRef->q);
+                pJob->iErrorCycles++;
+                pJob->fSumSqErrorDeg += fError * fError;
+                if (fError > pJob->fMaxErrorDeg) pJob->fMaxErrorDeg = fError;
+            }
+            pJob->iCycles++;
+        }
+#if F_USING_MAG
+        pJob->iValidMagCal = sfg->MagCal.iValidMagCal;
+        pJob->fFitErrorpc = sfg->MagCal.fFitErrorpc;
+        pJob->fB = sfg->MagCal.fB;
+#endif
+        pJob->iResult = 0;
+    }
+
+    if (fp) fclose(fp);
+    free(pSensor);
+    free(pControl);
+    free(pStatus);
+    free(sfg);
+} // end RunJob()
+
+// Take the next job from the worker's own queue, or steal one from the
+// tail of another worker's queue. Returns -1 once every queue is empty.
+static int NextJob(Pool *pPool, int iWorker)
+{
+    WorkQueue *pQueue;
+    int iJob = -1;
+    int i;
+
+    pQueue = &pPool->pQueues[iWorker];
+    pthread_mutex_lock(&pQueue->lock);
+    if (pQueue->iHead < pQueue->iTail) iJob = pQueue->piJob[pQueue->iHead++];
+    pthread_mutex_unlock(&pQueue->lock);
+
+    for (i = 1; (iJob < 0) && (i < pPool->iWorkers); i++) {
+        pQueue = &pPool->pQueues[(iWorker + i) % pPool->iWorkers];
+        pthread_mutex_lock(&pQueue->lock);
+        if (pQueue->iHead < pQueue->iTail) iJob = pQueue->piJob[--pQueue->iTail];
+        pthread_mutex_unlock(&pQueue->lock);
+    }
+    return iJob;
+} // end NextJob()
+
+static void *WorkerThread(void *pArg)
+{
+    Worker *pWorker = (Worker *) pArg;
+    int iJob;
+
+    while ((iJob = NextJob(pWorker->pPool, pWorker->iIndex)) >= 0)
+        RunJob(pWorker->pPool, &pWorker->pPool->pJobs[iJob]);
+    return NULL;
+} // end WorkerThread()
+
+// largest first, so that stealing evens out the finish times
+static int CompareSize(const void *pA, const void *pB)
+{
+    off_t iA = ((const Session *) pA)->iSize;
+    off_t iB = ((const Session *) pB)->iSize;
+    return (iA < iB) - (iA > iB);
+} // end CompareSize()
+
+// true if sName ends in sExtension, with something before it
+static bool HasExtension(const char *sName, const char *sExtension)
+{
+    size_t iLen = strlen(sName);
+
+    return (iLen > strlen(sExtension)) && (strcmp(&sName[iLen - strlen(sExtension)], sExtension) == 0);
+} // end HasExtension()
+
+// Add one recording to the session table. Returns false if out of memory.
+static bool AddSession(Session **ppSessions, int *piCount, int *piCapacity, const char *sPath)
+{
+    Session *pSession;
+    Session *pGrown;
+    struct stat st;
+    const char *sBase;
+
+    if (*piCount == *piCapacity) {
+        *piCapacity = *piCapacity ? 2 * *piCapacity : 64;
+        pGrown = (Session *) realloc(*ppSessions, *piCapacity * sizeof(Session));
+        if (pGrown == NULL) return false;
+        *ppSessions = pGrown;
+    }
+    pSession = &(*ppSessions)[(*piCount)++];
+    memset(pSession, 0, sizeof(Session));
+    snprintf(pSession->sPath, sizeof(pSession->sPath), "%s", sPath);
+    sBase = strrchr(sPath, '/');
+    sBase = sBase ? sBase + 1 : sPath;
+    snprintf(pSession->sName, sizeof(pSession->sName), "%s", sBase);
+    pSession->bFlightLog = HasExtension(sPath, FLIGHT_LOG_EXTENSION);
+    if (pSession->bFlightLog)
+        pSession->sName[strlen(pSession->sName) - strlen(FLIGHT_LOG_EXTENSION)] = '\0';
+    else if (HasExtension(pSession->sName, REPLAY_EXTENSION))
+        pSession->sName[strlen(pSession->sName) - strlen(REPLAY_EXTENSION)] = '\0';
+    pSession->iSize = (stat(sPath, &st) == 0) ? st.st_size : 0;
+    return true;
+} // end AddSession()
+
+// Add a recording, or every *.rec and *.frl file of a directory
+static bool AddPath(Session **ppSessions, int *piCount, int *piCapacity, const char *sPath)
+{
+    struct stat st;
+    struct dirent *pEntry;
+    DIR *pDir;
+    char sFile[MAX_PATH_LEN];
+    bool ok = true;
+
+    if ((stat(sPath, &st) != 0) || !S_ISDIR(st.st_mode))
+        return AddSession(ppSessions, piCount, piCapacity, sPath);
+
+    pDir = opendir(sPath);
+    if (pDir == NULL) {
+        fprintf(stderr, "%s: %s\n", sPath, strerror(errno));
+        return true;
+    }
+    while (ok && (pEntry = readdir(pDir)) != NULL) {
+        if (!HasExtension(pEntry->d_name, REPLAY_EXTENSION) &&
+            !HasExtension(pEntry->d_name, FLIGHT_LOG_EXTENSION)) continue;
+        snprintf(sFile, sizeof(sFile), "%s/%s", sPath, pEntry->d_name);
+        ok = AddSession(ppSessions, piCount, piCapacity, sFile);
+    }
+    closedir(pDir);
+    return ok;
+} // end AddPath()
+
+// Parse a -p argument "name=v1,v2,..." into a new sweep. Returns false if malformed.
+static bool AddSweep(Sweep *pSweeps, int *piNumSweeps, const char *sArg)
+{
+    Sweep *pSweep = &pSweeps[*piNumSweeps];
+    const char *sValues = strchr(sArg, '=');
+    char *sEnd;
+    int i;
+
+    if (sValues == NULL) return false;
+    pSweep->pParam = NULL;
+    for (i = 0; i < NUM_TUNING_PARAMS; i++)
+        if ((strlen(sTuningParams[i].sName) == (size_t) (sValues - sArg)) &&
+            (strncmp(sTuningParams[i].sName, sArg, sValues - sArg) == 0))
+            pSweep->pParam = &sTuningParams[i];
+    if (pSweep->pParam == NULL) return false;
+    for (i = 0; i < *piNumSweeps; i++)
+        if (pSweeps[i].pParam == pSweep->pParam) return false;     // each parameter once
+
+    pSweep->iNumValues = 0;
+    do {
+        if (pSweep->iNumValues == MAX_SWEEP_VALUES) return false;
+        sValues++;      // past '=' or ','
+        pSweep->fValues[pSweep->iNumValues++] = strtof(sValues, &sEnd);
+        if (sEnd == sValues) return false;
+        sValues = sEnd;
+    } while (*sValues == ',');
+    if (*sValues != '\0') return false;
+    (*piNumSweeps)++;
+    return true;
+} // end AddSweep()
+
+// Write sweep.csv, one line per grid point with the errors over all sessions,
+// and print the grid point with the lowest RMS orientation error.
+static bool WriteSweep(const Pool *pPool, int iNumSessions)
+{
+    char sPath[MAX_PATH_LEN];
+    FILE *fp;
+    FusionTuning tuning;
+    uint32_t iCycles, iErrorCycles;
+    double fMicros, fSumSq, fMax, fRMS;
+    double fBestRMS = -1.0;
+    int iBest = -1;
+    int iPoint, i;
+
+    snprintf(sPath, sizeof(sPath), "%s/sweep.csv", pPool->sOutDir);
+    fp = fopen(sPath, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", sPath, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "point");
+    for (i = 0; i < pPool->iNumSweeps; i++) fprintf(fp, ",%s", pPool->pSweeps[i].pParam->sName);
+    fprintf(fp, ",cycles,error_cycles,rms_error_deg,max_error_deg,fusion_us_mean\n");
+
+    for (iPoint = 0; iPoint < pPool->iNumPoints; iPoint++) {
+        iCycles = iErrorCycles = 0;
+        fMicros = fSumSq = fMax = 0.0;
+        for (i = 0; i < iNumSessions; i++) {
+            const Job *pJob = &pPool->pJobs[iPoint * iNumSessions + i];
+            if (pJob->iResult != 0) continue;
+            iCycles += pJob->iCycles;
+            iErrorCycles += pJob->iErrorCycles;
+            fMicros += pJob->fFusionMicros;
+            fSumSq += pJob->fSumSqErrorDeg;
+            if (pJob->fMaxErrorDeg > fMax) fMax = pJob->fMaxErrorDeg;
+        }
+        fRMS = iErrorCycles ? sqrt(fSumSq / iErrorCycles) : 0.0;
+        if (iErrorCycles && ((iBest < 0) || (fRMS < fBestRMS))) {
+            iBest = iPoint;
+            fBestRMS = fRMS;
+        }
+
+        GetGridTuning(pPool, iPoint, &tuning);
+        fprintf(fp, "%d", iPoint);
+        for (i = 0; i < pPool->iNumSweeps; i++)
+            fprintf(fp, ",%g", *(const float *) ((const char *) &tuning + pPool->pSweeps[i].pParam->iOffset));
+        fprintf(fp, ",%u,%u,%.4f,%.4f,%.2f\n", iCycles, iErrorCycles, fRMS, fMax,
+                iCycles ? fMicros / iCycles : 0.0);
+    }
+    fclose(fp);
+
+    if (iBest < 0) {
+        printf("no reference orientations after the warm up, errors not computed\n");
+    } else {
+        GetGridTuning(pPool, iBest, &tuning);
+        printf("lowest RMS error %.4f deg at point %d:", fBestRMS, iBest);
+        for (i = 0; i < pPool->iNumSweeps; i++)
+            printf(" %s=%g", pPool->pSweeps[i].pParam->sName,
+                   *(const float *) ((const char *) &tuning + pPool->pSweeps[i].pParam->iOffset));
+        printf("\n");
+    }
+    return true;
+} // end WriteSweep()
+
+static void Usage(const char *sProgram)
+{
+    int i;
+
+    fprintf(stderr, "usage: %s [-j workers] [-o output_dir] [-w warmup_cycles]\n"
+                    "       [-p parameter=value,value,...]... recording.rec|log.frl|directory ...\n"
+                    "parameters:", sProgram);
+    for (i = 0; i < NUM_TUNING_PARAMS; i++) fprintf(stderr, " %s", sTuningParams[i].sName);
+    fprintf(stderr, "\n");
+} // end Usage()
+
+int main(int argc, char *argv[])
+{
+    Pool pool;
+    Session *pSessions = NULL;
+    Job *pJobs;
+    Sweep sweeps[NUM_TUNING_PARAMS];
+    Worker *pWorkers;
+    pthread_t *pThreads;
+    int iNumSessions = 0;
+    int iNumSweeps = 0;
+    int iNumPoints = 1;
+    int iNumJobs;
+    int iCapacity = 0;
+    int iWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    long iWarmup = 0;
+    const char *sOutDir = ".";
+    char sSummary[MAX_PATH_LEN];
+    FILE *fp;
+    int iFailed = 0;
+    int opt;
+    int i, j;
+
+    while ((opt = getopt(argc, argv, "j:o:p:w:")) != -1) {
+        switch (opt) {
+            case 'j': iWorkers = atoi(optarg); break;
+            case 'o': sOutDir = optarg; break;
+            case 'w': iWarmup = atol(optarg); break;
+            case 'p':
+                if (!AddSweep(sweeps, &iNumSweeps, optarg)) {
+                    fprintf(stderr, "bad or repeated parameter sweep: %s\n", optarg);
+                    Usage(argv[0]);
+                    return 2;
+                }
+                iNumPoints *= sweeps[iNumSweeps - 1].iNumValues;
+                break;
+            default:  Usage(argv[0]); return 2;
+        }
+    }
+    if ((optind >= argc) || (iWarmup < 0)) {
+        Usage(argv[0]);
+        return 2;
+    }
+    for (i = optind; i < argc; i++) {
+        if (!AddPath(&pSessions, &iNumSessions, &iCapacity, argv[i])) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    if (iNumSessions == 0) {
+        fprintf(stderr, "no recordings found\n");
+        return 1;
+    }
+
+    // every recording is read once and shared by the jobs of all grid points
+    qsort(pSessions, iNumSessions, sizeof(Session), CompareSize);
+    for (i = 0; i < iNumSessions; i++) {
+        if (pSessions[i].bFlightLog) pSessions[i].bLoaded = FlightLogOpen(&pSessions[i].log, pSessions[i].sPath);
+        else pSessions[i].bLoaded = LoadRecording(&pSessions[i]);
+    }
+
+    // job iPoint * iNumSessions + iSession replays one session with one tuning
+    iNumJobs = iNumPoints * iNumSessions;
+    pJobs = (Job *) calloc(iNumJobs, sizeof(Job));
+    if (pJobs == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < iNumJobs; i++) {
+        pJobs[i].iSession = i % iNumSessions;
+        pJobs[i].iPoint = i / iNumSessions;
+    }
+    if (iWorkers < 1) iWorkers = 1;
+    if (iWorkers > iNumJobs) iWorkers = iNumJobs;
+
+    // deal the jobs round robin, largest session first, into one queue per worker
+    pool.pSessions = pSessions;
+    pool.pJobs = pJobs;
+    pool.pSweeps = sweeps;
+    pool.iNumSweeps = iNumSweeps;
+    pool.iNumPoints = iNumPoints;
+    pool.iWarmupCycles = (uint32_t) iWarmup;
+    pool.iWorkers = iWorkers;
+    pool.sOutDir = sOutDir;
+    pool.pQueues = (WorkQueue *) calloc(iWorkers, sizeof(WorkQueue));
+    pWorkers = (Worker *) calloc(iWorkers, sizeof(Worker));
+    pThreads = (pthread_t *) calloc(iWorkers, sizeof(pthread_t));
+    if (!pool.pQueues || !pWorkers || !pThreads) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < iWorkers; i++) {
+        pthread_mutex_init(&pool.pQueues[i].lock, NULL);
+        pool.pQueues[i].piJob = (int *) calloc(iNumJobs / iWorkers + 1, sizeof(int));
+        if (pool.pQueues[i].piJob == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < iNumSessions; i++) {
+        for (j = 0; j < iNumPoints; j++) {
+            int iJob = j * iNumSessions + i;
+            WorkQueue *pQueue = &pool.pQueues[(i * iNumPoints + j) % iWorkers];
+            pQueue->piJob[pQueue->iTail++] = iJob;
+        }
+    }
+
+    for (i = 0; i < iWorkers; i++) {
+        pWorkers[i].pPool = &pool;
+        pWorkers[i].iIndex = i;
+        if (pthread_create(&pThreads[i], NULL, WorkerThread, &pWorkers[i]) != 0) {
+            // the workers already running will steal this worker's jobs
+            fprintf(stderr, "could not start worker %d\n", i);
+            pThreads[i] = pthread_self();
+        }
+    }
+    for (i = 0; i < iWorkers; i++)
+        if (!pthread_equal(pThreads[i], pthread_self())) pthread_join(pThreads[i], NULL);
+
+    snprintf(sSummary, sizeof(sSummary), "%s/summary.csv", sOutDir);
+    fp = fopen(sSummary, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", sSummary, strerror(errno));
+        return 1;
+    }
+    fprintf(fp, "session,point,result,cycles,fusion_us_mean,fusion_us_max,"
+                "first_magcal_cycle,magcal_solver,fit_error_pc,field_uT,"
+                "error_cycles,rms_error_deg,max_error_deg\n");
+    for (i = 0; i < iNumJobs; i++) {
+        const Job *pJob = &pJobs[i];
+        if (pJob->iResult != 0) iFailed++;
+        fprintf(fp, "%s,%d,%s,%u,%.2f,%.2f,%d,%d,%.2f,%.2f,%u,%.4f,%.4f\n",
+                pSessions[pJob->iSession].sName, pJob->iPoint,
+                pJob->iResult ? "failed" : "ok", pJob->iCycles,
+                pJob->iCycles ? pJob->fFusionMicros / pJob->iCycles : 0.0,
+                pJob->fMaxCycleMicros, pJob->iFirstMagCalCycle,
+                pJob->iValidMagCal, pJob->fFitErrorpc, pJob->fB, pJob->iErrorCycles,
+                pJob->iErrorCycles ? sqrt(pJob->fSumSqErrorDeg / pJob->iErrorCycles) : 0.0,
+                pJob->fMaxErrorDeg);
+    }
+    fclose(fp);
+    if ((iNumSweeps > 0) && !WriteSweep(&pool, iNumSessions)) return 1;
+
+    printf("%d sessions x %d tunings replayed by %d workers, %d failed\n",
+           iNumSessions, iNumPoints, iWorkers, iFailed);
+    for (i = 0; i < iNumSessions; i++) {
+        free((void *) pSessions[i].source.pSamples);
+        free(pSessions[i].pRefs);
+        if (pSessions[i].bFlightLog && pSessions[i].bLoaded) FlightLogClose(&pSessions[i].log);
+    }
+    return iFailed ? 1 : 0;
+} // end main()
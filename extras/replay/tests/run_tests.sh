@@ -0,0 +1,42 @@
+#!/bin/sh
+# Builds and runs the host tests of the fusion library. Run from the repository root:
+#   sh extras/replay/tests/run_tests.sh
+# Each test links the C files of src/sensor_fusion with the replay platform stand-ins
+# and exits non-zero on failure. Binaries go to $TEST_OUT (default /tmp/sensor_fusion_tests),
+# and each test is given $TEST_OUT/<test name>.dat as a scratch file.
+
+set -e
+
+OUT=${TEST_OUT:-/tmp/sensor_fusion_tests}
+CC=${CC:-gcc}
+CFLAGS="-O2 -Wall -pthread -ffp-contract=off -Iextras/replay/host -Iextras/replay -Isrc -Isrc/sensor_fusion"
+LIBSRC="$(ls src/sensor_fusion/*.c | grep -v driver_fx) $(ls extras/replay/*.c | grep -v replay_runner.c)"
+
+mkdir -p "$OUT"
+failed=0
+
+# run_test <test name> <binary suffix> [extra compiler flags]
+run_test()
+{
+    name=$1
+    bin="$OUT/$1$2"
+    shift 2
+    $CC $CFLAGS "$@" "extras/replay/tests/$name.c" $LIBSRC -lm -o "$bin"
+    if "$bin" "$OUT/$name.dat"; then
+        echo "PASS $name $*"
+    else
+        echo "FAIL $name $*"
+        failed=1
+    fi
+}
+
+run_test test_quaternion ""
+run_test test_quaternion _scalar -DF_QUATERNION_SCALAR
+run_test test_eigen ""
+run_test test_voting ""
+run_test test_flight_log ""
+# the joint update writes the reference the sequential update is compared with
+run_test test_sequential_update _joint -DF_9DOF_SEQUENTIAL_UPDATE=0
+run_test test_sequential_update _sequential -DF_9DOF_SEQUENTIAL_UPDATE=1
+
+exit $failed
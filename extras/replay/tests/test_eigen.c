@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file test_eigen.c
+    \brief Checks the early exit of the Jacobi eigensolvers against full sweeps
+
+    fEigenCompute10(), fEigenCompute4() and the time sliced fComputeEigSliceNext() stop
+    rotating an element once it is too small to change the diagonal in float precision.
+    The reference below rotates every non-zero element, sweep after sweep, until all
+    above diagonal elements are exactly zero as the solvers used to. For random symmetric
+    10x10 and 4x4 matrices, both indefinite and positive definite with a wide eigenvalue
+    spread like the magnetic calibration matrices, the eigenvalues and the eigenvectors
+    of separated eigenvalues must agree, and A.v = lambda.v must hold for every pair.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensor_fusion.h"
+#include "matrix.h"
+
+#define NUM_MATRICES    2000        // random matrices of each size and kind
+#define NITERATIONS     15          // sweep limit, as in the solvers
+#define EIGVAL_TOL      2E-6F       // eigenvalue difference relative to the largest eigenvalue
+#define EIGVEC_TOL      2E-4F       // 1 - |cos(angle)| between eigenvectors of separated eigenvalues
+#define RESIDUAL_TOL    5E-6F       // |A.v - lambda.v| relative to the largest eigenvalue
+#define MIN_GAP         1E-3F       // eigenvalues closer than this relative gap have no unique eigenvector
+
+static float fMaxEigvalErr, fMaxEigvecErr, fMaxResidual;
+
+static float RandomUniform(void)
+{
+    return 2.0F * ((float) rand() / (float) RAND_MAX) - 1.0F;
+}
+
+// fills the top left n x n of A with a random symmetric matrix. iKind 0 has uniform entries,
+// iKind 1 is X^T.X for a random 2n x n matrix X with columns scaled over three decades
+static void RandomSymmetric(float A[10][10], int8_t n, int8_t iKind)
+{
+    float X[20][10];
+    float fScale[10];
+    int8_t i, j, k;
+
+    memset(A, 0, 100 * sizeof(float));
+    if (iKind == 0)
+    {
+        for (i = 0; i < n; i++)
+            for (j = i; j < n; j++)
+                A[i][j] = A[j][i] = RandomUniform();
+        return;
+    }
+
+    for (j = 0; j < n; j++)
+        fScale[j] = powf(10.0F, 1.5F * (RandomUniform() + 1.0F));
+    for (k = 0; k < 2 * n; k++)
+        for (j = 0; j < n; j++)
+            X[k][j] = fScale[j] * RandomUniform();
+    for (i = 0; i < n; i++)
+        for (j = i; j < n; j++)
+        {
+            A[i][j] = 0.0F;
+            for (k = 0; k < 2 * n; k++)
+                A[i][j] += X[k][i] * X[k][j];
+            A[j][i] = A[i][j];
+        }
+}
+
+// the full sweep reference: every non-zero above diagonal element is rotated until none is left
+static void RefEigen(float A[10][10], float eigval[10], float eigvec[10][10], int8_t n)
+{
+    float residue;
+    int8_t i, j, ctr;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+            eigvec[i][j] = 0.0F;
+        eigvec[i][i] = 1.0F;
+        eigval[i] = A[i][i];
+    }
+
+    ctr = 0;
+    do
+    {
+        residue = 0.0F;
+        for (i = 0; i < n - 1; i++)
+            for (j = i + 1; j < n; j++)
+                residue += fabsf(A[i][j]);
+        for (i = 0; i < n - 1; i++)
+            for (j = i + 1; j < n; j++)
+                if (A[i][j] != 0.0F)
+                    fComputeEigSlice(A, eigvec, eigval, i, j, n);
+    } while ((residue > 0.0F) && (ctr++ < NITERATIONS));
+}
+
+// the time sliced decomposition as driven by the magnetic calibration, one element per call
+static void SlicedEigen(float A[10][10], float eigval[10], float eigvec[10][10], int8_t n)
+{
+    float residue;
+    int8_t i, j, k, ctr;
+    int8_t iElements = (int8_t) (n * (n - 1) / 2);
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+            eigvec[i][j] = 0.0F;
+        eigvec[i][i] = 1.0F;
+        eigval[i] = A[i][i];
+    }
+
+    ctr = 0;
+    do
+    {
+        for (k = 0; k < iElements; )
+            k = fComputeEigSliceNext(A, eigvec, eigval, k, n);
+        residue = 0.0F;
+        for (i = 0; i < n - 1; i++)
+            for (j = i + 1; j < n; j++)
+                residue += fabsf(A[i][j]);
+    } while ((residue > 0.0F) && (ctr++ < NITERATIONS));
+}
+
+// returns the eigenvalue order of eigval[0..n-1], smallest first
+static void SortOrder(const float eigval[], int8_t n, int8_t order[])
+{
+    int8_t i, j, t;
+
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = 1; i < n; i++)
+        for (j = i; (j > 0) && (eigval[order[j - 1]] > eigval[order[j]]); j--)
+        {
+            t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+}
+
+// compares an early exit decomposition (eigval, eigvec) of the original matrix A0 with the
+// reference decomposition. Returns 1 on failure.
+static int Compare(const char *sName, float A0[10][10], int8_t n, const float eigval[10],
+                   float eigvec[10][10], const float refval[10], float refvec[10][10])
+{
+    int8_t order[10], reforder[10];
+    float fMaxEig = 0.0F, fErr, fGap, fDot, fRes;
+    int8_t i, j, k, a, b;
+
+    SortOrder(eigval, n, order);
+    SortOrder(refval, n, reforder);
+    for (i = 0; i < n; i++)
+        if (fabsf(refval[i]) > fMaxEig) fMaxEig = fabsf(refval[i]);
+
+    for (i = 0; i < n; i++)
+    {
+        a = order[i];
+        b = reforder[i];
+
+        fErr = fabsf(eigval[a] - refval[b]) / fMaxEig;
+        if (fErr > fMaxEigvalErr) fMaxEigvalErr = fErr;
+        if (fErr > EIGVAL_TOL)
+        {
+            printf("%s %dx%d: eigenvalue %g, reference %g\n", sName, n, n, eigval[a], refval[b]);
+            return 1;
+        }
+
+        // A.v = lambda.v with the original matrix
+        fRes = 0.0F;
+        for (j = 0; j < n; j++)
+        {
+            float fRow = -eigval[a] * eigvec[j][a];
+            for (k = 0; k < n; k++)
+                fRow += A0[j][k] * eigvec[k][a];
+            fRes += fRow * fRow;
+        }
+        fRes = sqrtf(fRes) / fMaxEig;
+        if (fRes > fMaxResidual) fMaxResidual = fRes;
+        if (fRes > RESIDUAL_TOL)
+        {
+            printf("%s %dx%d: residual %g for eigenvalue %g\n", sName, n, n, fRes, eigval[a]);
+            return 1;
+        }
+
+        // the eigenvector itself only where the eigenvalue is well separated from its neighbours
+        fGap = 1.0F;
+        if (i > 0) fGap = fminf(fGap, (refval[b] - refval[reforder[i - 1]]) / fMaxEig);
+        if (i < n - 1) fGap = fminf(fGap, (refval[reforder[i + 1]] - refval[b]) / fMaxEig);
+        if (fGap < MIN_GAP) continue;
+        fDot = 0.0F;
+        for (j = 0; j < n; j++)
+            fDot += eigvec[j][a] * refvec[j][b];
+        fErr = 1.0F - fabsf(fDot);
+        if (fErr > fMaxEigvecErr) fMaxEigvecErr = fErr;
+        if (fErr > EIGVEC_TOL)
+        {
+            printf("%s %dx%d: eigenvector of %g differs, |cos| %g\n", sName, n, n, eigval[a], fabsf(fDot));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    float A0[10][10], A[10][10], refA[10][10];
+    float eigval[10], refval[10];
+    float eigvec[10][10], refvec[10][10];
+    float A4[4][4], eigvec4[4][4];
+    int8_t n, iKind, i, j;
+    int iMatrix, iFailed = 0;
+
+    srand(1);
+    for (n = 4; n <= 10; n += 6)
+        for (iKind = 0; iKind < 2; iKind++)
+            for (iMatrix = 0; iMatrix < NUM_MATRICES; iMatrix++)
+            {
+                RandomSymmetric(A0, n, iKind);
+                memcpy(refA, A0, sizeof(refA));
+                RefEigen(refA, refval, refvec, n);
+
+                // the whole matrix solvers
+                if (n == 10)
+                {
+                    memcpy(A, A0, sizeof(A));
+                    fEigenCompute10(A, eigval, eigvec, n);
+                    iFailed += Compare("fEigenCompute10", A0, n, eigval, eigvec, refval, refvec);
+                }
+                else
+                {
+                    for (i = 0; i < 4; i++)
+                        for (j = 0; j < 4; j++)
+                            A4[i][j] = A0[i][j];
+                    fEigenCompute4(A4, eigval, eigvec4, n);
+                    memset(eigvec, 0, sizeof(eigvec));
+                    for (i = 0; i < 4; i++)
+                        for (j = 0; j < 4; j++)
+                            eigvec[i][j] = eigvec4[i][j];
+                    iFailed += Compare("fEigenCompute4", A0, n, eigval, eigvec, refval, refvec);
+                }
+
+                // the time sliced solver
+                memcpy(A, A0, sizeof(A));
+                SlicedEigen(A, eigval, eigvec, n);
+                iFailed += Compare("fComputeEigSliceNext", A0, n, eigval, eigvec, refval, refvec);
+            }
+
+    printf("eigen early exit: largest eigenvalue difference %.2g, eigenvector 1-|cos| %.2g, residual %.2g\n",
+           fMaxEigvalErr, fMaxEigvecErr, fMaxResidual);
+    printf("%s\n", iFailed ? "FAILED" : "matches the full sweeps");
+    return iFailed ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file test_flight_log.c
+    \brief Checks flight_log_reader.c against a log written to the format of flight_recorder.h
+
+    The log has two power ups. The first is FIRST_BOOT_BLOCKS data blocks with
+    an index block after every FR_INDEX_INTERVAL of them, so it is listed from
+    both index blocks and block headers; the second has no index block. One
+    block fails its CRC and one gyroscope record claims more samples than its
+    length holds.
+
+    - FlightLogOpen() lists every data block, and a cursor reads every cycle
+      except those of the bad block.
+    - FlightLogSeek() finds the first cycle at or after every cycle time, and
+      just before and after it, and fails past the end of a power up.
+    - FlightLogReplay() from a seek feeds the samples of each cycle to the
+      FIFOs, leaving out the record with the bad count.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor_fusion.h"
+#include "control.h"
+#include "flight_log_reader.h"
+
+#define FIRST_BOOT_BLOCKS   37      // two indexed groups and a partial one
+#define SECOND_BOOT_BLOCKS  6
+#define NUM_DATA_BLOCKS     (FIRST_BOOT_BLOCKS + SECOND_BOOT_BLOCKS)
+#define CYCLES_PER_BLOCK    10
+#define NUM_CYCLES          (NUM_DATA_BLOCKS * CYCLES_PER_BLOCK)
+#define CYCLE_US            25000
+#define BAD_CRC_BLOCK       20      // data block failing its CRC, in the second indexed group
+#define BAD_COUNT_CYCLE     123     // cycle whose gyroscope record has a bad iCount
+#define ACCEL_PER_CYCLE     2
+#define MAG_PER_CYCLE       1
+#define GYRO_PER_CYCLE      4
+
+/// A cycle as written to the log
+typedef struct TestCycle {
+    uint32_t iBoot;
+    uint64_t iTime;
+    int bReadable;              ///< not in the block failing its CRC
+} TestCycle;
+
+static TestCycle sCycles[NUM_CYCLES];
+static SensorFusionGlobals sfg;
+static int iFailed;
+
+static void Check(int iOk, const char *sWhat)
+{
+    if (!iOk)
+    {
+        printf("FAILED: %s\n", sWhat);
+        iFailed++;
+    }
+}
+
+static void AddRecord(FlightBlock *pBlock, uint8_t iType, uint8_t iCount, const void *pPayload, uint16_t iLength)
+{
+    uint8_t *pDest = &pBlock->iBytes[sizeof(FlightBlockHeader) + pBlock->header.iUsed];
+    FlightRecord record;
+
+    record.iType = iType;
+    record.iCount = iCount;
+    record.iLength = (uint16_t) ((iLength + 3U) & ~3U);
+    memcpy(pDest, &record, sizeof(record));
+    memcpy(pDest + sizeof(record), pPayload, iLength);
+    pBlock->header.iUsed += (uint16_t) (sizeof(record) + record.iLength);
+}
+
+// samples of cycle iCycle: X is the cycle, Y the sample, Z the sensor
+static void AddSamples(FlightBlock *pBlock, uint8_t iType, uint32_t iCycle, uint8_t iCount)
+{
+    int16_t iSamples[GYRO_PER_CYCLE][3];
+    FlightRecord *pRecord = (FlightRecord *) &pBlock->iBytes[sizeof(FlightBlockHeader) + pBlock->header.iUsed];
+    uint8_t i;
+
+    for (i = 0; i < iCount; i++)
+    {
+        iSamples[i][CHX] = (int16_t) iCycle;
+        iSamples[i][CHY] = (int16_t) i;
+        iSamples[i][CHZ] = (int16_t) iType;
+    }
+    AddRecord(pBlock, iType, iCount, iSamples, (uint16_t) (iCount * sizeof(iSamples[0])));
+    // claims far more samples than the record holds
+    if ((iType == FR_REC_GYRO) && (iCycle == BAD_COUNT_CYCLE)) pRecord->iCount = 255;
+}
+
+static void WriteBlock(FILE *fp, FlightBlock *pBlock)
+{
+    pBlock->header.iCRC = CRC16(&pBlock->iBytes[sizeof(FlightBlockHeader)], pBlock->header.iUsed, 0xFFFF);
+    fwrite(pBlock->iBytes, 1, FR_BLOCK_SIZE, fp);
+}
+
+static int WriteLog(const char *sPath)
+{
+    FlightBlock block;
+    FlightBlock index;
+    FlightIndexEntry entry;
+    FlightSensitivity sensitivity = {8192, 10, 16, 0};
+    FlightCycle cycle;
+    FlightOrientation orientation;
+    FILE *fp = fopen(sPath, "wb");
+    uint32_t iSequence = 0;
+    uint32_t iCycle = 0;
+    uint32_t iBlock, iInBoot, i;
+
+    if (fp == NULL)
+    {
+        perror(sPath);
+        return 0;
+    }
+    memset(&index, 0, sizeof(index));
+    for (iBlock = 0; iBlock < NUM_DATA_BLOCKS; iBlock++)
+    {
+        iInBoot = (iBlock < FIRST_BOOT_BLOCKS) ? iBlock : iBlock - FIRST_BOOT_BLOCKS;
+        memset(&block, 0, sizeof(block));
+        block.header.iMagic = FR_BLOCK_MAGIC;
+        block.header.iSequence = iSequence++;
+        block.header.iFirstTime = (uint64_t) iInBoot * CYCLES_PER_BLOCK * CYCLE_US;
+        block.header.iFirstCycle = iCycle;
+        block.header.iType = FR_BLOCK_DATA;
+        block.header.iVersion = FR_FORMAT_VERSION;
+        block.header.iBoot = (iBlock < FIRST_BOOT_BLOCKS) ? 1 : 2;
+        AddRecord(&block, FR_REC_SENSITIVITY, 0, &sensitivity, sizeof(sensitivity));
+        for (i = 0; i < CYCLES_PER_BLOCK; i++, iCycle++)
+        {
+            sCycles[iCycle].iBoot = block.header.iBoot;
+            sCycles[iCycle].iTime = block.header.iFirstTime + (uint64_t) i * CYCLE_US;
+            sCycles[iCycle].bReadable = (iBlock != BAD_CRC_BLOCK);
+            memset(&cycle, 0, sizeof(cycle));
+            cycle.iTime = sCycles[iCycle].iTime;
+            cycle.iLoopCounter = iCycle;
+            AddRecord(&block, FR_REC_CYCLE, 0, &cycle, sizeof(cycle));
+            AddSamples(&block, FR_REC_ACCEL, iCycle, ACCEL_PER_CYCLE);
+            AddSamples(&block, FR_REC_MAG, iCycle, MAG_PER_CYCLE);
+            AddSamples(&block, FR_REC_GYRO, iCycle, GYRO_PER_CYCLE);
+            memset(&orientation, 0, sizeof(orientation));
+            orientation.iq[0] = 32767;
+            AddRecord(&block, FR_REC_ORIENTATION, 0, &orientation, sizeof(orientation));
+        }
+        if (iBlock == BAD_CRC_BLOCK)
+        {
+            WriteBlock(fp, &block);
+            block.iBytes[sizeof(FlightBlockHeader) + block.header.iUsed - 1] ^= 0x01;    // after the CRC was taken
+            fseek(fp, -FR_BLOCK_SIZE, SEEK_CUR);
+            fwrite(block.iBytes, 1, FR_BLOCK_SIZE, fp);
+        }
+        else
+            WriteBlock(fp, &block);
+
+        if (iBlock >= FIRST_BOOT_BLOCKS) continue;     // the second power up has no index block
+        if (index.header.iUsed == 0)
+        {
+            memset(&index, 0, sizeof(index));
+            index.header.iMagic = FR_BLOCK_MAGIC;
+            index.header.iType = FR_BLOCK_INDEX;
+            index.header.iVersion = FR_FORMAT_VERSION;
+            index.header.iBoot = block.header.iBoot;
+        }
+        memset(&entry, 0, sizeof(entry));
+        entry.iSequence = block.header.iSequence;
+        entry.iOffset = (uint32_t) (ftell(fp) - FR_BLOCK_SIZE);
+        entry.iFirstTime = block.header.iFirstTime;
+        entry.iFirstCycle = block.header.iFirstCycle;
+        entry.iBoot = block.header.iBoot;
+        memcpy(&index.iBytes[sizeof(FlightBlockHeader) + index.header.iUsed], &entry, sizeof(entry));
+        index.header.iUsed += sizeof(entry);
+        if (index.header.iUsed == FR_INDEX_INTERVAL * sizeof(FlightIndexEntry))
+        {
+            index.header.iSequence = iSequence++;
+            WriteBlock(fp, &index);
+            index.header.iUsed = 0;
+        }
+    }
+    fclose(fp);
+    return 1;
+}
+
+// loop counter of the FR_REC_CYCLE record at the cursor, or -1 if there is none
+static int32_t CycleAt(const FlightLogCursor *pCursor)
+{
+    FlightLogCursor ahead = *pCursor;
+    const FlightRecord *pRecord = FlightLogNextRecord(&ahead);
+    FlightCycle cycle;
+
+    if ((pRecord == NULL) || (pRecord->iType != FR_REC_CYCLE)) return -1;
+    memcpy(&cycle, FlightLogPayload(pRecord), sizeof(cycle));
+    return (int32_t) cycle.iLoopCounter;
+}
+
+// first readable cycle of power up iBoot at or after iTime, or -1 if there is none
+static int32_t ExpectedSeek(uint32_t iBoot, uint64_t iTime)
+{
+    int32_t i;
+
+    for (i = 0; i < NUM_CYCLES; i++)
+        if (sCycles[i].bReadable && (sCycles[i].iBoot == iBoot) && (sCycles[i].iTime >= iTime)) return i;
+    return -1;
+}
+
+static void CheckSeek(const FlightLog *pLog, uint32_t iBoot, uint64_t iTime)
+{
+    FlightLogCursor cursor;
+    int32_t iExpected = ExpectedSeek(iBoot, iTime);
+    bool bFound = FlightLogSeek(&cursor, pLog, iBoot, iTime);
+    char sWhat[80];
+
+    snprintf(sWhat, sizeof(sWhat), "seek to power up %u at %llu us", (unsigned) iBoot, (unsigned long long) iTime);
+    Check((bFound == (iExpected >= 0)) && (CycleAt(&cursor) == iExpected), sWhat);
+}
+
+// fifo holds iCount samples of cycle iCycle and sensor iType, in the order written
+static int FifoHolds(const int16_t *pFifo, uint16_t iFifoSize, uint8_t iFIFOCount, uint8_t iCount,
+                     int32_t iCycle, uint8_t iType)
+{
+    uint8_t i;
+
+    if (iFIFOCount != iCount) return 0;
+    for (i = 0; i < iCount; i++)
+        if ((pFifo[CHX * iFifoSize + i] != iCycle) || (pFifo[CHY * iFifoSize + i] != i) ||
+            (pFifo[CHZ * iFifoSize + i] != iType)) return 0;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FlightLog log;
+    FlightLogCursor cursor, previous;
+    const FlightRecord *pRecord;
+    ReplaySource source;
+    struct PhysicalSensor sensor;
+    int32_t iNext;
+    uint32_t iCycles = 0;
+    uint32_t iReadable = 0;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s log_file\n", argv[0]);
+        return 2;
+    }
+    if (!WriteLog(argv[1]) || !FlightLogOpen(&log, argv[1])) return 1;
+    for (i = 0; i < NUM_CYCLES; i++) iReadable += sCycles[i].bReadable;
+
+    // listing and reading through
+    Check(log.iNumBlocks == NUM_DATA_BLOCKS, "every data block listed");
+    Check(log.iSkippedBlocks == 0, "no block skipped");
+    Check((log.sensitivity.iCountsPerg == 8192) && (log.sensitivity.iCountsPeruT == 10) &&
+          (log.sensitivity.iCountsPerDegPerSec == 16), "sensitivities");
+    FlightLogCursorInit(&cursor, &log, 0);
+    iNext = 0;
+    for (;;)
+    {
+        previous = cursor;
+        if ((pRecord = FlightLogNextRecord(&cursor)) == NULL) break;
+        if (pRecord->iType != FR_REC_CYCLE) continue;
+        while ((iNext < NUM_CYCLES) && !sCycles[iNext].bReadable) iNext++;
+        if (CycleAt(&previous) != iNext) break;
+        iNext++;
+        iCycles++;
+    }
+    Check(iCycles == iReadable, "every readable cycle read in order");
+    Check(cursor.iBadBlocks == 1, "one block fails its CRC");
+
+    // seeks to every cycle time of both power ups, to just before and after it, and past the end
+    for (i = 0; i < NUM_CYCLES; i++)
+    {
+        CheckSeek(&log, sCycles[i].iBoot, sCycles[i].iTime);
+        CheckSeek(&log, sCycles[i].iBoot, sCycles[i].iTime + 1);
+        if (sCycles[i].iTime > 0) CheckSeek(&log, sCycles[i].iBoot, sCycles[i].iTime - 1);
+    }
+    CheckSeek(&log, 1, (uint64_t) FIRST_BOOT_BLOCKS * CYCLES_PER_BLOCK * CYCLE_US);
+    CheckSeek(&log, 3, 0);
+
+    // replay from part way through the first power up to the end of the log
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.pAccel = &sfg.Accel;
+    sensor.pMag = &sfg.Mag;
+    sensor.pGyro = &sfg.Gyro;
+    iNext = 100;
+    Check(FlightLogSeek(&cursor, &log, 1, sCycles[iNext].iTime), "seek before replay");
+    FlightLogReplay(&source, &cursor);
+    iCycles = 0;
+    while (!ReplayFinished(&source))
+    {
+        sfg.Accel.iFIFOCount = sfg.Mag.iFIFOCount = sfg.Gyro.iFIFOCount = 0;
+        source.fReadCycle(&source, &sensor);
+        while ((iNext < NUM_CYCLES) && !sCycles[iNext].bReadable) iNext++;
+        if (!FifoHolds(&sfg.Accel.iGsFIFO[0][0], ACCEL_FIFO_SIZE, sfg.Accel.iFIFOCount, ACCEL_PER_CYCLE,
+                       iNext, FR_REC_ACCEL) ||
+            !FifoHolds(&sfg.Mag.iBsFIFO[0][0], MAG_FIFO_SIZE, sfg.Mag.iFIFOCount, MAG_PER_CYCLE,
+                       iNext, FR_REC_MAG) ||
+            !FifoHolds(&sfg.Gyro.iYsFIFO[0][0], GYRO_FIFO_SIZE, sfg.Gyro.iFIFOCount,
+                       (iNext == BAD_COUNT_CYCLE) ? 0 : GYRO_PER_CYCLE, iNext, FR_REC_GYRO))
+        {
+            printf("FAILED: replayed samples of cycle %d\n", (int) iNext);
+            iFailed++;
+            break;
+        }
+        iNext++;
+        iCycles++;
+    }
+    Check(iNext == NUM_CYCLES, "replay reaches the end of the log");
+    Check((source.iCountsPerg == 8192) && (source.iCountsPeruT == 10) && (source.iCountsPerDegPerSec == 16),
+          "replay takes the sensitivities of the log");
+    printf("%u cycles replayed\n", (unsigned) iCycles);
+
+    FlightLogClose(&log);
+    printf("%s\n", iFailed ? "FAILED" : "flight log read, searched and replayed as written");
+    return iFailed ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file test_quaternion.c
+    \brief Checks the quaternion products of orientation.c against the scalar formulas
+
+    qAeqBxC(), qAeqAxB() and qconjgAxB() use 4-lane SSE or NEON code on hosts
+    that have it, and the scalar code otherwise or with F_QUATERNION_SCALAR.
+    Both builds must give results bit for bit equal to the scalar formulas
+    below over 1e6 random pairs, run_tests.sh builds this test both ways.
+    Needs -ffp-contract=off so the reference is not fused either.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor_fusion.h"
+#include "orientation.h"
+
+#define NUM_PAIRS   1000000
+
+static Quaternion RefProduct(const Quaternion *pqB, const Quaternion *pqC)
+{
+    Quaternion q;
+
+    q.q0 = pqB->q0 * pqC->q0 - pqB->q1 * pqC->q1 - pqB->q2 * pqC->q2 - pqB->q3 * pqC->q3;
+    q.q1 = pqB->q0 * pqC->q1 + pqB->q1 * pqC->q0 + pqB->q2 * pqC->q3 - pqB->q3 * pqC->q2;
+    q.q2 = pqB->q0 * pqC->q2 - pqB->q1 * pqC->q3 + pqB->q2 * pqC->q0 + pqB->q3 * pqC->q1;
+    q.q3 = pqB->q0 * pqC->q3 + pqB->q1 * pqC->q2 - pqB->q2 * pqC->q1 + pqB->q3 * pqC->q0;
+    return q;
+}
+
+static Quaternion RefConjgProduct(const Quaternion *pqA, const Quaternion *pqB)
+{
+    Quaternion q;
+
+    q.q0 = pqA->q0 * pqB->q0 + pqA->q1 * pqB->q1 + pqA->q2 * pqB->q2 + pqA->q3 * pqB->q3;
+    q.q1 = pqA->q0 * pqB->q1 - pqA->q1 * pqB->q0 - pqA->q2 * pqB->q3 + pqA->q3 * pqB->q2;
+    q.q2 = pqA->q0 * pqB->q2 + pqA->q1 * pqB->q3 - pqA->q2 * pqB->q0 - pqA->q3 * pqB->q1;
+    q.q3 = pqA->q0 * pqB->q3 - pqA->q1 * pqB->q2 + pqA->q2 * pqB->q1 - pqA->q3 * pqB->q0;
+    return q;
+}
+
+static float RandomComponent(void)
+{
+    return 4.0F * ((float) rand() / (float) RAND_MAX) - 2.0F;
+}
+
+static int Differ(const char *sName, long iPair, const Quaternion *pqGot, const Quaternion *pqRef)
+{
+    if (memcmp(pqGot, pqRef, sizeof(Quaternion)) == 0) return 0;
+    printf("%s differs at pair %ld: %.9g %.9g %.9g %.9g, expected %.9g %.9g %.9g %.9g\n", sName, iPair,
+           pqGot->q0, pqGot->q1, pqGot->q2, pqGot->q3, pqRef->q0, pqRef->q1, pqRef->q2, pqRef->q3);
+    return 1;
+}
+
+int main(void)
+{
+    Quaternion qB, qC, qGot, qRef;
+    long iPair;
+    int iFailed = 0;
+
+    srand(1);
+    for (iPair = 0; (iPair < NUM_PAIRS) && (iFailed < 10); iPair++)
+    {
+        qB.q0 = RandomComponent(); qB.q1 = RandomComponent(); qB.q2 = RandomComponent(); qB.q3 = RandomComponent();
+        qC.q0 = RandomComponent(); qC.q1 = RandomComponent(); qC.q2 = RandomComponent(); qC.q3 = RandomComponent();
+
+        qRef = RefProduct(&qB, &qC);
+        qAeqBxC(&qGot, &qB, &qC);
+        iFailed += Differ("qAeqBxC", iPair, &qGot, &qRef);
+
+        // the result overwrites an input
+        qGot = qB;
+        qAeqAxB(&qGot, &qC);
+        iFailed += Differ("qAeqAxB", iPair, &qGot, &qRef);
+
+        qRef = RefConjgProduct(&qB, &qC);
+        qGot = qconjgAxB(&qB, &qC);
+        iFailed += Differ("qconjgAxB", iPair, &qGot, &qRef);
+    }
+
+#ifdef F_QUATERNION_SCALAR
+    printf("scalar quaternion products: ");
+#else
+    printf("default quaternion products: ");
+#endif
+    printf("%s\n", iFailed ? "FAILED" : "bit exact over 1e6 pairs");
+    return iFailed ? 1 : 0;
+}
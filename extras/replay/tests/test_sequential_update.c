@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file test_sequential_update.c
+    \brief Compares the sequential and joint measurement updates of the 9DOF Kalman filter
+
+    F_9DOF_SEQUENTIAL_UPDATE selects at compile time how the 9DOF filter processes its six
+    measurement errors, so run_tests.sh builds this test twice. Both builds replay the same
+    synthetic 6000 cycle session from power up, through the magnetic calibration, to the end:
+    the board yaws while rocking in roll and pitch, with a hard iron offset, a gyro offset and
+    sensor noise. The joint build writes its quaternions and gyro offsets to the file named on
+    the command line and the sequential build compares its own with them.
+
+    The two updates are the same in exact arithmetic but round differently in float, and the
+    filter carries the differences forward. Here the quaternions differ by up to 1.3E-3 in a
+    component and the gyro offsets by 3E-5 deg/s. Other recordings have reached 1.8E-3, so the
+    test allows QUAT_TOL.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensor_fusion.h"
+#include "control.h"
+#include "status.h"
+#include "driver_replay.h"
+
+#define NUM_CYCLES          6000
+#define SAMPLES_PER_CYCLE   5           // 200 Hz sensor readings, fused at 40 Hz
+#define QUAT_TOL            3E-3F       // largest difference in a quaternion component
+#define GYRO_OFFSET_TOL     1E-3F       // largest difference in a gyro offset (deg/s)
+
+// Gaussian noise by the Box-Muller method
+static float RandomGauss(float fSigma)
+{
+    double u1 = ((double) rand() + 1.0) / ((double) RAND_MAX + 2.0);
+    double u2 = ((double) rand() + 1.0) / ((double) RAND_MAX + 2.0);
+
+    return (float) (fSigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+// adds a reading given in the NED sensor frame as the raw counts that ApplyAccelHAL(),
+// ApplyMagHAL() or ApplyGyroHAL() turn back into it
+static void AddSample(ReplaySample *pSample, uint8_t iType, const double fv[3], double fCounts, float fSigma)
+{
+    double fRaw[3];
+    int8_t i;
+
+    if (iType == REPLAY_ACCEL)
+    {
+        fRaw[CHX] = fv[CHY];
+        fRaw[CHY] = fv[CHX];
+        fRaw[CHZ] = fv[CHZ];
+    }
+    else
+    {
+        fRaw[CHX] = -fv[CHY];
+        fRaw[CHY] = -fv[CHX];
+        fRaw[CHZ] = -fv[CHZ];
+    }
+    pSample->iType = iType;
+    for (i = CHX; i <= CHZ; i++)
+        pSample->iSample[i] = (int16_t) (fCounts * fRaw[i] + RandomGauss(fSigma));
+}
+
+// rotation matrix from the earth frame into the sensor frame at time t (s). The board
+// yaws at a steady rate while rocking in roll and pitch.
+static void Attitude(double t, double fR[3][3])
+{
+    double fYaw = 0.6 * t;
+    double fRoll = 0.4 * sin(0.3 * t);
+    double fPitch = 0.3 * sin(0.2 * t);
+
+    fR[0][0] = cos(fPitch) * cos(fYaw);
+    fR[0][1] = cos(fPitch) * sin(fYaw);
+    fR[0][2] = -sin(fPitch);
+    fR[1][0] = sin(fRoll) * sin(fPitch) * cos(fYaw) - cos(fRoll) * sin(fYaw);
+    fR[1][1] = sin(fRoll) * sin(fPitch) * sin(fYaw) + cos(fRoll) * cos(fYaw);
+    fR[1][2] = sin(fRoll) * cos(fPitch);
+    fR[2][0] = cos(fRoll) * sin(fPitch) * cos(fYaw) + sin(fRoll) * sin(fYaw);
+    fR[2][1] = cos(fRoll) * sin(fPitch) * sin(fYaw) - sin(fRoll) * cos(fYaw);
+    fR[2][2] = cos(fRoll) * cos(fPitch);
+}
+
+// one 200 Hz reading of each sensor: sensitivities of 8192 counts per g, 10 per uT and 16 per
+// deg/s, a hard iron offset of (10, -5, 3) uT and a gyro offset of (1, -2, 0.5) deg/s
+static uint32_t MakeSession(ReplaySample *pSamples)
+{
+    const double fGravity[3] = {0.0, 0.0, 1.0};
+    const double fGeomag[3] = {20.0, 0.0, 45.0};
+    const double fHardIron[3] = {10.0, -5.0, 3.0};
+    const double fGyroOffset[3] = {1.0, -2.0, 0.5};
+    const double h = 1E-4;
+    double fR[3][3], fRh[3][3], fS[3][3], fg[3], fb[3], fw[3], t;
+    uint32_t iNum = 0;
+    int iCycle, k, i, j;
+
+    srand(1);
+    for (iCycle = 0; iCycle < NUM_CYCLES; iCycle++)
+    {
+        for (k = 0; k < SAMPLES_PER_CYCLE; k++)
+        {
+            t = (iCycle * SAMPLES_PER_CYCLE + k) / 200.0;
+            Attitude(t, fR);
+            Attitude(t + h, fRh);
+            for (i = 0; i < 3; i++)
+            {
+                fg[i] = fb[i] = 0.0;
+                for (j = 0; j < 3; j++)
+                {
+                    fg[i] += fR[i][j] * fGravity[j];
+                    fb[i] += fR[i][j] * fGeomag[j];
+                    fS[i][j] = (fRh[i][0] * fR[j][0] + fRh[i][1] * fR[j][1] + fRh[i][2] * fR[j][2]) / h;
+                }
+                fb[i] += fHardIron[i];
+            }
+            // a fixed earth vector turns the other way in the sensor frame: dR/dt.R^T = -[w x]
+            fw[0] = -fS[2][1] * 180.0 / M_PI + fGyroOffset[0];
+            fw[1] = -fS[0][2] * 180.0 / M_PI + fGyroOffset[1];
+            fw[2] = -fS[1][0] * 180.0 / M_PI + fGyroOffset[2];
+
+            AddSample(&pSamples[iNum++], REPLAY_ACCEL, fg, 8192.0, 20.0F);
+            AddSample(&pSamples[iNum++], REPLAY_GYRO, fw, 16.0, 3.0F);
+            if (k == 0) AddSample(&pSamples[iNum++], REPLAY_MAG, fb, 10.0, 3.0F);
+        }
+        pSamples[iNum++].iType = REPLAY_END_CYCLE;
+    }
+
+    return iNum;
+}
+
+int main(int argc, char *argv[])
+{
+    static SensorFusionGlobals sfg;
+    static StatusSubsystem status;
+    static ControlSubsystem control;
+    static struct PhysicalSensor sensor;
+    static ReplaySample samples[NUM_CYCLES * (2 * SAMPLES_PER_CYCLE + 2)];
+    ReplaySource source;
+    FILE *fp;
+    float fq[4], fMaxQuatErr = 0.0F, fMaxOffsetErr = 0.0F;
+    int iCycle = 0;
+#if F_9DOF_SEQUENTIAL_UPDATE
+    float fqRef[4], fErr;
+    int iWorstCycle = 0, i;
+#endif
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s quaternion_file\n", argv[0]);
+        return 2;
+    }
+    fp = fopen(argv[1], F_9DOF_SEQUENTIAL_UPDATE ? "rb" : "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+
+    ReplaySourceInit(&source, samples, MakeSession(samples));
+    source.iCountsPerg = 8192;
+    source.iCountsPeruT = 10;
+    source.iCountsPerDegPerSec = 16;
+    initializeStatusSubsystem(&status);
+    initSensorFusionGlobals(&sfg, &status, &control);
+    sfg.installSensor(&sfg, &sensor, 0, 1, NULL, Replay_Init, Replay_Read);
+    ReplayAttach(&sensor, &source);
+    sfg.initializeFusionEngine(&sfg, -1, -1);
+
+    while (!ReplayFinished(&source))
+    {
+        sfg.readSensors(&sfg, 1);
+        sfg.conditionSensorReadings(&sfg);
+        sfg.runFusion(&sfg);
+        sfg.loopcounter++;
+
+        fq[0] = sfg.SV_9DOF_GBY_KALMAN.fqPl.q0;
+        fq[1] = sfg.SV_9DOF_GBY_KALMAN.fqPl.q1;
+        fq[2] = sfg.SV_9DOF_GBY_KALMAN.fqPl.q2;
+        fq[3] = sfg.SV_9DOF_GBY_KALMAN.fqPl.q3;
+#if F_9DOF_SEQUENTIAL_UPDATE
+        if (fread(fqRef, sizeof(fqRef), 1, fp) != 1)
+        {
+            printf("%s ends at cycle %d\n", argv[1], iCycle);
+            return 1;
+        }
+        // q and -q are the same orientation, which matters when q0 is close to zero
+        fErr = fq[0] * fqRef[0] + fq[1] * fqRef[1] + fq[2] * fqRef[2] + fq[3] * fqRef[3];
+        if (fErr < 0.0F)
+            for (i = 0; i < 4; i++) fqRef[i] = -fqRef[i];
+        for (i = 0; i < 4; i++)
+        {
+            fErr = fabsf(fq[i] - fqRef[i]);
+            if (fErr > fMaxQuatErr)
+            {
+                fMaxQuatErr = fErr;
+                iWorstCycle = iCycle;
+            }
+        }
+#else
+        fwrite(fq, sizeof(fq), 1, fp);
+#endif
+        iCycle++;
+    }
+
+    // the gyro offsets follow the quaternions
+#if F_9DOF_SEQUENTIAL_UPDATE
+    if (fread(fqRef, 3 * sizeof(float), 1, fp) != 1)
+    {
+        printf("%s has no gyro offsets\n", argv[1]);
+        return 1;
+    }
+    for (i = 0; i < 3; i++)
+        fMaxOffsetErr = fmaxf(fMaxOffsetErr, fabsf(sfg.SV_9DOF_GBY_KALMAN.fbPl[i] - fqRef[i]));
+    printf("sequential update over %d cycles: largest quaternion difference %.2g (cycle %d), gyro offset %.2g deg/s, magnetic calibration %s\n",
+           iCycle, fMaxQuatErr, iWorstCycle, fMaxOffsetErr, sfg.MagCal.iValidMagCal ? "valid" : "not valid");
+#else
+    fwrite(sfg.SV_9DOF_GBY_KALMAN.fbPl, 3 * sizeof(float), 1, fp);
+    printf("joint update over %d cycles written to %s\n", iCycle, argv[1]);
+#endif
+    fclose(fp);
+
+    if (!sfg.MagCal.iValidMagCal)
+    {
+        printf("no magnetic calibration, so the magnetometer errors were never fused\n");
+        return 1;
+    }
+    return ((fMaxQuatErr > QUAT_TOL) || (fMaxOffsetErr > GYRO_OFFSET_TOL)) ? 1 : 0;
+}
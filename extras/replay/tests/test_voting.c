@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file test_voting.c
+    \brief Checks fCombineReadings() of sensor_voting.c and voteGyroData() of sensor_fusion.c
+
+    - SENSOR_VOTE_MEDIAN returns the per-axis median, and stays with the good
+      sensors while fewer than half have failed.
+    - A reading further than fMaxDeviation from the median is left out of the
+      SENSOR_VOTE_MEAN and of the returned mask.
+    - The mean of N sensors with independent noise has sqrt(N) less noise.
+    - Weights scale the mean, a weight of 0 leaves a reading out, and when no
+      reading agrees with the median the one with the highest weight is used.
+    - voteGyroData() carries the FIFO of a gyroscope with another sensitivity
+      into the primary in the primary's counts, and keeps the primary's scale.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sensor_fusion.h"
+#include "sensor_voting.h"
+
+#define NUM_NOISE_TRIALS    200000
+#define NOISE_SIGMA         1.0F
+#define NOISE_RATIO_TOL     0.02F   // relative error allowed in the noise reduction
+
+#define PRIMARY_COUNTSPERDEGPERSEC  16      // FXAS21002 at 2000 deg/s
+#define OTHER_COUNTSPERDEGPERSEC    20      // FXAS21000 at 1600 deg/s
+#define GYRO_SAMPLES                4
+
+// defined in sensor_fusion.c without a prototype in a header
+void voteGyroData(SensorFusionGlobals *sfg);
+
+static int iFailed;
+
+static void Check(int iOk, const char *sWhat)
+{
+    if (!iOk)
+    {
+        printf("FAILED: %s\n", sWhat);
+        iFailed++;
+    }
+}
+
+static int Near(const float fa[3], float x, float y, float z)
+{
+    return (fabsf(fa[0] - x) < 1E-5F) && (fabsf(fa[1] - y) < 1E-5F) && (fabsf(fa[2] - z) < 1E-5F);
+}
+
+static float RandomGauss(float fSigma)
+{
+    double u1 = ((double) rand() + 1.0) / ((double) RAND_MAX + 2.0);
+    double u2 = ((double) rand() + 1.0) / ((double) RAND_MAX + 2.0);
+
+    return (float) (fSigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+// standard deviation of the x axis of the SENSOR_VOTE_MEAN of iCount noisy readings of zero
+static float VotedNoise(uint8_t iCount, const SensorVote *pVote)
+{
+    float fIn[MAX_VOTING_SENSORS][3];
+    float fOut[3];
+    uint8_t iIndex[MAX_VOTING_SENSORS];
+    double fSumSq = 0.0;
+    long iTrial;
+    uint8_t i, j;
+
+    for (i = 0; i < iCount; i++) iIndex[i] = i;
+    for (iTrial = 0; iTrial < NUM_NOISE_TRIALS; iTrial++)
+    {
+        for (i = 0; i < iCount; i++)
+            for (j = 0; j < 3; j++) fIn[i][j] = RandomGauss(NOISE_SIGMA);
+        fCombineReadings(fOut, fIn, iIndex, iCount, SENSOR_VOTE_MEAN, pVote);
+        fSumSq += fOut[0] * fOut[0];
+    }
+    return (float) sqrt(fSumSq / NUM_NOISE_TRIALS);
+}
+
+// sets up a gyroscope of the given sensitivity reading fDegPerSec[] on the x axis
+static void SetGyro(struct GyroSensor *pGyro, int16_t iCountsPerDegPerSec, const float fDegPerSec[GYRO_SAMPLES])
+{
+    float fSum = 0.0F;
+    uint8_t i;
+
+    pGyro->isEnabled = true;
+    pGyro->iCountsPerDegPerSec = iCountsPerDegPerSec;
+    pGyro->fDegPerSecPerCount = 1.0F / iCountsPerDegPerSec;
+    pGyro->iFIFOCount = GYRO_SAMPLES;
+    for (i = 0; i < GYRO_SAMPLES; i++)
+    {
+        pGyro->iYsFIFO[CHX][i] = (int16_t) lroundf(fDegPerSec[i] * iCountsPerDegPerSec);
+        pGyro->iYsFIFO[CHY][i] = pGyro->iYsFIFO[CHZ][i] = 0;
+        fSum += fDegPerSec[i];
+    }
+    pGyro->fYs[CHX] = fSum / GYRO_SAMPLES;
+    pGyro->fYs[CHY] = pGyro->fYs[CHZ] = 0.0F;
+}
+
+int main(void)
+{
+    SensorVote vote;
+    float fOut[3];
+    uint8_t iUsed;
+    float fNoise1, fNoise2, fNoise4;
+
+    initSensorVote(&vote, 5.0F);
+    srand(1);
+
+    // the median, per axis
+    {
+        float fIn[][3] = {{1, 20, -3}, {2, 10, -1}, {3, 30, -2}};
+        const uint8_t iIndex[] = {0, 1, 2};
+
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 3, SENSOR_VOTE_MEDIAN, &vote);
+        Check(Near(fOut, 2, 20, -2), "median of three");
+    }
+    {
+        float fIn[][3] = {{1, 1, 1}, {2, 2, 2}, {4, 4, 4}, {3, 3, 3}};
+        const uint8_t iIndex[] = {0, 1, 2, 3};
+
+        fCombineReadings(fOut, fIn, iIndex, 4, SENSOR_VOTE_MEDIAN, &vote);
+        Check(Near(fOut, 2.5F, 2.5F, 2.5F), "median of four is the mean of the middle two");
+    }
+
+    // two of five sensors failing far out on the same side leave the median with the good ones
+    {
+        float fIn[][3] = {{10, 0, 0}, {500, 500, 500}, {10.5F, 0.5F, 0}, {900, 900, 900}, {9.5F, -0.5F, 0}};
+        const uint8_t iIndex[] = {0, 1, 2, 3, 4};
+
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 5, SENSOR_VOTE_MEDIAN, &vote);
+        Check((fOut[0] >= 9.5F) && (fOut[0] <= 10.5F) && (fOut[1] >= -0.5F) && (fOut[1] <= 0.5F) &&
+              (fOut[2] == 0.0F), "median stays within the good sensors with two of five failed");
+        Check(iUsed == 0x15, "median mask leaves out the failed sensors");
+    }
+
+    // an outlier is left out of the mean and of the mask
+    {
+        float fIn[][3] = {{1, 2, 3}, {1.2F, 2.2F, 3.2F}, {40, 2, 3}, {1.4F, 2.4F, 3.4F}};
+        const uint8_t iIndex[] = {0, 1, 2, 3};
+
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 4, SENSOR_VOTE_MEAN, &vote);
+        Check(Near(fOut, 1.2F, 2.2F, 3.2F), "mean without the outlier");
+        Check(iUsed == 0x0B, "mean mask without the outlier");
+    }
+
+    // the mask is by instance number, not by position in fIn
+    {
+        float fIn[][3] = {{1, 1, 1}, {1, 1, 1}};
+        const uint8_t iIndex[] = {2, 5};
+
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 2, SENSOR_VOTE_MEAN, &vote);
+        Check(iUsed == 0x24, "mask by instance number");
+    }
+
+    // weights, and a weight of 0 leaves a reading out
+    {
+        float fIn[][3] = {{0, 0, 0}, {3, 3, 3}, {1, 1, 1}};
+        const uint8_t iIndex[] = {0, 1, 2};
+
+        vote.fWeight[0] = 2.0F;
+        vote.fWeight[1] = 1.0F;
+        vote.fWeight[2] = 0.0F;
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 3, SENSOR_VOTE_MEAN, &vote);
+        Check(Near(fOut, 1, 1, 1), "weighted mean");
+        Check(iUsed == 0x03, "weight 0 is left out");
+        initSensorVote(&vote, 5.0F);
+    }
+
+    // two readings that disagree fall back to the highest weight, never to a weight of 0
+    {
+        float fIn[][3] = {{0, 0, 0}, {100, 0, 0}};
+        const uint8_t iIndex[] = {0, 1};
+
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 2, SENSOR_VOTE_MEAN, &vote);
+        Check((iUsed == 0x01) && Near(fOut, 0, 0, 0), "equal weights fall back to the first");
+
+        vote.fWeight[0] = 0.0F;
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 2, SENSOR_VOTE_MEAN, &vote);
+        Check((iUsed == 0x02) && Near(fOut, 100, 0, 0), "fallback skips a weight of 0");
+
+        vote.fWeight[0] = 0.5F;
+        vote.fWeight[1] = 2.0F;
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 2, SENSOR_VOTE_MEAN, &vote);
+        Check((iUsed == 0x02) && Near(fOut, 100, 0, 0), "fallback to the highest weight");
+
+        vote.fWeight[0] = vote.fWeight[1] = 0.0F;
+        fOut[0] = fOut[1] = fOut[2] = 7.0F;
+        iUsed = fCombineReadings(fOut, fIn, iIndex, 2, SENSOR_VOTE_MEAN, &vote);
+        Check((iUsed == 0) && Near(fOut, 7, 7, 7), "all weights 0 leaves fOut unchanged");
+        initSensorVote(&vote, 5.0F);
+    }
+
+    // no readings
+    {
+        float fIn[1][3];
+
+        fOut[0] = fOut[1] = fOut[2] = 7.0F;
+        iUsed = fCombineReadings(fOut, fIn, NULL, 0, SENSOR_VOTE_MEAN, &vote);
+        Check((iUsed == 0) && Near(fOut, 7, 7, 7), "no readings leaves fOut unchanged");
+    }
+
+    // noise of the mean of 1, 2 and 4 sensors. The threshold is far beyond the noise.
+    initSensorVote(&vote, 100.0F * NOISE_SIGMA);
+    fNoise1 = VotedNoise(1, &vote);
+    fNoise2 = VotedNoise(2, &vote);
+    fNoise4 = VotedNoise(4, &vote);
+    printf("noise of the mean of 1, 2 and 4 sensors: %.4f %.4f %.4f\n", fNoise1, fNoise2, fNoise4);
+    Check(fabsf(fNoise1 / fNoise2 - sqrtf(2.0F)) < NOISE_RATIO_TOL * sqrtf(2.0F), "mean of 2 lowers noise by sqrt(2)");
+    Check(fabsf(fNoise1 / fNoise4 - 2.0F) < NOISE_RATIO_TOL * 2.0F, "mean of 4 lowers noise by 2");
+
+    // a primary FXAS21002 outvoted by two FXAS21000 carries the FIFO of the first of
+    // them, converted to its own counts and shifted to the mean of both
+    {
+        static SensorFusionGlobals sfg;
+        static struct GyroInstance other[2];
+        const float fPrimary[GYRO_SAMPLES] = {100, 100, 100, 100};
+        const float fOther0[GYRO_SAMPLES] = {10, 11, 9, 10};
+        const float fOther1[GYRO_SAMPLES] = {12, 12, 12, 12};
+        const float fExpected[GYRO_SAMPLES] = {11, 12, 10, 11};    // fOther0 shifted by 1 deg/s
+        int iOk = 1;
+        uint8_t i;
+
+        SetGyro(&sfg.Gyro, PRIMARY_COUNTSPERDEGPERSEC, fPrimary);
+        SetGyro(&other[0].Gyro, OTHER_COUNTSPERDEGPERSEC, fOther0);
+        SetGyro(&other[1].Gyro, OTHER_COUNTSPERDEGPERSEC, fOther1);
+        other[0].next = &other[1];
+        sfg.pGyroInstances = &other[0];
+        sfg.iVoteMode = SENSOR_VOTE_MEAN;
+        initSensorVote(&sfg.GyroVote, 5.0F);
+
+        voteGyroData(&sfg);
+        Check(sfg.GyroVote.iUsed == 0x06, "gyro vote leaves out the primary");
+        Check((sfg.Gyro.iCountsPerDegPerSec == PRIMARY_COUNTSPERDEGPERSEC) &&
+              (sfg.Gyro.fDegPerSecPerCount == 1.0F / PRIMARY_COUNTSPERDEGPERSEC), "gyro vote keeps the primary scale");
+        Check(Near(sfg.Gyro.fYs, 11, 0, 0) && (sfg.Gyro.iYs[CHX] == 11 * PRIMARY_COUNTSPERDEGPERSEC),
+              "gyro vote average in primary counts");
+        for (i = 0; i < GYRO_SAMPLES; i++)
+            iOk &= (sfg.Gyro.iYsFIFO[CHX][i] == (int16_t) (fExpected[i] * PRIMARY_COUNTSPERDEGPERSEC)) &&
+                   (sfg.Gyro.iYsFIFO[CHY][i] == 0) && (sfg.Gyro.iYsFIFO[CHZ][i] == 0);
+        Check(iOk && (sfg.Gyro.iFIFOCount == GYRO_SAMPLES), "gyro vote FIFO converted to primary counts");
+    }
+
+    printf("%s\n", iFailed ? "FAILED" : "sensor voting as documented");
+    return iFailed ? 1 : 0;
+}
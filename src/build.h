@@ -73,6 +73,35 @@ extern "C" {
     0x4000 ///< 9DOF accel, mag and gyro algorithm selector                  - 0x4000 to include, 0x0000 otherwise
 ///@}
 
+/// @name TrigApproximationTiers
+/// Precision of fasin_deg(), facos_deg(), fatan_deg() and fatan2_deg() used by the fusion
+/// algorithms. The _fast and _precise variants in approximations.h are always available.
+///@{
+#define TRIG_TIER_FAST      0   ///< odd polynomial over 0 to 45 deg, max error 0.7E-3 deg, no divisions in the core
+#define TRIG_TIER_STANDARD  1   ///< AN5015 modified Pade approximation, max error 53E-6 deg (asin/acos near +-1)
+#define TRIG_TIER_PRECISE   2   ///< odd polynomial over -15 to 15 deg, max error 15E-6 deg (float resolution at 180 deg)
+#define F_TRIG_TIER         TRIG_TIER_STANDARD ///< the tier used by the fusion algorithms
+///@}
+
+// 9DOF Kalman measurement update. Set to 1 to process the six accelerometer and magnetometer
+// errors as sequential scalar updates, which needs no matrix factorization, or 0 for the joint update.
+// Since the measurement noise Qv is diagonal the two are the same in exact arithmetic. In float they
+// round differently and the orientations differ by up to 2E-3 in a quaternion component.
+#ifndef F_9DOF_SEQUENTIAL_UPDATE
+#define F_9DOF_SEQUENTIAL_UPDATE 0
+#endif
+
+/// @name RedundantSensorVoting
+/// How the readings of several sensors of one type (e.g. on redundant IMU boards) are
+/// combined into the one reading the fusion algorithms use. See sensor_voting.h.
+/// The mode can be changed at run time through sfg->iVoteMode.
+///@{
+#define F_SENSOR_VOTE           SENSOR_VOTE_MEAN ///< SENSOR_VOTE_PRIMARY, SENSOR_VOTE_MEAN or SENSOR_VOTE_MEDIAN
+#define VOTE_MAX_DEV_ACCEL_G    0.1F    ///< accelerometer outlier threshold (g)
+#define VOTE_MAX_DEV_MAG_UT     10.0F   ///< calibrated magnetometer outlier threshold (uT)
+#define VOTE_MAX_DEV_GYRO_DPS   10.0F   ///< gyroscope outlier threshold (deg/s), must allow for differing offsets
+///@}
+
 /// @name SensorParameters
 // The Output Data Rates (ODR) are set by the calls to *_Init() for each physical sensor.
 // If a sensor has a FIFO, then it can be read once/fusion cycle; if not, then read more often
@@ -94,6 +123,24 @@ extern "C" {
 #define F_USE_WIRELESS_UART     0x0000	///< 0x0001 to include, 0x0000 otherwise
 #define F_USE_WIRED_UART        0x0000	///< 0x0002 to include, 0x0000 otherwise
 
+/// @name FlightRecorder
+/// Recording of raw sensor readings, fusion outputs and status changes to a LittleFS
+/// partition, for replay on a PC. See flight_recorder.h and SensorFusion::BeginFlightRecorder().
+/// The log takes up to FLIGHT_RECORDER_SEGMENTS * FLIGHT_RECORDER_SEGMENT_BLOCKS * 2 kB of flash.
+///@{
+#define F_FLIGHT_RECORDER               0   ///< 1 to include the flash storage of the recorder (needs LittleFS), 0 otherwise
+#define FLIGHT_RECORDER_SEGMENTS        8   ///< log files kept. The oldest is deleted when a new one is started
+#define FLIGHT_RECORDER_SEGMENT_BLOCKS  64  ///< blocks per log file, index blocks included
+///@}
+
+/// @name CalibrationStore
+/// Journal of saved calibrations on the LittleFS partition, see calibration_storage.cc.
+/// Takes two files of up to CALIBRATION_STORE_FILE_BYTES each.
+///@{
+#define CALIBRATION_STORE_PATH          "/calib"    ///< journal files are this followed by 0.jnl and 1.jnl
+#define CALIBRATION_STORE_FILE_BYTES    4096        ///< journal file size at which the other file is started
+///@}
+
 //#define INCLUDE_DEBUG_FUNCTIONS // Comment this line to disable the ApplyPerturbation function
 
 
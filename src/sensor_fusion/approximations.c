@@ -19,29 +19,36 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "build.h"
 #include "approximations.h"
 
+// the tier functions below are written once and specialized for each tier by the
+// compiler, since every public function passes them a constant iTier
+static float fatan_deg_tier(float x, int8_t iTier);
+static float fatan_1_fast(float x);
+static float fatan_15deg_precise(float x);
+
 // function returns an approximation to angle(deg)=asin(x) for x in the range -1 <= x <= 1
 // and returns -90 <= angle <= 90 deg
-
-// maximum error is 10.29E-6 deg
-float fasin_deg(float x)
+static inline float fasin_deg_tier(float x, int8_t iTier)
 {
     // for robustness, check for invalid argument
     if (x >= 1.0F) return 90.0F;
     if (x <= -1.0F) return -90.0F;
 
     // call the atan which will return an angle in the correct range -90 to 90 deg
-    // this line cannot fail from division by zero or negative square root since |x| < 1
-    return (fatan_deg(x / sqrtf(1.0F - x * x)));
+    // this line cannot fail from division by zero or negative square root since |x| < 1.
+    // (1 - x)(1 + x) avoids the cancellation in 1 - x * x for x close to +-1
+    if (iTier == TRIG_TIER_PRECISE) return (fatan_deg_tier(x / sqrtf((1.0F - x) * (1.0F + x)), iTier));
+    return (fatan_deg_tier(x / sqrtf(1.0F - x * x), iTier));
 }
 
 // function returns an approximation to angle(deg)=acos(x) for x in the range -1 <= x <= 1
 // and returns 0 <= angle <= 180 deg
-
-// maximum error is 14.67E-6 deg
-float facos_deg(float x)
+static inline float facos_deg_tier(float x, int8_t iTier)
 {
+    float   fsin;                       // sqrt(1 - x * x)
+
     // for robustness, check for invalid arguments
     if (x >= 1.0F) return 0.0F;
     if (x <= -1.0F) return 180.0F;
@@ -49,14 +56,16 @@ float facos_deg(float x)
     // call the atan which will return an angle in the incorrect range -90 to 90 deg
     // these lines cannot fail from division by zero or negative square root
     if (x == 0.0F) return 90.0F;
-    if (x > 0.0F) return fatan_deg((sqrtf(1.0F - x * x) / x));
-    return 180.0F + fatan_deg((sqrtf(1.0F - x * x) / x));
+    if (iTier == TRIG_TIER_PRECISE)
+        fsin = sqrtf((1.0F - x) * (1.0F + x));
+    else
+        fsin = sqrtf(1.0F - x * x);
+    if (x > 0.0F) return fatan_deg_tier((fsin / x), iTier);
+    return 180.0F + fatan_deg_tier((fsin / x), iTier);
 }
 
 // function returns angle in range -90 to 90 deg
-
-// maximum error is 9.84E-6 deg
-float fatan_deg(float x)
+static float fatan_deg_tier(float x, int8_t iTier)
 {
     float   fangledeg;                  // compute computed (deg)
     int8_t    ixisnegative;             // argument x is negative
@@ -81,19 +90,30 @@ float fatan_deg(float x)
         ixexceeds1 = 1;
     }
 
-    // at this point, x is in the range 0 to 1 inclusive
-    // map argument onto range -tan(15 deg) to tan(15 deg)
-    // using tan(angle-30deg) = (tan(angle)-tan(30deg)) / (1 + tan(angle)tan(30deg))
-    // tan(15deg) maps to tan(-15 deg) = -tan(15 deg)
-    // 1. maps to (sqrt(3) - 1) / (sqrt(3) + 1) = 2 - sqrt(3) = tan(15 deg)
-    if (x > TAN15DEG)
+    if (iTier == TRIG_TIER_FAST)
     {
-        x = (x - TAN30DEG) / (1.0F + TAN30DEG * x);
-        ixmapped = 1;
+        // the fast polynomial covers the range 0 to 1 directly
+        fangledeg = fatan_1_fast(x);
     }
+    else
+    {
+        // at this point, x is in the range 0 to 1 inclusive
+        // map argument onto range -tan(15 deg) to tan(15 deg)
+        // using tan(angle-30deg) = (tan(angle)-tan(30deg)) / (1 + tan(angle)tan(30deg))
+        // tan(15deg) maps to tan(-15 deg) = -tan(15 deg)
+        // 1. maps to (sqrt(3) - 1) / (sqrt(3) + 1) = 2 - sqrt(3) = tan(15 deg)
+        if (x > TAN15DEG)
+        {
+            x = (x - TAN30DEG) / (1.0F + TAN30DEG * x);
+            ixmapped = 1;
+        }
 
-    // call the atan estimator to obtain -15 deg <= angle <= 15 deg
-    fangledeg = fatan_15deg(x);
+        // call the atan estimator to obtain -15 deg <= angle <= 15 deg
+        if (iTier == TRIG_TIER_PRECISE)
+            fangledeg = fatan_15deg_precise(x);
+        else
+            fangledeg = fatan_15deg(x);
+    }
 
     // undo the distortions applied earlier to obtain -90 deg <= angle <= 90 deg
     if (ixmapped) fangledeg += 30.0F;
@@ -104,10 +124,10 @@ float fatan_deg(float x)
 }
 
 // function returns approximate atan2 angle in range -180 to 180 deg
-
-// maximum error is 14.58E-6 deg
-float fatan2_deg(float y, float x)
+static inline float fatan2_deg_tier(float y, float x, int8_t iTier)
 {
+    float   fangledeg;                  // angle in quadrant 1 (deg)
+
     // check for zero x to avoid division by zero
     if (x == 0.0F)
     {
@@ -121,15 +141,96 @@ float fatan2_deg(float y, float x)
         return 0.0F;
     }
 
+    if (iTier == TRIG_TIER_PRECISE)
+    {
+        // divide the smaller magnitude by the larger so the atan argument is at most 1
+        // and only rounded once, then reflect the quadrant 1 angle into the other quadrants
+        if (fabsf(y) <= fabsf(x))
+            fangledeg = fatan_deg_tier(fabsf(y) / fabsf(x), iTier);
+        else
+            fangledeg = 90.0F - fatan_deg_tier(fabsf(x) / fabsf(y), iTier);
+        if (x < 0.0F) fangledeg = 180.0F - fangledeg;
+
+        // negative x on the axis returns -180 deg as for the other tiers
+        if ((y < 0.0F) || ((y == 0.0F) && (x < 0.0F))) return -fangledeg;
+        return fangledeg;
+    }
+
     // from here onwards, x is guaranteed to be non-zero
     // compute atan2 for quadrant 1 (0 to 90 deg) and quadrant 4 (-90 to 0 deg)
-    if (x > 0.0F) return (fatan_deg(y / x));
+    if (x > 0.0F) return (fatan_deg_tier(y / x, iTier));
 
     // compute atan2 for quadrant 2 (90 to 180 deg)
-    if ((x < 0.0F) && (y > 0.0F)) return (180.0F + fatan_deg(y / x));
+    if ((x < 0.0F) && (y > 0.0F)) return (180.0F + fatan_deg_tier(y / x, iTier));
 
     // compute atan2 for quadrant 3 (-180 to -90 deg)
-    return (-180.0F + fatan_deg(y / x));
+    return (-180.0F + fatan_deg_tier(y / x, iTier));
+}
+
+// maximum error by tier: fast 0.67E-3 deg, standard 49E-6 deg (near x = +-1), precise 9.2E-6 deg
+float fasin_deg(float x)
+{
+    return fasin_deg_tier(x, F_TRIG_TIER);
+}
+
+// maximum error by tier: fast 0.67E-3 deg, standard 53E-6 deg (near x = +-1), precise 15E-6 deg
+float facos_deg(float x)
+{
+    return facos_deg_tier(x, F_TRIG_TIER);
+}
+
+// maximum error by tier: fast 0.66E-3 deg, standard 11E-6 deg, precise 8.0E-6 deg
+float fatan_deg(float x)
+{
+    return fatan_deg_tier(x, F_TRIG_TIER);
+}
+
+// maximum error by tier: fast 0.67E-3 deg, standard 16E-6 deg, precise 12E-6 deg
+float fatan2_deg(float y, float x)
+{
+    return fatan2_deg_tier(y, x, F_TRIG_TIER);
+}
+
+// fast tier variants
+float fasin_deg_fast(float x)
+{
+    return fasin_deg_tier(x, TRIG_TIER_FAST);
+}
+
+float facos_deg_fast(float x)
+{
+    return facos_deg_tier(x, TRIG_TIER_FAST);
+}
+
+float fatan_deg_fast(float x)
+{
+    return fatan_deg_tier(x, TRIG_TIER_FAST);
+}
+
+float fatan2_deg_fast(float y, float x)
+{
+    return fatan2_deg_tier(y, x, TRIG_TIER_FAST);
+}
+
+// precise tier variants
+float fasin_deg_precise(float x)
+{
+    return fasin_deg_tier(x, TRIG_TIER_PRECISE);
+}
+
+float facos_deg_precise(float x)
+{
+    return facos_deg_tier(x, TRIG_TIER_PRECISE);
+}
+
+float fatan_deg_precise(float x)
+{
+    return fatan_deg_tier(x, TRIG_TIER_PRECISE);
+}
+
+float fatan2_deg_precise(float y, float x)
+{
+    return fatan2_deg_tier(y, x, TRIG_TIER_PRECISE);
 }
 
 // approximation to inverse tan function (deg) for x in range
@@ -147,3 +248,34 @@ float fatan_15deg(float x)
     x2 = x * x;
     return (x * (PADE_A + x2 * PADE_B) / (PADE_C + x2));
 }
+
+// approximation to inverse tan function (deg) for x in range 0 to 1 giving
+// an output 0 deg <= angle <= 45 deg, used by the fast tier
+
+// using an odd minimax polynomial of degree 9. No division is needed.
+static float fatan_1_fast(float x)
+{
+    float   x2;                 // x^2
+#define FAST_A  57.288120902F   // coefficient of x (theoretical Taylor value is 180/PI=57.29578)
+#define FAST_B  -18.925070871F  // coefficient of x^3
+#define FAST_C  10.322367618F   // coefficient of x^5
+#define FAST_D  -4.8790982946F  // coefficient of x^7
+#define FAST_E  1.1943360095F   // coefficient of x^9
+    x2 = x * x;
+    return (x * (FAST_A + x2 * (FAST_B + x2 * (FAST_C + x2 * (FAST_D + x2 * FAST_E)))));
+}
+
+// approximation to inverse tan function (deg) for x in range
+// -tan(15 deg) to tan(15 deg) giving an output -15 deg <= angle <= 15 deg, used by the precise tier
+
+// using an odd minimax polynomial of degree 7 whose error is below the float resolution
+static float fatan_15deg_precise(float x)
+{
+    float   x2;                 // x^2
+#define PREC_A  57.295774399F   // coefficient of x (theoretical Taylor value is 180/PI=57.29578)
+#define PREC_B  -19.097630684F  // coefficient of x^3
+#define PREC_C  11.410034148F   // coefficient of x^5
+#define PREC_D  -7.2435993994F  // coefficient of x^7
+    x2 = x * x;
+    return (x * (PREC_A + x2 * (PREC_B + x2 * (PREC_C + x2 * PREC_D))));
+}
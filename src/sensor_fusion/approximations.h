@@ -20,6 +20,10 @@ extern "C" {
     Significant efficiencies were found by creating a set of trig functions
     which trade off precision for improved power/CPU performance.  Full details
     are included in Application Note AN5015: Trigonometry Approximations
+
+    fasin_deg(), facos_deg(), fatan_deg() and fatan2_deg() use the tier selected
+    by F_TRIG_TIER in build.h. The _fast and _precise variants select a tier
+    explicitly, whatever F_TRIG_TIER is set to.
 */
 
 // function prototypes
@@ -29,6 +33,22 @@ float fatan_deg(float x);
 float fatan2_deg(float y, float x);
 float fatan_15deg(float x);
 
+/// @name Fast tier: max error 0.7E-3 deg
+///@{
+float fasin_deg_fast(float x);
+float facos_deg_fast(float x);
+float fatan_deg_fast(float x);
+float fatan2_deg_fast(float y, float x);
+///@}
+
+/// @name Precise tier: max error 15E-6 deg, close to the resolution of a float
+///@{
+float fasin_deg_precise(float x);
+float facos_deg_precise(float x);
+float fatan_deg_precise(float x);
+float fatan2_deg_precise(float y, float x);
+///@}
+
 #if defined(__cplusplus)
 }
 #endif /* __cplusplus */
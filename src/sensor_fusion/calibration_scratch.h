@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CALIBRATION_SCRATCH_H
+#define CALIBRATION_SCRATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file calibration_scratch.h
+    \brief Scratch arena shared by the magnetic and accelerometer calibration solvers
+
+    The 4, 7 and 10 element solvers of both calibrations need the same set of
+    10x10 working matrices. Rather than each calibration structure carrying its
+    own copy, a single CalibrationScratch is owned by SensorFusionGlobals and
+    both MagCalibration and AccelCalibration point into it.
+
+    The magnetic calibration is time sliced, so its partial results stay in
+    the arena between fusion cycles. The accelerometer calibration runs to
+    completion in a single call. Each solver records itself in iOwner when it
+    starts; a time sliced magnetic calibration that finds it no longer owns the
+    arena abandons the attempt and retries later.
+*/
+
+#include <stdint.h>
+
+#define CAL_SCRATCH_DIM         10  ///< largest solver size (10 element calibration)
+#define CAL_SCRATCH_VECB_DIM    4   ///< length of fvecB
+
+/// @name Scratch arena owners
+///@{
+#define CAL_SCRATCH_FREE        0   ///< no solver is using the arena
+#define CAL_SCRATCH_MAG         1   ///< a magnetic calibration is in progress
+#define CAL_SCRATCH_ACCEL       2   ///< the accelerometer calibration is running
+///@}
+
+/// Compile time check that a solver fits the arena. Fails with a negative array size otherwise.
+#define CAL_SCRATCH_CHECK(cond, name) typedef char name[(cond) ? 1 : -1]
+
+/// Working storage for the calibration solvers
+typedef struct CalibrationScratch {
+    float fmatA[CAL_SCRATCH_DIM][CAL_SCRATCH_DIM];  ///< scratch 10x10 float matrix
+    float fmatB[CAL_SCRATCH_DIM][CAL_SCRATCH_DIM];  ///< scratch 10x10 float matrix
+    float fvecA[CAL_SCRATCH_DIM];                   ///< scratch 10x1 vector
+    float fvecB[CAL_SCRATCH_VECB_DIM];              ///< scratch 4x1 vector
+    uint8_t iOwner;                                 ///< CAL_SCRATCH_* of the solver that last claimed the arena
+} CalibrationScratch;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CALIBRATION_SCRATCH_H
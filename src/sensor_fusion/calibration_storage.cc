@@ -9,381 +9,550 @@
 /*! \file calibration_storage.cc
     \brief Provides functions to store calibration to NVM
 
-    Written for use on Arduino-Espressif environment where EEPROM library available.
-    
+    Written for use on Arduino-Espressif environment where the LittleFS
+    library is available.
+
+    Calibrations are kept in a journal: each save appends one record, made of
+    a CalRecordHeader with a sequence number and CRC followed by the
+    calibration, to a journal file. Saving a calibration therefore writes a
+    few dozen bytes rather than rewriting and committing a whole flash
+    sector as the EEPROM library does, so calibrations may be saved often.
+    Erasing a calibration appends a record without a calibration.
+
+    There are two journal files of up to CALIBRATION_STORE_FILE_BYTES. When
+    the one being appended to is full, the other is started afresh with the
+    newest record of each type, so the journal never grows and a power loss
+    while starting it leaves the full file intact.
+
+    The first call of any function reads both files, each with one read,
+    and keeps the newest valid record of each type in RAM. Later Get*()
+    calls are served from RAM. Reading stops at the first record of a file
+    whose CRC fails, as that is where a save was interrupted.
+
+    The LittleFS partition is never formatted here, as it may hold the files
+    of the application; formatting is left to the application. If it cannot
+    be mounted, each calibration is kept instead at a fixed offset of the
+    emulated EEPROM, as earlier versions did. When the journal is first
+    started, the calibrations found in the EEPROM are taken into it.
+
+    The store is not locked, so all of these functions are called from the
+    task running the fusion cycle.
 */
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include <EEPROM.h>
+#include <LittleFS.h>
+#include <EEPROM.h>     // calibrations of earlier versions, and fallback if LittleFS is unavailable
 
 #include "sensor_fusion.h"
+#include "control.h"
 #include "calibration_storage.h"
+#include "fusion.h"
 #include "debug_print.h"
 
-#define CALIBRATION_STORAGE_SIZE_BYTES 256
-#define CALIBRATION_BUF_MAGNETIC_START 0
-#define CALIBRATION_BUF_MAGNETIC_HDR_SIZE 4
-#define CALIBRATION_BUF_MAGNETIC_HDR_MAGIC 0x12345678
-#define CALIBRATION_BUF_MAGNETIC_VAL_SIZE 64
-#define CALIBRATION_BUF_MAGNETIC_TOT_SIZE (CALIBRATION_BUF_MAGNETIC_HDR_SIZE + CALIBRATION_BUF_MAGNETIC_VAL_SIZE)
-#define CALIBRATION_BUF_GYRO_START (CALIBRATION_BUF_MAGNETIC_TOT_SIZE)
-#define CALIBRATION_BUF_GYRO_HDR_SIZE 4
-#define CALIBRATION_BUF_GYRO_HDR_MAGIC 0x12345678
-#define CALIBRATION_BUF_GYRO_VAL_SIZE 12
-#define CALIBRATION_BUF_GYRO_TOT_SIZE (CALIBRATION_BUF_GYRO_HDR_SIZE + CALIBRATION_BUF_GYRO_VAL_SIZE)
-#define CALIBRATION_BUF_ACCEL_START (CALIBRATION_BUF_MAGNETIC_TOT_SIZE + CALIBRATION_BUF_GYRO_TOT_SIZE)
-#define CALIBRATION_BUF_ACCEL_HDR_SIZE 4
-#define CALIBRATION_BUF_ACCEL_HDR_MAGIC 0x12345678
-#define CALIBRATION_BUF_ACCEL_VAL_SIZE 84
-#define CALIBRATION_BUF_ACCEL_TOT_SIZE (CALIBRATION_BUF_ACCEL_HDR_SIZE + CALIBRATION_BUF_ACCEL_VAL_SIZE)
-#define CALIBRATION_NO_MAGIC 0xdeadbeef
-#if CALIBRATION_STORAGE_SIZE_BYTES < (CALIBRATION_BUF_MAGNETIC_TOT_SIZE + CALIBRATION_BUF_GYRO_TOT_SIZE + CALIBRATION_BUF_ACCEL_TOT_SIZE)
-	#error insufficient space allocated for calibration buffer
-#endif
-
+#define CAL_RECORD_MAGIC        0xCA1B
+#define CAL_STORE_FILES         2
+
+/// @name Record types and the version of their calibration layout
+///@{
+#define CAL_REC_MAG             1   ///< MagCalibration from fV to iValidMagCal
+#define CAL_REC_GYRO            2   ///< gyro offset fbPl of the Kalman filter
+#define CAL_REC_ACCEL           3   ///< AccelCalibration fV, finvW and fR0
+#define CAL_REC_WARMSTART       4   ///< WarmStart9DOF state of the 9DOF Kalman filter
+#define CAL_REC_TYPES           4
+#define CAL_MAG_VERSION         1
+#define CAL_GYRO_VERSION        1
+#define CAL_ACCEL_VERSION       1
+#define CAL_WARMSTART_VERSION   1
+///@}
+
+#define CAL_MAG_BYTES           64
+#define CAL_GYRO_BYTES          12
+#define CAL_ACCEL_BYTES         84
+#define CAL_WARMSTART_BYTES     68
+#define CAL_MAX_BYTES           CAL_ACCEL_BYTES
+
+/// @name Calibrations in the emulated EEPROM, each behind a 4 byte magic number
+///@{
+#define EEPROM_BYTES            256
+#define EEPROM_MAGIC            0x12345678  ///< calibration present
+#define EEPROM_GYRO_MAGIC       0x12345679  ///< gyro offset present. Earlier versions stored the wrong bytes under EEPROM_MAGIC
+#define EEPROM_NO_MAGIC         0xdeadbeef  ///< calibration erased
+#define EEPROM_MAG_START        0
+#define EEPROM_GYRO_START       (EEPROM_MAG_START + 4 + CAL_MAG_BYTES)
+#define EEPROM_ACCEL_START      (EEPROM_GYRO_START + 4 + CAL_GYRO_BYTES)
+#define EEPROM_WARMSTART_START  (EEPROM_ACCEL_START + 4 + CAL_ACCEL_BYTES)
+///@}
+
+static_assert(sizeof(struct WarmStart9DOF) == CAL_WARMSTART_BYTES, "WarmStart9DOF layout changed");
+static_assert(EEPROM_WARMSTART_START + 4 + CAL_WARMSTART_BYTES <= EEPROM_BYTES, "EEPROM too small");
+
+/// Offset, size and layout version of each record type in the EEPROM, by CAL_REC_*
+static const int eeprom_start[CAL_REC_TYPES + 1] = {
+    0, EEPROM_MAG_START, EEPROM_GYRO_START, EEPROM_ACCEL_START, EEPROM_WARMSTART_START};
+static const uint8_t cal_bytes[CAL_REC_TYPES + 1] = {
+    0, CAL_MAG_BYTES, CAL_GYRO_BYTES, CAL_ACCEL_BYTES, CAL_WARMSTART_BYTES};
+static const uint8_t cal_version[CAL_REC_TYPES + 1] = {
+    0, CAL_MAG_VERSION, CAL_GYRO_VERSION, CAL_ACCEL_VERSION, CAL_WARMSTART_VERSION};
+
+/// Start of every record in a journal file
+struct CalRecordHeader {
+  uint16_t magic;         ///< CAL_RECORD_MAGIC
+  uint8_t type;           ///< CAL_REC_*
+  uint8_t version;        ///< layout version of the calibration
+  uint32_t sequence;      ///< counts up through all records of both files
+  uint16_t length;        ///< calibration bytes following, 0 for an erased calibration
+  uint16_t crc;           ///< CRC16() of the header up to here, then the calibration
+};
+
+/// Newest records, as read from the journal or since saved. There is one flash, so one of these.
+static struct CalibrationStore {
+  bool is_loaded;                     ///< journal read, or found unreadable
+  bool is_mounted;                    ///< LittleFS mounted
+  bool use_eeprom;                    ///< LittleFS unavailable, calibrations kept in the EEPROM
+  uint32_t next_sequence;             ///< sequence of the next record appended
+  uint8_t active_file;                ///< journal file being appended to
+  uint32_t active_bytes;              ///< valid bytes in the active file
+  bool start_new_file;                ///< active file ends in a damaged record, so don't append to it
+  bool recorded[CAL_REC_TYPES + 1];   ///< a record of the type was read or written
+  bool present[CAL_REC_TYPES + 1];    ///< a calibration of the type is stored
+  uint32_t sequence[CAL_REC_TYPES + 1];
+  uint8_t version[CAL_REC_TYPES + 1];
+  uint8_t length[CAL_REC_TYPES + 1];
+  uint8_t data[CAL_REC_TYPES + 1][CAL_MAX_BYTES];
+} cal_store;
+
+static void JournalPath(char *path, size_t size, uint8_t file) {
+  snprintf(path, size, "%s%u.jnl", CALIBRATION_STORE_PATH, (unsigned)file);
+}  // end JournalPath()
+
+static uint16_t RecordCRC(const CalRecordHeader *header, const uint8_t *data) {
+  uint16_t crc = CRC16((const uint8_t *)header, offsetof(CalRecordHeader, crc), 0xFFFF);
+  return CRC16(data, header->length, crc);
+}  // end RecordCRC()
+
+// Mount LittleFS, never formatting it
+static bool MountStore(void) {
+  if (cal_store.is_mounted) return true;
 #ifdef ESP8266
-// define a replacement for EEPROM.readBytes(), which is only available in the
-// ESP32 library
-void EepromReadBytes(int start_loc, void *buffer, int num_bytes);
-void EepromReadBytes(int start_loc, void *buffer, int num_bytes) {
-  uint8_t *ptr = (uint8_t *)buffer;
-  for (int i = 0; i < num_bytes; i++) {
-    ptr[i] = EEPROM.read(i + start_loc);    //read single bytes at a time
-  }
-  return;  // EEPROM.read() doesn't return errors, so neither do we
-}//end EepromReadBytes()
-#endif
-
-//fetch the Magnetic calibration values from non-volatile memory.
-//If cal values are unavailable, returns false. If successful, returns true.
-bool GetMagCalibrationFromNVM( float *cal_values ) {
-    if( NULL == cal_values ) {
-      return false;
-    }
-#if F_USING_MAG
-    //header of each calibration block type contains 
-    //magic value if valid calibration has been previously stored.
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM    
-    //check for the expected header - if not found, then calibration invalid
-    uint8_t buf_magic[CALIBRATION_BUF_MAGNETIC_HDR_SIZE];
-#ifdef ESP8266
-    EepromReadBytes(CALIBRATION_BUF_MAGNETIC_START, buf_magic,
-                    CALIBRATION_BUF_MAGNETIC_HDR_SIZE);
+  if (!LittleFS.begin()) return false;
 #endif
 #ifdef ESP32
-    EEPROM.readBytes(CALIBRATION_BUF_MAGNETIC_START, buf_magic,
-                     CALIBRATION_BUF_MAGNETIC_HDR_SIZE);
+  if (!LittleFS.begin(false)) return false;  // false: leave an unmountable partition alone
 #endif
-    uint32_t magic_value = CALIBRATION_BUF_MAGNETIC_HDR_MAGIC;
-    uint8_t *pSrc = (uint8_t *)&magic_value;
-    for (int i = 0; i < CALIBRATION_BUF_MAGNETIC_HDR_SIZE; i++) {
-      if( *pSrc != buf_magic[i] ) {
-        return false;
-      }
-      ++pSrc;
+  cal_store.is_mounted = true;
+  return true;
+}  // end MountStore()
+
+// Take the valid records of one journal file into the store. Returns the
+// highest sequence number seen, or sets *found false if there are none.
+static uint32_t ScanJournal(uint8_t file, bool *found, uint32_t *valid_bytes,
+                            bool *damaged) {
+  char path[32];
+  CalRecordHeader header;
+  uint32_t newest = 0;
+  uint32_t offset = 0;
+  size_t size;
+  uint8_t *buffer;
+
+  *found = false;
+  *valid_bytes = 0;
+  *damaged = false;
+  JournalPath(path, sizeof(path), file);
+  if (!LittleFS.exists(path)) return 0;
+  File journal = LittleFS.open(path, "r");
+  if (!journal) return 0;
+  size = journal.size();
+  if (size > CALIBRATION_STORE_FILE_BYTES + sizeof(header) + CAL_MAX_BYTES) {
+    size = CALIBRATION_STORE_FILE_BYTES + sizeof(header) + CAL_MAX_BYTES;
+  }
+  buffer = (uint8_t *)malloc(size ? size : 1);
+  if (buffer == NULL) {
+    journal.close();
+    return 0;
+  }
+  size = journal.read(buffer, size);  // the whole file at once
+  journal.close();
+
+  while (offset + sizeof(header) <= size) {
+    memcpy(&header, &buffer[offset], sizeof(header));
+    const uint8_t *data = &buffer[offset + sizeof(header)];
+    if ((header.magic != CAL_RECORD_MAGIC) || (header.length > CAL_MAX_BYTES) ||
+        (offset + sizeof(header) + header.length > size) ||
+        (RecordCRC(&header, data) != header.crc)) {
+      break;
     }
-    //read the valid calibration into provided destination
+    // sequence numbers are compared as differences so the journal survives wrapping
+    if ((header.type >= 1) && (header.type <= CAL_REC_TYPES) &&
+        (!cal_store.recorded[header.type] ||
+         ((int32_t)(header.sequence - cal_store.sequence[header.type]) > 0))) {
+      cal_store.recorded[header.type] = true;
+      cal_store.sequence[header.type] = header.sequence;
+      cal_store.present[header.type] = (header.length > 0);
+      cal_store.version[header.type] = header.version;
+      cal_store.length[header.type] = (uint8_t)header.length;
+      memcpy(cal_store.data[header.type], data, header.length);
+    }
+    if (!*found || ((int32_t)(header.sequence - newest) > 0)) newest = header.sequence;
+    *found = true;
+    offset += sizeof(header) + header.length;
+  }
+  *valid_bytes = offset;
+  *damaged = (offset < size);
+  free(buffer);
+  return newest;
+}  // end ScanJournal()
+
+static bool AppendRecord(uint8_t type, uint8_t version, const void *data, uint16_t length);
+
+static uint32_t EepromMagic(uint8_t type) {
+  return (type == CAL_REC_GYRO) ? EEPROM_GYRO_MAGIC : EEPROM_MAGIC;
+}  // end EepromMagic()
+
+// Copy bytes out of the EEPROM buffer without marking it changed
+static void EepromRead(int address, void *buffer, size_t length) {
 #ifdef ESP8266
-    EepromReadBytes(
-        CALIBRATION_BUF_MAGNETIC_START + CALIBRATION_BUF_MAGNETIC_HDR_SIZE,
-        cal_values, CALIBRATION_BUF_MAGNETIC_VAL_SIZE);
+  const uint8_t *eeprom = EEPROM.getConstDataPtr();
+  if (eeprom != NULL) {
+    memcpy(buffer, &eeprom[address], length);
+  } else {
+    memset(buffer, 0, length);
+  }
 #endif
 #ifdef ESP32
-    EEPROM.readBytes(
-        CALIBRATION_BUF_MAGNETIC_START + CALIBRATION_BUF_MAGNETIC_HDR_SIZE,
-        cal_values, CALIBRATION_BUF_MAGNETIC_VAL_SIZE);
+  EEPROM.readBytes(address, buffer, length);
 #endif
-    EEPROM.end();
+}  // end EepromRead()
+
+// Copy the calibration of a type stored in the EEPROM. Returns false if there is none.
+// EEPROM.begin() has been called.
+static bool ReadEepromRecord(uint8_t type, uint8_t *data) {
+  uint32_t magic;
+
+  EepromRead(eeprom_start[type], &magic, sizeof(magic));
+  if (magic != EepromMagic(type)) return false;
+  EepromRead(eeprom_start[type] + 4, data, cal_bytes[type]);
+  return true;
+}  // end ReadEepromRecord()
+
+// Store or, with length 0, erase the calibration of a type in the EEPROM
+static bool WriteEepromRecord(uint8_t type, const void *data, uint16_t length) {
+  uint32_t magic = length ? EepromMagic(type) : EEPROM_NO_MAGIC;
+  bool ok;
+  int i;
+
+  EEPROM.begin(EEPROM_BYTES);
+  for (i = 0; i < 4; i++) {
+    EEPROM.write(eeprom_start[type] + i, ((const uint8_t *)&magic)[i]);
+  }
+  for (i = 0; i < length; i++) {
+    EEPROM.write(eeprom_start[type] + 4 + i, ((const uint8_t *)data)[i]);
+  }
+  ok = EEPROM.commit();
+  EEPROM.end();
+  return ok;
+}  // end WriteEepromRecord()
+
+// Take the calibrations kept in the EEPROM into the store, when LittleFS is unavailable
+static void LoadEepromCalibrations(void) {
+  uint8_t type;
+
+  EEPROM.begin(EEPROM_BYTES);
+  for (type = 1; type <= CAL_REC_TYPES; type++) {
+    cal_store.present[type] = ReadEepromRecord(type, cal_store.data[type]);
+    cal_store.recorded[type] = true;
+    cal_store.version[type] = cal_version[type];
+    cal_store.length[type] = cal_bytes[type];
+  }
+  EEPROM.end();
+}  // end LoadEepromCalibrations()
+
+// Start an empty journal with the calibrations of the EEPROM, stored by earlier
+// versions or while LittleFS was unavailable. Every type gets a record, an erased
+// one if the EEPROM has none, so the journal is no longer empty and this is
+// done once.
+static void ImportEepromCalibrations(void) {
+  uint8_t records[CAL_REC_TYPES + 1][CAL_MAX_BYTES];
+  bool present[CAL_REC_TYPES + 1];
+  uint8_t type;
+
+  EEPROM.begin(EEPROM_BYTES);
+  for (type = 1; type <= CAL_REC_TYPES; type++) {
+    present[type] = ReadEepromRecord(type, records[type]);
+  }
+  EEPROM.end();
+  for (type = 1; type <= CAL_REC_TYPES; type++) {
+    if (present[type]) {
+      AppendRecord(type, cal_version[type], records[type], cal_bytes[type]);
+    } else {
+      AppendRecord(type, 0, NULL, 0);
+    }
+  }
+}  // end ImportEepromCalibrations()
+
+// Read both journal files, once
+static bool LoadStore(void) {
+  bool found[CAL_STORE_FILES], damaged[CAL_STORE_FILES];
+  uint32_t newest[CAL_STORE_FILES], valid_bytes[CAL_STORE_FILES];
+  uint8_t file;
+
+  if (cal_store.is_loaded) return true;
+  cal_store.is_loaded = true;
+  if (!MountStore()) {
+    debug_log("LittleFS unavailable, calibrations kept in EEPROM\n");
+    cal_store.use_eeprom = true;
+    LoadEepromCalibrations();
     return true;
-#endif  // if F_USING_MAG
+  }
+  for (file = 0; file < CAL_STORE_FILES; file++) {
+    newest[file] = ScanJournal(file, &found[file], &valid_bytes[file], &damaged[file]);
+  }
+
+  // append to the file holding the newest record
+  cal_store.active_file = 0;
+  if (found[1] && (!found[0] || ((int32_t)(newest[1] - newest[0]) > 0))) {
+    cal_store.active_file = 1;
+  }
+  cal_store.active_bytes = valid_bytes[cal_store.active_file];
+  cal_store.start_new_file = damaged[cal_store.active_file];
+  cal_store.next_sequence = found[cal_store.active_file] ? newest[cal_store.active_file] + 1 : 1;
+
+  if (!found[0] && !found[1]) ImportEepromCalibrations();
+  return true;
+}  // end LoadStore()
+
+// Write one record to an open journal file
+static bool WriteRecord(File &journal, uint8_t type, uint8_t version,
+                        const void *data, uint16_t length) {
+  uint8_t record[sizeof(CalRecordHeader) + CAL_MAX_BYTES];
+  CalRecordHeader header;
+
+  header.magic = CAL_RECORD_MAGIC;
+  header.type = type;
+  header.version = version;
+  header.sequence = cal_store.next_sequence;
+  header.length = length;
+  header.crc = RecordCRC(&header, (const uint8_t *)data);
+  memcpy(record, &header, sizeof(header));
+  if (length) memcpy(&record[sizeof(header)], data, length);
+  // one write, so the record is either whole or fails its CRC
+  if (journal.write(record, sizeof(header) + length) != sizeof(header) + length) {
+    return false;
+  }
+  cal_store.recorded[type] = true;
+  cal_store.sequence[type] = cal_store.next_sequence++;
+  cal_store.active_bytes += sizeof(header) + length;
+  return true;
+}  // end WriteRecord()
+
+// Start the other journal file with the newest record of every type,
+// erased types included, so the full file is no longer needed.
+static bool StartJournal(void) {
+  char path[32];
+  uint8_t file = (uint8_t)((cal_store.active_file + 1) % CAL_STORE_FILES);
+  uint8_t type;
+  bool ok = true;
+
+  JournalPath(path, sizeof(path), file);
+  File journal = LittleFS.open(path, "w");
+  if (!journal) return false;
+  cal_store.active_file = file;
+  cal_store.active_bytes = 0;
+  cal_store.start_new_file = false;
+  for (type = 1; ok && (type <= CAL_REC_TYPES); type++) {
+    if (cal_store.present[type]) {
+      ok = WriteRecord(journal, type, cal_store.version[type], cal_store.data[type],
+                       cal_store.length[type]);
+    } else {
+      ok = WriteRecord(journal, type, 0, NULL, 0);
+    }
+  }
+  journal.close();
+  if (!ok) cal_store.start_new_file = true;
+  return ok;
+}  // end StartJournal()
+
+// Append a record and keep it as the newest of its type. length 0 erases the type.
+static bool AppendRecord(uint8_t type, uint8_t version, const void *data, uint16_t length) {
+  char path[32];
+  bool ok;
+
+  if (!LoadStore()) return false;
+  cal_store.present[type] = (length > 0);
+  cal_store.version[type] = version;
+  cal_store.length[type] = (uint8_t)length;
+  if (length) memcpy(cal_store.data[type], data, length);
+  if (cal_store.use_eeprom) return WriteEepromRecord(type, data, length);
+
+  if (cal_store.start_new_file ||
+      (cal_store.active_bytes + sizeof(CalRecordHeader) + length > CALIBRATION_STORE_FILE_BYTES)) {
+    // the record just taken into the store is written with the others
+    return StartJournal();
+  }
+  JournalPath(path, sizeof(path), cal_store.active_file);
+  File journal = LittleFS.open(path, "a");
+  if (!journal) return false;
+  ok = WriteRecord(journal, type, version, data, length);
+  journal.close();
+  if (!ok) cal_store.start_new_file = true;
+  return ok;
+}  // end AppendRecord()
+
+// Copy the stored calibration of a type. Returns false if there is none of this layout.
+static bool GetRecord(uint8_t type, uint8_t version, void *data, uint16_t length) {
+  if ((data == NULL) || !LoadStore()) return false;
+  if (!cal_store.present[type] || (cal_store.version[type] != version) ||
+      (cal_store.length[type] != length)) {
+    return false;
+  }
+  memcpy(data, cal_store.data[type], length);
+  return true;
+}  // end GetRecord()
+
+//fetch the Magnetic calibration values from non-volatile memory.
+//If cal values are unavailable, returns false. If successful, returns true.
+bool GetMagCalibrationFromNVM( float *cal_values ) {
+#if F_USING_MAG
+    return GetRecord(CAL_REC_MAG, CAL_MAG_VERSION, cal_values, CAL_MAG_BYTES);
+#else
     return false;
+#endif
 }//end GetMagCalibrationFromNVM()
 
 bool GetGyroCalibrationFromNVM( float *cal_values ) {
-    if( NULL == cal_values ) {
-      return false;
-    }
 #if F_USING_GYRO
-    //header of each calibration block type contains 
-    //magic value if valid calibration has been previously stored.
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM    
-    //check for the expected header - if not found, then calibration invalid
-    uint8_t buf_magic[CALIBRATION_BUF_GYRO_HDR_SIZE];
-#ifdef ESP8266
-    EepromReadBytes(CALIBRATION_BUF_GYRO_START, buf_magic,
-                    CALIBRATION_BUF_GYRO_HDR_SIZE);
-#endif
-#ifdef ESP32
-    EEPROM.readBytes(CALIBRATION_BUF_GYRO_START, buf_magic,
-                     CALIBRATION_BUF_GYRO_HDR_SIZE);
-#endif
-    uint32_t magic_value = CALIBRATION_BUF_GYRO_HDR_MAGIC;
-    uint8_t *pSrc = (uint8_t *)&magic_value;
-    for (int i = 0; i < CALIBRATION_BUF_GYRO_HDR_SIZE; i++) {
-      if( *pSrc != buf_magic[i] ) {
-        return false;
-      }
-      ++pSrc;
-    }
-    //read the valid calibration into provided destination
-#ifdef ESP8266
-    EepromReadBytes(CALIBRATION_BUF_GYRO_START + CALIBRATION_BUF_GYRO_HDR_SIZE,
-                    cal_values, CALIBRATION_BUF_GYRO_VAL_SIZE);
-#endif
-#ifdef ESP32
-    EEPROM.readBytes(CALIBRATION_BUF_GYRO_START + CALIBRATION_BUF_GYRO_HDR_SIZE,
-                     cal_values, CALIBRATION_BUF_GYRO_VAL_SIZE);
-#endif
-    EEPROM.end();
-    return true;
-#endif  // if F_USING_GYRO
+    return GetRecord(CAL_REC_GYRO, CAL_GYRO_VERSION, cal_values, CAL_GYRO_BYTES);
+#else
     return false;
+#endif
 }//end GetGyroCalibrationFromNVM()
 
 bool GetAccelCalibrationFromNVM( float *cal_values ) {
-    if( NULL == cal_values ) {
-      return false;
-    }
 #if F_USING_ACCEL
-    //header of each calibration block type contains
-    //magic value if valid calibration has been previously stored.
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    
-    //check for the expected header - if not found, then calibration invalid
-    uint8_t buf_magic[CALIBRATION_BUF_ACCEL_HDR_SIZE];
-#ifdef ESP8266
-    EepromReadBytes(CALIBRATION_BUF_ACCEL_START, buf_magic,
-                     CALIBRATION_BUF_ACCEL_HDR_SIZE);
-#endif
-#ifdef ESP32
-    EEPROM.readBytes(CALIBRATION_BUF_ACCEL_START, buf_magic,
-                     CALIBRATION_BUF_ACCEL_HDR_SIZE);
-#endif
-    uint32_t magic_value = CALIBRATION_BUF_ACCEL_HDR_MAGIC;
-    uint8_t *pSrc = (uint8_t *)&magic_value;
-    for (int i = 0; i < CALIBRATION_BUF_ACCEL_HDR_SIZE; i++) {
-      if( *pSrc != buf_magic[i] ) {
-        return false;
-      }
-      ++pSrc;
-    }
-    //read the valid calibration into provided destination
-#ifdef ESP8266
-    EepromReadBytes(
-        CALIBRATION_BUF_ACCEL_START + CALIBRATION_BUF_ACCEL_HDR_SIZE,
-        cal_values, CALIBRATION_BUF_ACCEL_VAL_SIZE);
-#endif
-#ifdef ESP32
-    EEPROM.readBytes(
-        CALIBRATION_BUF_ACCEL_START + CALIBRATION_BUF_ACCEL_HDR_SIZE,
-        cal_values, CALIBRATION_BUF_ACCEL_VAL_SIZE);
-#endif
-    EEPROM.end();
-    return true;
-#endif  // if F_USING_ACCEL
+    return GetRecord(CAL_REC_ACCEL, CAL_ACCEL_VERSION, cal_values, CAL_ACCEL_BYTES);
+#else
     return false;
+#endif
 }//end GetAccelCalibrationFromNVM()
 
+bool GetWarmStartFromNVM( struct WarmStart9DOF *state ) {
+#if F_9DOF_GBY_KALMAN
+    return GetRecord(CAL_REC_WARMSTART, CAL_WARMSTART_VERSION, state, CAL_WARMSTART_BYTES);
+#else
+    return false;
+#endif
+}//end GetWarmStartFromNVM()
 
 void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg)
 {
 #if F_USING_MAG
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    //modify magnetic, leave existing gyro and accelerometer calibrations in buffer
-    pDst = buf_NVM + CALIBRATION_BUF_MAGNETIC_START;
-
-    // write buffer with magnetic header + calibration in bytes 0 to 67
-	//bytes[0-3]: four byte header denoting magnetic calibration present
-    uint32_t itmp32 = CALIBRATION_BUF_MAGNETIC_HDR_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_MAGNETIC_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-    //bytes[4-67]: magnetic calibration: 15x float + 1x int32 subtotal 64 bytes
-    pSrc = (uint8_t *)&(sfg->MagCal);
-    for (int i = 0; i < CALIBRATION_BUF_MAGNETIC_VAL_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-	}
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM write mag cal failed\n");
+    // MagCalibration from fV to iValidMagCal: 15x float + 1x int32
+    if (!AppendRecord(CAL_REC_MAG, CAL_MAG_VERSION, &(sfg->MagCal), CAL_MAG_BYTES)) {
+		debug_log("save mag cal failed\n");
+		return;
 	}
-    EEPROM.end();
+	// automatic saves now compare against this calibration, and an older one still queued is dropped
+	sfg->MagCal.fStoredFitErrorpc = sfg->MagCal.fFitErrorpc;
+	sfg->MagCal.iStoredValidMagCal = sfg->MagCal.iValidMagCal;
+	sfg->MagCal.iSavePending = false;
+#endif  // if F_USING_MAG
+}
+
+void SavePendingCalibrationsToNVM(SensorFusionGlobals *sfg)
+{
+#if F_USING_MAG
+    // copy queued by fRunMagCalibration(), left untouched by it while iSavePending is set.
+    // Only a written copy becomes the one later calibrations are compared against, so
+    // fRunMagCalibration() queues it again after a failed write.
+    if (sfg->MagCal.iSavePending) {
+        __sync_synchronize();
+        if (AppendRecord(CAL_REC_MAG, CAL_MAG_VERSION, sfg->MagCal.fSaveValues, CAL_MAG_BYTES)) {
+            sfg->MagCal.fStoredFitErrorpc = sfg->MagCal.fSaveFitErrorpc;
+            sfg->MagCal.iStoredValidMagCal = sfg->MagCal.iSaveValidMagCal;
+        } else {
+            debug_log("auto save mag cal failed\n");
+        }
+        sfg->MagCal.iSavePending = false;
+    }
 #endif  // if F_USING_MAG
-        return;
+#if F_9DOF_GBY_KALMAN
+    // copy queued by fRun_9DOF_GBY_KALMAN(), left untouched by it while iWarmStartPending is set
+    if (sfg->SV_9DOF_GBY_KALMAN.iWarmStartPending) {
+        __sync_synchronize();
+        if (!AppendRecord(CAL_REC_WARMSTART, CAL_WARMSTART_VERSION,
+                          &(sfg->SV_9DOF_GBY_KALMAN.WarmStart), CAL_WARMSTART_BYTES)) {
+            debug_log("save warm start failed\n");
+        }
+        sfg->SV_9DOF_GBY_KALMAN.iWarmStartPending = false;
+    }
+#endif  // if F_9DOF_GBY_KALMAN
 }
 
 void SaveGyroCalibrationToNVM(SensorFusionGlobals *sfg)
 {
 #if F_USING_GYRO && (F_9DOF_GBY_KALMAN || F_6DOF_GY_KALMAN)
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    //modify gyro, leave existing magnetic and accelerometer calibrations in buffer
-    pDst = buf_NVM + CALIBRATION_BUF_GYRO_START;
-
-    // write buffer with gyro header + calibration in bytes 0 to 15
-	//bytes[0-3]: four byte header denoting gyro calibration present
-    uint32_t itmp32 = CALIBRATION_BUF_GYRO_HDR_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_GYRO_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-	//bytes [4-15]: 3 gyro offset floats sub totalling 12 bytes
+	// 3 gyro offset floats
 #if F_9DOF_GBY_KALMAN
-	pSrc = (uint8_t *) sfg->SV_9DOF_GBY_KALMAN.fbPl;
+	const float *pSrc = sfg->SV_9DOF_GBY_KALMAN.fbPl;
 #elif F_6DOF_GY_KALMAN
-	pSrc = (uint8 *) sfg->SV_6DOF_GY_KALMAN.fbPl;
+	const float *pSrc = sfg->SV_6DOF_GY_KALMAN.fbPl;
 #endif
-    pSrc = (uint8_t *)&(sfg->MagCal);
-    for (int i = 0; i < CALIBRATION_BUF_GYRO_VAL_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-	}
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM write gyro cal failed\n");
+    if (!AppendRecord(CAL_REC_GYRO, CAL_GYRO_VERSION, pSrc, CAL_GYRO_BYTES)) {
+		debug_log("save gyro cal failed\n");
 	}
-    EEPROM.end();
 #endif
-	return;
 }
 
 void SaveAccelCalibrationToNVM(SensorFusionGlobals *sfg)
 {
 #if F_USING_ACCEL
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    //modify accel, leave existing magnetic and gyro calibrations in buffer
-    pDst = buf_NVM + CALIBRATION_BUF_ACCEL_START;
-
-    // write buffer with accel header + calibration in bytes 0 to 87
-	//bytes[0-3]: four byte header denoting gyro calibration present
-    uint32_t itmp32 = CALIBRATION_BUF_ACCEL_HDR_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_ACCEL_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-	//bytes [4-87]: 21 precision accelerometer calibration floats subtotalling 84 bytes
-	pSrc = (uint8_t *) &(sfg->AccelCal);
-    for (int i = 0; i < CALIBRATION_BUF_ACCEL_VAL_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
+	// 21 precision accelerometer calibration floats
+    if (!AppendRecord(CAL_REC_ACCEL, CAL_ACCEL_VERSION, &(sfg->AccelCal), CAL_ACCEL_BYTES)) {
+		debug_log("save accel cal failed\n");
 	}
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM write accel cal failed\n");
+#endif
+}
+
+void SaveWarmStartToNVM(SensorFusionGlobals *sfg)
+{
+#if F_9DOF_GBY_KALMAN
+    struct WarmStart9DOF state;
+
+    // the orientation is of no use until locked to the eCompass
+    if (!sfg->SV_9DOF_GBY_KALMAN.iFirstAccelMagLock) return;
+    fGetWarmStart9DOF(&(sfg->SV_9DOF_GBY_KALMAN), &state);
+    if (!AppendRecord(CAL_REC_WARMSTART, CAL_WARMSTART_VERSION, &state, CAL_WARMSTART_BYTES)) {
+		debug_log("save warm start failed\n");
 	}
-    EEPROM.end();
 #endif
-	return;
 }
 
 void EraseMagCalibrationFromNVM(void)
 {
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    pDst = buf_NVM + CALIBRATION_BUF_MAGNETIC_START;
-	//bytes[0-3]: four byte header denoting magnetic calibration present
-    uint32_t itmp32 = CALIBRATION_NO_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_MAGNETIC_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM clear magnetic cal failed\n");
+    if (!AppendRecord(CAL_REC_MAG, 0, NULL, 0)) {
+		debug_log("clear magnetic cal failed\n");
 	}
-    EEPROM.end();
-
-	return;
 }
 
 void EraseGyroCalibrationFromNVM(void)
 {
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    pDst = buf_NVM + CALIBRATION_BUF_GYRO_START;
-	//bytes[0-3]: four byte header denoting magnetic calibration present
-    uint32_t itmp32 = CALIBRATION_NO_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_GYRO_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM clear gyro cal failed\n");
+    if (!AppendRecord(CAL_REC_GYRO, 0, NULL, 0)) {
+		debug_log("clear gyro cal failed\n");
 	}
-    EEPROM.end();
-
-	return;
 }
 
 void EraseAccelCalibrationFromNVM(void)
 {
-	uint8_t *pSrc, *pDst;		// scratch pointers
-    uint8_t *buf_NVM = NULL;	//pointer into the non-volatile memory buffer
-
-    EEPROM.begin(
-        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
-    buf_NVM = EEPROM.getDataPtr();
-
-    pDst = buf_NVM + CALIBRATION_BUF_ACCEL_START;
-	//bytes[0-3]: four byte header denoting magnetic calibration present
-    uint32_t itmp32 = CALIBRATION_NO_MAGIC;
-    pSrc = (uint8_t *)&itmp32;
-    for (int i = 0; i < CALIBRATION_BUF_ACCEL_HDR_SIZE; i++) {
-		*pDst = *pSrc;
-        ++pDst;
-        ++pSrc;
-    }
-    // write the whole buffer contents to NVM
-    if( ! EEPROM.commit() ) {
-		debug_log("EEPROM clear magnetic cal failed\n");
+    if (!AppendRecord(CAL_REC_ACCEL, 0, NULL, 0)) {
+		debug_log("clear accel cal failed\n");
 	}
-    EEPROM.end();
+}
 
-	return;
+void EraseWarmStartFromNVM(void)
+{
+    if (!AppendRecord(CAL_REC_WARMSTART, 0, NULL, 0)) {
+		debug_log("clear warm start failed\n");
+	}
 }
@@ -14,17 +14,25 @@ extern "C" {
   
 /*! \file calibration_storage.h
     \brief Provides functions to store calibration to NVM, which
-     on ESP devices is provided by EEPROM.
+     on ESP devices is a journal on the LittleFS partition, or the
+     emulated EEPROM if the partition cannot be mounted. The partition
+     is not formatted by these functions.
 */
 bool GetMagCalibrationFromNVM( float *cal_values );
 bool GetGyroCalibrationFromNVM( float *cal_values );
 bool GetAccelCalibrationFromNVM( float *cal_values );
+bool GetWarmStartFromNVM( struct WarmStart9DOF *state );
 void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg);
 void SaveGyroCalibrationToNVM(SensorFusionGlobals *sfg);
 void SaveAccelCalibrationToNVM(SensorFusionGlobals *sfg);
+void SaveWarmStartToNVM(SensorFusionGlobals *sfg);
+/// Write out calibrations the fusion cycle queued for saving. Call from the task running
+/// the fusion cycle, between cycles.
+void SavePendingCalibrationsToNVM(SensorFusionGlobals *sfg);
 void EraseMagCalibrationFromNVM(void);
 void EraseGyroCalibrationFromNVM(void);
 void EraseAccelCalibrationFromNVM(void);
+void EraseWarmStartFromNVM(void);
 
 #ifdef __cplusplus
 }
@@ -27,9 +27,6 @@
 #include "build.h"
 #include "control.h"
 
-// global structures
-uint8_t sUARTOutputBuffer[MAX_LEN_SERIAL_OUTPUT_BUF];
-
 // Blocking function to write multiple bytes to specified output(s): a UART
 //  or a TCP socket
 // On ESP32, hardware UART has internal FIFO of length 0x7f, and once the
@@ -79,29 +76,49 @@ int8_t SendSerialBytesOut(SensorFusionGlobals *sfg)
     return (0);
 }//end SendSerialBytesOut()
 
-// Check for incoming commands, which are sequences of ASCII text,
-// arriving on either hardware UART or TCP socket. Send them to
-// function for decoding, as defined in DecodeCommandBytes.c
+// Check for incoming commands, which are either sequences of ASCII text
+// or framed binary commands, arriving on either hardware UART or TCP socket.
+// Binary frames are decoded by DecodeBinaryCommandByte(), which replies on the
+// same port with an ACK or NAK. All other bytes go to DecodeCommandBytes().
 // Doesn't distinguish between which path the commands arrive by, 
 // as it is unlikely one would have multiple simultaneous sources.
 int8_t ReceiveIncomingCommands(SensorFusionGlobals *sfg)
 {
     uint8_t     data;
-    WiFiClient *tcp_client = (WiFiClient *) sfg->pControlSubsystem->tcp_client;
-    HardwareSerial *serial_port = (HardwareSerial*) sfg->pControlSubsystem->serial_port;
+    ControlSubsystem *pComm = sfg->pControlSubsystem;
+    WiFiClient *tcp_client = (WiFiClient *) pComm->tcp_client;
+    HardwareSerial *serial_port = (HardwareSerial*) pComm->serial_port;
 
     // check for incoming bytes from serial UART
     if( serial_port ) {
-        while (0 < Serial.available() )
+        while (0 < serial_port->available() )
       {   data = serial_port->read(); 
-          DecodeCommandBytes(sfg, &data, 1);
+          switch (DecodeBinaryCommandByte(sfg, data)) {
+            case BINARY_CMD_NOT_FRAME:
+              DecodeCommandBytes(sfg, &data, 1);
+              break;
+            case BINARY_CMD_REPLY:
+              serial_port->write(pComm->BinaryCommand.iReply, pComm->BinaryCommand.iReplyLength);
+              break;
+            default:
+              break;
+          }
       }
     }
     // check for incoming bytes from TCP socket
     if (tcp_client) {
       while (tcp_client->connected() && (0 < tcp_client->available())) {
         tcp_client->read(&data, 1);
-        DecodeCommandBytes(sfg, &data, 1);
+        switch (DecodeBinaryCommandByte(sfg, data)) {
+          case BINARY_CMD_NOT_FRAME:
+            DecodeCommandBytes(sfg, &data, 1);
+            break;
+          case BINARY_CMD_REPLY:
+            tcp_client->write(pComm->BinaryCommand.iReply, pComm->BinaryCommand.iReplyLength);
+            break;
+          default:
+            break;
+        }
       }
     }
 
@@ -123,7 +140,23 @@ bool initializeIOSubsystem(
         pComm->RPCPacketOn = true;                  // transmit roll, pitch, compass packet
         pComm->AltPacketOn = false;                 // Altitude packet
         pComm->AccelCalPacketOn = false;
-        pComm->serial_out_buf = sUARTOutputBuffer;
+        pComm->BatchPacketSize = 0;                 // one sample per packet (batching off)
+        pComm->BatchCount = 0;
+        pComm->DeltaPacketOn = false;               // delta coded packet type 10
+        StreamEncoderInit(&pComm->DeltaEncoder, DELTA_PACKET_QUANT_SHIFT, STREAM_KEYFRAME_INTERVAL);
+        pComm->BinaryCommand.iCount = 0;            // waiting for the start of a binary command frame
+        pComm->EventPacketOn = false;               // use Throttle() rather than change-triggered output
+        pComm->fEventAngleDeg = EVENT_ANGLE_DEG;
+        pComm->fEventRateDegPerSec = EVENT_RATE_DEGPERSEC;
+        pComm->iEventHeartbeat = EVENT_HEARTBEAT_SECS * FUSION_HZ;
+        pComm->iEventCycles = pComm->iEventHeartbeat;  // send the first packet straight away
+        pComm->iThrottle = 0;
+        pComm->iTimeStamp = 0;
+        pComm->iPacketNumber = 0;
+        pComm->iMagneticPacketID = 0;
+        strcpy(pComm->iCommandBuffer, "~~~~");     // no command bytes received yet
+        pComm->iNumUserCommands = 0;
+        pComm->serial_out_buf = pComm->SerialOutBuf;
         pComm->write = SendSerialBytesOut;
         pComm->stream = CreateOutgoingPackets;
         pComm->readCommands = ReceiveIncomingCommands;
@@ -27,11 +27,68 @@
 #ifndef _CONTROL_H_
 #define _CONTROL_H_
 
+#include "stream_codec.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_LEN_SERIAL_OUTPUT_BUF   255  // larger than the nominal 124 byte size for outgoing packets
+#define MAX_BATCH_SAMPLES           6    // max samples per batched packet type 9 (worst case 208 bytes after byte stuffing)
+#define EVENT_ANGLE_DEG             1.0F // default orientation change (deg) that triggers a packet in event mode
+#define EVENT_RATE_DEGPERSEC        5.0F // default angular velocity change (deg/s) that triggers a packet in event mode
+#define EVENT_HEARTBEAT_SECS        5    // default max interval (s) between packets in event mode
+#define MAX_USER_COMMANDS           8    // max number of application commands added with RegisterCommand()
+#define DELTA_PACKET_QUANT_SHIFT    1    // low order bits dropped from each channel of delta coded packet type 10
+
+/// One fusion output sample held in the ControlSubsystem until a batched packet type 9 is sent
+typedef struct BatchSample {
+    uint16_t iDeltaT;       // time since previous sample in the batch (us), 0 for the first sample
+    int16_t  iQuat[4];      // quaternion scaled 30000 = 1.0F
+    int16_t  iOmega[3];     // angular velocity scaled 20 counts per deg/s
+} BatchSample;
+
+/// @name Binary command frames
+/// Binary commands are framed, checksummed alternatives to the 4-character ASCII commands,
+/// with an ACK or NAK reply to every frame. Layout of both commands and replies:
+/// [0]: BINARY_CMD_SYNC
+/// [1]: frame type (BINARY_CMD_TYPE_*)
+/// [2]: frame id, chosen by the sender of a command and echoed in the reply
+/// [3]: payload length N
+/// [4 to 3+N]: payload. For a command, the 4 ASCII command characters optionally followed by
+///          a little endian int32_t that replaces the argument in the command table. Only
+///          commands with an argument range accept one, and only from within the range.
+///          For a NAK, one BINARY_CMD_NAK_* reason byte. Empty for an ACK.
+/// [4+N to 5+N]: CRC-16/CCITT (poly 0x1021, initial value 0xFFFF) of bytes [1] to [3+N], little endian
+///@{
+#define BINARY_CMD_SYNC             0xA5    ///< first byte of every frame, never part of an ASCII command
+#define BINARY_CMD_TYPE_COMMAND     0x01    ///< command frame
+#define BINARY_CMD_TYPE_ACK         0x06    ///< command accepted and processed
+#define BINARY_CMD_TYPE_NAK         0x15    ///< command rejected
+#define BINARY_CMD_NAK_CRC          1       ///< NAK reason: CRC mismatch
+#define BINARY_CMD_NAK_LENGTH       2       ///< NAK reason: frame type or payload length invalid
+#define BINARY_CMD_NAK_UNKNOWN      3       ///< NAK reason: command not recognized
+#define BINARY_CMD_NAK_ARGUMENT     4       ///< NAK reason: argument not accepted by the command
+#define BINARY_CMD_MAX_PAYLOAD      8       ///< 4 command characters + int32_t argument
+#define BINARY_CMD_MAX_FRAME        (6 + BINARY_CMD_MAX_PAYLOAD)
+#define BINARY_CMD_BYTE_TIMEOUT_US  10000   ///< gap between bytes (us) after which a partial frame is dropped
+///@}
+
+/// Return values of DecodeBinaryCommandByte()
+typedef enum binary_cmd_result {
+    BINARY_CMD_NOT_FRAME = -1,  ///< byte is not part of a binary frame, pass it to DecodeCommandBytes()
+    BINARY_CMD_PENDING = 0,     ///< byte consumed, frame not yet complete
+    BINARY_CMD_REPLY = 1        ///< frame complete, reply waiting in iReply[]
+} binary_cmd_result;
+
+/// Receive state of the binary command channel
+typedef struct BinaryCommandParser {
+    uint8_t iCount;                         // bytes of the current frame received, 0 while waiting for sync
+    int32_t iLastByteTicks;                 // SystickStartCount() time of the last byte of the frame
+    uint8_t iFrame[BINARY_CMD_MAX_FRAME];   // frame being received
+    uint8_t iReply[7];                      // ACK or NAK frame to send back
+    uint8_t iReplyLength;                   // number of bytes in iReply[]
+} BinaryCommandParser;
 
 /// @name Control Port Function Type Definitions
 /// "write" "stream" and "readCommands" provide three control functions visible at the main()
@@ -43,11 +100,28 @@ typedef void (injectCommand_t) (SensorFusionGlobals *sfg, uint8_t input_buffer[]
 typedef void (streamData_t)(SensorFusionGlobals *sfg);
 ///@}
 
+/// Function called by the command interpreter when its command is received.
+/// iArg is the value supplied when the command was registered.
+typedef void (commandHandler_t)(SensorFusionGlobals *sfg, int32_t iArg);
+
+/// Entry in a command table: the packed 4-character command, the function
+/// that processes it and the argument passed to that function. A binary
+/// command frame may replace the argument by one from iArgMin to iArgMax.
+typedef struct CommandEntry {
+    int32_t iCommand;
+    commandHandler_t *handler;
+    int32_t iArg;
+    int32_t iArgMin;        ///< smallest argument a binary command frame may supply
+    int32_t iArgMax;        ///< largest argument a binary command frame may supply, below iArgMin if none
+} CommandEntry;
+
 /// \brief The ControlSubsystem encapsulates command and data streaming functions.
 ///
 /// The ControlSubsystem encapsulates command and data streaming functions
 /// for the library.  A C++-like typedef structure which includes executable methods
 /// for the subsystem is defined here.
+/// All streaming and command state lives here rather than in statics, so each
+/// SensorFusionGlobals with its own ControlSubsystem runs independently.
 typedef struct ControlSubsystem {
 	quaternion_type DefaultQuaternionPacketType;	// default quaternion transmitted at power on
 	volatile quaternion_type QuaternionPacketType;	// quaternion type transmitted over UART
@@ -56,6 +130,29 @@ typedef struct ControlSubsystem {
 	volatile uint8_t RPCPacketOn;			// flag to enable roll, pitch, compass packet
 	volatile uint8_t AltPacketOn;			// flag to enable altitude packet
 	volatile int8_t  AccelCalPacketOn;      // variable used to coordinate accelerometer calibration
+	volatile uint8_t BatchPacketSize;       // samples per batched packet type 9. 0 or 1 sends the normal packets
+    uint8_t         BatchCount;             // number of samples accumulated in BatchSamples[]
+    uint32_t        BatchTimeStamp;         // 1MHz time stamp of the first sample in the batch
+    uint32_t        BatchLastTimeStamp;     // 1MHz time stamp of the most recent sample in the batch
+    BatchSample     BatchSamples[MAX_BATCH_SAMPLES];  // samples waiting to be sent in packet type 9
+	volatile uint8_t DeltaPacketOn;         // flag to send delta coded packet type 10 instead of types 1 to 8
+    StreamEncoder   DeltaEncoder;           // keyframe/delta encoder state for packet type 10
+    BinaryCommandParser BinaryCommand;      // receive state of framed binary commands
+	volatile uint8_t EventPacketOn;         // flag to send packets only on orientation change instead of Throttle()
+    float           fEventAngleDeg;         // orientation change (deg) since last packet that triggers a new one
+    float           fEventRateDegPerSec;    // angular velocity change (deg/s) since last packet that triggers a new one
+    uint16_t        iEventHeartbeat;        // max fusion cycles between packets in event mode
+    uint16_t        iEventCycles;           // fusion cycles since the last packet in event mode
+    Quaternion      fqEventLast;            // quaternion sent in the last packet in event mode
+    int16_t         iEventOmegaLast[3];     // scaled angular velocity sent in the last packet in event mode
+    int32_t         iThrottle;              // Throttle() accumulator, transmits when it reaches RATERESOLUTION
+    uint32_t        iTimeStamp;             // 1MHz time stamp expected by the PC GUI
+    uint8_t         iPacketNumber;          // packet number of the outgoing stream
+    int16_t         iMagneticPacketID;      // magnetic variable sent in the next packet type 6
+    char            iCommandBuffer[5];      // delay line of the last 4 ASCII command bytes, plus terminating \0
+    CommandEntry    UserCommands[MAX_USER_COMMANDS];  // application commands added by RegisterCommand(), sorted
+    uint8_t         iNumUserCommands;       // number of entries in UserCommands[]
+    uint8_t         SerialOutBuf[MAX_LEN_SERIAL_OUTPUT_BUF];  // storage for serial_out_buf
     uint8_t         *serial_out_buf;        //buffer containing the output stream (data packet)
     uint16_t        bytes_to_send;          //how many bytes in output stream waiting to go out
     const void *serial_port;           //cast to Serial * and used to output to the serial port
@@ -88,6 +185,23 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg);
 /// Packet protocols are defined in the NXP Sensor Fusion for Kinetis Product Development Kit User Guide.
 void DecodeCommandBytes(SensorFusionGlobals *sfg, uint8_t input_buffer[], uint16_t nbytes);
 
+/// Located in control_input.c:
+/// Feeds one received byte to the binary command channel. Complete frames are checked,
+/// processed and an ACK or NAK reply is placed in pComm->BinaryCommand.iReply.
+binary_cmd_result DecodeBinaryCommandByte(SensorFusionGlobals *sfg, uint8_t iByte);
+
+/// Located in control_input.c:
+/// CRC-16/CCITT of iLength bytes. Pass 0xFFFF as iCRC to start a new calculation.
+uint16_t CRC16(const uint8_t *pData, uint16_t iLength, uint16_t iCRC);
+
+/// Located in control_input.c:
+/// Adds an application-defined 4-character command to the command interpreter.
+/// A binary command frame may replace iArg by a value from iArgMin to iArgMax;
+/// pass iArgMax below iArgMin to allow none.
+/// Returns false if the command already exists or MAX_USER_COMMANDS are registered.
+bool RegisterCommand(ControlSubsystem *pComm, const char *command, commandHandler_t *handler, int32_t iArg,
+                     int32_t iArgMin, int32_t iArgMax);
+
 /// Utility function used to place data in output buffer about to be transmitted via UART
 void OutputBufAppendItem(uint8_t *pDest, uint16_t *pIndex, uint8_t *pSource, uint16_t iBytesToCopy);
 
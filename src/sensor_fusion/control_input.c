@@ -15,10 +15,11 @@
 #include "calibration_storage.h"
 #include "control.h"
 #include "fusion.h"
+#include "hal_timer.h"
 
 // All commands for the command interpreter are exactly 4 characters long.
 // The command interpeter converts the incoming packet to a 32-bit integer, which is then
-// the index into a large switch statement for processing commands.
+// looked up in the sorted command table below to find the function that processes it.
 // The following block of #define statements are responsible for the conversion from 4-characters
 // into an easier to use integer format.
 #define cmd_VGplus      (((((('V' << 8) | 'G') << 8) | '+') << 8) | ' ') // "VG+ " = enable angular velocity packet transmission
@@ -35,6 +36,16 @@
 #define cmd_RPCminus    (((((('R' << 8) | 'P') << 8) | 'C') << 8) | '-') // "RPC-" = Roll/Pitch/Compass off
 #define cmd_ALTplus     (((((('A' << 8) | 'L') << 8) | 'T') << 8) | '+') // "ALT+" = Altitude packet on
 #define cmd_ALTminus    (((((('A' << 8) | 'L') << 8) | 'T') << 8) | '-') // "ALT-" = Altitude packet off
+#define cmd_BAT0        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '0') // "BAT0" = send normal unbatched packets
+#define cmd_BAT2        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '2') // "BAT2" = send 2 samples per batched packet type 9
+#define cmd_BAT3        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '3') // "BAT3" = send 3 samples per batched packet type 9
+#define cmd_BAT4        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '4') // "BAT4" = send 4 samples per batched packet type 9
+#define cmd_BAT5        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '5') // "BAT5" = send 5 samples per batched packet type 9
+#define cmd_BAT6        (((((('B' << 8) | 'A') << 8) | 'T') << 8) | '6') // "BAT6" = send 6 samples per batched packet type 9
+#define cmd_DLTplus     (((((('D' << 8) | 'L') << 8) | 'T') << 8) | '+') // "DLT+" = send delta coded packet type 10 instead of types 1 to 8
+#define cmd_DLTminus    (((((('D' << 8) | 'L') << 8) | 'T') << 8) | '-') // "DLT-" = send the normal packets
+#define cmd_EVTplus     (((((('E' << 8) | 'V') << 8) | 'T') << 8) | '+') // "EVT+" = send packets only when orientation changes
+#define cmd_EVTminus    (((((('E' << 8) | 'V') << 8) | 'T') << 8) | '-') // "EVT-" = send packets at the throttled fixed rate
 #define cmd_RST         (((((('R' << 8) | 'S') << 8) | 'T') << 8) | ' ') // "RST " = Soft reset
 #define cmd_RINS        (((((('R' << 8) | 'I') << 8) | 'N') << 8) | 'S') // "RINS" = Reset INS inertial navigation velocity and position
 #define cmd_SVAC        (((((('S' << 8) | 'V') << 8) | 'A') << 8) | 'C') // "SVAC" = save all calibrations to non-volatile storage
@@ -67,297 +78,400 @@
 #define cmd_PA10        (((((('P' << 8) | 'A') << 8) | '1') << 8) | '0') // "PA10" average precision accelerometer location 10
 #define cmd_PA11        (((((('P' << 8) | 'A') << 8) | '1') << 8) | '1') // "PA11" average precision accelerometer location 11
 
-void DecodeCommandBytes(SensorFusionGlobals *sfg, uint8_t input_buffer[], uint16_t nbytes)
-{
-  static char iCommandBuffer[5] = "~~~~";	// 5 bytes long to include the unused terminating \0
-  int32_t isum;		// 32 bit command identifier
-  int16_t i, j;		// loop counters
+// bit-fields used by the save and erase calibration commands
+#define CAL_MAG         0x01
+#define CAL_GYRO        0x02
+#define CAL_ACCEL       0x04
+#define CAL_WARMSTART   0x08
+#define CAL_ALL         (CAL_MAG | CAL_GYRO | CAL_ACCEL | CAL_WARMSTART)
 
-  sfg->setStatus(sfg, RECEIVING_WIRED);
+// command handlers. iArg is the value given in the command table entry.
+static void CmdAngularVelocityPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->pControlSubsystem->AngularVelocityPacketOn = (uint8_t) iArg;
+}
 
-	// parse all received bytes in sUARTInputBuf into the iCommandBuffer delay line
-	for (i = 0; i < nbytes; i++) {
-		// shuffle the iCommandBuffer delay line and add the new command byte
-		for (j = 0; j < 3; j++)
-			iCommandBuffer[j] = iCommandBuffer[j + 1];
-		iCommandBuffer[3] = input_buffer[i];
+static void CmdDebugPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->pControlSubsystem->DebugPacketOn = (uint8_t) iArg;
+}
 
-		// check if we have a valid command yet
-		isum = ((((((int32_t)iCommandBuffer[0] << 8) | iCommandBuffer[1]) << 8) | iCommandBuffer[2]) << 8) | iCommandBuffer[3];
-		switch (isum) 		{
-		case cmd_VGplus: // "VG+ " = enable angular velocity packet transmission
-                    sfg->pControlSubsystem->AngularVelocityPacketOn = true;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_VGminus: // "VG- " = disable angular velocity packet transmission
-                    sfg->pControlSubsystem->AngularVelocityPacketOn = false;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_DBplus: // "DB+ " = enable debug packet transmission
-                    sfg->pControlSubsystem->DebugPacketOn = true;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_DBminus: // "DB- " = disable debug packet transmission
-                    sfg->pControlSubsystem->DebugPacketOn = false;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q3: // "Q3  " = transmit 3-axis accelerometer quaternion in standard packet
+// the quaternion type is only changed if the matching algorithm is in this build
+static void CmdQuaternionType(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    switch ((quaternion_type) iArg)
+    {
 #if F_3DOF_G_BASIC
-                    sfg->pControlSubsystem->QuaternionPacketType = Q3;
+        case Q3:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q3M:  // "Q3M " = transmit 3-axis magnetometer quaternion in standard packet
 #if F_3DOF_B_BASIC
-                    sfg->pControlSubsystem->QuaternionPacketType = Q3M;
+        case Q3M:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q3G: // "Q3G " = transmit 3-axis gyro quaternion in standard packet
 #if F_3DOF_Y_BASIC
-                    sfg->pControlSubsystem->QuaternionPacketType = Q3G;
+        case Q3G:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q6MA: // "Q6MA" = transmit 6-axis mag/accel quaternion in standard packet
 #if F_6DOF_GB_BASIC
-                    sfg->pControlSubsystem->QuaternionPacketType = Q6MA;
+        case Q6MA:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q6AG: // "Q6AG" = transmit 6-axis accel/gyro quaternion in standard packet
 #if F_6DOF_GY_KALMAN
-                    sfg->pControlSubsystem->QuaternionPacketType = Q6AG;
+        case Q6AG:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_Q9: // "Q9  " = transmit 9-axis quaternion in standard packet (default)
 #if F_9DOF_GBY_KALMAN
-                    sfg->pControlSubsystem->QuaternionPacketType = Q9;
+        case Q9:
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_RPCplus: // "RPC+" = Roll/Pitch/Compass on
-                    sfg->pControlSubsystem->RPCPacketOn = true;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_RPCminus: // "RPC-" = Roll/Pitch/Compass off
-                    sfg->pControlSubsystem->RPCPacketOn = false;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ALTplus: // "ALT+" = Altitude packet on
-                    sfg->pControlSubsystem->AltPacketOn = true;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ALTminus: // "ALT-" = Altitude packet off
-                    sfg->pControlSubsystem->AltPacketOn = false;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_RST: // "RST " = Soft reset
-                    // reset sensor fusion
-                    fInitializeFusion(sfg);
-
-                    // reset magnetic calibration and magnetometer data buffer
+            sfg->pControlSubsystem->QuaternionPacketType = (quaternion_type) iArg;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void CmdRPCPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->pControlSubsystem->RPCPacketOn = (uint8_t) iArg;
+}
+
+static void CmdAltPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->pControlSubsystem->AltPacketOn = (uint8_t) iArg;
+}
+
+static void CmdBatchPacketSize(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->pControlSubsystem->BatchPacketSize = (uint8_t) iArg;
+    sfg->pControlSubsystem->BatchCount = 0;
+}
+
+static void CmdDeltaPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    // restart the stream with a keyframe
+    if (iArg) sfg->pControlSubsystem->DeltaEncoder.iChannels = 0;
+    sfg->pControlSubsystem->DeltaPacketOn = (uint8_t) iArg;
+}
+
+static void CmdEventPacket(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    // send the first packet straight away
+    if (iArg) sfg->pControlSubsystem->iEventCycles = sfg->pControlSubsystem->iEventHeartbeat;
+    sfg->pControlSubsystem->EventPacketOn = (uint8_t) iArg;
+}
+
+static void CmdReset(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    // reset sensor fusion
+    fInitializeFusion(sfg);
+
+    // reset magnetic calibration and magnetometer data buffer
 #if F_USING_MAG
-                    fInitializeMagCalibration(&sfg->MagCal, &sfg->MagBuffer);
+    fInitializeMagCalibration(&sfg->MagCal, &sfg->MagBuffer);
 #endif
-                    // reset precision accelerometer calibration and accelerometer measurements
+    // reset precision accelerometer calibration and accelerometer measurements
 #if F_USING_ACCEL
-                    fInitializeAccelCalibration(&sfg->AccelCal, &sfg->AccelBuffer, &(sfg->pControlSubsystem->AccelCalPacketOn)) ;
+    fInitializeAccelCalibration(&sfg->AccelCal, &sfg->AccelBuffer, &(sfg->pControlSubsystem->AccelCalPacketOn)) ;
 #endif
-                    iCommandBuffer[3] = '~';
-		break;
+}
 
-		case cmd_RINS: // "RINS" = Reset INS inertial navigation velocity and position
+static void CmdResetINS(SensorFusionGlobals *sfg, int32_t iArg)
+{
 #if F_9DOF_GBY_KALMAN
-                    for (i = CHX; i <= CHZ; i++) {
-			sfg->SV_9DOF_GBY_KALMAN.fVelGl[i] = 0.0F;
-			sfg->SV_9DOF_GBY_KALMAN.fDisGl[i] = 0.0F;
-                    }
+    int16_t i;
+    for (i = CHX; i <= CHZ; i++) {
+        sfg->SV_9DOF_GBY_KALMAN.fVelGl[i] = 0.0F;
+        sfg->SV_9DOF_GBY_KALMAN.fDisGl[i] = 0.0F;
+    }
 #endif
-		iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_SVAC: // "SVAC" = save all calibrations to non-volatile storage
-                    SaveMagCalibrationToNVM(sfg);
-                    SaveGyroCalibrationToNVM(sfg);
-                    SaveAccelCalibrationToNVM(sfg);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_SVMC: // "SVMC" = save magnetic calibration to non-volatile storage
-                    SaveMagCalibrationToNVM(sfg);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_SVYC: // "SVYC" = save gyroscope calibration to non-volatile storage
-                    SaveGyroCalibrationToNVM(sfg);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_SVGC: // "SVGC" = save precision accelerometer calibration to non-volatile storage
-                    SaveAccelCalibrationToNVM(sfg);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ERAC: // "ERAC" = erase all calibrations from non-volatile storage
-                    EraseMagCalibrationFromNVM();
-                    EraseGyroCalibrationFromNVM();
-                    EraseAccelCalibrationFromNVM();
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ERMC: // "ERMC" = erase magnetic calibration offset 0 bytes from non-volatile storage
-                    EraseMagCalibrationFromNVM();
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ERYC: // "ERYC" = erase gyro offset calibrationoffset 128 bytes from non-volatile storage
-                    EraseGyroCalibrationFromNVM();
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_ERGC: // "ERGC" = erase precision accelerometer calibration offset 192 bytesfrom non-volatile storage
-                    EraseAccelCalibrationFromNVM();
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_180X: // "180X" perturbation
-                    sfg->iPerturbation = 1;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_180Y: // "180Y" perturbation
-                    sfg->iPerturbation = 2;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_180Z: // "180Z" perturbation
-                    sfg->iPerturbation = 3;
-                  iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_M90X: // "M90X" perturbation
-                    sfg->iPerturbation = 4;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_P90X: // "P90X" perturbation
-                    sfg->iPerturbation = 5;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_M90Y: // "M90Y" perturbation
-                    sfg->iPerturbation = 6;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_P90Y: // "P90Y" perturbation
-                    sfg->iPerturbation = 7;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_M90Z: // "M90Z" perturbation
-                    sfg->iPerturbation = 8;
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_P90Z: // "P90Z" perturbation
-                    sfg->iPerturbation = 9;
-                    iCommandBuffer[3] = '~';
-		break;
+}
+
+static void CmdSaveCalibration(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    if (iArg & CAL_MAG) SaveMagCalibrationToNVM(sfg);
+    if (iArg & CAL_GYRO) SaveGyroCalibrationToNVM(sfg);
+    if (iArg & CAL_ACCEL) SaveAccelCalibrationToNVM(sfg);
+    if (iArg & CAL_WARMSTART) SaveWarmStartToNVM(sfg);
+}
+
+static void CmdEraseCalibration(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    if (iArg & CAL_MAG) EraseMagCalibrationFromNVM();
+    if (iArg & CAL_GYRO) EraseGyroCalibrationFromNVM();
+    if (iArg & CAL_ACCEL) EraseAccelCalibrationFromNVM();
+    if (iArg & CAL_WARMSTART) EraseWarmStartFromNVM();
+}
 
+static void CmdPerturbation(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    sfg->iPerturbation = (int16_t) iArg;
+}
+
+#if F_USING_ACCEL
+static void CmdAccelCalLocation(SensorFusionGlobals *sfg, int32_t iArg)
+{
+    // iStoreLocation indexes fGsStored[] and sets a bit of iStoreFlags
+    if ((iArg < 0) || (iArg >= MAX_ACCEL_CAL_ORIENTATIONS)) return;
+    sfg->AccelBuffer.iStoreLocation = (int16_t) iArg;
+    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
+}
+#endif
+
+// argument range of a command whose argument a binary command frame may not replace
+#define NO_ARG_OVERRIDE     1, 0
+
+// built-in commands. Entries MUST be kept in ASCII order of the command
+// string (which is also the numeric order of the packed value) since the
+// table is searched by bisection. The last two fields are the arguments a
+// binary command frame may supply in place of the third.
+static const CommandEntry BuiltinCommands[] = {
+    {cmd_180X,     CmdPerturbation,            1, 0, 9},
+    {cmd_180Y,     CmdPerturbation,            2, 0, 9},
+    {cmd_180Z,     CmdPerturbation,            3, 0, 9},
+    {cmd_ALTplus,  CmdAltPacket,               true, NO_ARG_OVERRIDE},
+    {cmd_ALTminus, CmdAltPacket,               false, NO_ARG_OVERRIDE},
+    {cmd_BAT0,     CmdBatchPacketSize,         0, 0, MAX_BATCH_SAMPLES},
+    {cmd_BAT2,     CmdBatchPacketSize,         2, 0, MAX_BATCH_SAMPLES},
+    {cmd_BAT3,     CmdBatchPacketSize,         3, 0, MAX_BATCH_SAMPLES},
+    {cmd_BAT4,     CmdBatchPacketSize,         4, 0, MAX_BATCH_SAMPLES},
+    {cmd_BAT5,     CmdBatchPacketSize,         5, 0, MAX_BATCH_SAMPLES},
+    {cmd_BAT6,     CmdBatchPacketSize,         6, 0, MAX_BATCH_SAMPLES},
+    {cmd_DBplus,   CmdDebugPacket,             true, NO_ARG_OVERRIDE},
+    {cmd_DBminus,  CmdDebugPacket,             false, NO_ARG_OVERRIDE},
+    {cmd_DLTplus,  CmdDeltaPacket,             true, NO_ARG_OVERRIDE},
+    {cmd_DLTminus, CmdDeltaPacket,             false, NO_ARG_OVERRIDE},
+    {cmd_ERAC,     CmdEraseCalibration,        CAL_ALL, NO_ARG_OVERRIDE},
+    {cmd_ERGC,     CmdEraseCalibration,        CAL_ACCEL, NO_ARG_OVERRIDE},
+    {cmd_ERMC,     CmdEraseCalibration,        CAL_MAG, NO_ARG_OVERRIDE},
+    {cmd_ERYC,     CmdEraseCalibration,        CAL_GYRO, NO_ARG_OVERRIDE},
+    {cmd_EVTplus,  CmdEventPacket,             true, NO_ARG_OVERRIDE},
+    {cmd_EVTminus, CmdEventPacket,             false, NO_ARG_OVERRIDE},
+    {cmd_M90X,     CmdPerturbation,            4, 0, 9},
+    {cmd_M90Y,     CmdPerturbation,            6, 0, 9},
+    {cmd_M90Z,     CmdPerturbation,            8, 0, 9},
+    {cmd_P90X,     CmdPerturbation,            5, 0, 9},
+    {cmd_P90Y,     CmdPerturbation,            7, 0, 9},
+    {cmd_P90Z,     CmdPerturbation,            9, 0, 9},
 #if F_USING_ACCEL
-		case cmd_PA00: // "PA00" average precision accelerometer location 0
-                    sfg->AccelBuffer.iStoreLocation = 0;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA01: // "PA01" average precision accelerometer location 1
-                    sfg->AccelBuffer.iStoreLocation = 1;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA02: // "PA02" average precision accelerometer location 2
-                    sfg->AccelBuffer.iStoreLocation = 2;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA03: // "PA03" average precision accelerometer location 3
-                    sfg->AccelBuffer.iStoreLocation = 3;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA04: // "PA04" average precision accelerometer location 4
-                    sfg->AccelBuffer.iStoreLocation = 4;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA05: // "PA05" average precision accelerometer location 5
-                    sfg->AccelBuffer.iStoreLocation = 5;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA06: // "PA06" average precision accelerometer location 6
-                    sfg->AccelBuffer.iStoreLocation = 6;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA07: // "PA07" average precision accelerometer location 7
-                    sfg->AccelBuffer.iStoreLocation = 7;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA08: // "PA08" average precision accelerometer location 8
-                    sfg->AccelBuffer.iStoreLocation = 8;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA09: // "PA09" average precision accelerometer location 9
-                    sfg->AccelBuffer.iStoreLocation = 9;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA10: // "PA10" average precision accelerometer location 10
-                    sfg->AccelBuffer.iStoreLocation = 10;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-
-		case cmd_PA11: // "PA11" average precision accelerometer location 11
-                    sfg->AccelBuffer.iStoreLocation = 11;
-                    sfg->AccelBuffer.iStoreCounter = (ACCEL_CAL_AVERAGING_SECS * FUSION_HZ);
-                    iCommandBuffer[3] = '~';
-		break;
-#endif // precision accelerometer calibration
-
-		default:
-			// no action
-			break;
+    {cmd_PA00,     CmdAccelCalLocation,        0, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA01,     CmdAccelCalLocation,        1, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA02,     CmdAccelCalLocation,        2, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA03,     CmdAccelCalLocation,        3, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA04,     CmdAccelCalLocation,        4, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA05,     CmdAccelCalLocation,        5, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA06,     CmdAccelCalLocation,        6, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA07,     CmdAccelCalLocation,        7, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA08,     CmdAccelCalLocation,        8, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA09,     CmdAccelCalLocation,        9, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA10,     CmdAccelCalLocation,        10, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+    {cmd_PA11,     CmdAccelCalLocation,        11, 0, MAX_ACCEL_CAL_ORIENTATIONS - 1},
+#endif // F_USING_ACCEL
+    {cmd_Q3,       CmdQuaternionType,          Q3, NO_ARG_OVERRIDE},
+    {cmd_Q3G,      CmdQuaternionType,          Q3G, NO_ARG_OVERRIDE},
+    {cmd_Q3M,      CmdQuaternionType,          Q3M, NO_ARG_OVERRIDE},
+    {cmd_Q6AG,     CmdQuaternionType,          Q6AG, NO_ARG_OVERRIDE},
+    {cmd_Q6MA,     CmdQuaternionType,          Q6MA, NO_ARG_OVERRIDE},
+    {cmd_Q9,       CmdQuaternionType,          Q9, NO_ARG_OVERRIDE},
+    {cmd_RINS,     CmdResetINS,                0, NO_ARG_OVERRIDE},
+    {cmd_RPCplus,  CmdRPCPacket,               true, NO_ARG_OVERRIDE},
+    {cmd_RPCminus, CmdRPCPacket,               false, NO_ARG_OVERRIDE},
+    {cmd_RST,      CmdReset,                   0, NO_ARG_OVERRIDE},
+    {cmd_SVAC,     CmdSaveCalibration,         CAL_ALL, NO_ARG_OVERRIDE},
+    {cmd_SVGC,     CmdSaveCalibration,         CAL_ACCEL, NO_ARG_OVERRIDE},
+    {cmd_SVMC,     CmdSaveCalibration,         CAL_MAG, NO_ARG_OVERRIDE},
+    {cmd_SVYC,     CmdSaveCalibration,         CAL_GYRO, NO_ARG_OVERRIDE},
+    {cmd_VGplus,   CmdAngularVelocityPacket,   true, NO_ARG_OVERRIDE},
+    {cmd_VGminus,  CmdAngularVelocityPacket,   false, NO_ARG_OVERRIDE},
+};
+#define NUM_BUILTIN_COMMANDS (sizeof(BuiltinCommands) / sizeof(BuiltinCommands[0]))
+
+// bisection search of a sorted command table. Returns NULL if not found.
+static const CommandEntry *FindCommand(const CommandEntry *pTable, int16_t iEntries, int32_t iCommand)
+{
+    int16_t iLow = 0;
+    int16_t iHigh = iEntries - 1;
+    int16_t iMid;
+
+    while (iLow <= iHigh)
+    {
+        iMid = (iLow + iHigh) >> 1;
+        if (pTable[iMid].iCommand < iCommand)       iLow = iMid + 1;
+        else if (pTable[iMid].iCommand > iCommand)  iHigh = iMid - 1;
+        else                                        return &pTable[iMid];
+    }
+    return NULL;
+} // end FindCommand()
+
+// Add an application command to the interpreter of pComm. Application commands
+// are kept in pComm->UserCommands[] in the same order as the built-in table.
+// command points to the 4
+// characters of the command (pad with spaces if shorter). The handler is
+// called with iArg each time the command is received, or with the argument of
+// a binary command frame if it is from iArgMin to iArgMax. Returns false if
+// the command duplicates an existing one or the table is full.
+bool RegisterCommand(ControlSubsystem *pComm, const char *command, commandHandler_t *handler, int32_t iArg,
+                     int32_t iArgMin, int32_t iArgMax)
+{
+    int32_t iCommand;
+    int16_t i;
+
+    if ((pComm == NULL) || (command == NULL) || (handler == NULL)) return false;
+    iCommand = ((((((int32_t)command[0] << 8) | command[1]) << 8) | command[2]) << 8) | command[3];
+    if (FindCommand(BuiltinCommands, NUM_BUILTIN_COMMANDS, iCommand) ||
+        FindCommand(pComm->UserCommands, pComm->iNumUserCommands, iCommand) ||
+        (pComm->iNumUserCommands >= MAX_USER_COMMANDS))
+        return false;
+
+    // insertion into the sorted table
+    for (i = pComm->iNumUserCommands; (i > 0) && (pComm->UserCommands[i - 1].iCommand > iCommand); i--)
+        pComm->UserCommands[i] = pComm->UserCommands[i - 1];
+    pComm->UserCommands[i].iCommand = iCommand;
+    pComm->UserCommands[i].handler = handler;
+    pComm->UserCommands[i].iArg = iArg;
+    pComm->UserCommands[i].iArgMin = iArgMin;
+    pComm->UserCommands[i].iArgMax = iArgMax;
+    pComm->iNumUserCommands++;
+
+    return true;
+} // end RegisterCommand()
+
+// CRC-16/CCITT (polynomial 0x1021) of iLength bytes, starting from iCRC
+// (0xFFFF for a new calculation)
+uint16_t CRC16(const uint8_t *pData, uint16_t iLength, uint16_t iCRC)
+{
+    uint16_t i;
+    int8_t   j;
+
+    for (i = 0; i < iLength; i++)
+    {
+        iCRC ^= (uint16_t) pData[i] << 8;
+        for (j = 0; j < 8; j++)
+            iCRC = (iCRC & 0x8000) ? (uint16_t) ((iCRC << 1) ^ 0x1021) : (uint16_t) (iCRC << 1);
+    }
+    return iCRC;
+} // end CRC16()
+
+// build the ACK or NAK reply frame for the command frame just received
+static void BinaryCommandReply(BinaryCommandParser *pParser, uint8_t iType, uint8_t iReason)
+{
+    uint16_t iCRC;
+    uint8_t  iIndex = 0;
+
+    pParser->iReply[iIndex++] = BINARY_CMD_SYNC;
+    pParser->iReply[iIndex++] = iType;
+    pParser->iReply[iIndex++] = pParser->iFrame[2];     // echo the command frame id
+    pParser->iReply[iIndex++] = (iType == BINARY_CMD_TYPE_NAK) ? 1 : 0;
+    if (iType == BINARY_CMD_TYPE_NAK) pParser->iReply[iIndex++] = iReason;
+    iCRC = CRC16(&pParser->iReply[1], iIndex - 1, 0xFFFF);
+    pParser->iReply[iIndex++] = (uint8_t) (iCRC & 0xFF);
+    pParser->iReply[iIndex++] = (uint8_t) (iCRC >> 8);
+    pParser->iReplyLength = iIndex;
+} // end BinaryCommandReply()
+
+binary_cmd_result DecodeBinaryCommandByte(SensorFusionGlobals *sfg, uint8_t iByte)
+{
+    BinaryCommandParser *pParser = &sfg->pControlSubsystem->BinaryCommand;
+    const CommandEntry *pEntry;     // matching command table entry
+    uint8_t  *pFrame = pParser->iFrame;
+    uint8_t  iPayload;              // payload length N
+    uint16_t iCRC;                  // CRC of received frame
+    int32_t  isum;                  // 32 bit command identifier
+    int32_t  iArg;                  // argument passed to the command handler
+
+    // a frame arrives in one burst, so a gap means bytes were lost. drop the partial frame
+    // rather than let the next frame complete it, which would leave the rest of that frame
+    // to be executed by the ASCII command path
+    if ((pParser->iCount > 0) &&
+        (SystickElapsedMicros(pParser->iLastByteTicks) > BINARY_CMD_BYTE_TIMEOUT_US))
+        pParser->iCount = 0;
+    SystickStartCount(&pParser->iLastByteTicks);
+
+    // wait for the sync byte. anything else belongs to the ASCII command path
+    if (pParser->iCount == 0)
+    {
+        if (iByte != BINARY_CMD_SYNC) return BINARY_CMD_NOT_FRAME;
+        pFrame[pParser->iCount++] = iByte;
+        return BINARY_CMD_PENDING;
+    }
+
+    pFrame[pParser->iCount++] = iByte;
+
+    // reject an impossible length as soon as it arrives so the parser resynchronizes quickly
+    if (pParser->iCount == 4)
+    {
+        if ((pFrame[1] != BINARY_CMD_TYPE_COMMAND) ||
+            ((pFrame[3] != 4) && (pFrame[3] != BINARY_CMD_MAX_PAYLOAD)))
+        {
+            pParser->iCount = 0;
+            BinaryCommandReply(pParser, BINARY_CMD_TYPE_NAK, BINARY_CMD_NAK_LENGTH);
+            return BINARY_CMD_REPLY;
+        }
+    }
+    if ((pParser->iCount < 4) || (pParser->iCount < (6 + pFrame[3])))
+        return BINARY_CMD_PENDING;
+
+    // the frame is complete
+    pParser->iCount = 0;
+    sfg->setStatus(sfg, RECEIVING_WIRED);
+    iPayload = pFrame[3];
+    iCRC = (uint16_t) pFrame[4 + iPayload] | ((uint16_t) pFrame[5 + iPayload] << 8);
+    if (CRC16(&pFrame[1], 3 + iPayload, 0xFFFF) != iCRC)
+    {
+        BinaryCommandReply(pParser, BINARY_CMD_TYPE_NAK, BINARY_CMD_NAK_CRC);
+        return BINARY_CMD_REPLY;
+    }
+
+    isum = ((((((int32_t)pFrame[4] << 8) | pFrame[5]) << 8) | pFrame[6]) << 8) | pFrame[7];
+    pEntry = FindCommand(BuiltinCommands, NUM_BUILTIN_COMMANDS, isum);
+    if (pEntry == NULL)
+        pEntry = FindCommand(sfg->pControlSubsystem->UserCommands, sfg->pControlSubsystem->iNumUserCommands, isum);
+    if (pEntry == NULL)
+    {
+        BinaryCommandReply(pParser, BINARY_CMD_TYPE_NAK, BINARY_CMD_NAK_UNKNOWN);
+        return BINARY_CMD_REPLY;
+    }
+
+    // an 8 byte payload supplies the handler argument, if within the range of the command.
+    // a command without a range has iArgMax below iArgMin, so accepts none
+    iArg = pEntry->iArg;
+    if (iPayload == BINARY_CMD_MAX_PAYLOAD)
+    {
+        iArg = (int32_t) ((uint32_t) pFrame[8] | ((uint32_t) pFrame[9] << 8) |
+                          ((uint32_t) pFrame[10] << 16) | ((uint32_t) pFrame[11] << 24));
+        if ((iArg < pEntry->iArgMin) || (iArg > pEntry->iArgMax))
+        {
+            BinaryCommandReply(pParser, BINARY_CMD_TYPE_NAK, BINARY_CMD_NAK_ARGUMENT);
+            return BINARY_CMD_REPLY;
+        }
+    }
+    pEntry->handler(sfg, iArg);
+
+    BinaryCommandReply(pParser, BINARY_CMD_TYPE_ACK, 0);
+    return BINARY_CMD_REPLY;
+} // end DecodeBinaryCommandByte()
+
+void DecodeCommandBytes(SensorFusionGlobals *sfg, uint8_t input_buffer[], uint16_t nbytes)
+{
+  ControlSubsystem *pComm = sfg->pControlSubsystem;
+  char *iCommandBuffer = pComm->iCommandBuffer;	// delay line of the last 4 bytes received
+  int32_t isum;		// 32 bit command identifier
+  int16_t i, j;		// loop counters
+  const CommandEntry *pEntry;	// matching command table entry
+
+  sfg->setStatus(sfg, RECEIVING_WIRED);
+
+	// parse all received bytes in sUARTInputBuf into the iCommandBuffer delay line
+	for (i = 0; i < nbytes; i++) {
+		// shuffle the iCommandBuffer delay line and add the new command byte
+		for (j = 0; j < 3; j++)
+			iCommandBuffer[j] = iCommandBuffer[j + 1];
+		iCommandBuffer[3] = input_buffer[i];
+
+		// check if we have a valid command yet
+		isum = ((((((int32_t)iCommandBuffer[0] << 8) | iCommandBuffer[1]) << 8) | iCommandBuffer[2]) << 8) | iCommandBuffer[3];
+		pEntry = FindCommand(BuiltinCommands, NUM_BUILTIN_COMMANDS, isum);
+		if (pEntry == NULL)
+			pEntry = FindCommand(pComm->UserCommands, pComm->iNumUserCommands, isum);
+		if (pEntry != NULL) {
+			pEntry->handler(sfg, pEntry->iArg);
+			iCommandBuffer[3] = '~';	// consume the command so it cannot match again
 		}
 	} // end of loop over received characters
 
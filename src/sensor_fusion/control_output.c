@@ -17,6 +17,7 @@
 #include "build.h"
 #include "control.h"        // Command/Streaming interface - application specific
 #include "fusion_testing.h" // will include SensorPerturbations for test purposes
+#include "stream_codec.h"   // keyframe/delta encoder for packet type 10
 
 // OutputBufAppendItem() appends a variable number of source bytes to a destination buffer
 // for transmission as the output packet.
@@ -90,10 +91,10 @@ void ReadCommonParams( SV_ptr data,
     *isystick = (uint16_t) (data->systick / 20);
 }//end ReadCommonParams()
 
-// Throttle back output stream by fractional multiplier
-bool Throttle()
+// Throttle back output stream by fractional multiplier. The accumulator is
+// held in pComm->iThrottle.
+bool Throttle(ControlSubsystem *pComm)
 {
-    static int32_t iThrottle = 0;
     bool skip;
     // The UART (serial over USB and over WiFi / Bluetooth)
     // is limited to 115kbps which is more than adequate for the 31kbps
@@ -103,10 +104,10 @@ bool Throttle()
     // support a higher rate, the limit is set to MAXPACKETRATEHZ=40Hz.
 
     // the increment applied to iThrottle is in the range 0 to (RATERESOLUTION - 1)
-    iThrottle += ((int32_t) MAXPACKETRATEHZ * (int32_t) RATERESOLUTION) / (int32_t) FUSION_HZ;
-    if (iThrottle >= RATERESOLUTION) {
+    pComm->iThrottle += ((int32_t) MAXPACKETRATEHZ * (int32_t) RATERESOLUTION) / (int32_t) FUSION_HZ;
+    if (pComm->iThrottle >= RATERESOLUTION) {
         // update the throttle counter and transmit the packets over UART (USB and Bluetooth)
-	iThrottle -= RATERESOLUTION;
+	pComm->iThrottle -= RATERESOLUTION;
         skip = false;
     } else {
         skip = true;
@@ -114,13 +115,51 @@ bool Throttle()
     return(skip);
 }//end Throttle()
 
+// Suppress the output stream unless the orientation or angular velocity has
+// changed by more than the thresholds in the ControlSubsystem since the last
+// packet was sent, or the heartbeat interval has expired. Packets are never
+// sent faster than MAXPACKETRATEHZ. Returns true if the packets are to be skipped.
+bool SkipUnchanged(ControlSubsystem *pComm, Quaternion *fq, int16_t iOmega[])
+{
+    float   fdot;       // cosine of half the rotation angle since the last packet
+    int16_t i;          // loop counter
+    bool    send;
+
+    if (pComm->iEventCycles < 0xFFFF) pComm->iEventCycles++;
+
+    // never exceed the rate the serial link is able to carry
+    if (pComm->iEventCycles < (FUSION_HZ + MAXPACKETRATEHZ - 1) / MAXPACKETRATEHZ) return true;
+
+    send = (pComm->iEventCycles >= pComm->iEventHeartbeat);
+
+    // the rotation between the two quaternions exceeds the threshold when the
+    // modulus of their dot product is below cos(threshold / 2)
+    if (!send)
+    {
+        fdot = fq->q0 * pComm->fqEventLast.q0 + fq->q1 * pComm->fqEventLast.q1 +
+               fq->q2 * pComm->fqEventLast.q2 + fq->q3 * pComm->fqEventLast.q3;
+        send = (fabsf(fdot) < cosf(0.5F * pComm->fEventAngleDeg * FPIOVER180));
+    }
+
+    // iOmega is scaled 20 counts per deg/s
+    for (i = CHX; !send && (i <= CHZ); i++)
+        send = (abs(iOmega[i] - pComm->iEventOmegaLast[i]) > (int16_t) (20.0F * pComm->fEventRateDegPerSec));
+
+    if (!send) return true;
+
+    pComm->fqEventLast = *fq;
+    for (i = CHX; i <= CHZ; i++) pComm->iEventOmegaLast[i] = iOmega[i];
+    pComm->iEventCycles = 0;
+    return false;
+}//end SkipUnchanged()
+
 // prepare packets to send, e.g. via Bluetooth, or UART to OpenSDA / USB
 void CreateOutgoingPackets(SensorFusionGlobals *sfg)
 {
-    uint8_t         *output_buf = sfg->pControlSubsystem->serial_out_buf;
+    ControlSubsystem *pComm = sfg->pControlSubsystem;   // stream state of this instance
+    uint8_t         *output_buf = pComm->serial_out_buf;
     Quaternion      fq;                 // quaternion to be transmitted
     float           ftmp;               // scratch
-    static uint32_t iTimeStamp = 0;     // 1MHz time stamp
     uint16_t        iIndex;             // output buffer counter
     int32_t         scratch32;          // scratch int32_t
     int16_t         scratch16;          // scratch int16_t
@@ -137,14 +176,9 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
                     DebugPacketOn,
                     RPCPacketOn;
     int8_t          AccelCalPacketOn;
-    static uint8_t  iPacketNumber = 0;  // packet number
 
     // update the 1MHz time stamp counter expected by the PC GUI (independent of project clock rates)
-    iTimeStamp += 1000000 / FUSION_HZ;
-
-#if (MAXPACKETRATEHZ < FUSION_HZ)
-    if (Throttle()) return;  // need to skip packet transmission to avoid UART overrun
-#endif
+    pComm->iTimeStamp += 1000000 / FUSION_HZ;
 
     // cache local copies of control flags so we don't have to keep dereferencing pointers below
     quaternion_type quaternionPacketType;
@@ -154,6 +188,269 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     RPCPacketOn = sfg->pControlSubsystem->RPCPacketOn;
     AccelCalPacketOn = sfg->pControlSubsystem->AccelCalPacketOn;
 
+    // initialize default quaternion, flags byte, angular velocity and orientation
+    fq.q0 = 1.0F;
+    fq.q1 = fq.q2 = fq.q3 = 0.0F;
+    flags = 0x00;
+    iOmega[CHX] = iOmega[CHY] = iOmega[CHZ] = 0;
+    iPhi = iThe = iRho = iDelta = 0;
+    isystick = 0;
+
+    // flags byte 33: quaternion type in least significant nibble
+    // Q3:   coordinate nibble, 1
+    // Q3M:	 coordinate nibble, 6
+    // Q3G:	 coordinate nibble, 3
+    // Q6MA: coordinate nibble, 2
+    // Q6AG: coordinate nibble, 4
+    // Q9:   coordinate nibble, 8
+    // flags byte 33: coordinate in most significant nibble
+    // Aerospace/NED:	0, quaternion nibble
+    // Android:	  		1, quaternion nibble
+    // Windows 8: 		2, quaternion nibble
+    // set the quaternion, flags, angular velocity and Euler angles
+    switch (quaternionPacketType)
+    {
+#if F_3DOF_G_BASIC
+        case Q3:
+            if (sfg->iFlags & F_3DOF_G_BASIC)
+            {
+                flags |= 0x01;
+                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_G_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+#if F_3DOF_B_BASIC
+        case Q3M:
+            if (sfg->iFlags & F_3DOF_B_BASIC)
+            {
+                flags |= 0x06;
+                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_B_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+#if F_3DOF_Y_BASIC
+        case Q3G:
+            if (sfg->iFlags & F_3DOF_Y_BASIC)
+            {
+                flags |= 0x03;
+                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_Y_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+#if F_6DOF_GB_BASIC
+        case Q6MA:
+            if (sfg->iFlags & F_6DOF_GB_BASIC)
+            {
+                flags |= 0x02;
+                iDelta = (int16_t) (10.0F * sfg->SV_6DOF_GB_BASIC.fLPDelta);
+                ReadCommonParams((SV_ptr)&sfg->SV_6DOF_GB_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+#if F_6DOF_GY_KALMAN
+        case Q6AG:
+            if (sfg->iFlags & F_6DOF_GY_KALMAN)
+            {
+                flags |= 0x04;
+                ReadCommonParams((SV_ptr)&sfg->SV_6DOF_GY_KALMAN, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+#if F_9DOF_GBY_KALMAN
+        case Q9:
+            if (sfg->iFlags & F_9DOF_GBY_KALMAN)
+             {
+                flags |= 0x08;
+                iDelta = (int16_t) (10.0F * sfg->SV_9DOF_GBY_KALMAN.fDeltaPl);
+                ReadCommonParams((SV_ptr)&sfg->SV_9DOF_GBY_KALMAN, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
+            }
+            break;
+#endif
+        default:
+            // use the default data already initialized
+            break;
+    }
+
+    // set the coordinate system bits in flags from default NED (00)
+#if THISCOORDSYSTEM == ANDROID
+    // set the Android flag bits
+    flags |= 0x10;
+#elif THISCOORDSYSTEM == WIN8
+    // set the Win8 flag bits
+    flags |= 0x20;
+#endif // THISCOORDSYSTEM
+
+    // ************************************************************************
+    // Batched orientation packet type 9
+    // sent instead of packet types 1 to 8 when BatchPacketSize is 2 or more.
+    // every fusion cycle stores one sample, and once BatchPacketSize samples
+    // are stored they go out in a single frame sharing one header. the
+    // Throttle() decimation is not applied since batching already divides
+    // the packet rate by BatchPacketSize.
+    // total size is 9 + 16 * BatchPacketSize bytes before byte stuffing
+    // ************************************************************************
+    if (sfg->pControlSubsystem->BatchPacketSize > 1)
+    {
+        BatchSample *pSample;
+
+        pComm->bytes_to_send = 0;
+#if F_USING_ACCEL
+        // packet type 8 is not sent in this mode. drop the request as the normal path does once
+        // it has sent the packet, so a stale one does not go out when batching is switched off
+        sfg->pControlSubsystem->AccelCalPacketOn = -1;
+#endif
+        if (pComm->BatchPacketSize > MAX_BATCH_SAMPLES)
+            pComm->BatchPacketSize = MAX_BATCH_SAMPLES;
+
+        // store this sample with its time stamp delta-coded against the previous one
+        pSample = &pComm->BatchSamples[pComm->BatchCount];
+        if (pComm->BatchCount == 0)
+        {
+            pComm->BatchTimeStamp = pComm->iTimeStamp;
+            pSample->iDeltaT = 0;
+        }
+        else if ((pComm->iTimeStamp - pComm->BatchLastTimeStamp) > 0xFFFF)
+            pSample->iDeltaT = 0xFFFF;
+        else
+            pSample->iDeltaT = (uint16_t) (pComm->iTimeStamp - pComm->BatchLastTimeStamp);
+        pComm->BatchLastTimeStamp = pComm->iTimeStamp;
+        pSample->iQuat[0] = (int16_t) (fq.q0 * 30000.0F);
+        pSample->iQuat[1] = (int16_t) (fq.q1 * 30000.0F);
+        pSample->iQuat[2] = (int16_t) (fq.q2 * 30000.0F);
+        pSample->iQuat[3] = (int16_t) (fq.q3 * 30000.0F);
+        pSample->iOmega[CHX] = iOmega[CHX];
+        pSample->iOmega[CHY] = iOmega[CHY];
+        pSample->iOmega[CHZ] = iOmega[CHZ];
+        pComm->BatchCount++;
+
+        // nothing to transmit until the batch is full
+        if (pComm->BatchCount < pComm->BatchPacketSize) return;
+
+        iIndex = 0;
+
+        // [0]: packet start byte
+        output_buf[iIndex++] = 0x7E;
+
+        // [1]: packet type 9 byte
+        tmpuint8_t = 0x09;
+        OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
+
+        // [2]: packet number byte
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
+
+        // [6-3]: 1MHz time stamp of the first sample (4 bytes)
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->BatchTimeStamp, 4);
+
+        // [7]: number of samples K in this packet
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->BatchCount, 1);
+
+        // [8]: flags byte, same coding as packet type 1
+        OutputBufAppendItem(output_buf, &iIndex, &flags, 1);
+
+        // [9 + 16k ... 24 + 16k]: sample k of K
+        //   [1-0]: time stamp delta from previous sample (us)
+        //   [9-2]: quaternion (30K = 1.0F)
+        //   [15-10]: angular velocity (20 counts per deg/s)
+        for (i = 0; i < pComm->BatchCount; i++)
+        {
+            pSample = &pComm->BatchSamples[i];
+            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pSample->iDeltaT, 2);
+            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) pSample->iQuat, 8);
+            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) pSample->iOmega, 6);
+        }
+
+        // [9 + 16K]: add the tail byte for the batched packet type 9
+        output_buf[iIndex++] = 0x7E;
+
+        pComm->BatchCount = 0;
+        pComm->bytes_to_send = iIndex;
+        return;
+    }
+
+    if (sfg->pControlSubsystem->EventPacketOn)
+    {
+        // only transmit when the orientation has changed appreciably
+        if (SkipUnchanged(sfg->pControlSubsystem, &fq, iOmega)) return;
+    }
+#if (MAXPACKETRATEHZ < FUSION_HZ)
+    else if (Throttle(sfg->pControlSubsystem)) return;  // need to skip packet transmission to avoid UART overrun
+#endif
+
+    // ************************************************************************
+    // Delta coded packet type 10
+    // sent instead of packet types 1 to 8 when DeltaPacketOn is set.
+    // carries STREAM_MAX_CHANNELS int16_t channels as a keyframe or as 4 or 8
+    // bit deltas from the previous packet (see stream_codec.h):
+    // channels 0-3: quaternion (30K = 1.0F)
+    // channels 4-6: angular velocity (20 counts per deg/s)
+    // channels 7-9: Kalman gyro offset fbPl (resolution 0.001 deg/sec)
+    // channels 10-12: Kalman linear acceleration fAccGl (resolution 1/8192 g)
+    // channels 13-15: magnetic hard iron offset fV (resolution 0.1uT)
+    // total size is 8 + 3 to 8 + 35 bytes before byte stuffing
+    // ************************************************************************
+    if (sfg->pControlSubsystem->DeltaPacketOn)
+    {
+        int16_t iChannel[STREAM_MAX_CHANNELS];      // channel values to be encoded
+        uint8_t iFrame[STREAM_MAX_FRAME_BYTES];     // encoded frame
+
+        iChannel[0] = (int16_t) (fq.q0 * 30000.0F);
+        iChannel[1] = (int16_t) (fq.q1 * 30000.0F);
+        iChannel[2] = (int16_t) (fq.q2 * 30000.0F);
+        iChannel[3] = (int16_t) (fq.q3 * 30000.0F);
+        for (i = CHX; i <= CHZ; i++)
+        {
+            iChannel[4 + i] = iOmega[i];
+            iChannel[7 + i] = 0;
+            iChannel[10 + i] = 0;
+            iChannel[13 + i] = 0;
+#if F_9DOF_GBY_KALMAN
+            if (sfg->iFlags & F_9DOF_GBY_KALMAN)
+            {
+                iChannel[7 + i] = (int16_t) (sfg->SV_9DOF_GBY_KALMAN.fbPl[i] * 1000.0F);
+                ftmp = sfg->SV_9DOF_GBY_KALMAN.fAccGl[i] * 8192.0F;
+                if (ftmp > 32767.0F)            iChannel[10 + i] = 32767;
+                else if (ftmp < -32768.0F)      iChannel[10 + i] = -32768;
+                else                            iChannel[10 + i] = (int16_t) ftmp;
+            }
+#endif
+#if F_USING_MAG
+            iChannel[13 + i] = (int16_t) (sfg->MagCal.fV[i] * 10.0F);
+#endif
+        }
+
+        iIndex = 0;
+
+        // [0]: packet start byte
+        output_buf[iIndex++] = 0x7E;
+
+        // [1]: packet type 10 byte
+        tmpuint8_t = 0x0A;
+        OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
+
+        // [2]: packet number byte
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
+
+        // [6-3]: 1MHz time stamp (4 bytes)
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
+
+        // [7...]: encoded frame
+        k = StreamEncodeFrame(&sfg->pControlSubsystem->DeltaEncoder, iChannel, STREAM_MAX_CHANNELS, iFrame);
+        OutputBufAppendItem(output_buf, &iIndex, iFrame, k);
+
+        // add the tail byte for the delta coded packet type 10
+        output_buf[iIndex++] = 0x7E;
+
+#if F_USING_ACCEL
+        // packet type 8 is replaced too, so drop the request as the normal path does once sent
+        sfg->pControlSubsystem->AccelCalPacketOn = -1;
+#endif
+
+        sfg->pControlSubsystem->bytes_to_send = iIndex;
+        return;
+    }
+
     // zero the counter for bytes accumulated into the transmit buffer
     sfg->pControlSubsystem->bytes_to_send = 0;
     iIndex = 0;
@@ -167,6 +464,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     // Magnetic type 6: range 0 to 16 = 18 bytes
     // Kalman packet 7: range 0 to 47 = 48 bytes
     // Precision Accelerometer packet 8: range 0 to 46 = 47 bytes
+    // Batched orientation packet 9: replaces all of the above when enabled
+    // Delta coded packet 10: replaces packets 1 to 8 when enabled
     //
     // Total excluding intermittent packet 8 is:
     // 152 bytes vs 256 bytes size of output_buf
@@ -187,11 +486,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
     // [2]: packet number byte
-    OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-    iPacketNumber++;
+    OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+    pComm->iPacketNumber++;
 
     // [6-3]: 1MHz time stamp (4 bytes)
-    OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+    OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
     // [12-7]: integer accelerometer data words (scaled to 8192 counts per g for PC GUI)
     // send non-zero data only if the accelerometer sensor is enabled and used by the selected quaternion
@@ -320,89 +619,6 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendZeros(output_buf, &iIndex, 3);
     }
 
-    // initialize default quaternion, flags byte, angular velocity and orientation
-    fq.q0 = 1.0F;
-    fq.q1 = fq.q2 = fq.q3 = 0.0F;
-    flags = 0x00;
-    iOmega[CHX] = iOmega[CHY] = iOmega[CHZ] = 0;
-    iPhi = iThe = iRho = iDelta = 0;
-    isystick = 0;
-
-    // flags byte 33: quaternion type in least significant nibble
-    // Q3:   coordinate nibble, 1
-    // Q3M:	 coordinate nibble, 6
-    // Q3G:	 coordinate nibble, 3
-    // Q6MA: coordinate nibble, 2
-    // Q6AG: coordinate nibble, 4
-    // Q9:   coordinate nibble, 8
-    // flags byte 33: coordinate in most significant nibble
-    // Aerospace/NED:	0, quaternion nibble
-    // Android:	  		1, quaternion nibble
-    // Windows 8: 		2, quaternion nibble
-    // set the quaternion, flags, angular velocity and Euler angles
-    switch (quaternionPacketType)
-    {
-#if F_3DOF_G_BASIC
-        case Q3:
-            if (sfg->iFlags & F_3DOF_G_BASIC)
-            {
-                flags |= 0x01;
-                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_G_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-#if F_3DOF_B_BASIC
-        case Q3M:
-            if (sfg->iFlags & F_3DOF_B_BASIC)
-            {
-                flags |= 0x06;
-                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_B_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-#if F_3DOF_Y_BASIC
-        case Q3G:
-            if (sfg->iFlags & F_3DOF_Y_BASIC)
-            {
-                flags |= 0x03;
-                ReadCommonParams((SV_ptr)&sfg->SV_3DOF_Y_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-#if F_6DOF_GB_BASIC
-        case Q6MA:
-            if (sfg->iFlags & F_6DOF_GB_BASIC)
-            {
-                flags |= 0x02;
-                iDelta = (int16_t) (10.0F * sfg->SV_6DOF_GB_BASIC.fLPDelta);
-                ReadCommonParams((SV_ptr)&sfg->SV_6DOF_GB_BASIC, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-#if F_6DOF_GY_KALMAN
-        case Q6AG:
-            if (sfg->iFlags & F_6DOF_GY_KALMAN)
-            {
-                flags |= 0x04;
-                ReadCommonParams((SV_ptr)&sfg->SV_6DOF_GY_KALMAN, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-#if F_9DOF_GBY_KALMAN
-        case Q9:
-            if (sfg->iFlags & F_9DOF_GBY_KALMAN)
-             {
-                flags |= 0x08;
-                iDelta = (int16_t) (10.0F * sfg->SV_9DOF_GBY_KALMAN.fDeltaPl);
-                ReadCommonParams((SV_ptr)&sfg->SV_9DOF_GBY_KALMAN, &fq, &iPhi, &iThe, &iRho, iOmega, &isystick);
-            }
-            break;
-#endif
-        default:
-            // use the default data already initialized
-            break;
-    }
-
     // [32-25]: scale the quaternion (30K = 1.0F) and add to the buffer
     scratch16 = (int16_t) (fq.q0 * 30000.0F);
     OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
@@ -413,15 +629,6 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     scratch16 = (int16_t) (fq.q3 * 30000.0F);
     OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
 
-    // set the coordinate system bits in flags from default NED (00)
-#if THISCOORDSYSTEM == ANDROID
-    // set the Android flag bits
-    flags |= 0x10;
-#elif THISCOORDSYSTEM == WIN8
-    // set the Win8 flag bits
-    flags |= 0x20;
-#endif // THISCOORDSYSTEM
-
     // [33]: add the flags byte to the buffer
     OutputBufAppendItem(output_buf, &iIndex, &flags, 1);
 
@@ -446,8 +653,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [4-3] software version number
         scratch16 = THISBUILD;
@@ -474,11 +681,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [6-3]: time stamp (4 bytes)
-        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
         // [12-7]: add the scaled angular velocity vector to the output buffer
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iOmega[CHX], 2);
@@ -503,11 +710,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [6-3]: time stamp (4 bytes)
-        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
         // [12-7]: add the angles (resolution 0.1 deg per count) to the transmit buffer
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iPhi, 2);
@@ -535,11 +742,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
             OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
             // [2]: packet number byte
-            OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-            iPacketNumber++;
+            OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+            pComm->iPacketNumber++;
 
             // [6-3]: time stamp (4 bytes)
-            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp,
+            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp,
                            4);
 
             // [10-7]: altitude (4 bytes, metres times 1000)
@@ -562,7 +769,6 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     // this packet is only transmitted if a magnetic algorithm is computed
     // ************************************************************************
 #if F_USING_MAG
-    static int16_t  MagneticPacketID = 0;   // magnetic packet number
     if (sfg->iFlags & F_USING_MAG)
     {
         // [0]: packet start byte
@@ -573,8 +779,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [4-3]: number of active measurements in the magnetic buffer
         OutputBufAppendItem(output_buf, &iIndex,
@@ -592,32 +798,33 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
 
         // always calculate magnetic buffer row and column (low overhead and saves warnings)
-        k = MagneticPacketID - 10;
+        k = pComm->iMagneticPacketID - 10;
         j = k / MAGBUFFSIZEX;
         i = k - j * MAGBUFFSIZEX;
+        k = (pComm->iMagneticPacketID >= 10) ? iMagBufferFind(&(sfg->MagBuffer), i * MAGBUFFSIZEY + j) : -1;
 
         // [10-9]: int16_t: ID of magnetic variable to be transmitted
         // ID 0 to 4 inclusive are magnetic calibration coefficients
         // ID 5 to 9 inclusive are for future expansion
         // ID 10 to (MAGBUFFSIZEX=12) * (MAGBUFFSIZEY=24)-1 or 10 to 10+288-1 are magnetic buffer elements
         // where the convention is used that a negative value indicates empty buffer element (index=-1)
-        if ((MagneticPacketID >= 10) && (sfg->MagBuffer.index[i][j] == -1))
+        if ((pComm->iMagneticPacketID >= 10) && (k == -1))
         {
             // use negative ID to indicate inactive magnetic buffer element
-            scratch16 = -MagneticPacketID;
+            scratch16 = -pComm->iMagneticPacketID;
             OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
         }
         else
         {
             // use positive ID unchanged for variable or active magnetic buffer entry
-            scratch16 = MagneticPacketID;
+            scratch16 = pComm->iMagneticPacketID;
             OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
         }
 
         // [12-11]: int16_t: variable 1 to be transmitted this iteration
         // [14-13]: int16_t: variable 2 to be transmitted this iteration
         // [16-15]: int16_t: variable 3 to be transmitted this iteration
-        switch (MagneticPacketID)
+        switch (pComm->iMagneticPacketID)
         {
             case 0:
                 // item 1: currently unused
@@ -674,20 +881,25 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
                 break;
 
             default:
-                // 10 and upwards: this handles the magnetic buffer elements
+                // 10 and upwards: this handles the magnetic buffer elements (zeroes for an empty bin)
+                if (k == -1)
+                {
+                    OutputBufAppendZeros(output_buf, &iIndex, 3);
+                    break;
+                }
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHX][i][j]), 2);
+                               (uint8_t *) &(sfg->MagBuffer.entry[k].iBs[CHX]), 2);
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHY][i][j]), 2);
+                               (uint8_t *) &(sfg->MagBuffer.entry[k].iBs[CHY]), 2);
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHZ][i][j]), 2);
+                               (uint8_t *) &(sfg->MagBuffer.entry[k].iBs[CHZ]), 2);
                 break;
         }
 
         // wrap the variable ID back to zero if necessary
-        MagneticPacketID++;
-        if (MagneticPacketID >= (10 + MAGBUFFSIZEX * MAGBUFFSIZEY))
-            MagneticPacketID = 0;
+        pComm->iMagneticPacketID++;
+        if (pComm->iMagneticPacketID >= (10 + MAGBUFFSIZEX * MAGBUFFSIZEY))
+            pComm->iMagneticPacketID = 0;
 
         // [17]: add the tail byte for the magnetic packet type 6
         output_buf[iIndex++] = 0x7E;
@@ -722,8 +934,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
             OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
             // [2]: packet number byte
-            OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-            iPacketNumber++;
+            OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+            pComm->iPacketNumber++;
 
             // [4-3]: fzgErr[CHX] resolution scaled by 30000
             // [6-5]: fzgErr[CHY] resolution scaled by 30000
@@ -863,8 +1075,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [3]: AccelCalPacketOn in range 0-11 denotes stored location and MAXORIENTATIONS denotes transmit
         // precision accelerometer calibration on power on before any measurements have been obtained.
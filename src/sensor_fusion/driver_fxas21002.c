@@ -178,8 +178,11 @@ int8_t FXAS21002_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
     uint8_t reg;
     int8_t status = SENSOR_ERROR_NONE;
 
+    if (!sensor->pGyro) {
+        return SENSOR_ERROR_INIT; // no gyroscope storage to fill
+    }
     if (I2CReadByte(sensor->addr, FXAS21002_WHO_AM_I, &reg)) {
-        sfg->Gyro.iWhoAmI = reg;
+        sensor->pGyro->iWhoAmI = reg;
         switch (reg) {
         case FXAS21002_WHO_AM_I_WHOAMI_PROD_VALUE:
         case FXAS21002_WHO_AM_I_WHOAMI_PRE_VALUE:
@@ -194,24 +197,24 @@ int8_t FXAS21002_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
     }
 
     // configure FXAS21000 or FXAS21002 depending on WHOAMI value read
-    switch (sfg->Gyro.iWhoAmI) {
+    switch (sensor->pGyro->iWhoAmI) {
     case (FXAS21000_WHO_AM_I_VALUE):
         // Configure and start the FXAS21000 sensor.  This does multiple register writes
         // (see FXAS21009_Initialization definition above)
         status = Sensor_I2C_Write_List(&sensor->deviceInfo, sensor->addr, FXAS21000_INITIALIZATION );
-        sfg->Gyro.iCountsPerDegPerSec = FXAS21000_COUNTSPERDEGPERSEC;
-        sfg->Gyro.fDegPerSecPerCount = 1.0F / FXAS21000_COUNTSPERDEGPERSEC;
+        sensor->pGyro->iCountsPerDegPerSec = FXAS21000_COUNTSPERDEGPERSEC;
+        sensor->pGyro->fDegPerSecPerCount = 1.0F / FXAS21000_COUNTSPERDEGPERSEC;
         break;
     case (FXAS21002_WHO_AM_I_WHOAMI_PRE_VALUE):
     case (FXAS21002_WHO_AM_I_WHOAMI_PROD_VALUE):
         status = Sensor_I2C_Write_List(&sensor->deviceInfo, sensor->addr, FXAS21002_INITIALIZATION );
-        sfg->Gyro.iCountsPerDegPerSec = FXAS21002_COUNTSPERDEGPERSEC;
-        sfg->Gyro.fDegPerSecPerCount = 1.0F / FXAS21002_COUNTSPERDEGPERSEC;
+        sensor->pGyro->iCountsPerDegPerSec = FXAS21002_COUNTSPERDEGPERSEC;
+        sensor->pGyro->fDegPerSecPerCount = 1.0F / FXAS21002_COUNTSPERDEGPERSEC;
         break;
     }
-    sfg->Gyro.iFIFOCount=0;
+    sensor->pGyro->iFIFOCount=0;
     sensor->isInitialized = F_USING_GYRO;
-    sfg->Gyro.isEnabled = true;
+    sensor->pGyro->isEnabled = true;
     return (status);
 }
 
@@ -246,7 +249,7 @@ int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
           // at this point there must be at least one measurement in the FIFO
           // available to read. handle the FXAS21000 and FXAS21002 differently
           // because only FXAS21002 supports WRAPTOONE feature.
-          if (sfg->Gyro.iWhoAmI == FXAS21002_WHO_AM_I_WHOAMI_OLD_VALUE) {
+          if (sensor->pGyro->iWhoAmI == FXAS21002_WHO_AM_I_WHOAMI_OLD_VALUE) {
 //    if (true) {
             // read six sequential gyro output bytes
             FXAS21002_DATA_READ[0].readFrom = FXAS21002_OUT_X_MSB;
@@ -265,7 +268,7 @@ int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
                 sample[CHY] = (I2C_Buffer[2] << 8) | I2C_Buffer[3];
                 sample[CHZ] = (I2C_Buffer[4] << 8) | I2C_Buffer[5];
                 conditionSample(sample);  // truncate negative values to -32767
-                addToFifo((union FifoSensor*) &(sfg->Gyro), GYRO_FIFO_SIZE, sample);
+                addToFifo((union FifoSensor*) sensor->pGyro, GYRO_FIFO_SIZE, sample);
             }
         }
     }   // end of FXAS21000 FIFO read
@@ -293,7 +296,7 @@ int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
                     sample[CHY] = (I2C_Buffer[j + 2] << 8) | I2C_Buffer[j + 3];
                     sample[CHZ] = (I2C_Buffer[j + 4] << 8) | I2C_Buffer[j + 5];
                     conditionSample(sample);  // truncate negative values to -32767
-                    addToFifo((union FifoSensor*) &(sfg->Gyro), GYRO_FIFO_SIZE, sample);
+                    addToFifo((union FifoSensor*) sensor->pGyro, GYRO_FIFO_SIZE, sample);
                 }
             }
         }
@@ -317,7 +320,7 @@ int8_t FXAS21002_Idle(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
     if(sensor->isInitialized == F_USING_GYRO) {
         status = Sensor_I2C_Write_List(&sensor->deviceInfo, sensor->addr, FXAS21002_IDLE );
         sensor->isInitialized = 0;
-        sfg->Gyro.isEnabled = false;
+        sensor->pGyro->isEnabled = false;
     } else {
       return SENSOR_ERROR_INIT;
     }
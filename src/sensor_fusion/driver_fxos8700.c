@@ -158,15 +158,19 @@ int8_t FXOS8700_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
 
     if (status==SENSOR_ERROR_NONE) {
 #if F_USING_ACCEL
-       sfg->Accel.iWhoAmI = reg;
-       sfg->Accel.iCountsPerg = FXOS8700_COUNTSPERG;
-       sfg->Accel.fgPerCount = 1.0F / FXOS8700_COUNTSPERG;
+       if (sensor->pAccel) {
+         sensor->pAccel->iWhoAmI = reg;
+         sensor->pAccel->iCountsPerg = FXOS8700_COUNTSPERG;
+         sensor->pAccel->fgPerCount = 1.0F / FXOS8700_COUNTSPERG;
+       }
 #endif
 #if F_USING_MAG
-       sfg->Mag.iWhoAmI = reg;
-       sfg->Mag.iCountsPeruT = FXOS8700_COUNTSPERUT;
-       sfg->Mag.fCountsPeruT = (float) FXOS8700_COUNTSPERUT;
-       sfg->Mag.fuTPerCount = 1.0F / FXOS8700_COUNTSPERUT;
+       if (sensor->pMag) {
+         sensor->pMag->iWhoAmI = reg;
+         sensor->pMag->iCountsPeruT = FXOS8700_COUNTSPERUT;
+         sensor->pMag->fCountsPeruT = (float) FXOS8700_COUNTSPERUT;
+         sensor->pMag->fuTPerCount = 1.0F / FXOS8700_COUNTSPERUT;
+       }
 #endif
        if (reg != FXOS8700_WHO_AM_I_PROD_VALUE) {
           return SENSOR_ERROR_INIT;  // The whoAmI did not match
@@ -182,10 +186,10 @@ int8_t FXOS8700_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
     status = Sensor_I2C_Write_List(&sensor->deviceInfo, sensor->addr, FXOS8700_Initialization );
     sensor->isInitialized = F_USING_ACCEL | F_USING_MAG;
 #if F_USING_ACCEL
-    sfg->Accel.isEnabled = true;
+    if (sensor->pAccel) sensor->pAccel->isEnabled = true;
 #endif
 #if F_USING_MAG
-    sfg->Mag.isEnabled = true;
+    if (sensor->pMag) sensor->pMag->isEnabled = true;
 #endif
 
     return (status);
@@ -199,7 +203,7 @@ int8_t FXOS8700_Accel_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *s
     uint8_t                     fifo_packet_count;
     int16_t                     sample[3];
 
-    if(!(sensor->isInitialized & F_USING_ACCEL)) {
+    if(!(sensor->isInitialized & F_USING_ACCEL) || !sensor->pAccel) {
        return SENSOR_ERROR_INIT;
     }
 
@@ -248,7 +252,7 @@ int8_t FXOS8700_Accel_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *s
             sample[CHZ] = (I2C_Buffer[j + 4] << 8) | (I2C_Buffer[j + 5]);
             conditionSample(sample);  //truncate negative values to -32767
             // place the 6 bytes read into the 16 bit accelerometer structure 
-            addToFifo((union FifoSensor*) &(sfg->Accel), ACCEL_FIFO_SIZE, sample);
+            addToFifo((union FifoSensor*) sensor->pAccel, ACCEL_FIFO_SIZE, sample);
         } // end transfer all bytes from each packet
       } // end processing a burst read
     } // end emptying all packets from FIFO
@@ -263,7 +267,7 @@ int8_t FXOS8700_Mag_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg
     int32_t                     status;         // I2C transaction status
     int16_t                     sample[3];
 
-    if(!(sensor->isInitialized & F_USING_MAG))
+    if(!(sensor->isInitialized & F_USING_MAG) || !sensor->pMag)
     {
         return SENSOR_ERROR_INIT;
     }
@@ -278,7 +282,7 @@ int8_t FXOS8700_Mag_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg
         sample[CHY] = (I2C_Buffer[2] << 8) | I2C_Buffer[3];
         sample[CHZ] = (I2C_Buffer[4] << 8) | I2C_Buffer[5];
         conditionSample(sample);  // truncate negative values to -32767
-        addToFifo((union FifoSensor*) &(sfg->Mag), MAG_FIFO_SIZE, sample);
+        addToFifo((union FifoSensor*) sensor->pMag, MAG_FIFO_SIZE, sample);
     }
     return status;
 }//end FXOS8700_ReadMagData()
@@ -341,10 +345,10 @@ int8_t FXOS8700_Idle(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
         status = Sensor_I2C_Write_List(&sensor->deviceInfo, sensor->addr, FXOS8700_FULL_IDLE );
         sensor->isInitialized = 0;
 #if F_USING_ACCEL
-        sfg->Accel.isEnabled = false;
+        if (sensor->pAccel) sensor->pAccel->isEnabled = false;
 #endif
 #if F_USING_MAG
-        sfg->Mag.isEnabled = false;
+        if (sensor->pMag) sensor->pMag->isEnabled = false;
 #endif
     } else {
       return SENSOR_ERROR_INIT;
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file driver_replay.c
+    \brief Plays back recorded raw readings in place of the sensor ICs.
+    See driver_replay.h for the form of a recording.
+*/
+
+#include "sensor_fusion.h"              // Sensor fusion structures and types
+#include "driver_replay.h"              // replay structures and prototypes
+
+// sensitivities used unless the recording states otherwise. Same as the
+// ranges configured by driver_fxos8700.c and driver_fxas21002.c
+#define REPLAY_COUNTSPERG           8192    // FXOS8700 accelerometer at +/-4 g
+#define REPLAY_COUNTSPERUT          10      // FXOS8700 magnetometer
+#define REPLAY_COUNTSPERDEGPERSEC   16      // FXAS21002 at 2000 deg/s
+#define REPLAY_WHO_AM_I             0xEE    // whoami reported by replayed sensors
+
+void ReplaySourceInit(ReplaySource *pSource, const ReplaySample *pSamples, uint32_t iNumSamples)
+{
+    pSource->pSamples = pSamples;
+    pSource->iNumSamples = iNumSamples;
+    pSource->iNext = 0;
+    pSource->iCycle = 0;
+    pSource->iCountsPerg = REPLAY_COUNTSPERG;
+    pSource->iCountsPeruT = REPLAY_COUNTSPERUT;
+    pSource->iCountsPerDegPerSec = REPLAY_COUNTSPERDEGPERSEC;
+    pSource->fReadCycle = NULL;
+    pSource->pReader = NULL;
+    pSource->bExhausted = false;
+} // end ReplaySourceInit()
+
+void ReplayAttach(struct PhysicalSensor *pSensor, ReplaySource *pSource)
+{
+    pSensor->deviceInfo.functionParam = pSource;
+} // end ReplayAttach()
+
+bool ReplayFinished(const ReplaySource *pSource)
+{
+    if (pSource->fReadCycle) return pSource->bExhausted;
+    return (pSource->iNext >= pSource->iNumSamples);
+} // end ReplayFinished()
+
+void ReplayAddSample(struct PhysicalSensor *pSensor, uint8_t iType, const int16_t iSample[3])
+{
+    int16_t sample[3];
+
+    sample[CHX] = iSample[CHX];
+    sample[CHY] = iSample[CHY];
+    sample[CHZ] = iSample[CHZ];
+    conditionSample(sample);    // the drivers truncate -32768 to -32767 too
+    switch (iType)
+    {
+#if F_USING_ACCEL
+        case REPLAY_ACCEL:
+            if (pSensor->pAccel) addToFifo((union FifoSensor *) pSensor->pAccel, ACCEL_FIFO_SIZE, sample);
+            break;
+#endif
+#if F_USING_MAG
+        case REPLAY_MAG:
+            if (pSensor->pMag) addToFifo((union FifoSensor *) pSensor->pMag, MAG_FIFO_SIZE, sample);
+            break;
+#endif
+#if F_USING_GYRO
+        case REPLAY_GYRO:
+            if (pSensor->pGyro) addToFifo((union FifoSensor *) pSensor->pGyro, GYRO_FIFO_SIZE, sample);
+            break;
+#endif
+        default:
+            break;
+    }
+} // end ReplayAddSample()
+
+// Set the sensitivities of the logical sensors fed by this replay and enable them.
+int8_t Replay_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
+{
+    ReplaySource *pSource = (ReplaySource *) sensor->deviceInfo.functionParam;
+
+    if (pSource == NULL) return SENSOR_ERROR_INIT;
+
+    sensor->isInitialized = F_USING_NONE;
+#if F_USING_ACCEL
+    if (sensor->pAccel) {
+        sensor->pAccel->iWhoAmI = REPLAY_WHO_AM_I;
+        sensor->pAccel->iCountsPerg = pSource->iCountsPerg;
+        sensor->pAccel->fCountsPerg = (float) pSource->iCountsPerg;
+        sensor->pAccel->fgPerCount = 1.0F / pSource->iCountsPerg;
+        sensor->pAccel->iFIFOCount = 0;
+        sensor->pAccel->isEnabled = true;
+        sensor->isInitialized |= F_USING_ACCEL;
+    }
+#endif
+#if F_USING_MAG
+    if (sensor->pMag) {
+        sensor->pMag->iWhoAmI = REPLAY_WHO_AM_I;
+        sensor->pMag->iCountsPeruT = pSource->iCountsPeruT;
+        sensor->pMag->fCountsPeruT = (float) pSource->iCountsPeruT;
+        sensor->pMag->fuTPerCount = 1.0F / pSource->iCountsPeruT;
+        sensor->pMag->iFIFOCount = 0;
+        sensor->pMag->isEnabled = true;
+        sensor->isInitialized |= F_USING_MAG;
+    }
+#endif
+#if F_USING_GYRO
+    if (sensor->pGyro) {
+        sensor->pGyro->iWhoAmI = REPLAY_WHO_AM_I;
+        sensor->pGyro->iCountsPerDegPerSec = pSource->iCountsPerDegPerSec;
+        sensor->pGyro->fDegPerSecPerCount = 1.0F / pSource->iCountsPerDegPerSec;
+        sensor->pGyro->iFIFOCount = 0;
+        sensor->pGyro->isEnabled = true;
+        sensor->isInitialized |= F_USING_GYRO;
+    }
+#endif
+    return (SENSOR_ERROR_NONE);
+} // end Replay_Init()
+
+// Move the samples of the next cycle of the recording into the sensor FIFOs.
+// Returns SENSOR_ERROR_READ once the recording is exhausted.
+int8_t Replay_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
+{
+    ReplaySource *pSource = (ReplaySource *) sensor->deviceInfo.functionParam;
+    const ReplaySample *pSample;
+
+    if ((pSource == NULL) || !sensor->isInitialized) return SENSOR_ERROR_INIT;
+    if (ReplayFinished(pSource)) return SENSOR_ERROR_READ;
+
+    if (pSource->fReadCycle)
+    {
+        pSource->fReadCycle(pSource, sensor);
+        pSource->iCycle++;
+        return (SENSOR_ERROR_NONE);
+    }
+    for (; pSource->iNext < pSource->iNumSamples; pSource->iNext++)
+    {
+        pSample = &pSource->pSamples[pSource->iNext];
+        if (pSample->iType == REPLAY_END_CYCLE)
+        {
+            pSource->iNext++;
+            pSource->iCycle++;
+            break;
+        }
+        ReplayAddSample(sensor, pSample->iType, pSample->iSample);
+    }
+    return (SENSOR_ERROR_NONE);
+} // end Replay_Read()
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef DRIVER_REPLAY_H
+#define DRIVER_REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file driver_replay.h
+    \brief Sensor driver that plays back recorded raw readings
+
+    Replay_Init() and Replay_Read() have the same form as the *_Init() and
+    *_Read() functions of the hardware drivers, so a recording installed with
+    installSensor() runs through the unchanged readSensors(),
+    conditionSensorReadings() and runFusion() path. The recorded samples are
+    raw sensor counts as read from the ICs, before the axis remapping of
+    hal_axis_remap.c, and go through addToFifo() just as the hardware
+    readings do.
+
+    A recording is a sequence of ReplaySample entries. Each call to
+    Replay_Read() adds the samples up to the next REPLAY_END_CYCLE entry to
+    the FIFOs of the sensor, so one REPLAY_END_CYCLE is needed per call of
+    readSensors(). The recording is held in memory and never modified, so
+    several fusion instances may replay the same recording at once.
+
+    installSensor() clears deviceInfo, so ReplayAttach() must be called after
+    installing the sensor.
+
+    Recordings in other forms, e.g. the flight recorder logs read by
+    extras/replay/flight_log_reader.c, are replayed by setting fReadCycle.
+    Replay_Read() then calls it in place of walking pSamples, and it hands
+    the samples of one cycle to ReplayAddSample().
+*/
+
+#include <stdint.h>
+
+/// @name Replay sample types
+///@{
+#define REPLAY_ACCEL            1   ///< accelerometer sample (counts)
+#define REPLAY_MAG              2   ///< magnetometer sample (counts)
+#define REPLAY_GYRO             3   ///< gyroscope sample (counts)
+#define REPLAY_END_CYCLE        4   ///< end of the samples read in one call of readSensors()
+///@}
+
+/// One recorded reading
+typedef struct ReplaySample {
+    uint8_t iType;          ///< REPLAY_*
+    int16_t iSample[3];     ///< X, Y and Z channel in sensor counts, unused for REPLAY_END_CYCLE
+} ReplaySample;
+
+/// A recording and the position reached in it
+typedef struct ReplaySource ReplaySource;
+struct ReplaySource {
+    const ReplaySample *pSamples;   ///< recorded samples
+    uint32_t iNumSamples;           ///< number of entries in pSamples
+    uint32_t iNext;                 ///< index of the next sample to be replayed
+    uint32_t iCycle;                ///< number of REPLAY_END_CYCLE entries replayed so far
+    int16_t iCountsPerg;            ///< accelerometer sensitivity of the recording
+    int16_t iCountsPeruT;           ///< magnetometer sensitivity of the recording
+    int16_t iCountsPerDegPerSec;    ///< gyroscope sensitivity of the recording
+    /// Optional reader of the next cycle, used in place of pSamples. Adds the samples
+    /// of one cycle with ReplayAddSample() and sets bExhausted after the last cycle.
+    void (*fReadCycle)(ReplaySource *pSource, struct PhysicalSensor *pSensor);
+    void *pReader;                  ///< state of fReadCycle
+    bool bExhausted;                ///< fReadCycle has no more cycles
+};
+
+/// Sets pSource to replay iNumSamples entries of pSamples from the start, with the
+/// sensitivities of the FXOS8700 and FXAS21002.
+void ReplaySourceInit(ReplaySource *pSource, const ReplaySample *pSamples, uint32_t iNumSamples);
+
+/// Makes pSensor, already installed with Replay_Init() and Replay_Read(), replay pSource
+void ReplayAttach(struct PhysicalSensor *pSensor, ReplaySource *pSource);
+
+/// True once every sample of the recording has been replayed
+bool ReplayFinished(const ReplaySource *pSource);
+
+/// Add one raw sample of type REPLAY_ACCEL, REPLAY_MAG or REPLAY_GYRO to the FIFO of pSensor
+void ReplayAddSample(struct PhysicalSensor *pSensor, uint8_t iType, const int16_t iSample[3]);
+
+int8_t Replay_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg);
+int8_t Replay_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRIVER_REPLAY_H
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file flight_recorder.c
+    \brief Fusion path half of the flight recorder: copies each cycle into RAM blocks.
+    See flight_recorder.h for the log format.
+*/
+
+#include <string.h>
+
+#include "sensor_fusion.h"              // Sensor fusion structures and types
+#include "flight_recorder.h"            // log format and recorder structure
+#include "status.h"                     // status subsystem
+#include "hal_timer.h"                  // microsecond clock
+
+// the log format relies on these sizes, with no padding added by the compiler
+typedef char FlightBlockHeaderSizeCheck[(sizeof(FlightBlockHeader) == 32) ? 1 : -1];
+typedef char FlightIndexEntrySizeCheck[(sizeof(FlightIndexEntry) == 24) ? 1 : -1];
+
+// space a record of iLength payload bytes takes in a block
+#define FR_RECORD_SPACE(iLength)    (sizeof(FlightRecord) + (((iLength) + 3U) & ~3U))
+
+// the block being filled by the fusion path
+static FlightBlock *CurrentBlock(FlightRecorder *pRec)
+{
+    return &pRec->blocks[pRec->iFilled % FR_RAM_BLOCKS];
+} // end CurrentBlock()
+
+// Append a record to the current block. The caller has checked that it fits.
+static void AppendRecord(FlightRecorder *pRec, uint8_t iType, uint8_t iCount, const void *pPayload, uint16_t iLength)
+{
+    FlightBlock *pBlock = CurrentBlock(pRec);
+    uint8_t *pDest = &pBlock->iBytes[sizeof(FlightBlockHeader) + pBlock->header.iUsed];
+    FlightRecord record;
+    uint16_t iPadded = (uint16_t) ((iLength + 3U) & ~3U);
+
+    record.iType = iType;
+    record.iCount = iCount;
+    record.iLength = iPadded;
+    memcpy(pDest, &record, sizeof(record));
+    memcpy(pDest + sizeof(record), pPayload, iLength);
+    memset(pDest + sizeof(record) + iLength, 0, iPadded - iLength);
+    pBlock->header.iUsed += (uint16_t) sizeof(record) + iPadded;
+} // end AppendRecord()
+
+// Append the FIFO contents of one sensor as interleaved X, Y, Z samples
+static void AppendFifo(FlightRecorder *pRec, uint8_t iType, const int16_t *pFifo, uint16_t iFifoSize, uint8_t iCount)
+{
+    int16_t iSamples[3 * (ACCEL_FIFO_SIZE > GYRO_FIFO_SIZE ? ACCEL_FIFO_SIZE : GYRO_FIFO_SIZE)];
+    uint8_t i;
+
+    if (iCount > sizeof(iSamples) / (3 * sizeof(int16_t))) iCount = sizeof(iSamples) / (3 * sizeof(int16_t));
+    for (i = 0; i < iCount; i++)
+    {
+        iSamples[3 * i + CHX] = pFifo[CHX * iFifoSize + i];
+        iSamples[3 * i + CHY] = pFifo[CHY * iFifoSize + i];
+        iSamples[3 * i + CHZ] = pFifo[CHZ * iFifoSize + i];
+    }
+    AppendRecord(pRec, iType, iCount, iSamples, (uint16_t) (iCount * 3 * sizeof(int16_t)));
+} // end AppendFifo()
+
+// Pass the current block to the storage half
+static void CompleteBlock(FlightRecorder *pRec)
+{
+    pRec->bBlockOpen = false;
+    __sync_synchronize();       // block contents visible before the storage half sees it
+    pRec->iFilled = pRec->iFilled + 1;
+} // end CompleteBlock()
+
+// Start a new block if a RAM block is free. Returns false if every block is waiting for flash.
+static bool StartBlock(FlightRecorder *pRec, SensorFusionGlobals *sfg)
+{
+    FlightBlock *pBlock;
+    FlightSensitivity sensitivity;
+
+    if (pRec->iFilled - pRec->iWritten >= FR_RAM_BLOCKS) return false;
+    pBlock = CurrentBlock(pRec);
+    memset(&pBlock->header, 0, sizeof(pBlock->header));
+    pBlock->header.iMagic = FR_BLOCK_MAGIC;
+    pBlock->header.iFirstTime = pRec->iTime;
+    pBlock->header.iFirstCycle = (uint32_t) sfg->loopcounter;
+    pBlock->header.iDropped = pRec->iDropped;
+    pBlock->header.iType = FR_BLOCK_DATA;
+    pBlock->header.iVersion = FR_FORMAT_VERSION;
+    pRec->iDropped = 0;
+    pRec->bBlockOpen = true;
+
+    memset(&sensitivity, 0, sizeof(sensitivity));
+#if F_USING_ACCEL
+    sensitivity.iCountsPerg = sfg->Accel.iCountsPerg;
+#endif
+#if F_USING_MAG
+    sensitivity.iCountsPeruT = sfg->Mag.iCountsPeruT;
+#endif
+#if F_USING_GYRO
+    sensitivity.iCountsPerDegPerSec = sfg->Gyro.iCountsPerDegPerSec;
+#endif
+    AppendRecord(pRec, FR_REC_SENSITIVITY, 0, &sensitivity, sizeof(sensitivity));
+    return true;
+} // end StartBlock()
+
+void initFlightRecorder(FlightRecorder *pRec)
+{
+    memset(pRec, 0, sizeof(FlightRecorder));
+    pRec->iLastStatus = 0xFF;   // the first cycle records the status it starts in
+} // end initFlightRecorder()
+
+void FlightRecorderEnable(FlightRecorder *pRec, bool bEnable)
+{
+    // stopping is left to the end of the fusion cycle, like a close request, since the
+    // block being filled belongs to the fusion path
+    pRec->bStopRequested = !bEnable;
+    if (bEnable) pRec->bEnabled = true;
+    else pRec->bCloseRequested = true;
+} // end FlightRecorderEnable()
+
+// carry out FlightRecorderRequestClose() and stopping at the end of a fusion cycle
+static void ServeRequests(FlightRecorder *pRec)
+{
+    if (pRec->bCloseRequested)
+    {
+        pRec->bCloseRequested = false;
+        if (pRec->bBlockOpen) CompleteBlock(pRec);
+    }
+    if (pRec->bStopRequested)
+    {
+        pRec->bStopRequested = false;
+        pRec->bEnabled = false;
+    }
+} // end ServeRequests()
+
+void FlightRecorderCompleteDetached(FlightRecorder *pRec)
+{
+    if (pRec->bBlockOpen) CompleteBlock(pRec);
+    pRec->bCloseRequested = false;
+    pRec->bStopRequested = false;
+    pRec->bCycleOpen = false;
+    pRec->bEnabled = false;
+} // end FlightRecorderCompleteDetached()
+
+void FlightRecordSamples(FlightRecorder *pRec, SensorFusionGlobals *sfg)
+{
+    FlightCycle cycle;
+    uint16_t iSpace;
+    int32_t iNow;
+
+    if (!pRec->bEnabled) return;
+
+    SystickStartCount(&iNow);
+    if (pRec->bTimeStarted) pRec->iTime += (uint32_t) (iNow - pRec->iLastMicros);
+    pRec->bTimeStarted = true;
+    pRec->iLastMicros = iNow;
+
+    // room for the whole cycle, outputs included, so a cycle never spans two blocks
+    iSpace = FR_RECORD_SPACE(sizeof(FlightCycle)) + FR_RECORD_SPACE(sizeof(FlightOrientation)) +
+             FR_RECORD_SPACE(sizeof(FlightStatus));
+#if F_USING_ACCEL
+    iSpace += FR_RECORD_SPACE(sfg->Accel.iFIFOCount * 3 * sizeof(int16_t));
+#endif
+#if F_USING_MAG
+    iSpace += FR_RECORD_SPACE(sfg->Mag.iFIFOCount * 3 * sizeof(int16_t));
+#endif
+#if F_USING_GYRO
+    iSpace += FR_RECORD_SPACE(sfg->Gyro.iFIFOCount * 3 * sizeof(int16_t));
+#endif
+    if (pRec->bBlockOpen &&
+        (sizeof(FlightBlockHeader) + CurrentBlock(pRec)->header.iUsed + iSpace > FR_BLOCK_SIZE))
+        CompleteBlock(pRec);
+    if (!pRec->bBlockOpen && !StartBlock(pRec, sfg))
+    {
+        // flash has fallen behind, lose this cycle
+        if (pRec->iDropped < 0xFFFF) pRec->iDropped++;
+        pRec->bCycleOpen = false;
+        return;
+    }
+
+    memset(&cycle, 0, sizeof(cycle));
+    cycle.iTime = pRec->iTime;
+    cycle.iLoopCounter = (uint32_t) sfg->loopcounter;
+    AppendRecord(pRec, FR_REC_CYCLE, 0, &cycle, sizeof(cycle));
+#if F_USING_ACCEL
+    if (sfg->Accel.isEnabled)
+        AppendFifo(pRec, FR_REC_ACCEL, &sfg->Accel.iGsFIFO[0][0], ACCEL_FIFO_SIZE, sfg->Accel.iFIFOCount);
+#endif
+#if F_USING_MAG
+    if (sfg->Mag.isEnabled)
+        AppendFifo(pRec, FR_REC_MAG, &sfg->Mag.iBsFIFO[0][0], MAG_FIFO_SIZE, sfg->Mag.iFIFOCount);
+#endif
+#if F_USING_GYRO
+    if (sfg->Gyro.isEnabled)
+        AppendFifo(pRec, FR_REC_GYRO, &sfg->Gyro.iYsFIFO[0][0], GYRO_FIFO_SIZE, sfg->Gyro.iFIFOCount);
+#endif
+    pRec->bCycleOpen = true;
+} // end FlightRecordSamples()
+
+// scale to int16_t, rounding and saturating
+static int16_t iScaled(float fValue, float fScale)
+{
+    float ftmp = fValue * fScale;
+
+    if (ftmp >= 32767.0F) return 32767;
+    if (ftmp <= -32767.0F) return -32767;
+    return (int16_t) ((ftmp >= 0.0F) ? (ftmp + 0.5F) : (ftmp - 0.5F));
+} // end iScaled()
+
+void FlightRecordOutputs(FlightRecorder *pRec, SensorFusionGlobals *sfg)
+{
+    FlightOrientation orientation;
+    FlightStatus status;
+    const Quaternion *pq = NULL;
+    float fPhi = 0.0F, fThe = 0.0F, fRho = 0.0F;
+
+    if (!pRec->bCycleOpen)
+    {
+        ServeRequests(pRec);
+        return;
+    }
+
+    // the most complete algorithm in the build, as sent in Toolbox packets
+#if F_9DOF_GBY_KALMAN
+    pq = &sfg->SV_9DOF_GBY_KALMAN.fqPl;
+    fPhi = sfg->SV_9DOF_GBY_KALMAN.fPhiPl;
+    fThe = sfg->SV_9DOF_GBY_KALMAN.fThePl;
+    fRho = sfg->SV_9DOF_GBY_KALMAN.fRhoPl;
+#elif F_6DOF_GY_KALMAN
+    pq = &sfg->SV_6DOF_GY_KALMAN.fqPl;
+    fPhi = sfg->SV_6DOF_GY_KALMAN.fPhiPl;
+    fThe = sfg->SV_6DOF_GY_KALMAN.fThePl;
+    fRho = sfg->SV_6DOF_GY_KALMAN.fRhoPl;
+#elif F_6DOF_GB_BASIC
+    pq = &sfg->SV_6DOF_GB_BASIC.fLPq;
+    fPhi = sfg->SV_6DOF_GB_BASIC.fLPPhi;
+    fThe = sfg->SV_6DOF_GB_BASIC.fLPThe;
+    fRho = sfg->SV_6DOF_GB_BASIC.fLPRho;
+#elif F_3DOF_Y_BASIC
+    pq = &sfg->SV_3DOF_Y_BASIC.fq;
+    fPhi = sfg->SV_3DOF_Y_BASIC.fPhi;
+    fThe = sfg->SV_3DOF_Y_BASIC.fThe;
+    fRho = sfg->SV_3DOF_Y_BASIC.fRho;
+#elif F_3DOF_B_BASIC
+    pq = &sfg->SV_3DOF_B_BASIC.fLPq;
+    fPhi = sfg->SV_3DOF_B_BASIC.fLPPhi;
+    fThe = sfg->SV_3DOF_B_BASIC.fLPThe;
+    fRho = sfg->SV_3DOF_B_BASIC.fLPRho;
+#elif F_3DOF_G_BASIC
+    pq = &sfg->SV_3DOF_G_BASIC.fLPq;
+    fPhi = sfg->SV_3DOF_G_BASIC.fLPPhi;
+    fThe = sfg->SV_3DOF_G_BASIC.fLPThe;
+    fRho = sfg->SV_3DOF_G_BASIC.fLPRho;
+#endif
+    memset(&orientation, 0, sizeof(orientation));
+    if (pq)
+    {
+        orientation.iq[0] = iScaled(pq->q0, 32767.0F);
+        orientation.iq[1] = iScaled(pq->q1, 32767.0F);
+        orientation.iq[2] = iScaled(pq->q2, 32767.0F);
+        orientation.iq[3] = iScaled(pq->q3, 32767.0F);
+    }
+    orientation.iPhi = iScaled(fPhi, 100.0F);
+    orientation.iThe = iScaled(fThe, 100.0F);
+    orientation.iRho = (uint16_t) (fRho * 100.0F + 0.5F);
+#if F_USING_MAG
+    orientation.iValidMagCal = (uint8_t) sfg->MagCal.iValidMagCal;
+#endif
+    AppendRecord(pRec, FR_REC_ORIENTATION, 0, &orientation, sizeof(orientation));
+
+    if (sfg->pStatusSubsystem && ((uint8_t) sfg->pStatusSubsystem->status != pRec->iLastStatus))
+    {
+        memset(&status, 0, sizeof(status));
+        status.iPrevious = pRec->iLastStatus;
+        status.iStatus = (uint8_t) sfg->pStatusSubsystem->status;
+        AppendRecord(pRec, FR_REC_STATUS, 0, &status, sizeof(status));
+        pRec->iLastStatus = status.iStatus;
+    }
+    pRec->bCycleOpen = false;
+    ServeRequests(pRec);
+} // end FlightRecordOutputs()
+
+FlightBlock *FlightRecorderNextBlock(FlightRecorder *pRec)
+{
+    if (pRec->iWritten == pRec->iFilled) return NULL;
+    __sync_synchronize();       // read the block only after seeing iFilled
+    return &pRec->blocks[pRec->iWritten % FR_RAM_BLOCKS];
+} // end FlightRecorderNextBlock()
+
+void FlightRecorderReleaseBlock(FlightRecorder *pRec)
+{
+    __sync_synchronize();       // finished with the block before the fusion path reuses it
+    pRec->iWritten = pRec->iWritten + 1;
+} // end FlightRecorderReleaseBlock()
+
+void FlightRecorderRequestClose(FlightRecorder *pRec)
+{
+    pRec->bCloseRequested = true;
+} // end FlightRecorderRequestClose()
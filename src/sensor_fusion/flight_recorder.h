@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file flight_recorder.h
+    \brief Records raw sensor FIFOs, fusion outputs and status changes for replay
+
+    The recorder has two halves. On the fusion path, conditionSensorReadings()
+    and runFusion() call FlightRecordSamples() and FlightRecordOutputs(), which
+    only copy the raw FIFO contents of the primary sensors, the orientation and
+    any status change into a block in RAM. Full blocks are handed to the
+    storage half (flight_recorder_storage.cc), which writes them to flash from
+    the main loop or another task, away from the fusion timing. If flash falls
+    behind and every RAM block is full, records are dropped and the number of
+    lost cycles is noted in the next block.
+
+    The log is a sequence of FR_BLOCK_SIZE byte blocks, each starting with a
+    FlightBlockHeader. Data blocks hold records, each a FlightRecord header
+    followed by its payload, padded so that every record starts on a 4 byte
+    boundary. Every data block starts with a FR_REC_SENSITIVITY record, so any
+    block can be replayed without the ones before it. After every
+    FR_INDEX_INTERVAL data blocks the storage half writes an index block
+    listing their sequence numbers, times and file offsets, so a reader can
+    seek without scanning every block.
+
+    A fusion cycle is a FR_REC_CYCLE record followed by the accelerometer,
+    magnetometer and gyroscope FIFO contents read since the previous cycle,
+    then the FR_REC_ORIENTATION record, and FR_REC_STATUS if the status changed.
+    Samples are raw counts as read from the ICs, before the axis remapping of
+    hal_axis_remap.c, i.e. exactly what driver_replay.c expects.
+    All fields are little endian, as written by the ESP processors.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// @name Log format constants
+///@{
+#define FR_BLOCK_SIZE           2048        ///< bytes per block, in RAM and in flash
+#define FR_BLOCK_MAGIC          0x4B425246  ///< "FRBK", start of every block
+#define FR_FORMAT_VERSION       1           ///< FlightBlockHeader.iVersion
+#define FR_BLOCK_DATA           1           ///< block of records
+#define FR_BLOCK_INDEX          2           ///< block of FlightIndexEntry
+#define FR_INDEX_INTERVAL       16          ///< data blocks per index block
+///@}
+
+/// @name Record types
+///@{
+#define FR_REC_SENSITIVITY      1   ///< FlightSensitivity, first record of every data block
+#define FR_REC_CYCLE            2   ///< FlightCycle, start of a fusion cycle
+#define FR_REC_ACCEL            3   ///< iCount accelerometer samples of int16_t[3] (counts)
+#define FR_REC_MAG              4   ///< iCount magnetometer samples of int16_t[3] (counts)
+#define FR_REC_GYRO             5   ///< iCount gyroscope samples of int16_t[3] (counts)
+#define FR_REC_ORIENTATION      6   ///< FlightOrientation, output of the fusion cycle
+#define FR_REC_STATUS           7   ///< FlightStatus, status change seen at the end of the cycle
+///@}
+
+#define FR_RAM_BLOCKS           4   ///< blocks staged in RAM while waiting for flash
+
+/// Start of every block in the log
+typedef struct FlightBlockHeader {
+    uint32_t iMagic;            ///< FR_BLOCK_MAGIC
+    uint32_t iSequence;         ///< block number, counting up through the whole log
+    uint64_t iFirstTime;        ///< FlightCycle.iTime of the first cycle in the block (us)
+    uint32_t iFirstCycle;       ///< FlightCycle.iLoopCounter of the first cycle in the block
+    uint16_t iUsed;             ///< bytes used after this header
+    uint16_t iDropped;          ///< cycles lost before this block because flash fell behind
+    uint8_t iType;              ///< FR_BLOCK_DATA or FR_BLOCK_INDEX
+    uint8_t iVersion;           ///< FR_FORMAT_VERSION
+    uint16_t iCRC;              ///< CRC16() of the iUsed bytes after this header
+    uint32_t iBoot;             ///< power-up count of the recorder, iFirstTime restarts at each
+} FlightBlockHeader;
+
+/// Start of every record in a data block
+typedef struct FlightRecord {
+    uint8_t iType;              ///< FR_REC_*
+    uint8_t iCount;             ///< number of samples of FR_REC_ACCEL, MAG and GYRO, else 0
+    uint16_t iLength;           ///< payload bytes following this header, a multiple of 4
+} FlightRecord;
+
+/// Payload of FR_REC_SENSITIVITY
+typedef struct FlightSensitivity {
+    int16_t iCountsPerg;        ///< accelerometer
+    int16_t iCountsPeruT;       ///< magnetometer
+    int16_t iCountsPerDegPerSec;///< gyroscope
+    int16_t iReserved;
+} FlightSensitivity;
+
+/// Payload of FR_REC_CYCLE
+typedef struct FlightCycle {
+    uint64_t iTime;             ///< microseconds since the recorder started
+    uint32_t iLoopCounter;      ///< sfg->loopcounter
+    uint32_t iReserved;
+} FlightCycle;
+
+/// Payload of FR_REC_ORIENTATION
+typedef struct FlightOrientation {
+    int16_t iq[4];              ///< q0 to q3 of the most complete algorithm, times 32767
+    int16_t iPhi;               ///< roll, 0.01 deg
+    int16_t iThe;               ///< pitch, 0.01 deg
+    uint16_t iRho;              ///< compass heading, 0.01 deg
+    uint8_t iValidMagCal;       ///< magnetic calibration solver in use, 0 if none
+    uint8_t iReserved;
+} FlightOrientation;
+
+/// Payload of FR_REC_STATUS
+typedef struct FlightStatus {
+    uint8_t iPrevious;          ///< fusion_status_t before the change
+    uint8_t iStatus;            ///< fusion_status_t after the change
+    uint16_t iReserved;
+} FlightStatus;
+
+/// One data block listed in an index block
+typedef struct FlightIndexEntry {
+    uint32_t iSequence;         ///< FlightBlockHeader.iSequence
+    uint32_t iOffset;           ///< byte offset of the block in its file
+    uint64_t iFirstTime;        ///< FlightBlockHeader.iFirstTime
+    uint32_t iFirstCycle;       ///< FlightBlockHeader.iFirstCycle
+    uint32_t iBoot;             ///< FlightBlockHeader.iBoot
+} FlightIndexEntry;
+
+/// A block as staged in RAM, 4 byte aligned so records can be written in place
+typedef union FlightBlock {
+    FlightBlockHeader header;
+    uint8_t iBytes[FR_BLOCK_SIZE];
+    uint32_t iAlign;
+} FlightBlock;
+
+/// \brief Recorder state
+///
+/// FR_RAM_BLOCKS blocks form a ring with one writer, the fusion path, and one
+/// reader, the storage half. The fusion path fills block iFilled (modulo
+/// FR_RAM_BLOCKS) and advances iFilled once it is full; the storage half writes blocks iWritten to
+/// iFilled - 1 to flash and advances iWritten. Each side only changes its own
+/// counter, so the storage half may run in a different task.
+typedef struct FlightRecorder {
+    FlightBlock blocks[FR_RAM_BLOCKS];  ///< staging ring
+    volatile uint32_t iFilled;          ///< number of blocks completed by the fusion path
+    volatile uint32_t iWritten;         ///< number of blocks written to flash
+    volatile bool bCloseRequested;      ///< complete the current block at the end of the next cycle
+    volatile bool bStopRequested;       ///< clear bEnabled at the end of the next cycle
+    bool bEnabled;                      ///< recording on
+    bool bBlockOpen;                    ///< block iFilled has been started
+    bool bCycleOpen;                    ///< FlightRecordSamples() ran, FlightRecordOutputs() pending
+    bool bTimeStarted;                  ///< iLastMicros is valid
+    uint8_t iLastStatus;                ///< status at the end of the previous cycle
+    uint16_t iDropped;                  ///< cycles lost since the last completed block
+    int32_t iLastMicros;                ///< microsecond clock at the previous cycle
+    uint64_t iTime;                     ///< microseconds since the recorder started
+} FlightRecorder;
+
+/// Prepare a recorder, initially disabled. Set sfg->pFlightRecorder to pRec to attach it.
+void initFlightRecorder(FlightRecorder *pRec);
+
+/// Start or stop recording. Stopping completes the block being filled at the end of the next cycle,
+/// so it may be called from any task.
+void FlightRecorderEnable(FlightRecorder *pRec, bool bEnable);
+
+/// Copy the raw FIFO contents of the primary sensors. Called by conditionSensorReadings().
+void FlightRecordSamples(FlightRecorder *pRec, SensorFusionGlobals *sfg);
+
+/// Copy the orientation and any status change. Called by runFusion().
+void FlightRecordOutputs(FlightRecorder *pRec, SensorFusionGlobals *sfg);
+
+/// Oldest completed block not yet written to flash, or NULL if none
+FlightBlock *FlightRecorderNextBlock(FlightRecorder *pRec);
+
+/// Hand the block returned by FlightRecorderNextBlock() back to the fusion path
+void FlightRecorderReleaseBlock(FlightRecorder *pRec);
+
+/// Have the block being filled completed at the end of the next cycle, e.g. before power down
+void FlightRecorderRequestClose(FlightRecorder *pRec);
+
+/// Stop recording and complete the block being filled at once. Only for a recorder no fusion
+/// cycle can reach any more, i.e. after sfg->pFlightRecorder has been cleared between cycles.
+void FlightRecorderCompleteDetached(FlightRecorder *pRec);
+
+/// @name Flash storage, see flight_recorder_storage.cc
+///@{
+bool FlightRecorderBeginStorage(FlightRecorder *pRec, const char *sDirectory);
+uint8_t FlightRecorderService(FlightRecorder *pRec);
+void FlightRecorderEndStorage(FlightRecorder *pRec);
+bool FlightRecorderEraseStorage(void);
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLIGHT_RECORDER_H
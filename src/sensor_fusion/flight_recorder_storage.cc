@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file flight_recorder_storage.cc
+    \brief Writes the blocks of the flight recorder to a LittleFS partition
+
+    Written for use on Arduino-Espressif environment where the LittleFS
+    library is available. Only compiled in if F_FLIGHT_RECORDER is set in
+    build.h; otherwise FlightRecorderBeginStorage() fails and the recorder
+    is never attached.
+
+    The log is kept as up to FLIGHT_RECORDER_SEGMENTS files in one directory,
+    each named by the sequence number of its first block in 8 hex digits with
+    a .frl extension, and holding up to FLIGHT_RECORDER_SEGMENT_BLOCKS blocks.
+    Blocks are only ever appended, which LittleFS handles without rewriting
+    the rest of the file. A new file is started at each FlightRecorderBeginStorage()
+    and whenever the current one is full, and the oldest file is deleted to
+    make room. The power-up count stored in the file "boot" of the directory
+    tells apart recordings made between resets.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "sensor_fusion.h"
+#include "control.h"
+#include "flight_recorder.h"
+#include "debug_print.h"
+
+#if F_FLIGHT_RECORDER
+#include <LittleFS.h>
+
+#define FLIGHT_STORAGE_PATH_LEN 48
+#define FLIGHT_STORAGE_BOOT_FILE "boot"
+#define FLIGHT_STORAGE_EXTENSION ".frl"
+
+/// State of the log files. There is one flash, so one of these.
+static struct FlightStorage {
+  bool is_open;                       ///< directory and current file ready
+  char directory[FLIGHT_STORAGE_PATH_LEN];
+  File file;                          ///< segment being appended to
+  uint32_t file_blocks;               ///< blocks in the current segment
+  uint32_t next_sequence;             ///< iSequence of the next block written
+  uint32_t boot;                      ///< power-up count, stamped into each block
+  FlightIndexEntry index[FR_INDEX_INTERVAL];  ///< data blocks awaiting an index block
+  uint8_t index_count;
+  FlightBlock index_block;            ///< scratch for building index blocks
+} flight_storage;
+
+// Call fn(name, sequence, arg) for each segment file in the log directory
+static void ForEachSegment(void (*fn)(const char *, uint32_t, void *), void *arg) {
+  char name[FLIGHT_STORAGE_PATH_LEN];
+  unsigned long sequence;
+#ifdef ESP8266
+  Dir dir = LittleFS.openDir(flight_storage.directory);
+  while (dir.next()) {
+    snprintf(name, sizeof(name), "%s", dir.fileName().c_str());
+#endif
+#ifdef ESP32
+  File dir = LittleFS.open(flight_storage.directory);
+  if (!dir || !dir.isDirectory()) return;
+  for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    const char *base = strrchr(entry.name(), '/');
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : entry.name());
+    entry.close();
+#endif
+    char extension[8] = "";
+    if ((sscanf(name, "%8lx%7s", &sequence, extension) == 2) &&
+        (strcmp(extension, FLIGHT_STORAGE_EXTENSION) == 0)) {
+      fn(name, (uint32_t)sequence, arg);
+    }
+  }
+}  // end ForEachSegment()
+
+/// Summary of the segment files present
+struct SegmentScan {
+  uint32_t count;
+  uint32_t oldest;        ///< sequence of the oldest segment
+  uint32_t newest;        ///< sequence of the newest segment
+};
+
+static void ScanSegment(const char *name, uint32_t sequence, void *arg) {
+  SegmentScan *scan = (SegmentScan *)arg;
+  (void)name;
+  // sequence numbers are compared as differences so the log survives wrapping
+  if ((scan->count == 0) || ((int32_t)(sequence - scan->oldest) < 0)) {
+    scan->oldest = sequence;
+  }
+  if ((scan->count == 0) || ((int32_t)(sequence - scan->newest) > 0)) {
+    scan->newest = sequence;
+  }
+  scan->count++;
+}  // end ScanSegment()
+
+static void SegmentPath(char *path, size_t size, uint32_t sequence) {
+  snprintf(path, size, "%s/%08lx%s", flight_storage.directory,
+           (unsigned long)sequence, FLIGHT_STORAGE_EXTENSION);
+}  // end SegmentPath()
+
+// Delete the oldest segments until there is room for one more
+static void TrimSegments(void) {
+  char path[2 * FLIGHT_STORAGE_PATH_LEN];
+  for (;;) {
+    SegmentScan scan;
+    memset(&scan, 0, sizeof(scan));
+    ForEachSegment(ScanSegment, &scan);
+    if (scan.count < FLIGHT_RECORDER_SEGMENTS) return;
+    SegmentPath(path, sizeof(path), scan.oldest);
+    if (!LittleFS.remove(path)) return;
+  }
+}  // end TrimSegments()
+
+// Close the current segment and start a new one at next_sequence
+static bool StartSegment(void) {
+  char path[2 * FLIGHT_STORAGE_PATH_LEN];
+  if (flight_storage.file) {
+    flight_storage.file.close();
+  }
+  TrimSegments();
+  SegmentPath(path, sizeof(path), flight_storage.next_sequence);
+  flight_storage.file = LittleFS.open(path, "w");
+  flight_storage.file_blocks = 0;
+  return (bool)flight_storage.file;
+}  // end StartSegment()
+
+// Stamp a block with its sequence number, power-up count and CRC, and append
+// it to the current segment. Returns the byte offset of the block in the file.
+// A block that cannot be written whole takes no sequence number and leaves
+// the following blocks at their fixed offsets.
+static bool AppendBlock(FlightBlock *block, uint32_t *offset) {
+  size_t written;
+
+  if (!flight_storage.file && !StartSegment()) return false;
+  block->header.iSequence = flight_storage.next_sequence++;
+  block->header.iBoot = flight_storage.boot;
+  block->header.iCRC = CRC16(&block->iBytes[sizeof(FlightBlockHeader)],
+                             block->header.iUsed, 0xFFFF);
+  *offset = flight_storage.file_blocks * FR_BLOCK_SIZE;
+  // whole blocks are written, so every block of a file is at a fixed offset
+  written = flight_storage.file.write(block->iBytes, FR_BLOCK_SIZE);
+  if (written != FR_BLOCK_SIZE) {
+    debug_log("flight recorder write failed\n");
+    flight_storage.next_sequence--;
+    // the next block overwrites the part written, or goes to a new file if
+    // the write position cannot be moved back. The blocks of the old file
+    // awaiting an index are then listed from their headers by the reader.
+    if ((written > 0) && !flight_storage.file.seek(*offset)) {
+      flight_storage.index_count = 0;
+      StartSegment();
+    }
+    return false;
+  }
+  flight_storage.file_blocks++;
+  return true;
+}  // end AppendBlock()
+
+// Write an index block for the data blocks written since the last one
+static bool WriteIndex(void) {
+  FlightBlock *block = &flight_storage.index_block;
+  uint32_t offset;
+  uint16_t used = flight_storage.index_count * sizeof(FlightIndexEntry);
+
+  if (flight_storage.index_count == 0) return true;
+  memset(block->iBytes, 0, sizeof(block->iBytes));
+  block->header.iMagic = FR_BLOCK_MAGIC;
+  block->header.iFirstTime = flight_storage.index[0].iFirstTime;
+  block->header.iFirstCycle = flight_storage.index[0].iFirstCycle;
+  block->header.iUsed = used;
+  block->header.iType = FR_BLOCK_INDEX;
+  block->header.iVersion = FR_FORMAT_VERSION;
+  memcpy(&block->iBytes[sizeof(FlightBlockHeader)], flight_storage.index, used);
+  flight_storage.index_count = 0;
+  return AppendBlock(block, &offset);
+}  // end WriteIndex()
+
+/**
+ * Open the log directory sDirectory, creating it if needed, and start a new
+ * log file. Mounts LittleFS, but never formats it, as it also holds the
+ * calibration journal; formatting is left to the application.
+ * Returns false if the file system or the log file is unavailable.
+ */
+bool FlightRecorderBeginStorage(FlightRecorder *pRec, const char *sDirectory) {
+  char path[2 * FLIGHT_STORAGE_PATH_LEN];
+  SegmentScan scan;
+  File boot_file;
+  uint32_t boot = 0;
+
+  (void)pRec;
+  if (flight_storage.is_open) return false;
+#ifdef ESP8266
+  if (!LittleFS.begin()) {
+    debug_log("flight recorder LittleFS unavailable\n");
+    return false;
+  }
+#endif
+#ifdef ESP32
+  if (!LittleFS.begin(false)) {  // false: leave an unmountable partition alone
+    debug_log("flight recorder LittleFS unavailable\n");
+    return false;
+  }
+#endif
+  snprintf(flight_storage.directory, sizeof(flight_storage.directory), "%s",
+           sDirectory);
+  if (!LittleFS.exists(flight_storage.directory)) {
+    LittleFS.mkdir(flight_storage.directory);
+  }
+
+  // count power-ups, so the times of different recordings can be told apart
+  snprintf(path, sizeof(path), "%s/%s", flight_storage.directory,
+           FLIGHT_STORAGE_BOOT_FILE);
+  boot_file = LittleFS.open(path, "r");
+  if (boot_file) {
+    if (boot_file.read((uint8_t *)&boot, sizeof(boot)) != sizeof(boot)) boot = 0;
+    boot_file.close();
+  }
+  flight_storage.boot = ++boot;
+  boot_file = LittleFS.open(path, "w");
+  if (boot_file) {
+    boot_file.write((const uint8_t *)&boot, sizeof(boot));
+    boot_file.close();
+  }
+
+  // continue the sequence numbers after the newest segment
+  memset(&scan, 0, sizeof(scan));
+  ForEachSegment(ScanSegment, &scan);
+  flight_storage.next_sequence = 0;
+  if (scan.count > 0) {
+    SegmentPath(path, sizeof(path), scan.newest);
+    File newest = LittleFS.open(path, "r");
+    flight_storage.next_sequence =
+        scan.newest + (newest ? newest.size() / FR_BLOCK_SIZE : 0);
+    if (newest) newest.close();
+  }
+  flight_storage.index_count = 0;
+  if (!StartSegment()) return false;
+  flight_storage.is_open = true;
+  debug_log("flight recorder log opened\n");
+  return true;
+}  // end FlightRecorderBeginStorage()
+
+/**
+ * Write the blocks completed by the fusion path to flash. Call regularly from
+ * loop(), or from a task of its own, but not from the task running fusion
+ * in the middle of a fusion cycle. Returns the number of blocks written.
+ */
+uint8_t FlightRecorderService(FlightRecorder *pRec) {
+  FlightBlock *block;
+  uint32_t offset;
+  uint8_t written = 0;
+
+  if (!flight_storage.is_open) return 0;
+  while ((block = FlightRecorderNextBlock(pRec)) != NULL) {
+    // the last block of each file is kept for the index of its data blocks,
+    // so every file can be read on its own
+    if (flight_storage.file_blocks + 1 >= FLIGHT_RECORDER_SEGMENT_BLOCKS) {
+      WriteIndex();
+      StartSegment();
+    }
+    if (AppendBlock(block, &offset)) {
+      FlightIndexEntry *entry = &flight_storage.index[flight_storage.index_count++];
+      entry->iSequence = block->header.iSequence;
+      entry->iOffset = offset;
+      entry->iFirstTime = block->header.iFirstTime;
+      entry->iFirstCycle = block->header.iFirstCycle;
+      entry->iBoot = block->header.iBoot;
+      written++;
+    }
+    // a block that cannot be written is lost rather than stalling the fusion path
+    FlightRecorderReleaseBlock(pRec);
+    if (flight_storage.index_count == FR_INDEX_INTERVAL) WriteIndex();
+  }
+  if (written) flight_storage.file.flush();
+  return written;
+}  // end FlightRecorderService()
+
+/**
+ * Write any completed blocks and a final index block, and close the log
+ * file. Complete the last block first, with FlightRecorderCompleteDetached()
+ * or by disabling the recorder and letting a fusion cycle pass.
+ */
+void FlightRecorderEndStorage(FlightRecorder *pRec) {
+  if (!flight_storage.is_open) return;
+  FlightRecorderService(pRec);
+  WriteIndex();
+  flight_storage.file.close();
+  flight_storage.is_open = false;
+}  // end FlightRecorderEndStorage()
+
+static void RemoveSegment(const char *name, uint32_t sequence, void *arg) {
+  char path[2 * FLIGHT_STORAGE_PATH_LEN];
+  (void)sequence;
+  (void)arg;
+  snprintf(path, sizeof(path), "%s/%s", flight_storage.directory, name);
+  LittleFS.remove(path);
+}  // end RemoveSegment()
+
+/**
+ * Delete every log file. Only possible while the log is not open.
+ */
+bool FlightRecorderEraseStorage(void) {
+  if (flight_storage.is_open || (flight_storage.directory[0] == '\0')) {
+    return false;
+  }
+  ForEachSegment(RemoveSegment, NULL);
+  return true;
+}  // end FlightRecorderEraseStorage()
+
+#else  // F_FLIGHT_RECORDER
+
+bool FlightRecorderBeginStorage(FlightRecorder *pRec, const char *sDirectory) {
+  (void)pRec;
+  (void)sDirectory;
+  return false;
+}  // end FlightRecorderBeginStorage()
+
+uint8_t FlightRecorderService(FlightRecorder *pRec) {
+  (void)pRec;
+  return 0;
+}  // end FlightRecorderService()
+
+void FlightRecorderEndStorage(FlightRecorder *pRec) { (void)pRec; }
+
+bool FlightRecorderEraseStorage(void) { return false; }
+
+#endif  // F_FLIGHT_RECORDER
@@ -63,6 +63,153 @@ void fInitializeFusion(SensorFusionGlobals *sfg)
     return;
 }
 
+void fInitializeFusionTuning(FusionTuning *pTuning)
+{
+    pTuning->fLPFSecs_1DOF_P_BASIC = FLPFSECS_1DOF_P_BASIC;
+    pTuning->fLPFSecs_3DOF_G_BASIC = FLPFSECS_3DOF_G_BASIC;
+    pTuning->fLPFSecs_3DOF_B_BASIC = FLPFSECS_3DOF_B_BASIC;
+    pTuning->fLPFSecs_6DOF_GB_BASIC = FLPFSECS_6DOF_GB_BASIC;
+    pTuning->fQvY_6DOF_GY_KALMAN = FQVY_6DOF_GY_KALMAN;
+    pTuning->fQvG_6DOF_GY_KALMAN = FQVG_6DOF_GY_KALMAN;
+    pTuning->fQwb_6DOF_GY_KALMAN = FQWB_6DOF_GY_KALMAN;
+    pTuning->fQvY_9DOF_GBY_KALMAN = FQVY_9DOF_GBY_KALMAN;
+    pTuning->fQvG_9DOF_GBY_KALMAN = FQVG_9DOF_GBY_KALMAN;
+    pTuning->fQvB_9DOF_GBY_KALMAN = FQVB_9DOF_GBY_KALMAN;
+    pTuning->fQwb_9DOF_GBY_KALMAN = FQWB_9DOF_GBY_KALMAN;
+    return;
+} // end fInitializeFusionTuning()
+
+void fGetFusionTuning(const SensorFusionGlobals *sfg, FusionTuning *pTuning)
+{
+    // start from the defaults so fields of algorithms not built are still sensible
+    fInitializeFusionTuning(pTuning);
+#if F_1DOF_P_BASIC
+    pTuning->fLPFSecs_1DOF_P_BASIC = sfg->SV_1DOF_P_BASIC.fLPFSecs;
+#endif
+#if F_3DOF_G_BASIC
+    pTuning->fLPFSecs_3DOF_G_BASIC = sfg->SV_3DOF_G_BASIC.fLPFSecs;
+#endif
+#if F_3DOF_B_BASIC
+    pTuning->fLPFSecs_3DOF_B_BASIC = sfg->SV_3DOF_B_BASIC.fLPFSecs;
+#endif
+#if F_6DOF_GB_BASIC
+    pTuning->fLPFSecs_6DOF_GB_BASIC = sfg->SV_6DOF_GB_BASIC.fLPFSecs;
+#endif
+#if F_6DOF_GY_KALMAN
+    pTuning->fQvY_6DOF_GY_KALMAN = sfg->SV_6DOF_GY_KALMAN.fQvY;
+    pTuning->fQvG_6DOF_GY_KALMAN = sfg->SV_6DOF_GY_KALMAN.fQvG;
+    pTuning->fQwb_6DOF_GY_KALMAN = sfg->SV_6DOF_GY_KALMAN.fQwb;
+#endif
+#if F_9DOF_GBY_KALMAN
+    pTuning->fQvY_9DOF_GBY_KALMAN = sfg->SV_9DOF_GBY_KALMAN.fQvY;
+    pTuning->fQvG_9DOF_GBY_KALMAN = sfg->SV_9DOF_GBY_KALMAN.fQvG;
+    pTuning->fQvB_9DOF_GBY_KALMAN = sfg->SV_9DOF_GBY_KALMAN.fQvB;
+    pTuning->fQwb_9DOF_GBY_KALMAN = sfg->SV_9DOF_GBY_KALMAN.fQwb;
+#endif
+    (void) sfg;
+    return;
+} // end fGetFusionTuning()
+
+void fSetFusionTuning(SensorFusionGlobals *sfg, const FusionTuning *pTuning)
+{
+    // the constants are folded into the filter state when an algorithm initializes,
+    // so each algorithm is reset to pick up its new values on its next run
+#if F_1DOF_P_BASIC
+    sfg->SV_1DOF_P_BASIC.fLPFSecs = pTuning->fLPFSecs_1DOF_P_BASIC;
+    sfg->SV_1DOF_P_BASIC.resetflag = true;
+#endif
+#if F_3DOF_G_BASIC
+    sfg->SV_3DOF_G_BASIC.fLPFSecs = pTuning->fLPFSecs_3DOF_G_BASIC;
+    sfg->SV_3DOF_G_BASIC.resetflag = true;
+#endif
+#if F_3DOF_B_BASIC
+    sfg->SV_3DOF_B_BASIC.fLPFSecs = pTuning->fLPFSecs_3DOF_B_BASIC;
+    sfg->SV_3DOF_B_BASIC.resetflag = true;
+#endif
+#if F_6DOF_GB_BASIC
+    sfg->SV_6DOF_GB_BASIC.fLPFSecs = pTuning->fLPFSecs_6DOF_GB_BASIC;
+    sfg->SV_6DOF_GB_BASIC.resetflag = true;
+#endif
+#if F_6DOF_GY_KALMAN
+    sfg->SV_6DOF_GY_KALMAN.fQvY = pTuning->fQvY_6DOF_GY_KALMAN;
+    sfg->SV_6DOF_GY_KALMAN.fQvG = pTuning->fQvG_6DOF_GY_KALMAN;
+    sfg->SV_6DOF_GY_KALMAN.fQwb = pTuning->fQwb_6DOF_GY_KALMAN;
+    sfg->SV_6DOF_GY_KALMAN.resetflag = true;
+#endif
+#if F_9DOF_GBY_KALMAN
+    sfg->SV_9DOF_GBY_KALMAN.fQvY = pTuning->fQvY_9DOF_GBY_KALMAN;
+    sfg->SV_9DOF_GBY_KALMAN.fQvG = pTuning->fQvG_9DOF_GBY_KALMAN;
+    sfg->SV_9DOF_GBY_KALMAN.fQvB = pTuning->fQvB_9DOF_GBY_KALMAN;
+    sfg->SV_9DOF_GBY_KALMAN.fQwb = pTuning->fQwb_9DOF_GBY_KALMAN;
+    sfg->SV_9DOF_GBY_KALMAN.resetflag = true;
+#endif
+    (void) sfg;
+    (void) pTuning;
+    return;
+} // end fSetFusionTuning()
+
+void fSetWarmStartInterval(SensorFusionGlobals *sfg, int32_t iLoops)
+{
+#if F_9DOF_GBY_KALMAN
+    // a countdown of -1 means no save is scheduled
+    sfg->SV_9DOF_GBY_KALMAN.iWarmStartLoops = iLoops;
+    sfg->SV_9DOF_GBY_KALMAN.iWarmStartCountdown = (iLoops > 0) ? iLoops : -1;
+#endif
+    (void) sfg;
+    (void) iLoops;
+    return;
+} // end fSetWarmStartInterval()
+
+void fRequestWarmStartSave(SensorFusionGlobals *sfg)
+{
+#if F_9DOF_GBY_KALMAN
+    sfg->SV_9DOF_GBY_KALMAN.iWarmStartCountdown = 0;
+#endif
+    (void) sfg;
+    return;
+} // end fRequestWarmStartSave()
+
+#if F_9DOF_GBY_KALMAN
+void fGetWarmStart9DOF(const struct SV_9DOF_GBY_KALMAN *pthisSV, struct WarmStart9DOF *pState)
+{
+    int8_t i;  // loop counter
+
+    for (i = CHX; i <= CHZ; i++) {
+        pState->fbPl[i] = pthisSV->fbPl[i];
+        pState->fqgErrPl[i] = pthisSV->fqgErrPl[i];
+        pState->fqmErrPl[i] = pthisSV->fqmErrPl[i];
+        pState->fbErrPl[i] = pthisSV->fbErrPl[i];
+    }
+    pState->fqPl = pthisSV->fqPl;
+    pState->fDeltaPl = pthisSV->fDeltaPl;
+    return;
+} // end fGetWarmStart9DOF()
+
+#ifndef SIMULATION
+// check that a saved filter state is fit to continue from: every field finite, the gyro offset
+// within the power on limits and the orientation quaternion close to unit length, after which
+// it is renormalized. returns false if any check fails.
+static int8_t iCheckWarmStart9DOF(struct WarmStart9DOF *pState)
+{
+    const float *pf = (const float *) pState;   // every field of WarmStart9DOF is a float
+    float fnormsq;                              // squared norm of the quaternion
+    int8_t i;                                   // loop counter
+
+    for (i = 0; i < (int8_t) (sizeof(struct WarmStart9DOF) / sizeof(float)); i++)
+        if (!isfinite(pf[i])) return false;
+    for (i = CHX; i <= CHZ; i++)
+        if ((pState->fbPl[i] < FMIN_9DOF_GBY_BPL) || (pState->fbPl[i] > FMAX_9DOF_GBY_BPL)) return false;
+    if ((pState->fDeltaPl < -90.0F) || (pState->fDeltaPl > 90.0F)) return false;
+    // the quaternion was normalized when saved, so a larger error is not rounding
+    fnormsq = pState->fqPl.q0 * pState->fqPl.q0 + pState->fqPl.q1 * pState->fqPl.q1 +
+        pState->fqPl.q2 * pState->fqPl.q2 + pState->fqPl.q3 * pState->fqPl.q3;
+    if (fabsf(fnormsq - 1.0F) > 0.01F) return false;
+    fqAeqNormqA(&(pState->fqPl));
+    return true;
+} // end iCheckWarmStart9DOF()
+#endif // SIMULATION
+#endif
+
 void fFuseSensors(struct SV_1DOF_P_BASIC *pthisSV_1DOF_P_BASIC,
                   struct SV_3DOF_G_BASIC *pthisSV_3DOF_G_BASIC,
                   struct SV_3DOF_B_BASIC *pthisSV_3DOF_B_BASIC,
@@ -285,12 +432,12 @@ void fInit_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
 
     // compute and store useful product terms to save floating point calculations later
     pthisSV->fdeltat = 1.0F / (float) FUSION_HZ;
-    pthisSV->fQwbOver3 = FQWB_6DOF_GY_KALMAN / 3.0F;
+    pthisSV->fQwbOver3 = pthisSV->fQwb / 3.0F;
     pthisSV->fAlphaOver2 = FPIOVER180 * pthisSV->fdeltat / 2.0F;
     pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
     pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
-    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_6DOF_GY_KALMAN + FQWB_6DOF_GY_KALMAN) / 3.0F;
-    pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(FQWB_6DOF_GY_KALMAN)) / (float)FUSION_HZ;
+    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (pthisSV->fQvY + pthisSV->fQwb) / 3.0F;
+    pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(pthisSV->fQwb)) / (float)FUSION_HZ;
 
     // zero the a posteriori gyro offset and error vectors
     for (i = CHX; i <= CHZ; i++)
@@ -348,12 +495,12 @@ void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSenso
     // compute and store useful product terms to save floating point calculations later
     pthisSV->fdeltat = 1.0F / (float) FUSION_HZ;
     pthisSV->fgdeltat = GTOMSEC2 * pthisSV->fdeltat;
-    pthisSV->fQwbOver3 = FQWB_9DOF_GBY_KALMAN / 3.0F;
+    pthisSV->fQwbOver3 = pthisSV->fQwb / 3.0F;
     pthisSV->fAlphaOver2 = FPIOVER180 * pthisSV->fdeltat / 2.0F;
     pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
     pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
-    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_9DOF_GBY_KALMAN + FQWB_9DOF_GBY_KALMAN) / 3.0F;
-    pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(FQWB_9DOF_GBY_KALMAN)) / (float)FUSION_HZ;
+    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (pthisSV->fQvY + pthisSV->fQwb) / 3.0F;
+    pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(pthisSV->fQwb)) / (float)FUSION_HZ;
 
     // zero the a posteriori error vectors and inertial outputs
     for (i = CHX; i <= CHZ; i++) {
@@ -364,10 +511,24 @@ void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSenso
         pthisSV->fDisGl[i] = 0.0F;
     }
 
+    // on the first initialization after power up, continue from the filter state saved before the
+    // last power down if there is one and it passes its checks. otherwise, and after a reset,
     // check to see if a gyro calibration exists in flash
 #ifndef SIMULATION
     float   pFlash[3];    // pointer to flash float words
-    if (GetGyroCalibrationFromNVM(pFlash))
+    struct WarmStart9DOF warm;    // saved filter state
+    int8_t  iWarm = pthisSV->iWarmStartAllowed && GetWarmStartFromNVM(&warm) && iCheckWarmStart9DOF(&warm);
+    pthisSV->iWarmStartAllowed = false;
+    if (iWarm)
+    {
+        // the error vectors set the leading diagonal of Qw on the first iteration
+        for (i = CHX; i <= CHZ; i++) {
+            pthisSV->fbPl[i] = warm.fbPl[i];
+            pthisSV->fqgErrPl[i] = warm.fqgErrPl[i];
+            pthisSV->fqmErrPl[i] = warm.fqmErrPl[i];
+            pthisSV->fbErrPl[i] = warm.fbErrPl[i];
+        }
+    } else if (GetGyroCalibrationFromNVM(pFlash))
     {
         // copy the gyro calibration from flash into the state vector
         for (i = CHX; i <= CHZ; i++) pthisSV->fbPl[i] = pFlash[i];
@@ -398,6 +559,30 @@ void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSenso
 #endif
     fQuaternionFromRotationMatrix(pthisSV->fRPl, &(pthisSV->fqPl));
 
+#ifndef SIMULATION
+    // keep the saved orientation, so skipping the first lock to the eCompass, if it is within
+    // WARMSTART_MAX_ANGLE_DEG of the eCompass orientation. the unit was then not moved while off.
+    // the eCompass heading only means something with a valid magnetic calibration
+    if (iWarm && pthisMagCal->iValidMagCal)
+    {
+        // ftmp = cos of half the angle between the two orientations
+        ftmp = fabsf(warm.fqPl.q0 * pthisSV->fqPl.q0 + warm.fqPl.q1 * pthisSV->fqPl.q1 +
+            warm.fqPl.q2 * pthisSV->fqPl.q2 + warm.fqPl.q3 * pthisSV->fqPl.q3);
+        if (ftmp >= cosf(0.5F * FPIOVER180 * WARMSTART_MAX_ANGLE_DEG))
+        {
+            pthisSV->fqPl = warm.fqPl;
+            fRotationMatrixFromQuaternion(pthisSV->fRPl, &(pthisSV->fqPl));
+            pthisSV->fDeltaPl = warm.fDeltaPl;
+            pthisSV->fsinDeltaPl = sinf(FPIOVER180 * warm.fDeltaPl);
+            pthisSV->fcosDeltaPl = cosf(FPIOVER180 * warm.fDeltaPl);
+            pthisSV->iFirstAccelMagLock = true;
+        }
+    }
+#endif
+
+    // next save of the state for a warm start is one interval from now
+    pthisSV->iWarmStartCountdown = (pthisSV->iWarmStartLoops > 0) ? pthisSV->iWarmStartLoops : -1;
+
     // clear the reset flag
     pthisSV->resetflag = false;
 
@@ -416,7 +601,7 @@ void fRun_1DOF_P_BASIC(struct SV_1DOF_P_BASIC *pthisSV,
     // if requested, do a reset and return
     if (pthisSV->resetflag)
     {
-        fInit_1DOF_P_BASIC(pthisSV, pthisPressure, FLPFSECS_1DOF_P_BASIC);
+        fInit_1DOF_P_BASIC(pthisSV, pthisPressure, pthisSV->fLPFSecs);
         return;
     }
 
@@ -436,7 +621,7 @@ void fRun_3DOF_G_BASIC(struct SV_3DOF_G_BASIC *pthisSV,
     // if requested, do a reset and return
     if (pthisSV->resetflag)
     {
-        fInit_3DOF_G_BASIC(pthisSV, pthisAccel, FLPFSECS_3DOF_G_BASIC);
+        fInit_3DOF_G_BASIC(pthisSV, pthisAccel, pthisSV->fLPFSecs);
         return;
     }
 
@@ -485,7 +670,7 @@ void fRun_3DOF_B_BASIC(struct SV_3DOF_B_BASIC *pthisSV, struct MagSensor *pthisM
     // if requested, do a reset and return
     if (pthisSV->resetflag)
     {
-        fInit_3DOF_B_BASIC(pthisSV, pthisMag, FLPFSECS_3DOF_B_BASIC);
+        fInit_3DOF_B_BASIC(pthisSV, pthisMag, pthisSV->fLPFSecs);
         return;
     }
 
@@ -582,7 +767,7 @@ void fRun_6DOF_GB_BASIC(struct SV_6DOF_GB_BASIC *pthisSV,
     if (pthisSV->resetflag)
     {
         fInit_6DOF_GB_BASIC(pthisSV, pthisAccel, pthisMag,
-                            FLPFSECS_6DOF_GB_BASIC);
+                            pthisSV->fLPFSecs);
         return;
     }
 
@@ -641,16 +826,14 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     Quaternion  fqMi;               // a priori orientation quaternion
     Quaternion  ftmpq;              // scratch quaternion
     float       ftmp;               // scratch float
-    int8_t        ierror;             // matrix inversion error flag
+    float       fYsFIFO[3][GYRO_FIFO_SIZE];  // gyro FIFO in deg/s less the gyro offset
+    int8_t        ierror;             // matrix factorization error flag
     int8_t        i,
                 j,
                 k;                  // loop counters
 
-    // working arrays for 3x3 matrix inversion
+    // row pointers for the 3x3 Cholesky factorization
     float       *pfRows[3];
-    int8_t        iColInd[3];
-    int8_t        iRowInd[3];
-    int8_t        iPivot[3];
 
     // if requested, do a reset initialization with no further processing
     if (pthisSV->resetflag)
@@ -673,14 +856,17 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
         // set ftmp to the interval between the FIFO gyro measurements
         ftmp = pthisSV->fdeltat / (float) pthisGyro->iFIFOCount;
 
+        // convert the buffered gyroscope measurements to angular velocity less the gyro offset, a channel at a time
+        for (i = CHX; i <= CHZ; i++)
+            fScaleFifoChannel(fYsFIFO[i], pthisGyro->iYsFIFO[i], pthisGyro->iFIFOCount,
+                              pthisGyro->fDegPerSecPerCount, pthisSV->fbPl[i]);
+
         // normal case, loop over all the buffered gyroscope measurements
         for (j = 0; j < pthisGyro->iFIFOCount; j++)
         {
-            // calculate the instantaneous angular velocity subtracting the gyro offset
+            // fetch the instantaneous angular velocity
             for (i = CHX; i <= CHZ; i++)
-                ftmpMi3x1[i] = (float) pthisGyro->iYsFIFO[j][i] *
-                    pthisGyro->fDegPerSecPerCount -
-                    pthisSV->fbPl[i];
+                ftmpMi3x1[i] = fYsFIFO[i][j];
 
             // compute the incremental rotation quaternion ftmpq and integrate the a priori orientation quaternion fqMi
             fQuaternionFromRotationVectorDeg(&ftmpq, ftmpMi3x1, ftmp);
@@ -801,7 +987,7 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     // calculate the vector fQv containing the diagonal elements of the measurement covariance matrix Qv
     ftmp = fmodGc - 1.0F;
     fQvGQa = 3.0F * ftmp * ftmp;
-    if (fQvGQa < FQVG_6DOF_GY_KALMAN) fQvGQa = FQVG_6DOF_GY_KALMAN;
+    if (fQvGQa < pthisSV->fQvG) fQvGQa = pthisSV->fQvG;
     pthisSV->fQv = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
 
     // calculate the 6x3 Kalman gain matrix K = Qw * C^T * inv(C * Qw * C^T + Qv)
@@ -863,38 +1049,29 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
         }
     }
 
-    // set ftmpA3x3 below diagonal elements to above diagonal elements
+    // factor ftmpA3x3 = C * Qw * C^T + Qv = L.L^T in situ. ftmpA3x3 is a covariance matrix and so
+    // symmetric positive definite, and only its on and below diagonal elements are needed.
     ftmpA3x3[1][0] = ftmpA3x3[0][1];
     ftmpA3x3[2][0] = ftmpA3x3[0][2];
     ftmpA3x3[2][1] = ftmpA3x3[1][2];
-
-    // invert ftmpA3x3 in situ to give ftmpA3x3 = inv(C * Qw * C^T + Qv) = inv(ftmpA3x3)
     for (i = 0; i < 3; i++) pfRows[i] = ftmpA3x3[i];
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 3, &ierror);
+    fmatrixCholeskyA(pfRows, 3, &ierror);
 
-    // on successful inversion set Kalman gain matrix fK6x3 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT6x3 * ftmpA3x3
+    // on successful factorization set Kalman gain matrix fK6x3 = Qw * C^T * inv(C * Qw * C^T + Qv).
+    // since the inverse is symmetric, each row of fK6x3 is the solution of (C * Qw * C^T + Qv).x = the
+    // same row of fQwCT6x3, so the gain is computed without forming an explicit inverse
     if (!ierror)
     {
         // normal case
         for (i = 0; i < 6; i++)     // loop over rows
         {
-            for (j = 0; j < 3; j++) // loop over columns
-            {
-                pthisSV->fK6x3[i][j] = 0.0F;
-                for (k = 0; k < 3; k++)
-                {
-                    if ((pthisSV->fQwCT6x3[i][k] != 0.0F) &&
-                        (ftmpA3x3[k][j] != 0.0F))
-                    {
-                        pthisSV->fK6x3[i][j] += pthisSV->fQwCT6x3[i][k] * ftmpA3x3[k][j];
-                    }
-                }
-            }
+            for (j = 0; j < 3; j++) pthisSV->fK6x3[i][j] = pthisSV->fQwCT6x3[i][j];
+            fmatrixCholeskySolve(pfRows, pthisSV->fK6x3[i], 3);
         }
     }
     else
     {
-        // ftmpA3x3 was singular so set Kalman gain matrix fK6x3 to zero
+        // ftmpA3x3 was not positive definite so set Kalman gain matrix fK6x3 to zero
         for (i = 0; i < 6; i++)     // loop over rows
         {
             for (j = 0; j < 3; j++) // loop over columns
@@ -1017,7 +1194,6 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
                           struct MagCalibration *pthisMagCal)
 {
     // local scalars and arrays
-    float       ftmpA6x6[6][6];     // scratch 6x6 matrix
     float       fRMi[3][3];         // a priori orientation matrix
     float       fR6DOF[3][3];       // eCompass (6DOF accelerometer+magnetometer) orientation matrix
     float       fgMi[3];            // a priori estimate of the gravity vector (sensor frame)
@@ -1028,27 +1204,32 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     float       ftmpA3x1[3];        // scratch 3x1 vector
     float       fQvGQa;             // accelerometer noise covariance to 1g sphere
     float       fQvBQd;             // magnetometer noise covariance to geomagnetic sphere
-    float       fC6x9ik;            // element i, k of measurement matrix C
-    float       fC6x9jk;            // element j, k of measurement matrix C
     Quaternion  fqMi;               // a priori orientation quaternion
     Quaternion  fq6DOF;             // eCompass (6DOF accelerometer+magnetometer) orientation quaternion
     Quaternion  ftmpq;              // scratch quaternion used for gyro integration
+    float       fYsFIFO[3][GYRO_FIFO_SIZE];  // gyro FIFO in deg/s less the gyro offset
     float       fDelta6DOF;         // geomagnetic inclination angle computed from accelerometer and magnetometer (deg)
     float       fsinDelta6DOF;    // sin(fDelta6DOF)
     float       fcosDelta6DOF;    // cos(fDelta6DOF)
     float       fmodGc;    // modulus of calibrated accelerometer measurement (g)
     float       fmodBc;    // modulus of calibrated magnetometer measurement (uT)
     float       ftmp;               // scratch float
-    int8_t        ierror;             // matrix inversion error flag
     int8_t        i,
                 j,
                 k;                  // loop counters
 
-    // working arrays for 6x6 matrix inversion
+#if F_9DOF_SEQUENTIAL_UPDATE
+    float       ftmpA9x9[9][9];     // covariance updated after each scalar measurement
+    float       ftmpA9x1[9];        // a posteriori error vector accumulated over the scalar measurements
+#else
+    float       ftmpA6x6[6][6];     // scratch 6x6 matrix
+    float       fC6x9ik;            // element i, k of measurement matrix C
+    float       fC6x9jk;            // element j, k of measurement matrix C
+    int8_t        ierror;             // matrix factorization error flag
+
+    // row pointers for the 6x6 Cholesky factorization
     float       *pfRows[6];
-    int8_t       iColInd[6];
-    int8_t        iRowInd[6];
-    int8_t        iPivot[6];
+#endif
 
     // if requested, do a reset initialization with no further processing
     if (pthisSV->resetflag) {
@@ -1066,10 +1247,15 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
         // set ftmp to the average interval between FIFO gyro measurements
         ftmp = pthisSV->fdeltat / (float)pthisGyro->iFIFOCount;
 
+        // convert the buffered gyroscope measurements to angular velocity less the gyro offset, a channel at a time
+        for (i = CHX; i <= CHZ; i++)
+            fScaleFifoChannel(fYsFIFO[i], pthisGyro->iYsFIFO[i], pthisGyro->iFIFOCount,
+                              pthisGyro->fDegPerSecPerCount, pthisSV->fbPl[i]);
+
         // normal case, loop over all the buffered gyroscope measurements
         for (j = 0; j < pthisGyro->iFIFOCount; j++) {
-        // calculate the instantaneous angular velocity subtracting the gyro offset
-            for (i = CHX; i <= CHZ; i++) ftmpA3x1[i] = (float)pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount - pthisSV->fbPl[i];
+            // fetch the instantaneous angular velocity
+            for (i = CHX; i <= CHZ; i++) ftmpA3x1[i] = fYsFIFO[i][j];
             // compute the incremental rotation quaternion ftmpq and integrate the a priori orientation quaternion fqMi
             fQuaternionFromRotationVectorDeg(&ftmpq, ftmpA3x1, ftmp);
             qAeqAxB(&fqMi, &ftmpq);
@@ -1100,14 +1286,14 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // calculate the acceleration noise variance relative to 1g sphere
     ftmp = fmodGc - 1.0F;
     fQvGQa = 3.0F * ftmp * ftmp;
-    if (fQvGQa < FQVG_9DOF_GBY_KALMAN)
-    fQvGQa = FQVG_9DOF_GBY_KALMAN;
+    if (fQvGQa < pthisSV->fQvG)
+    fQvGQa = pthisSV->fQvG;
 
     // calculate magnetic noise variance relative to geomagnetic sphere
     ftmp = fmodBc - pthisMagCal->fB;
     fQvBQd = 3.0F * ftmp * ftmp;
-    if (fQvBQd < FQVB_9DOF_GBY_KALMAN)
-    fQvBQd = FQVB_9DOF_GBY_KALMAN;
+    if (fQvBQd < pthisSV->fQvB)
+    fQvBQd = pthisSV->fQvB;
 
     // do a once-only orientation lock immediately after the first valid magnetic calibration by:
     // i) setting the a priori and a posteriori orientations to the 6DOF eCompass orientation
@@ -1219,6 +1405,57 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     pthisSV->fQv6x1[0] = pthisSV->fQv6x1[1] = pthisSV->fQv6x1[2] = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
     pthisSV->fQv6x1[3] = pthisSV->fQv6x1[4] = pthisSV->fQv6x1[5] = ONEOVER12 * fQvBQd / pthisMagCal->fBSq + pthisSV->fAlphaSqQvYQwbOver12;
 
+#if F_9DOF_SEQUENTIAL_UPDATE
+    // process the six measurement errors in fZErr one at a time. Since Qv is diagonal this gives the same
+    // a posteriori errors as the joint update below in exact arithmetic, but each step only divides by the
+    // scalar innovation variance. The two round differently in float: replays differ by up to 2E-3 in a
+    // quaternion component (extras/replay/tests/test_sequential_update.c). Row m of the measurement
+    // matrix C has two non-zero elements: 1 at column m and -alpha/2 at column m+6 (gravity, m < 3) or
+    // m+3 (geomagnetic, m >= 3). fK9x6 column m is set to the gain of measurement m given measurements
+    // 0 to m-1. fQwCT9x6 is not used.
+    for (i = 0; i < 9; i++)
+    {
+        for (j = 0; j < 9; j++) ftmpA9x9[i][j] = pthisSV->fQw9x9[i][j];
+        ftmpA9x1[i] = 0.0F;
+    }
+    for (k = 0; k < 6; k++)
+    {
+        int8_t  ib = (k < 3) ? (k + 6) : (k + 3);   // column of the -alpha/2 element of row k of C
+        float   fPCT9x1[9];                         // covariance times row k of C transposed
+        float   fS;                                 // innovation variance
+
+        for (i = 0; i < 9; i++)
+            fPCT9x1[i] = ftmpA9x9[i][k] - pthisSV->fAlphaOver2 * ftmpA9x9[i][ib];
+        fS = fPCT9x1[k] - pthisSV->fAlphaOver2 * fPCT9x1[ib] + pthisSV->fQv6x1[k];
+
+        // the innovation variance is positive unless the covariance has been corrupted so skip the measurement
+        if (fS <= 0.0F)
+        {
+            for (i = 0; i < 9; i++) pthisSV->fK9x6[i][k] = 0.0F;
+            continue;
+        }
+
+        // gain, and innovation of measurement k against the a posteriori errors of the previous measurements
+        ftmp = 1.0F / fS;
+        for (i = 0; i < 9; i++) pthisSV->fK9x6[i][k] = fPCT9x1[i] * ftmp;
+        ftmp = pthisSV->fZErr[k] - (ftmpA9x1[k] - pthisSV->fAlphaOver2 * ftmpA9x1[ib]);
+
+        // update the error vector and the covariance P = P - K.(P.C^T)^T
+        for (i = 0; i < 9; i++)
+        {
+            ftmpA9x1[i] += pthisSV->fK9x6[i][k] * ftmp;
+            for (j = 0; j < 9; j++)
+                ftmpA9x9[i][j] -= pthisSV->fK9x6[i][k] * fPCT9x1[j];
+        }
+    }
+
+    // ftmpA9x1 holds the a posteriori gravity and geomagnetic tilt quaternion errors and gyro offset error
+    for (i = CHX; i <= CHZ; i++) {
+        pthisSV->fqgErrPl[i] = ftmpA9x1[i];
+        pthisSV->fqmErrPl[i] = ftmpA9x1[i + 3];
+        pthisSV->fbErrPl[i] = ftmpA9x1[i + 6];
+    }
+#else
     // calculate the Kalman gain matrix K = Qw * C^T * inv(C * Qw * C^T + Qv)
     // set fQwCT9x6 = Qw.C^T where Qw has size 9x9 and C^T has size 9x6
     for (i = 0; i < 9; i++) { // loop over rows
@@ -1275,29 +1512,25 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
           }
       }
     }
-    // set ftmpA6x6 below diagonal elements to above diagonal elements
+    // factor ftmpA6x6 = C * Qw * C^T + Qv = L.L^T in situ. ftmpA6x6 is a covariance matrix and so
+    // symmetric positive definite, and only its on and below diagonal elements are needed.
     for (i = 1; i < 6; i++) // loop over rows
         for (j = 0; j < i; j++) // loop over below diagonal columns
             ftmpA6x6[i][j] = ftmpA6x6[j][i];
-
-    // invert ftmpA6x6 in situ to give ftmpA6x6 = inv(C * Qw * C^T + Qv) = inv(ftmpA6x6)
     for (i = 0; i < 6; i++)
         pfRows[i] = ftmpA6x6[i];
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 6, &ierror);
+    fmatrixCholeskyA(pfRows, 6, &ierror);
 
-    // on successful inversion set Kalman gain matrix K9x6 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT9x6 * ftmpA6x6
+    // on successful factorization set Kalman gain matrix K9x6 = Qw * C^T * inv(C * Qw * C^T + Qv).
+    // each row of K9x6 is the solution of (C * Qw * C^T + Qv).x = the same row of fQwCT9x6
     if (!ierror) {
     // normal case
-    for (i = 0; i < 9; i++) // loop over rows
-        for (j = 0; j < 6; j++) { // loop over columns
-            pthisSV->fK9x6[i][j] = 0.0F;
-            for (k = 0; k < 6; k++) {
-                if ((pthisSV->fQwCT9x6[i][k] != 0.0F) && (ftmpA6x6[k][j] != 0.0F))
-                    pthisSV->fK9x6[i][j] += pthisSV->fQwCT9x6[i][k] * ftmpA6x6[k][j];
-            }
-        }
+    for (i = 0; i < 9; i++) { // loop over rows
+        for (j = 0; j < 6; j++) pthisSV->fK9x6[i][j] = pthisSV->fQwCT9x6[i][j];
+        fmatrixCholeskySolve(pfRows, pthisSV->fK9x6[i], 6);
+    }
     } else {
-        // ftmpA6x6 was singular so set Kalman gain matrix to zero
+        // ftmpA6x6 was not positive definite so set Kalman gain matrix to zero
         for (i = 0; i < 9; i++) // loop over rows
             for (j = 0; j < 6; j++) // loop over columns
                 pthisSV->fK9x6[i][j] = 0.0F;
@@ -1321,6 +1554,7 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
                 pthisSV->fbErrPl[i] += pthisSV->fK9x6[i + 6][j] * pthisSV->fZErr[j];
         }
     }
+#endif // F_9DOF_SEQUENTIAL_UPDATE
 
     // set ftmpq to the a posteriori gravity tilt correction (conjugate) quaternion
     ftmpq.q1 = -pthisSV->fqgErrPl[CHX];
@@ -1418,6 +1652,16 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     fWin8AnglesDegFromRotationMatrix(pthisSV->fRPl, &(pthisSV->fPhiPl), &(pthisSV->fThePl), &(pthisSV->fPsiPl), &(pthisSV->fRhoPl), &(pthisSV->fChiPl));
 #endif
 
+    // queue the state for a warm start after the next power up, once locked to the eCompass.
+    // the flash write is left to SavePendingCalibrationsToNVM() in the main loop
+    if (pthisSV->iWarmStartCountdown > 0) pthisSV->iWarmStartCountdown--;
+    if (!pthisSV->iWarmStartCountdown && pthisSV->iFirstAccelMagLock && !pthisSV->iWarmStartPending) {
+        fGetWarmStart9DOF(pthisSV, &(pthisSV->WarmStart));
+        pthisSV->iWarmStartCountdown = (pthisSV->iWarmStartLoops > 0) ? pthisSV->iWarmStartLoops : -1;
+        __sync_synchronize();       // WarmStart complete before the main loop sees iWarmStartPending
+        pthisSV->iWarmStartPending = true;
+    }
+
     return;
 } // end fRun_9DOF_GBY_KALMAN
 #endif // #if F_9DOF_GBY_KALMAN
@@ -64,6 +64,41 @@ extern "C" {
 #define FQWB_9DOF_GBY_KALMAN		2E-2F	        ///< gyro offset random walk units (deg/s)^2
 #define FMIN_9DOF_GBY_BPL		-7.0F           ///< minimum permissible power on gyro offsets (deg/s)
 #define FMAX_9DOF_GBY_BPL		7.0F            ///< maximum permissible power on gyro offsets (deg/s)
+#define WARMSTART_SAVE_SECS		300             ///< default interval (s) between saves of the filter state for a warm start, 0 disables
+#define WARMSTART_MAX_ANGLE_DEG		10.0F           ///< largest difference from the power on eCompass orientation for which the saved orientation is used
+///@}
+
+/// Run time tuning of the fusion algorithms. Each instance starts with the
+/// defaults above; fSetFusionTuning() replaces them and makes the affected
+/// algorithms reinitialize on their next run, as after a reset command.
+/// Fields of algorithms not selected in build.h are ignored.
+typedef struct FusionTuning
+{
+    float fLPFSecs_1DOF_P_BASIC;    ///< pressure low pass filter time constant (s)
+    float fLPFSecs_3DOF_G_BASIC;    ///< tilt orientation low pass filter time constant (s)
+    float fLPFSecs_3DOF_B_BASIC;    ///< 2D eCompass orientation low pass filter time constant (s)
+    float fLPFSecs_6DOF_GB_BASIC;   ///< 3D eCompass orientation low pass filter time constant (s)
+    float fQvY_6DOF_GY_KALMAN;      ///< gyro sensor noise variance units (deg/s)^2
+    float fQvG_6DOF_GY_KALMAN;      ///< accelerometer sensor noise variance units g^2
+    float fQwb_6DOF_GY_KALMAN;      ///< gyro offset random walk units (deg/s)^2
+    float fQvY_9DOF_GBY_KALMAN;     ///< gyro sensor noise variance units (deg/s)^2
+    float fQvG_9DOF_GBY_KALMAN;     ///< accelerometer sensor noise variance units g^2
+    float fQvB_9DOF_GBY_KALMAN;     ///< magnetometer sensor noise variance units uT^2
+    float fQwb_9DOF_GBY_KALMAN;     ///< gyro offset random walk units (deg/s)^2
+} FusionTuning;
+
+/// @name Fusion Tuning Functions
+///@{
+void fInitializeFusionTuning(FusionTuning *pTuning);    ///< fill with the build time defaults
+void fGetFusionTuning(const SensorFusionGlobals *sfg, FusionTuning *pTuning);
+void fSetFusionTuning(SensorFusionGlobals *sfg, const FusionTuning *pTuning);
+///@}
+
+/// @name Warm Start Functions
+///@{
+void fSetWarmStartInterval(SensorFusionGlobals *sfg, int32_t iLoops);  ///< fusion cycles between saves, 0 disables
+void fRequestWarmStartSave(SensorFusionGlobals *sfg);   ///< queue the filter state for saving on the next cycle
+void fGetWarmStart9DOF(const struct SV_9DOF_GBY_KALMAN *pthisSV, struct WarmStart9DOF *pState);
 ///@}
 
 /// @name Fusion Function Prototypes
@@ -63,9 +63,9 @@ void ApplyAccelHAL(struct AccelSensor *Accel) {
   for (i = 0; i < Accel->iFIFOCount; i++) {
     // apply mapping for coordinate system used
 #if THISCOORDSYSTEM == NED
-		itmp16 = Accel->iGsFIFO[i][CHX];
-		Accel->iGsFIFO[i][CHX] = Accel->iGsFIFO[i][CHY];
-		Accel->iGsFIFO[i][CHY] = itmp16;
+		itmp16 = Accel->iGsFIFO[CHX][i];
+		Accel->iGsFIFO[CHX][i] = Accel->iGsFIFO[CHY][i];
+		Accel->iGsFIFO[CHY][i] = itmp16;
 #endif  // NED
 #if THISCOORDSYSTEM == ANDROID
     // the ANDROID transformation has not been confirmed
@@ -86,10 +86,10 @@ void ApplyMagHAL(struct MagSensor *Mag) {
   for (i = 0; i < Mag->iFIFOCount; i++) {
     // apply mapping for coordinate system used
 #if THISCOORDSYSTEM == NED
-		itmp16 = Mag->iBsFIFO[i][CHX];
-    Mag->iBsFIFO[i][CHX] = -Mag->iBsFIFO[i][CHY];
-		Mag->iBsFIFO[i][CHY] = -itmp16;
-		Mag->iBsFIFO[i][CHZ] = -Mag->iBsFIFO[i][CHZ];
+		itmp16 = Mag->iBsFIFO[CHX][i];
+    Mag->iBsFIFO[CHX][i] = -Mag->iBsFIFO[CHY][i];
+		Mag->iBsFIFO[CHY][i] = -itmp16;
+		Mag->iBsFIFO[CHZ][i] = -Mag->iBsFIFO[CHZ][i];
 #endif  // NED
 #if THISCOORDSYSTEM == ANDROID
 #endif  // Android
@@ -108,10 +108,10 @@ void ApplyGyroHAL(struct GyroSensor *Gyro) {
   for (i = 0; i < Gyro->iFIFOCount; i++) {
     // apply mapping for coordinate system used
 #if THISCOORDSYSTEM == NED
-		itmp16 = Gyro->iYsFIFO[i][CHX];
-		Gyro->iYsFIFO[i][CHX] = -Gyro->iYsFIFO[i][CHY];
-		Gyro->iYsFIFO[i][CHY] = -itmp16;
-		Gyro->iYsFIFO[i][CHZ] = -Gyro->iYsFIFO[i][CHZ];
+		itmp16 = Gyro->iYsFIFO[CHX][i];
+		Gyro->iYsFIFO[CHX][i] = -Gyro->iYsFIFO[CHY][i];
+		Gyro->iYsFIFO[CHY][i] = -itmp16;
+		Gyro->iYsFIFO[CHZ][i] = -Gyro->iYsFIFO[CHZ][i];
 #endif  // NED
 #if THISCOORDSYSTEM == ANDROID
 #endif  // Android
@@ -17,12 +17,27 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "sensor_fusion.h"
 #include "calibration_storage.h"
 #include "magnetic.h"
 
 #if F_USING_MAG
+// working set of the solvers in the shared scratch arena. the 10 element solver uses 10x10
+// fmatA and fmatB (eigenvectors) and a 10x1 fvecA, the 4 element solver a 4x1 fvecB
+#define MAG_SOLVER_DIM          10
+#define MAG_SOLVER_VECB_DIM     4
+typedef struct MagScratchNeed {
+    float fmatA[MAG_SOLVER_DIM][MAG_SOLVER_DIM];
+    float fmatB[MAG_SOLVER_DIM][MAG_SOLVER_DIM];
+    float fvecA[MAG_SOLVER_DIM];
+    float fvecB[MAG_SOLVER_VECB_DIM];
+} MagScratchNeed;
+CAL_SCRATCH_CHECK(MAG_SOLVER_DIM <= CAL_SCRATCH_DIM, MagSolverFitsScratchMatrices);
+CAL_SCRATCH_CHECK(MAG_SOLVER_VECB_DIM <= CAL_SCRATCH_VECB_DIM, MagSolverFitsScratchVecB);
+CAL_SCRATCH_CHECK(sizeof(MagScratchNeed) <= sizeof(CalibrationScratch), MagSolverFitsCalibrationScratch);
+
 // function resets the magnetometer buffer and magnetic calibration
 void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
                                struct MagBuffer *pthisMagBuffer)
@@ -30,10 +45,9 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
     int8_t    i,
             j;          // loop counters
 
-    // set magnetic buffer index to invalid value -1 to denote no measurement present
+    // empty the magnetic buffer
     pthisMagBuffer->iMagBufferCount = 0;
-    for (i = 0; i < MAGBUFFSIZEX; i++)
-        for (j = 0; j < MAGBUFFSIZEY; j++) pthisMagBuffer->index[i][j] = -1;
+    pthisMagBuffer->iStampBase = 0;
 
     // initialize the array of (MAGBUFFSIZEX - 1) elements of 100 * tangents used for buffer indexing
     // entries cover the range 100 * tan(-PI/2 + PI/MAGBUFFSIZEX), 100 * tan(-PI/2 + 2*PI/MAGBUFFSIZEX) to
@@ -65,16 +79,16 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
 #endif
         // flash has been erased and no magnetic calibration is present
         // initialize the magnetic calibration in RAM to null default
-        pthisMagCal->fV[CHX] = pthisMagCal->fV[CHY] = pthisMagCal->fV[CHZ] = 0.0F;
-        f3x3matrixAeqI(pthisMagCal->finvW);
-        pthisMagCal->fB = DEFAULTB;
-        pthisMagCal->fBSq = DEFAULTB * DEFAULTB;
-        pthisMagCal->fFitErrorpc = 100.0F;
-        pthisMagCal->iValidMagCal = 0;
+        fSetMagCalibrationDefault(pthisMagCal);
 #ifndef SIMULATION
     }
 #endif
 
+    // the calibration in RAM is now the stored one, if there is one
+    pthisMagCal->fStoredFitErrorpc = pthisMagCal->fFitErrorpc;
+    pthisMagCal->iStoredValidMagCal = pthisMagCal->iValidMagCal;
+    pthisMagCal->iSaveRequested = false;
+
     // initialize remaining elements of the magnetic calibration structure
     pthisMagCal->iCalInProgress = 0;
     pthisMagCal->iInitiateMagCal = 0;
@@ -87,6 +101,60 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
     return;
 } // end fInitializeMagCalibration()
 
+// function sets the stored elements of the magnetic calibration to the null default (no calibration)
+void fSetMagCalibrationDefault(struct MagCalibration *pthisMagCal)
+{
+    pthisMagCal->fV[CHX] = pthisMagCal->fV[CHY] = pthisMagCal->fV[CHZ] = 0.0F;
+    f3x3matrixAeqI(pthisMagCal->finvW);
+    pthisMagCal->fB = DEFAULTB;
+    pthisMagCal->fBSq = DEFAULTB * DEFAULTB;
+    pthisMagCal->fFitErrorpc = 100.0F;
+    pthisMagCal->iValidMagCal = 0;
+
+    return;
+} // end fSetMagCalibrationDefault()
+
+// function returns the buffer entry holding bin iBin, or -1 if the bin is empty
+int16_t iMagBufferFind(const struct MagBuffer *pthisMagBuffer, int16_t iBin)
+{
+    int16_t   n;          // buffer entry counter
+
+    for (n = 0; n < pthisMagBuffer->iMagBufferCount; n++)
+    {
+        if (pthisMagBuffer->entry[n].iBin == (uint16_t) iBin) return n;
+    }
+
+    return -1;
+} // end iMagBufferFind()
+
+// function converts loopcounter to a 16 bit time stamp relative to iStampBase.
+// when loopcounter runs out of the 16 bit range the base is moved forward and all stored
+// stamps are shifted to match. entries older than the range saturate at zero, so they
+// still compare as the oldest.
+static uint16_t iMagBufferStamp(struct MagBuffer *pthisMagBuffer, int32_t loopcounter)
+{
+    int32_t   iStamp;     // time stamp relative to iStampBase
+    int32_t   iNewBase;   // replacement for iStampBase
+    int16_t   n;          // buffer entry counter
+
+    iStamp = loopcounter - pthisMagBuffer->iStampBase;
+    if ((iStamp < 0) || (iStamp > 0xFFFF))
+    {
+        iNewBase = loopcounter - 0x8000;
+        for (n = 0; n < pthisMagBuffer->iMagBufferCount; n++)
+        {
+            iStamp = (int32_t) pthisMagBuffer->entry[n].iStamp + pthisMagBuffer->iStampBase - iNewBase;
+            if (iStamp < 0) iStamp = 0;
+            if (iStamp > 0xFFFF) iStamp = 0xFFFF;
+            pthisMagBuffer->entry[n].iStamp = (uint16_t) iStamp;
+        }
+        pthisMagBuffer->iStampBase = iNewBase;
+        iStamp = loopcounter - iNewBase;
+    }
+
+    return (uint16_t) iStamp;
+} // end iMagBufferStamp()
+
 // function updates the magnetic measurement buffer with most recent magnetic data
 // the uncalibrated measurements iBs are stored in the buffer but the calibrated measurements iBc are used for indexing.
 void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag,
@@ -94,13 +162,16 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
 {
     // local variables
     int32_t   idelta;     // absolute vector distance
-    int32_t   i;          // counter
     int16_t   itanj,
             itank;      // indexing accelerometer ratios
-    int8_t    j,
-            k,
-            l,
-            m;          // counters
+    int16_t   iBin;       // bin of the current measurement
+    int16_t   n;          // buffer entry holding iBin, or -1
+    int16_t   m;          // buffer entry counter
+    uint16_t  iStamp;     // time stamp of the current measurement
+    uint8_t   iOccupied[(MAGBUFFSIZEX * MAGBUFFSIZEY + 7) / 8];  // one bit per bin with a measurement
+    int8_t    i,
+            j,
+            k;          // counters
     int8_t    itooclose;  // flag denoting measurement is too close to existing ones
 
     // calculate the magnetometer buffer bins from the tangent ratios
@@ -117,90 +188,74 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
     while ((k < (MAGBUFFSIZEX - 1) && (itank >= pthisMagBuffer->tanarray[k])))
         k++;
     if (pthisMag->iBc[CHX] < 0) k += MAGBUFFSIZEX;
+    iBin = j * MAGBUFFSIZEY + k;
+
+    // find the entry, if any, already holding a measurement in this bin
+    n = iMagBufferFind(pthisMagBuffer, iBin);
+    iStamp = iMagBufferStamp(pthisMagBuffer, loopcounter);
 
     // case 1: buffer is full and this bin has a measurement: over-write without increasing number of measurements
     // this is the most common option at run time
-    if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] != -1))
+    if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) && (n != -1))
     {
-        // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
+        // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer entry
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            pthisMagBuffer->entry[n].iBs[i] = pthisMag->iBs[i];
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
+        pthisMagBuffer->entry[n].iStamp = iStamp;
         return;
     }                   // end case 1
 
-    // case 2: the buffer is full and this bin does not have a measurement: store and retire the oldest
+    // case 2: the buffer is full and this bin does not have a measurement: retire the oldest and store in its place
     // this is the second most common option at run time
-    if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] == -1))
+    if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) && (n == -1))
     {
-        // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
-        for (i = CHX; i <= CHZ; i++)
+        // set n to the oldest active entry
+        n = 0;
+        for (m = 1; m < pthisMagBuffer->iMagBufferCount; m++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            if (pthisMagBuffer->entry[m].iStamp < pthisMagBuffer->entry[n].iStamp) n = m;
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
-
-        // set l and m to the oldest active entry and disable it
-        i = loopcounter;
-        l = m = 0;      // to avoid compiler complaint
-        for (j = 0; j < MAGBUFFSIZEX; j++)
+        // re-use the oldest entry for this bin and store the fast integer magnetometer reading
+        for (i = CHX; i <= CHZ; i++)
         {
-            for (k = 0; k < MAGBUFFSIZEY; k++)
-            {
-                // check if the time stamp is older than the oldest found so far (normally fails this test)
-                if (pthisMagBuffer->index[j][k] < i)
-                {
-                    // check if this bin is active (normally passes this test)
-                    if (pthisMagBuffer->index[j][k] != -1)
-                    {
-                        // set l and m to the indices of the oldest entry found so far
-                        l = j;
-                        m = k;
-
-                        // set i to the time stamp of the oldest entry found so far
-                        i = pthisMagBuffer->index[l][m];
-                    }   // end of test for active
-                }       // end of test for older
-            }           // end of loop over k
-        }               // end of loop over j
-
-        // deactivate the oldest measurement (no need to zero the measurement data)
-        pthisMagBuffer->index[l][m] = -1;
+            pthisMagBuffer->entry[n].iBs[i] = pthisMag->iBs[i];
+        }
+
+        pthisMagBuffer->entry[n].iBin = (uint16_t) iBin;
+        pthisMagBuffer->entry[n].iStamp = iStamp;
         return;
     }                   // end case 2
 
     // case 3: buffer is not full and this bin is empty: store and increment number of measurements
-    if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] == -1))
+    if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) && (n == -1))
     {
-        // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
+        // store the fast (unaveraged at typically 200Hz) integer magnetometer reading in a new entry
+        n = pthisMagBuffer->iMagBufferCount;
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            pthisMagBuffer->entry[n].iBs[i] = pthisMag->iBs[i];
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
+        pthisMagBuffer->entry[n].iBin = (uint16_t) iBin;
+        pthisMagBuffer->entry[n].iStamp = iStamp;
         (pthisMagBuffer->iMagBufferCount)++;
         return;
     }                   // end case 3
 
     // case 4: buffer is not full and this bin has a measurement: over-write if close or try to slot in
     // elsewhere if not close to the other measurements so as to create a mesh
-    if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] != -1))
+    if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) && (n != -1))
     {
         // calculate the vector difference between current measurement and the buffer entry
         idelta = 0;
         for (i = CHX; i <= CHZ; i++)
         {
             idelta += abs((int32_t) pthisMag->iBs[i] -
-                          (int32_t) pthisMagBuffer->iBs[i][j][k]);
+                          (int32_t) pthisMagBuffer->entry[n].iBs[i]);
         }
 
         // check to see if the current reading is close to this existing magnetic buffer entry
@@ -209,68 +264,56 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
             // simply over-write the measurement and return
             for (i = CHX; i <= CHZ; i++)
             {
-                pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+                pthisMagBuffer->entry[n].iBs[i] = pthisMag->iBs[i];
             }
 
-            pthisMagBuffer->index[j][k] = loopcounter;
+            pthisMagBuffer->entry[n].iStamp = iStamp;
         }
         else
         {
             // reset the flag denoting that the current measurement is close to any measurement in the buffer
+            // and the map of occupied bins
             itooclose = 0;
+            for (m = 0; m < (int16_t) sizeof(iOccupied); m++) iOccupied[m] = 0;
 
-            // to avoid compiler warning
-            l = m = 0;
-
-            // loop over the buffer j from 0 potentially up to MAGBUFFSIZEX - 1
-            j = 0;
-            while (!itooclose && (j < MAGBUFFSIZEX))
+            // loop over the active entries until one too close is found
+            m = 0;
+            while (!itooclose && (m < pthisMagBuffer->iMagBufferCount))
             {
-                // loop over the buffer k from 0 potentially up to MAGBUFFSIZEY - 1
-                k = 0;
-                while (!itooclose && (k < MAGBUFFSIZEY))
+                // calculate the vector difference between current measurement and the buffer entry
+                idelta = 0;
+                for (i = CHX; i <= CHZ; i++)
+                {
+                    idelta += abs((int32_t) pthisMag->iBs[i] -
+                                  (int32_t) pthisMagBuffer->entry[m].iBs[i]);
+                }
+
+                // check to see if the current reading is close to this existing magnetic buffer entry
+                if (idelta < MESHDELTACOUNTS)
                 {
-                    // check whether this buffer entry already has a measurement or not
-                    if (pthisMagBuffer->index[j][k] != -1)
-                    {
-                        // calculate the vector difference between current measurement and the buffer entry
-                        idelta = 0;
-                        for (i = CHX; i <= CHZ; i++)
-                        {
-                            idelta += abs((int32_t) pthisMag->iBs[i] -
-                                          (int32_t) pthisMagBuffer->iBs[i][j][k]);
-                        }
-
-                        // check to see if the current reading is close to this existing magnetic buffer entry
-                        if (idelta < MESHDELTACOUNTS)
-                        {
-                            // set the flag to abort the search
-                            itooclose = 1;
-                        }
-                    }
-                    else
-                    {
-                        // store the location of this empty bin for future use
-                        l = j;
-                        m = k;
-                    }   // end of test for valid measurement in this bin
-
-                    k++;
-                }       // end of k loop
-
-                j++;
-            }           // end of j loop
-
-            // if none too close, store the measurement in the last empty bin found and return
-            // l and m are guaranteed to be set if no entries too close are detected
+                    // set the flag to abort the search
+                    itooclose = 1;
+                }
+
+                iOccupied[pthisMagBuffer->entry[m].iBin >> 3] |= (uint8_t) (1 << (pthisMagBuffer->entry[m].iBin & 7));
+                m++;
+            }
+
+            // if none too close, store the measurement in the last empty bin and return.
+            // an empty bin is guaranteed to exist since MAXMEASUREMENTS does not exceed the number of bins
             if (!itooclose)
             {
+                iBin = MAGBUFFSIZEX * MAGBUFFSIZEY - 1;
+                while (iOccupied[iBin >> 3] & (1 << (iBin & 7))) iBin--;
+
+                n = pthisMagBuffer->iMagBufferCount;
                 for (i = CHX; i <= CHZ; i++)
                 {
-                    pthisMagBuffer->iBs[i][l][m] = pthisMag->iBs[i];
+                    pthisMagBuffer->entry[n].iBs[i] = pthisMag->iBs[i];
                 }
 
-                pthisMagBuffer->index[l][m] = loopcounter;
+                pthisMagBuffer->entry[n].iBin = (uint16_t) iBin;
+                pthisMagBuffer->entry[n].iStamp = iStamp;
                 (pthisMagBuffer->iMagBufferCount)++;
             }
         }               // end of test for closeness to current buffer entry
@@ -406,6 +449,25 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
         pthisMagCal->iCalInProgress = pthisMagCal->iInitiateMagCal;
     }
 
+    // a new calibration claims the scratch arena shared with the accelerometer calibration.
+    // partial results stay in the arena between time slices, so if the accelerometer calibration
+    // has run since, abandon this attempt and let the same solver be tried again
+    if (pthisMagCal->iCalInProgress)
+    {
+        if (pthisMagCal->iInitiateMagCal)
+        {
+            pthisMagCal->pScratch->iOwner = CAL_SCRATCH_MAG;
+        }
+        else if (pthisMagCal->pScratch->iOwner != CAL_SCRATCH_MAG)
+        {
+            if (pthisMagCal->iCalInProgress == 4) pthisMagCal->i4ElementSolverTried = false;
+            else if (pthisMagCal->iCalInProgress == 7) pthisMagCal->i7ElementSolverTried = false;
+            else pthisMagCal->i10ElementSolverTried = false;
+            pthisMagCal->iCalInProgress = 0;
+            pthisMagCal->iMagBufferReadOnly = false;
+        }
+    }
+
     // on entry each of the calibration functions resets iInitiateMagCal and on completion sets
     // iCalInProgress=0 and iNewCalibrationAvailable=4,7,10 according to the solver used
     switch (pthisMagCal->iCalInProgress)
@@ -429,6 +491,10 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
             break;
     }
 
+    // release the scratch arena once the calibration has completed
+    if (!pthisMagCal->iCalInProgress && (pthisMagCal->pScratch->iOwner == CAL_SCRATCH_MAG))
+        pthisMagCal->pScratch->iOwner = CAL_SCRATCH_FREE;
+
     // evaluate the new calibration to determine whether to accept it
     if (pthisMagCal->iNewCalibrationAvailable)
     {
@@ -458,9 +524,6 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
         {
             // the magnetic buffer is presumed corrupted so clear out all measurements and restart calibration attempts
             pthisMagBuffer->iMagBufferCount = 0;
-            for (i = 0; i < MAGBUFFSIZEX; i++)
-                for (j = 0; j < MAGBUFFSIZEY; j++)
-                    pthisMagBuffer->index[i][j] = -1;
             pthisMagCal->i4ElementSolverTried = false;
             pthisMagCal->i7ElementSolverTried = false;
             pthisMagCal->i10ElementSolverTried = false;
@@ -474,6 +537,28 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
     // this prevents a calibration remaining for ever if a unit is never powered down
     if (pthisMagCal->iValidMagCal)
         pthisMagCal->fFitErrorpc += 1.0F / ((float) FUSION_HZ * FITERRORAGINGSECS);
+    if (pthisMagCal->iStoredValidMagCal)
+        pthisMagCal->fStoredFitErrorpc += 1.0F / ((float) FUSION_HZ * FITERRORAGINGSECS);
+
+    // queue the calibration for saving if it is from a better solver or has a fit error improved by
+    // fAutoSaveImprovementpc on the stored one. the flash write takes tens of ms so is left to
+    // SavePendingCalibrationsToNVM(), which makes it the stored one once written, so a failed write
+    // is retried. saves are at least iAutoSaveIntervalLoops apart to limit flash wear, so a run of
+    // small improvements is saved as one.
+    if ((pthisMagCal->fAutoSaveImprovementpc > 0.0F) && pthisMagCal->iValidMagCal && !pthisMagCal->iSavePending &&
+        ((pthisMagCal->iValidMagCal > pthisMagCal->iStoredValidMagCal) ||
+         (pthisMagCal->fStoredFitErrorpc - pthisMagCal->fFitErrorpc >= pthisMagCal->fAutoSaveImprovementpc)) &&
+        (!pthisMagCal->iSaveRequested || (loopcounter - pthisMagCal->iLastSaveLoop >= pthisMagCal->iAutoSaveIntervalLoops)))
+    {
+        // fV to iValidMagCal are the first 64 bytes of the structure
+        memcpy(pthisMagCal->fSaveValues, pthisMagCal, sizeof(pthisMagCal->fSaveValues));
+        pthisMagCal->fSaveFitErrorpc = pthisMagCal->fFitErrorpc;
+        pthisMagCal->iSaveValidMagCal = pthisMagCal->iValidMagCal;
+        pthisMagCal->iLastSaveLoop = loopcounter;
+        pthisMagCal->iSaveRequested = true;
+        __sync_synchronize();       // fSaveValues complete before the main loop sees iSavePending
+        pthisMagCal->iSavePending = true;
+    }
 
     return;
 } // end fRunMagCalibration()
@@ -486,12 +571,10 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
     int8_t    i,
             j,
             k;                  // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 
-    // working arrays for 4x4 matrix inversion
+    // row pointers for the 4x4 Cholesky factorization
     float   *pfRows[4];
-    int8_t    iColInd[4];
-    int8_t    iRowInd[4];
-    int8_t    iPivot[4];
 
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -520,17 +603,11 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         for (i = 0; i < 3; i++) pthisMagCal->iSumBs[i] = 0;
 
         // compute the sum of measurements in the magnetic buffer
-        for (i = 0; i < MAGBUFFSIZEX; i++)
+        for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
         {
-            for (j = 0; j < MAGBUFFSIZEY; j++)
-            {
-                if (pthisMagBuffer->index[i][j] != -1)
-                {
-                    iM++;
-                    for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
-                }
-            }
+            iM++;
+            for (k = 0; k < 3; k++)
+                pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->entry[iEntry].iBs[k];
         }
 
         // compute the magnetic buffer measurement averages with rounding
@@ -568,51 +645,53 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         int32_t  iBsZeroMean[3]; // zero mean magnetic buffer measurement (counts)
 
         // accumulate the measurement matrix elements XTX (in fmatA), XTY (in fvecA) and YTY on the zero mean measurements
-        i = pthisMagCal->itimeslice - 1;
-        for (j = 0; j < MAGBUFFSIZEY; j++)
+        // each time slice takes an equal share of the buffer entries
+        for (iEntry = ((pthisMagCal->itimeslice - 1) * pthisMagBuffer->iMagBufferCount) / MAGBUFFSIZEX;
+             iEntry < (pthisMagCal->itimeslice * pthisMagBuffer->iMagBufferCount) / MAGBUFFSIZEX; iEntry++)
         {
-            if (pthisMagBuffer->index[i][j] != -1)
-            {
-                // compute zero mean measurements
-                for (k = 0; k < 3; k++)
-                    iBsZeroMean[k] = (int32_t) pthisMagBuffer->iBs[k][i][j] - (int32_t) pthisMagCal->iMeanBs[k];
-
-                // accumulate the non-zero elements of zero mean XTX (in fmatA)
-                pthisMagCal->fmatA[0][0] += (float) (iBsZeroMean[0] * iBsZeroMean[0]);
-                pthisMagCal->fmatA[0][1] += (float) (iBsZeroMean[0] * iBsZeroMean[1]);
-                pthisMagCal->fmatA[0][2] += (float) (iBsZeroMean[0] * iBsZeroMean[2]);
-                pthisMagCal->fmatA[1][1] += (float) (iBsZeroMean[1] * iBsZeroMean[1]);
-                pthisMagCal->fmatA[1][2] += (float) (iBsZeroMean[1] * iBsZeroMean[2]);
-                pthisMagCal->fmatA[2][2] += (float) (iBsZeroMean[2] * iBsZeroMean[2]);
-
-                // accumulate XTY (in fvecA)
-                fBsZeroMeanSq = (float)
-                    (
-                        iBsZeroMean[CHX] *
-                        iBsZeroMean[CHX] +
-                        iBsZeroMean[CHY] *
-                        iBsZeroMean[CHY] +
-                        iBsZeroMean[CHZ] *
-                        iBsZeroMean[CHZ]
-                    );
-                for (k = 0; k < 3; k++)
-                    pthisMagCal->fvecA[k] += (float) iBsZeroMean[k] * fBsZeroMeanSq;
-                pthisMagCal->fvecA[3] += fBsZeroMeanSq;
+            // compute zero mean measurements
+            for (k = 0; k < 3; k++)
+                iBsZeroMean[k] = (int32_t) pthisMagBuffer->entry[iEntry].iBs[k] - (int32_t) pthisMagCal->iMeanBs[k];
+
+            // accumulate the non-zero elements of zero mean XTX (in fmatA)
+            pthisMagCal->fmatA[0][0] += (float) (iBsZeroMean[0] * iBsZeroMean[0]);
+            pthisMagCal->fmatA[0][1] += (float) (iBsZeroMean[0] * iBsZeroMean[1]);
+            pthisMagCal->fmatA[0][2] += (float) (iBsZeroMean[0] * iBsZeroMean[2]);
+            pthisMagCal->fmatA[1][1] += (float) (iBsZeroMean[1] * iBsZeroMean[1]);
+            pthisMagCal->fmatA[1][2] += (float) (iBsZeroMean[1] * iBsZeroMean[2]);
+            pthisMagCal->fmatA[2][2] += (float) (iBsZeroMean[2] * iBsZeroMean[2]);
+
+            // accumulate XTY (in fvecA)
+            fBsZeroMeanSq = (float)
+                (
+                    iBsZeroMean[CHX] *
+                    iBsZeroMean[CHX] +
+                    iBsZeroMean[CHY] *
+                    iBsZeroMean[CHY] +
+                    iBsZeroMean[CHZ] *
+                    iBsZeroMean[CHZ]
+                );
+            for (k = 0; k < 3; k++)
+                pthisMagCal->fvecA[k] += (float) iBsZeroMean[k] * fBsZeroMeanSq;
+            pthisMagCal->fvecA[3] += fBsZeroMeanSq;
 
-                // accumulate fYTY
-                pthisMagCal->fYTY += fBsZeroMeanSq * fBsZeroMeanSq;
-            }
+            // accumulate fYTY
+            pthisMagCal->fYTY += fBsZeroMeanSq * fBsZeroMeanSq;
         }
 
         // increment the time slice
         (pthisMagCal->itimeslice)++;
     }                   // end of time slices 1 to MAGBUFFSIZEX
 
-    // time slice MAGBUFFSIZEX+1: 18.3K ticks = 0.38ms on KL25Z (constant) (stored in systick[2])
-    // re-enable magnetic buffer for writing and invert fmatB = fmatA = X^T.X in situ
+    // time slice MAGBUFFSIZEX+1
+    // re-enable magnetic buffer for writing, solve the normal equations (X^T.X).beta = X^T.Y
+    // by Cholesky factorization of X^T.X (which is symmetric positive definite) and compute
+    // the calibration coefficients. This used to take two time slices with an explicit inverse.
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX + 1))
     {
-        int8_t    ierror; // matrix inversion error flag
+        float   fE;     // error function = r^T.r
+        float   ftmp;   // scratch
+        int8_t    ierror; // Cholesky factorization error flag
 
         // set fmatA[3][3] = X^T.X[3][3] to number of measurements found
         pthisMagCal->fmatA[3][3] = (float) pthisMagBuffer->iMagBufferCount;
@@ -620,38 +699,29 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         // enable the magnetic buffer for writing now that the matrices have been computed
         pthisMagCal->iMagBufferReadOnly = false;
 
-        // set fmatA and fmatB to above diagonal elements of fmatA
+        // set fmatA and fmatB to above diagonal elements of fmatA and fvecB to X^T.Y
         for (i = 0; i < 4; i++)
         {
             for (j = 0; j <= i; j++)
                 pthisMagCal->fmatB[i][j] = pthisMagCal->fmatB[j][i] = pthisMagCal->fmatA[i][j] = pthisMagCal->fmatA[j][i];
+            pthisMagCal->fvecB[i] = pthisMagCal->fvecA[i];
         }
 
-        // set fmatB = inv(fmatB) = inv(X^T.X)
+        // factor fmatB = L.L^T = X^T.X. a degenerate buffer (for example every measurement in one plane)
+        // is not positive definite so abandon the calibration attempt without a new calibration
         for (i = 0; i < 4; i++) pfRows[i] = pthisMagCal->fmatB[i];
-        fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 4, &ierror);
-
-        // increment the time slice
-        (pthisMagCal->itimeslice)++;
-    }                   // // end of time slice MAGBUFFSIZEX+1
-
-    // time slice MAGBUFFSIZEX+2: 17.2K ticks = 0.36ms on KL25Z (constant) (stored in systick[3])
-    // compute the solution vector and the calibration coefficients
-    else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX + 2))
-    {
-        float   fE;     // error function = r^T.r
-        float   ftmp;   // scratch
+        fmatrixCholeskyA(pfRows, 4, &ierror);
+        if (ierror)
+        {
+            pthisMagCal->iCalInProgress = 0;
+            return;
+        }
 
         // the trial inverse soft iron matrix invW always equals the identity matrix for 4 element calibration
         f3x3matrixAeqI(pthisMagCal->ftrinvW);
 
-        // calculate solution vector fvecB = beta (4x1) = inv(X^T.X).X^T.Y = fmatB * fvecA (counts)
-        for (i = 0; i < 4; i++)
-        {
-            pthisMagCal->fvecB[i] = pthisMagCal->fmatB[i][0] * pthisMagCal->fvecA[0];
-            for (j = 1; j < 4; j++)
-                pthisMagCal->fvecB[i] += pthisMagCal->fmatB[i][j] * pthisMagCal->fvecA[j];
-        }
+        // calculate solution vector fvecB = beta (4x1) = inv(X^T.X).X^T.Y (counts)
+        fmatrixCholeskySolve(pfRows, pthisMagCal->fvecB, 4);
 
         // compute the hard iron vector (uT) correction for zero mean data
         ftmp = 0.5F * pthisMag->fuTPerCount;
@@ -704,7 +774,7 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         // that a new 4 element calibration is available
         pthisMagCal->iCalInProgress = 0;
         pthisMagCal->iNewCalibrationAvailable = 4;
-    }                   // end of time slice MAGBUFFSIZEX+2
+    }                   // end of time slice MAGBUFFSIZEX+1
 
     return;
 } // end fUpdateMagCalibration4Slice()
@@ -720,6 +790,7 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
             j,
             k,
             l;          // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 #define MATRIX_7_SIZE   7
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -743,17 +814,11 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // compute the sum of measurements in the magnetic buffer
         iM = 0;
         for (i = 0; i < 3; i++) pthisMagCal->iSumBs[i] = 0;
-        for (i = 0; i < MAGBUFFSIZEX; i++)
+        for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
         {
-            for (j = 0; j < MAGBUFFSIZEY; j++)
-            {
-                if (pthisMagBuffer->index[i][j] != -1)
-                {
-                    iM++;
-                    for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
-                }
-            }
+            iM++;
+            for (k = 0; k < 3; k++)
+                pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->entry[iEntry].iBs[k];
         }
 
         // compute the magnetic buffer measurement averages with nearest integer rounding
@@ -787,16 +852,15 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
              (pthisMagCal->itimeslice <= MAGBUFFSIZEX * MAGBUFFSIZEY))
     {
         // accumulate the symmetric matrix fmatA on the zero mean measurements
-        i = (pthisMagCal->itimeslice - 1) / MAGBUFFSIZEY;   // matrix row i ranges 0 to MAGBUFFSIZEX-1
-        j = (pthisMagCal->itimeslice - 1) % MAGBUFFSIZEY;   // matrix column j ranges 0 to MAGBUFFSIZEY-1
-        if (pthisMagBuffer->index[i][j] != -1)
+        iEntry = pthisMagCal->itimeslice - 1;   // one buffer entry per time slice
+        if (iEntry < pthisMagBuffer->iMagBufferCount)
         {
             // set fvecA to be vector of zero mean measurements and their squares
             for (k = 0; k < 3; k++)
             {
                 pthisMagCal->fvecA[k + 3] = (float)
                     (
-                        (int32_t) pthisMagBuffer->iBs[k][i][j] -
+                        (int32_t) pthisMagBuffer->entry[iEntry].iBs[k] -
                         (int32_t) pthisMagCal->iMeanBs[k]
                     );
                 pthisMagCal->fvecA[k] = pthisMagCal->fvecA[k + 3] * pthisMagCal->fvecA[k + 3];
@@ -854,46 +918,13 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
     else if ((pthisMagCal->itimeslice >= (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) &&
              (pthisMagCal->itimeslice <= (MAGBUFFSIZEX * MAGBUFFSIZEY + 22)))
     {
-        // set k to the matrix element in range 0 to 20 to be zeroed and used it to set row i and column j
+        // rotate the next above diagonal element, in range 0 to 20, that has not yet converged.
+        // elements already zeroed are skipped within this time slice and if none remain,
+        // the next time slice is the residue check.
         k = pthisMagCal->itimeslice - (MAGBUFFSIZEX * MAGBUFFSIZEY + 2);
-        if (k < 6)
-        {
-            i = 0;
-            j = k + 1;
-        }
-        else if (k < 11)
-        {
-            i = 1;
-            j = k - 4;
-        }
-        else if (k < 15)
-        {
-            i = 2;
-            j = k - 8;
-        }
-        else if (k < 18)
-        {
-            i = 3;
-            j = k - 11;
-        }
-        else if (k < 20)
-        {
-            i = 4;
-            j = k - 13;
-        }
-        else
-        {
-            i = 5;
-            j = 6;
-        }
-
-        // only continue if matrix element i, j has not already been zeroed
-        if (fabsf(pthisMagCal->fmatA[i][j]) > 0.0F)
-            fComputeEigSlice(pthisMagCal->fmatA, pthisMagCal->fmatB,
-                             pthisMagCal->fvecA, i, j, MATRIX_7_SIZE);
-
-        // increment the time slice for the next iteration
-        (pthisMagCal->itimeslice)++;
+        k = fComputeEigSliceNext(pthisMagCal->fmatA, pthisMagCal->fmatB,
+                                 pthisMagCal->fvecA, k, MATRIX_7_SIZE);
+        pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 2 + k;
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 22 inclusive
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 23: 2.6k ticks on KL25Z = 0.05ms on KL25Z (constant) (stored in systick[4])
@@ -1007,6 +1038,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
             j,
             k,
             l;          // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 #define MATRIX_10_SIZE  10
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -1030,17 +1062,11 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // compute the sum of measurements in the magnetic buffer
         iM = 0;
         for (i = 0; i < 3; i++) pthisMagCal->iSumBs[i] = 0;
-        for (i = 0; i < MAGBUFFSIZEX; i++)
+        for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
         {
-            for (j = 0; j < MAGBUFFSIZEY; j++)
-            {
-                if (pthisMagBuffer->index[i][j] != -1)
-                {
-                    iM++;
-                    for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
-                }
-            }
+            iM++;
+            for (k = 0; k < 3; k++)
+                pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->entry[iEntry].iBs[k];
         }
 
         // compute the magnetic buffer measurement averages with nearest integer rounding
@@ -1075,15 +1101,14 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
              (pthisMagCal->itimeslice <= MAGBUFFSIZEX * MAGBUFFSIZEY))
     {
         // accumulate the symmetric matrix fmatA on the zero mean measurements
-        i = (pthisMagCal->itimeslice - 1) / MAGBUFFSIZEY;   // matrix row i ranges 0 to MAGBUFFSIZEX-1
-        j = (pthisMagCal->itimeslice - 1) % MAGBUFFSIZEY;   // matrix column j ranges 0 to MAGBUFFSIZEY-1
-        if (pthisMagBuffer->index[i][j] != -1)
+        iEntry = pthisMagCal->itimeslice - 1;   // one buffer entry per time slice
+        if (iEntry < pthisMagBuffer->iMagBufferCount)
         {
             // set fvecA[6-8] to the zero mean measurements
             for (k = 0; k < 3; k++)
                 pthisMagCal->fvecA[k + 6] = (float)
                     (
-                        (int32_t) pthisMagBuffer->iBs[k][i][j] -
+                        (int32_t) pthisMagBuffer->entry[iEntry].iBs[k] -
                         (int32_t) pthisMagCal->iMeanBs[k]
                     );
 
@@ -1153,61 +1178,13 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     else if ((pthisMagCal->itimeslice >= (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) &&
              (pthisMagCal->itimeslice <= (MAGBUFFSIZEX * MAGBUFFSIZEY + 46)))
     {
-        // set k to the matrix element of interest in range 0 to 44 to be zeroed and set row i and column j
+        // rotate the next above diagonal element, in range 0 to 44, that has not yet converged.
+        // elements already zeroed are skipped within this time slice and if none remain,
+        // the next time slice is the residue check.
         k = pthisMagCal->itimeslice - (MAGBUFFSIZEX * MAGBUFFSIZEY + 2);
-        if (k < 9)
-        {
-            i = 0;
-            j = k + 1;
-        }
-        else if (k < 17)
-        {
-            i = 1;
-            j = k - 7;
-        }
-        else if (k < 24)
-        {
-            i = 2;
-            j = k - 14;
-        }
-        else if (k < 30)
-        {
-            i = 3;
-            j = k - 20;
-        }
-        else if (k < 35)
-        {
-            i = 4;
-            j = k - 25;
-        }
-        else if (k < 39)
-        {
-            i = 5;
-            j = k - 29;
-        }
-        else if (k < 42)
-        {
-            i = 6;
-            j = k - 32;
-        }
-        else if (k < 44)
-        {
-            i = 7;
-            j = k - 34;
-        }
-        else
-        {
-            i = 8;
-            j = 9;
-        }
-
-        // only continue if matrix element i, j has not already been zeroed
-        if (fabsf(pthisMagCal->fmatA[i][j]) > 0.0F)
-            fComputeEigSlice(pthisMagCal->fmatA, pthisMagCal->fmatB,
-                             pthisMagCal->fvecA, i, j, MATRIX_10_SIZE);
-
-        // increment the time slice for the next iteration
-        (pthisMagCal->itimeslice)++;
+        k = fComputeEigSliceNext(pthisMagCal->fmatA, pthisMagCal->fmatB,
+                                 pthisMagCal->fvecA, k, MATRIX_10_SIZE);
+        pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 2 + k;
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 46 inclusive
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 47: 5.6k ticks on KL25Z = 0.12ms on KL25Z (constant) (stored in systick[4])
@@ -1445,6 +1422,7 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
             j,
             k,
             l;          // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 
     // working arrays for 4x4 matrix inversion
     float   *pfRows[4];
@@ -1474,64 +1452,58 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
 
     // use entries from magnetic buffer to compute matrices
     iCount = 0;
-    for (j = 0; j < MAGBUFFSIZEX; j++)
+    for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
     {
-        for (k = 0; k < MAGBUFFSIZEY; k++)
+        // use first valid magnetic buffer entry as estimate (in counts) for offset
+        if (iCount == 0)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            for (l = CHX; l <= CHZ; l++)
             {
-                // use first valid magnetic buffer entry as estimate (in counts) for offset
-                if (iCount == 0)
-                {
-                    for (l = CHX; l <= CHZ; l++)
-                    {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
-                    }
-                }
-
-                // store scaled and offset fBs[XYZ] in fvecA[0-2] and fBs[XYZ]^2 in fvecA[3-5]
-                for (l = CHX; l <= CHZ; l++)
-                {
-                    pthisMagCal->fvecA[l] = (float)
-                        (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
-                            (int32_t) iOffset[l]
-                        ) * fscaling;
-                    pthisMagCal->fvecA[l + 3] = pthisMagCal->fvecA[l] * pthisMagCal->fvecA[l];
-                }
+                iOffset[l] = pthisMagBuffer->entry[iEntry].iBs[l];
+            }
+        }
 
-                // calculate fBs2 = fBs[CHX]^2 + fBs[CHY]^2 + fBs[CHZ]^2 (scaled uT^2)
-                fBs2 = pthisMagCal->fvecA[3] +
-                    pthisMagCal->fvecA[4] +
-                    pthisMagCal->fvecA[5];
+        // store scaled and offset fBs[XYZ] in fvecA[0-2] and fBs[XYZ]^2 in fvecA[3-5]
+        for (l = CHX; l <= CHZ; l++)
+        {
+            pthisMagCal->fvecA[l] = (float)
+                (
+                    (int32_t) pthisMagBuffer->entry[iEntry].iBs[l] -
+                    (int32_t) iOffset[l]
+                ) * fscaling;
+            pthisMagCal->fvecA[l + 3] = pthisMagCal->fvecA[l] * pthisMagCal->fvecA[l];
+        }
 
-                // accumulate fBs^4 over all measurements into fSumBs4=Y^T.Y
-                fSumBs4 += fBs2 * fBs2;
+        // calculate fBs2 = fBs[CHX]^2 + fBs[CHY]^2 + fBs[CHZ]^2 (scaled uT^2)
+        fBs2 = pthisMagCal->fvecA[3] +
+            pthisMagCal->fvecA[4] +
+            pthisMagCal->fvecA[5];
 
-                // now we have fBs2, accumulate fvecB[0-2] = X^T.Y =sum(fBs2.fBs[XYZ])
-                for (l = CHX; l <= CHZ; l++)
-                {
-                    pthisMagCal->fvecB[l] += pthisMagCal->fvecA[l] * fBs2;
-                }
+        // accumulate fBs^4 over all measurements into fSumBs4=Y^T.Y
+        fSumBs4 += fBs2 * fBs2;
 
-                //accumulate fvecB[3] = X^T.Y =sum(fBs2)
-                pthisMagCal->fvecB[3] += fBs2;
-
-                // accumulate on and above-diagonal terms of fmatA = X^T.X ignoring fmatA[3][3]
-                pthisMagCal->fmatA[0][0] += pthisMagCal->fvecA[CHX + 3];
-                pthisMagCal->fmatA[0][1] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHY];
-                pthisMagCal->fmatA[0][2] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHZ];
-                pthisMagCal->fmatA[0][3] += pthisMagCal->fvecA[CHX];
-                pthisMagCal->fmatA[1][1] += pthisMagCal->fvecA[CHY + 3];
-                pthisMagCal->fmatA[1][2] += pthisMagCal->fvecA[CHY] * pthisMagCal->fvecA[CHZ];
-                pthisMagCal->fmatA[1][3] += pthisMagCal->fvecA[CHY];
-                pthisMagCal->fmatA[2][2] += pthisMagCal->fvecA[CHZ + 3];
-                pthisMagCal->fmatA[2][3] += pthisMagCal->fvecA[CHZ];
-
-                // increment the counter for next iteration
-                iCount++;
-            }
+        // now we have fBs2, accumulate fvecB[0-2] = X^T.Y =sum(fBs2.fBs[XYZ])
+        for (l = CHX; l <= CHZ; l++)
+        {
+            pthisMagCal->fvecB[l] += pthisMagCal->fvecA[l] * fBs2;
         }
+
+        //accumulate fvecB[3] = X^T.Y =sum(fBs2)
+        pthisMagCal->fvecB[3] += fBs2;
+
+        // accumulate on and above-diagonal terms of fmatA = X^T.X ignoring fmatA[3][3]
+        pthisMagCal->fmatA[0][0] += pthisMagCal->fvecA[CHX + 3];
+        pthisMagCal->fmatA[0][1] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHY];
+        pthisMagCal->fmatA[0][2] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHZ];
+        pthisMagCal->fmatA[0][3] += pthisMagCal->fvecA[CHX];
+        pthisMagCal->fmatA[1][1] += pthisMagCal->fvecA[CHY + 3];
+        pthisMagCal->fmatA[1][2] += pthisMagCal->fvecA[CHY] * pthisMagCal->fvecA[CHZ];
+        pthisMagCal->fmatA[1][3] += pthisMagCal->fvecA[CHY];
+        pthisMagCal->fmatA[2][2] += pthisMagCal->fvecA[CHZ + 3];
+        pthisMagCal->fmatA[2][3] += pthisMagCal->fvecA[CHZ];
+
+        // increment the counter for next iteration
+        iCount++;
     }
 
     // set the last element of the measurement matrix to the number of buffer elements used
@@ -1636,10 +1608,10 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     int16_t   iCount;     // number of measurements counted
     int8_t    i,
             j,
-            k,
             l,
             m,
             n;          // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 
     // compute fscaling to reduce multiplications later
     fscaling = pthisMag->fuTPerCount / DEFAULTB;
@@ -1658,54 +1630,48 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
 
     // add magnetic buffer entries into product matrix fmatA
     iCount = 0;
-    for (j = 0; j < MAGBUFFSIZEX; j++)
+    for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
     {
-        for (k = 0; k < MAGBUFFSIZEY; k++)
+        // use first valid magnetic buffer entry as offset estimate (bit counts)
+        if (iCount == 0)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            for (l = CHX; l <= CHZ; l++)
             {
-                // use first valid magnetic buffer entry as offset estimate (bit counts)
-                if (iCount == 0)
-                {
-                    for (l = CHX; l <= CHZ; l++)
-                    {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
-                    }
-                }
-
-                // apply the offset and scaling and store in fvecA
-                for (l = CHX; l <= CHZ; l++)
-                {
-                    pthisMagCal->fvecA[l + 3] = (float)
-                        (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
-                            (int32_t) iOffset[l]
-                        ) * fscaling;
-                    pthisMagCal->fvecA[l] = pthisMagCal->fvecA[l + 3] * pthisMagCal->fvecA[l + 3];
-                }
+                iOffset[l] = pthisMagBuffer->entry[iEntry].iBs[l];
+            }
+        }
 
-                // accumulate the on-and above-diagonal terms of pthisMagCal->fmatA=Sigma{fvecA^T * fvecA}
-                // with the exception of fmatA[6][6] which will sum to the number of measurements
-                // and remembering that fvecA[6] equals 1.0F
-                // update the right hand column [6] of fmatA except for fmatA[6][6]
-                for (m = 0; m < 6; m++)
-                {
-                    pthisMagCal->fmatA[m][6] += pthisMagCal->fvecA[m];
-                }
+        // apply the offset and scaling and store in fvecA
+        for (l = CHX; l <= CHZ; l++)
+        {
+            pthisMagCal->fvecA[l + 3] = (float)
+                (
+                    (int32_t) pthisMagBuffer->entry[iEntry].iBs[l] -
+                    (int32_t) iOffset[l]
+                ) * fscaling;
+            pthisMagCal->fvecA[l] = pthisMagCal->fvecA[l + 3] * pthisMagCal->fvecA[l + 3];
+        }
 
-                // update the on and above diagonal terms except for right hand column 6
-                for (m = 0; m < 6; m++)
-                {
-                    for (n = m; n < 6; n++)
-                    {
-                        pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
-                    }
-                }
+        // accumulate the on-and above-diagonal terms of pthisMagCal->fmatA=Sigma{fvecA^T * fvecA}
+        // with the exception of fmatA[6][6] which will sum to the number of measurements
+        // and remembering that fvecA[6] equals 1.0F
+        // update the right hand column [6] of fmatA except for fmatA[6][6]
+        for (m = 0; m < 6; m++)
+        {
+            pthisMagCal->fmatA[m][6] += pthisMagCal->fvecA[m];
+        }
 
-                // increment the measurement counter for the next iteration
-                iCount++;
+        // update the on and above diagonal terms except for right hand column 6
+        for (m = 0; m < 6; m++)
+        {
+            for (n = m; n < 6; n++)
+            {
+                pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
             }
         }
+
+        // increment the measurement counter for the next iteration
+        iCount++;
     }
 
     // finally set the last element fmatA[6][6] to the number of measurements
@@ -1803,6 +1769,7 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
             l,
             m,
             n;              // loop counters
+    int16_t   iEntry;     // magnetic buffer entry counter
 
     // compute fscaling to reduce multiplications later
     fscaling = pthisMag->fuTPerCount / DEFAULTB;
@@ -1821,66 +1788,60 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
 
     // add magnetic buffer entries into the 10x10 product matrix fmatA
     iCount = 0;
-    for (j = 0; j < MAGBUFFSIZEX; j++)
+    for (iEntry = 0; iEntry < pthisMagBuffer->iMagBufferCount; iEntry++)
     {
-        for (k = 0; k < MAGBUFFSIZEY; k++)
+        // use first valid magnetic buffer entry as estimate for offset to help solution (bit counts)
+        if (iCount == 0)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            for (l = CHX; l <= CHZ; l++)
             {
-                // use first valid magnetic buffer entry as estimate for offset to help solution (bit counts)
-                if (iCount == 0)
-                {
-                    for (l = CHX; l <= CHZ; l++)
-                    {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
-                    }
-                }
+                iOffset[l] = pthisMagBuffer->entry[iEntry].iBs[l];
+            }
+        }
 
-                // apply the fixed offset and scaling and enter into fvecA[6-8]
-                for (l = CHX; l <= CHZ; l++)
-                {
-                    pthisMagCal->fvecA[l + 6] = (float)
-                        (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
-                            (int32_t) iOffset[l]
-                        ) * fscaling;
-                }
+        // apply the fixed offset and scaling and enter into fvecA[6-8]
+        for (l = CHX; l <= CHZ; l++)
+        {
+            pthisMagCal->fvecA[l + 6] = (float)
+                (
+                    (int32_t) pthisMagBuffer->entry[iEntry].iBs[l] -
+                    (int32_t) iOffset[l]
+                ) * fscaling;
+        }
 
-                // compute measurement vector elements fvecA[0-5] from fvecA[6-8]
-                pthisMagCal->fvecA[0] = pthisMagCal->fvecA[6] * pthisMagCal->fvecA[6];
-                pthisMagCal->fvecA[1] = 2.0F *
-                    pthisMagCal->fvecA[6] *
-                    pthisMagCal->fvecA[7];
-                pthisMagCal->fvecA[2] = 2.0F *
-                    pthisMagCal->fvecA[6] *
-                    pthisMagCal->fvecA[8];
-                pthisMagCal->fvecA[3] = pthisMagCal->fvecA[7] * pthisMagCal->fvecA[7];
-                pthisMagCal->fvecA[4] = 2.0F *
-                    pthisMagCal->fvecA[7] *
-                    pthisMagCal->fvecA[8];
-                pthisMagCal->fvecA[5] = pthisMagCal->fvecA[8] * pthisMagCal->fvecA[8];
-
-                // accumulate the on-and above-diagonal terms of fmatA=Sigma{fvecA^T * fvecA}
-                // with the exception of fmatA[9][9] which equals the number of measurements
-                // update the right hand column [9] of fmatA[0-8][9] ignoring fmatA[9][9]
-                for (m = 0; m < 9; m++)
-                {
-                    pthisMagCal->fmatA[m][9] += pthisMagCal->fvecA[m];
-                }
+        // compute measurement vector elements fvecA[0-5] from fvecA[6-8]
+        pthisMagCal->fvecA[0] = pthisMagCal->fvecA[6] * pthisMagCal->fvecA[6];
+        pthisMagCal->fvecA[1] = 2.0F *
+            pthisMagCal->fvecA[6] *
+            pthisMagCal->fvecA[7];
+        pthisMagCal->fvecA[2] = 2.0F *
+            pthisMagCal->fvecA[6] *
+            pthisMagCal->fvecA[8];
+        pthisMagCal->fvecA[3] = pthisMagCal->fvecA[7] * pthisMagCal->fvecA[7];
+        pthisMagCal->fvecA[4] = 2.0F *
+            pthisMagCal->fvecA[7] *
+            pthisMagCal->fvecA[8];
+        pthisMagCal->fvecA[5] = pthisMagCal->fvecA[8] * pthisMagCal->fvecA[8];
 
-                // update the on and above diagonal terms of fmatA ignoring right hand column 9
-                for (m = 0; m < 9; m++)
-                {
-                    for (n = m; n < 9; n++)
-                    {
-                        pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
-                    }
-                }
+        // accumulate the on-and above-diagonal terms of fmatA=Sigma{fvecA^T * fvecA}
+        // with the exception of fmatA[9][9] which equals the number of measurements
+        // update the right hand column [9] of fmatA[0-8][9] ignoring fmatA[9][9]
+        for (m = 0; m < 9; m++)
+        {
+            pthisMagCal->fmatA[m][9] += pthisMagCal->fvecA[m];
+        }
 
-                // increment the measurement counter for the next iteration
-                iCount++;
+        // update the on and above diagonal terms of fmatA ignoring right hand column 9
+        for (m = 0; m < 9; m++)
+        {
+            for (n = m; n < 9; n++)
+            {
+                pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
             }
         }
+
+        // increment the measurement counter for the next iteration
+        iCount++;
     }
 
     // set the last element fmatA[9][9] to the number of measurements
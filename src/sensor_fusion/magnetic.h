@@ -18,6 +18,8 @@
 #ifndef MAGNETIC_H
 #define MAGNETIC_H
 
+#include "calibration_scratch.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,24 +36,42 @@ extern "C" {
 #define MINMEASUREMENTS4CAL 110			///< minimum number of measurements for 4 element calibration
 #define MINMEASUREMENTS7CAL 220			///< minimum number of measurements for 7 element calibration
 #define MINMEASUREMENTS10CAL 330		///< minimum number of measurements for 10 element calibration
-#define MAXMEASUREMENTS 360			///< maximum number of measurements used for calibration
+#define MAXMEASUREMENTS 360			///< maximum number of measurements used for calibration (up to MAGBUFFSIZEX * MAGBUFFSIZEY)
 #define CAL_INTERVAL_SECS 300			///< 300s or 5min interval for regular calibration checks
 #define MINBFITUT 10.0F				///< minimum acceptable geomagnetic field B (uT) for valid calibration
 #define MAXBFITUT 90.0F				///< maximum acceptable geomagnetic field B (uT) for valid calibration
 #define FITERRORAGINGSECS 86400.0F		///< 24 hours: time (s) for fit error to increase (age) by e=2.718
 #define MESHDELTACOUNTS 50			///< magnetic buffer mesh spacing in counts (here 5uT)
 #define DEFAULTB 50.0F				///< default geomagnetic field (uT)
+#define MAGCAL_AUTOSAVE_IMPROVEMENT_PC 0.5F	///< default fit error improvement (%) on the stored calibration that is saved automatically, 0 disables
+#define MAGCAL_AUTOSAVE_INTERVAL_SECS 600	///< default minimum time (s) between automatic saves, limits flash wear
 ///@}
 
+// iUpdateMagBuffer() relies on an empty bin existing whenever the buffer is not full
+#if MAXMEASUREMENTS > MAGBUFFSIZEX * MAGBUFFSIZEY
+#error "MAXMEASUREMENTS must not exceed the number of magnetometer buffer bins"
+#endif
+
+/// One measurement in the magnetometer buffer
+struct MagBufferEntry
+{
+	int16_t iBs[3];					///< uncalibrated magnetometer reading (counts)
+	uint16_t iStamp;				///< loopcounter when stored, relative to iStampBase
+	uint16_t iBin;					///< constellation bin j * MAGBUFFSIZEY + k of this reading
+};
+
 /// The Magnetometer Measurement Buffer holds a 3-dimensional "constellation"
 /// of data points.
 ///
 /// The constellation of points are used to compute magnetic hard/soft iron compensation terms.
 /// The contents of this buffer are updated on a continuing basis.
+/// Each of the MAGBUFFSIZEX x MAGBUFFSIZEY bins holds at most one measurement. Only occupied
+/// bins are stored, packed into entry[0] to entry[iMagBufferCount - 1] in no particular order,
+/// so RAM grows with MAXMEASUREMENTS (10 bytes each) rather than with the number of bins.
 struct MagBuffer
 {
-	int16_t iBs[3][MAGBUFFSIZEX][MAGBUFFSIZEY];		///< uncalibrated magnetometer readings
-	int32_t index[MAGBUFFSIZEX][MAGBUFFSIZEY];		///< array of time indices
+	struct MagBufferEntry entry[MAXMEASUREMENTS];		///< active measurements
+	int32_t iStampBase;					///< loopcounter corresponding to iStamp 0
 	int16_t tanarray[MAGBUFFSIZEX - 1];			///< array of tangents of (100 * angle)
 	int16_t iMagBufferCount;				///< number of magnetometer readings
 };
@@ -74,10 +94,11 @@ struct MagCalibration
 	float ftrFitErrorpc;			        ///< trial value of fit error %
 	float fA[3][3];					///< ellipsoid matrix A
 	float finvA[3][3];				///< inverse of ellipsoid matrix A
-	float fmatA[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
-	float fmatB[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
-	float fvecA[10];				///< scratch 10x1 vector used by calibration algorithms
-	float fvecB[4];					///< scratch 4x1 vector used by calibration algorithms
+	CalibrationScratch *pScratch;			///< scratch arena shared with the accelerometer calibration
+	float (*fmatA)[CAL_SCRATCH_DIM];		///< scratch 10x10 float matrix in pScratch
+	float (*fmatB)[CAL_SCRATCH_DIM];		///< scratch 10x10 float matrix in pScratch
+	float *fvecA;					///< scratch 10x1 vector in pScratch
+	float *fvecB;					///< scratch 4x1 vector in pScratch
 	float fYTY;					///< Y^T.Y for 4 element calibration = (iB^2)^2
 	int32_t iSumBs[3];				///< sum of measurements in buffer (counts)
 	int32_t iMeanBs[3];				///< average magnetic measurement (counts)
@@ -89,6 +110,18 @@ struct MagCalibration
 	int8_t i4ElementSolverTried;		        ///< flag to denote at least one attempt made with 4 element calibration
 	int8_t i7ElementSolverTried;		        ///< flag to denote at least one attempt made with 7 element calibration
 	int8_t i10ElementSolverTried;		        ///< flag to denote at least one attempt made with 10 element calibration
+	// automatic saving of improved calibrations, see fRunMagCalibration(). fInitializeMagCalibration()
+	// resets the state but not the two settings, which are set by initSensorFusionGlobals()
+	float fAutoSaveImprovementpc;			///< fit error improvement (%) on the stored calibration that triggers a save, 0 disables
+	int32_t iAutoSaveIntervalLoops;			///< minimum number of fusion cycles between automatic saves
+	float fStoredFitErrorpc;			///< fit error of the stored calibration, aged like fFitErrorpc (100 if none)
+	int32_t iStoredValidMagCal;			///< solver of the stored calibration (0 if none)
+	int32_t iLastSaveLoop;				///< loopcounter of the last automatic save request
+	int8_t iSaveRequested;				///< flag denoting an automatic save was requested since initialization
+	volatile int8_t iSavePending;			///< flag denoting fSaveValues awaits writing by SavePendingCalibrationsToNVM()
+	float fSaveValues[16];				///< copy of fV to iValidMagCal to be saved
+	float fSaveFitErrorpc;				///< fit error of fSaveValues, fStoredFitErrorpc once written
+	int32_t iSaveValidMagCal;			///< solver of fSaveValues, iStoredValidMagCal once written
 };
 
 
@@ -100,6 +133,8 @@ struct MagSensor;  // actual typedef is located in sensor_fusion_types.h
 /// as details are provided in sensor_fusion.h.
 ///@{
 void fInitializeMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer);
+void fSetMagCalibrationDefault(struct MagCalibration *pthisMagCal);
+int16_t iMagBufferFind(const struct MagBuffer *pthisMagBuffer, int16_t iBin);
 void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag, int32_t loopcounter);
 void fInvertMagCal(struct MagSensor *pthisMag, struct MagCalibration *pthisMagCal);
 void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor* pthisMag, int32_t loopcounter);
@@ -205,6 +205,17 @@ float f3x3matrixDetA(float A[][3])
         );
 }
 
+// returns true if the off-diagonal element Aij is too small to change the diagonal elements
+// eigi and eigj in float precision. A Jacobi rotation on it would only churn rounding errors,
+// so the eigensolvers set it to zero instead, which ends the iterations as soon as the
+// decomposition has converged to float precision rather than when every element is exactly zero.
+static int8_t isJacobiNegligible(float Aij, float eigi, float eigj)
+{
+    float   g = 100.0F * fabsf(Aij);    // element scaled by a safety margin
+
+    return ((fabsf(eigi) + g == fabsf(eigi)) && (fabsf(eigj) + g == fabsf(eigj)));
+}
+
 // function computes all eigenvalues and eigenvectors of a real symmetric matrix A[0..n-1][0..n-1]
 // stored in the top left of a 10x10 array A[10][10]
 // A[][] is changed on output.
@@ -283,6 +294,12 @@ void fEigenCompute10(float A[][10], float eigval[], float eigvec[][10], int8_t n
                 // loop over columns j (where j is always greater than i since above diagonal)
                 for (j = i + 1; j < n; j++)
                 {
+                    // zero elements that are already negligible compared with the diagonal
+                    if (isJacobiNegligible(A[i][j], eigval[i], eigval[j]))
+                    {
+                        A[i][j] = 0.0F;
+                    }
+
                     // only continue with this element if the element is non-zero
                     if (fabsf(A[i][j]) > 0.0F)
                     {
@@ -641,6 +658,115 @@ void fComputeEigSlice(float fmatA[10][10], float fmatB[10][10], float fvecA[10],
     return;
 }
 
+// performs one time slice of the Jacobi eigen-decomposition used by the time sliced magnetic
+// calibration. Above diagonal elements of fmatA are numbered in row order from 0 to
+// iMatrixSize * (iMatrixSize - 1) / 2 - 1. Starting from element k, elements that are zero or
+// negligible are skipped (and zeroed) and the first remaining element is rotated to zero.
+// returns the number of the element following the one rotated, or the number of above diagonal
+// elements if the rest of the sweep had nothing to rotate, so the caller need not spend a time
+// slice on each element that has already converged.
+int8_t fComputeEigSliceNext(float fmatA[10][10], float fmatB[10][10], float fvecA[10],
+                            int8_t k, int8_t iMatrixSize)
+{
+    int8_t    i, j;       // row and column of element k
+    int8_t    kelement;   // number of element i, j
+
+    // find row i and column j of element k
+    i = 0;
+    kelement = 0;
+    while ((i < iMatrixSize - 1) && (kelement + (iMatrixSize - 1 - i) <= k))
+    {
+        kelement += iMatrixSize - 1 - i;
+        i++;
+    }
+    j = i + 1 + (k - kelement);
+
+    // scan the rest of the sweep in row order
+    for (; i < iMatrixSize - 1; i++, j = i + 1)
+    {
+        for (; j < iMatrixSize; j++, k++)
+        {
+            if (isJacobiNegligible(fmatA[i][j], fvecA[i], fvecA[j]))
+                fmatA[i][j] = 0.0F;
+
+            if (fabsf(fmatA[i][j]) > 0.0F)
+            {
+                fComputeEigSlice(fmatA, fmatB, fvecA, i, j, iMatrixSize);
+                return (int8_t) (k + 1);
+            }
+        }
+    }
+
+    return k;
+}
+
+// function computes the Cholesky factorization A = L.L^T of a symmetric positive definite matrix A in situ
+// only the on and below diagonal elements of A are used and they are replaced with L.
+// the above diagonal elements of A are not changed.
+// *pierror is set to true if A is not positive definite to float precision, in which case A is undefined
+void fmatrixCholeskyA(float *A[], int8_t isize, int8_t *pierror)
+{
+    float   fsum;       // accumulator
+    int8_t    i,
+            j,
+            k;          // index counters
+
+    // default to successful factorization
+    *pierror = false;
+
+    // loop over the columns of L
+    for (j = 0; j < isize; j++)
+    {
+        // compute the diagonal element L[j][j] = sqrt(A[j][j] - sum(L[j][k]^2))
+        fsum = A[j][j];
+        for (k = 0; k < j; k++)
+            fsum -= A[j][k] * A[j][k];
+        if (fsum <= 0.0F)
+        {
+            *pierror = true;
+            return;
+        }
+        A[j][j] = sqrtf(fsum);
+
+        // compute the below diagonal elements of column j
+        for (i = j + 1; i < isize; i++)
+        {
+            fsum = A[i][j];
+            for (k = 0; k < j; k++)
+                fsum -= A[i][k] * A[j][k];
+            A[i][j] = fsum / A[j][j];
+        }
+    }
+
+    return;
+}
+
+// function solves L.L^T.x = b for x in situ, where L is the Cholesky factor computed by fmatrixCholeskyA()
+// on exit, b is replaced with the solution x
+void fmatrixCholeskySolve(float *L[], float b[], int8_t isize)
+{
+    int8_t    i,
+            k;          // index counters
+
+    // forward substitution to solve L.y = b
+    for (i = 0; i < isize; i++)
+    {
+        for (k = 0; k < i; k++)
+            b[i] -= L[i][k] * b[k];
+        b[i] /= L[i][i];
+    }
+
+    // back substitution to solve L^T.x = y
+    for (i = isize - 1; i >= 0; i--)
+    {
+        for (k = i + 1; k < isize; k++)
+            b[i] -= L[k][i] * b[k];
+        b[i] /= L[i][i];
+    }
+
+    return;
+}
+
 // function uses Gauss-Jordan elimination to compute the inverse of matrix A in situ
 
 // on exit, A is replaced with its inverse
@@ -87,6 +87,29 @@ void fComputeEigSlice(
     int8_t j, 
     int8_t iMatrixSize
 );
+/// function performs the Jacobi rotation for the first above diagonal element of fmatA, counting
+/// in row order from element k, that has not converged. Returns the number of the following element,
+/// which equals iMatrixSize * (iMatrixSize - 1) / 2 at the end of the sweep.
+int8_t fComputeEigSliceNext(
+    float fmatA[10][10], 
+    float fmatB[10][10], 
+    float fvecA[10], 
+    int8_t k,                   ///< number of the first above diagonal element to consider
+    int8_t iMatrixSize
+);
+/// function computes the Cholesky factorization A = L.L^T of a symmetric positive definite matrix in situ
+/// on exit, the on and below diagonal elements of A are replaced with L
+void fmatrixCholeskyA(
+    float *A[],                 ///< pointers to the rows of A
+    int8_t isize,               ///< dimension of A
+    int8_t *pierror             ///< set to true if A is not positive definite
+);
+/// function solves L.L^T.x = b in situ using the Cholesky factor L from fmatrixCholeskyA()
+void fmatrixCholeskySolve(
+    float *L[],                 ///< pointers to the rows of L
+    float b[],                  ///< right hand side b (input), solution x (output)
+    int8_t isize                ///< dimension of L
+);
 /// function uses Gauss-Jordan elimination to compute the inverse of matrix A in situ
 /// on exit, A is replaced with its inverse
 void fmatrixAeqInvA(
@@ -31,6 +31,18 @@
 #define CORRUPTQUAT 0.001F	// threshold for deciding rotation quaternion is corrupt
 #define SMALLMODULUS 0.01F	// limit where rounding errors may appear
 
+// 4-lane float SIMD for the quaternion products where the compiler provides it (host builds
+// for replay and analysis). The Xtensa cores of the ESP32 family have no float SIMD lanes
+// (ESP32-S3 PIE is integer only), so they and any other target use the scalar code.
+// Define F_QUATERNION_SCALAR to force the scalar code.
+#if !defined(F_QUATERNION_SCALAR) && defined(__SSE__)
+#include <xmmintrin.h>
+#define F_QUATERNION_SSE 1
+#elif !defined(F_QUATERNION_SCALAR) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define F_QUATERNION_NEON 1
+#endif
+
 #if F_USING_ACCEL  // Need tilt conversion routines
 // Aerospace NED accelerometer 3DOF tilt function computing rotation matrix fR
 #if (THISCOORDSYSTEM == NED) || (THISCOORDSYSTEM == ANDROID)
@@ -536,6 +548,21 @@ void fNEDAnglesDegFromRotationMatrix(float R[][3], float *pfPhiDeg, float *pfThe
 
 	return;
 }
+
+// batch version of fNEDAnglesDegFromRotationMatrix(). The angle functions are out of line
+// so this loop is not vectorized, but it writes each angle to its own contiguous array.
+void fNEDAnglesDegFromRotationMatrixBatch(float R[][3][3], uint32_t iCount, float fPhiDeg[],
+		float fTheDeg[], float fPsiDeg[], float fRhoDeg[], float fChiDeg[])
+{
+	uint32_t n;			// matrix counter
+
+	for (n = 0; n < iCount; n++)
+	{
+		fNEDAnglesDegFromRotationMatrix(R[n], &fPhiDeg[n], &fTheDeg[n], &fPsiDeg[n], &fRhoDeg[n], &fChiDeg[n]);
+	}
+
+	return;
+}
 #endif // #if THISCOORDSYSTEM == NED
 
 // extract the Android angles in degrees from the Android rotation matrix
@@ -837,6 +864,139 @@ void fRotationMatrixFromQuaternion(float R[][3], const Quaternion *pq)
 	return;
 }
 
+// loop of fQuaternionFromRotationMatrixBatch(). Both the general and the near 180 deg cases
+// are evaluated for every matrix and the result selected, so the loop has no branches.
+// The output arrays are restrict qualified so the compiler can vectorize the loop. GCC only
+// does so with -fno-math-errno -fno-trapping-math since the division is otherwise kept
+// conditional; without those flags the loop runs as scalar code with identical results.
+static void fQuaternionFromRotationMatrixLoop(float *restrict pq0, float *restrict pq1, float *restrict pq2,
+		float *restrict pq3, const RotationMatrixArrays *pR, uint32_t iCount)
+{
+	const float *restrict pRxx = pR->R[CHX][CHX];
+	const float *restrict pRxy = pR->R[CHX][CHY];
+	const float *restrict pRxz = pR->R[CHX][CHZ];
+	const float *restrict pRyx = pR->R[CHY][CHX];
+	const float *restrict pRyy = pR->R[CHY][CHY];
+	const float *restrict pRyz = pR->R[CHY][CHZ];
+	const float *restrict pRzx = pR->R[CHZ][CHX];
+	const float *restrict pRzy = pR->R[CHZ][CHY];
+	const float *restrict pRzz = pR->R[CHZ][CHZ];
+	uint32_t n;			// matrix counter
+
+	for (n = 0; n < iCount; n++)
+	{
+		float fq0sq;		// q0^2
+		float recip4q0;		// 1/4q0
+		float fd1, fd2, fd3;	// differenced off-diagonal terms
+		float fs1, fs2, fs3;	// q1 to q3 for the near 180 deg case
+		float q0, q1, q2, q3;	// un-normalized quaternion
+		float fNorm;		// quaternion Norm
+		int8_t isGeneral;	// q0 is large enough for the general case
+		int8_t isValid;		// quaternion is not corrupt
+
+		fq0sq = 0.25F * (1.0F + pRxx[n] + pRyy[n] + pRzz[n]);
+		q0 = sqrtf(fabsf(fq0sq));
+		fd1 = pRyz[n] - pRzy[n];
+		fd2 = pRzx[n] - pRxz[n];
+		fd3 = pRxy[n] - pRyx[n];
+
+		// general case (the division result is discarded when q0 is small)
+		recip4q0 = 0.25F / q0;
+
+		// near 180 deg case with signs taken from the differenced off-diagonal terms
+		fs1 = sqrtf(fabsf(0.5F + 0.5F * pRxx[n] - fq0sq));
+		fs2 = sqrtf(fabsf(0.5F + 0.5F * pRyy[n] - fq0sq));
+		fs3 = sqrtf(fabsf(0.5F + 0.5F * pRzz[n] - fq0sq));
+		fs1 = (fd1 < 0.0F) ? -fs1 : fs1;
+		fs2 = (fd2 < 0.0F) ? -fs2 : fs2;
+		fs3 = (fd3 < 0.0F) ? -fs3 : fs3;
+
+		isGeneral = (q0 > SMALLQ0);
+		q1 = isGeneral ? recip4q0 * fd1 : fs1;
+		q2 = isGeneral ? recip4q0 * fd2 : fs2;
+		q3 = isGeneral ? recip4q0 * fd3 : fs3;
+
+		// normalize as fqAeqNormqA(). q0 is never negative here so no sign correction is needed.
+		fNorm = sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+		isValid = (fNorm > CORRUPTQUAT);
+		fNorm = 1.0F / fNorm;
+		pq0[n] = isValid ? q0 * fNorm : 1.0F;
+		pq1[n] = isValid ? q1 * fNorm : 0.0F;
+		pq2[n] = isValid ? q2 * fNorm : 0.0F;
+		pq3[n] = isValid ? q3 * fNorm : 0.0F;
+	}
+
+	return;
+}
+
+// batch version of fQuaternionFromRotationMatrix(). Results are identical to the single matrix function.
+void fQuaternionFromRotationMatrixBatch(const RotationMatrixArrays *pR, uint32_t iCount, const QuaternionArrays *pq)
+{
+	fQuaternionFromRotationMatrixLoop(pq->q0, pq->q1, pq->q2, pq->q3, pR, iCount);
+
+	return;
+}
+
+// loop of fRotationMatrixFromQuaternionBatch(). The output arrays are passed as restrict
+// qualified arguments so the compiler knows they do not overlap and can vectorize the loop.
+static void fRotationMatrixFromQuaternionLoop(float *restrict pRxx, float *restrict pRxy, float *restrict pRxz,
+		float *restrict pRyx, float *restrict pRyy, float *restrict pRyz, float *restrict pRzx,
+		float *restrict pRzy, float *restrict pRzz, const Quaternion *restrict pq, uint32_t iCount)
+{
+	uint32_t n;			// quaternion counter
+
+	for (n = 0; n < iCount; n++)
+	{
+		float q0 = pq[n].q0;
+		float q1 = pq[n].q1;
+		float q2 = pq[n].q2;
+		float q3 = pq[n].q3;
+		float f2q;
+		float f2q0q0, f2q0q1, f2q0q2, f2q0q3;
+		float f2q1q1, f2q1q2, f2q1q3;
+		float f2q2q2, f2q2q3;
+		float f2q3q3;
+
+		// same products and operation order as fRotationMatrixFromQuaternion()
+		f2q = 2.0F * q0;
+		f2q0q0 = f2q * q0;
+		f2q0q1 = f2q * q1;
+		f2q0q2 = f2q * q2;
+		f2q0q3 = f2q * q3;
+		f2q = 2.0F * q1;
+		f2q1q1 = f2q * q1;
+		f2q1q2 = f2q * q2;
+		f2q1q3 = f2q * q3;
+		f2q = 2.0F * q2;
+		f2q2q2 = f2q * q2;
+		f2q2q3 = f2q * q3;
+		f2q3q3 = 2.0F * q3 * q3;
+
+		pRxx[n] = f2q0q0 + f2q1q1 - 1.0F;
+		pRxy[n] = f2q1q2 + f2q0q3;
+		pRxz[n] = f2q1q3 - f2q0q2;
+		pRyx[n] = f2q1q2 - f2q0q3;
+		pRyy[n] = f2q0q0 + f2q2q2 - 1.0F;
+		pRyz[n] = f2q2q3 + f2q0q1;
+		pRzx[n] = f2q1q3 + f2q0q2;
+		pRzy[n] = f2q2q3 - f2q0q1;
+		pRzz[n] = f2q0q0 + f2q3q3 - 1.0F;
+	}
+
+	return;
+}
+
+// batch version of fRotationMatrixFromQuaternion(). Straight line arithmetic per quaternion
+// writing to separate arrays, so the loop can be vectorized.
+void fRotationMatrixFromQuaternionBatch(const RotationMatrixArrays *pR, const Quaternion pq[], uint32_t iCount)
+{
+	fRotationMatrixFromQuaternionLoop(pR->R[CHX][CHX], pR->R[CHX][CHY], pR->R[CHX][CHZ],
+			pR->R[CHY][CHX], pR->R[CHY][CHY], pR->R[CHY][CHZ],
+			pR->R[CHZ][CHX], pR->R[CHZ][CHY], pR->R[CHZ][CHZ], pq, iCount);
+
+	return;
+}
+
 // computes rotation vector (deg) from rotation quaternion
 void fRotationVectorDegFromQuaternion(Quaternion *pq, float rvecdeg[])
 {
@@ -933,13 +1093,49 @@ void fLPFOrientationQuaternion(Quaternion *pq, Quaternion *pLPq, float flpf, flo
 	return;
 }
 
+#if F_QUATERNION_SSE || F_QUATERNION_NEON
+// quaternion product qA = qB * qC, four lanes at a time. Each lane sums its four products in the
+// same order as the scalar code with separate multiply and add (no fused multiply-add), so the
+// result is bit for bit the same as the scalar version. pqA may alias pqB or pqC.
+static void qProductSIMD(Quaternion *pqA, const Quaternion *pqB, const Quaternion *pqC)
+{
+	// columns of the product: lane i of column k multiplies component qk of qB
+	const float fc1[4] = {-pqC->q1, pqC->q0, -pqC->q3, pqC->q2};
+	const float fc2[4] = {-pqC->q2, pqC->q3, pqC->q0, -pqC->q1};
+	const float fc3[4] = {-pqC->q3, -pqC->q2, pqC->q1, pqC->q0};
+#if F_QUATERNION_SSE
+	__m128 vProd;
+
+	vProd = _mm_mul_ps(_mm_set1_ps(pqB->q0), _mm_loadu_ps(&pqC->q0));
+	vProd = _mm_add_ps(vProd, _mm_mul_ps(_mm_set1_ps(pqB->q1), _mm_loadu_ps(fc1)));
+	vProd = _mm_add_ps(vProd, _mm_mul_ps(_mm_set1_ps(pqB->q2), _mm_loadu_ps(fc2)));
+	vProd = _mm_add_ps(vProd, _mm_mul_ps(_mm_set1_ps(pqB->q3), _mm_loadu_ps(fc3)));
+	_mm_storeu_ps(&pqA->q0, vProd);
+#else
+	float32x4_t vProd;
+
+	vProd = vmulq_n_f32(vld1q_f32(&pqC->q0), pqB->q0);
+	vProd = vaddq_f32(vProd, vmulq_n_f32(vld1q_f32(fc1), pqB->q1));
+	vProd = vaddq_f32(vProd, vmulq_n_f32(vld1q_f32(fc2), pqB->q2));
+	vProd = vaddq_f32(vProd, vmulq_n_f32(vld1q_f32(fc3), pqB->q3));
+	vst1q_f32(&pqA->q0, vProd);
+#endif
+
+	return;
+}
+#endif
+
 // function compute the quaternion product qA * qB
 void qAeqBxC(Quaternion *pqA, const Quaternion *pqB, const Quaternion *pqC)
 {
+#if F_QUATERNION_SSE || F_QUATERNION_NEON
+	qProductSIMD(pqA, pqB, pqC);
+#else
 	pqA->q0 = pqB->q0 * pqC->q0 - pqB->q1 * pqC->q1 - pqB->q2 * pqC->q2 - pqB->q3 * pqC->q3;
 	pqA->q1 = pqB->q0 * pqC->q1 + pqB->q1 * pqC->q0 + pqB->q2 * pqC->q3 - pqB->q3 * pqC->q2;
 	pqA->q2 = pqB->q0 * pqC->q2 - pqB->q1 * pqC->q3 + pqB->q2 * pqC->q0 + pqB->q3 * pqC->q1;
 	pqA->q3 = pqB->q0 * pqC->q3 + pqB->q1 * pqC->q2 - pqB->q2 * pqC->q1 + pqB->q3 * pqC->q0;
+#endif
 
 	return;
 }
@@ -947,6 +1143,9 @@ void qAeqBxC(Quaternion *pqA, const Quaternion *pqB, const Quaternion *pqC)
 // function compute the quaternion product qA = qA * qB
 void qAeqAxB(Quaternion *pqA, const Quaternion *pqB)
 {
+#if F_QUATERNION_SSE || F_QUATERNION_NEON
+	qProductSIMD(pqA, pqA, pqB);
+#else
 	Quaternion qProd;
 
 	// perform the quaternion product
@@ -957,6 +1156,7 @@ void qAeqAxB(Quaternion *pqA, const Quaternion *pqB)
 
 	// copy the result back into qA
 	*pqA = qProd;
+#endif
 
 	return;
 }
@@ -966,10 +1166,17 @@ Quaternion qconjgAxB(const Quaternion *pqA, const Quaternion *pqB)
 {
 	Quaternion qProd;
 
+#if F_QUATERNION_SSE || F_QUATERNION_NEON
+	// conjg(qA) * qB is the ordinary product with the vector part of qA negated
+	Quaternion qConjgA = {pqA->q0, -pqA->q1, -pqA->q2, -pqA->q3};
+
+	qProductSIMD(&qProd, &qConjgA, pqB);
+#else
 	qProd.q0 = pqA->q0 * pqB->q0 + pqA->q1 * pqB->q1 + pqA->q2 * pqB->q2 + pqA->q3 * pqB->q3;
 	qProd.q1 = pqA->q0 * pqB->q1 - pqA->q1 * pqB->q0 - pqA->q2 * pqB->q3 + pqA->q3 * pqB->q2;
 	qProd.q2 = pqA->q0 * pqB->q2 + pqA->q1 * pqB->q3 - pqA->q2 * pqB->q0 - pqA->q3 * pqB->q1;
 	qProd.q3 = pqA->q0 * pqB->q3 - pqA->q1 * pqB->q2 + pqA->q2 * pqB->q1 - pqA->q3 * pqB->q0;
+#endif
 
 	return qProd;
 }
@@ -28,6 +28,22 @@ typedef struct Quaternion
 	float q2;	        ///< y vector component
 	float q3;	        ///< z vector component
 } Quaternion;
+
+/// N quaternions held as one array per component, written by the batch conversion functions
+typedef struct QuaternionArrays
+{
+	float *q0;	        ///< scalar components
+	float *q1;	        ///< x vector components
+	float *q2;	        ///< y vector components
+	float *q3;	        ///< z vector components
+} QuaternionArrays;
+
+/// N rotation matrices held as one array per matrix element: R[i][j][n] is element [i][j] of matrix n.
+/// Written by the batch conversion functions.
+typedef struct RotationMatrixArrays
+{
+	float *R[3][3];     ///< one array per element of the 3x3 matrix
+} RotationMatrixArrays;
               
 // function prototypes
 /// Aerospace NED accelerometer 3DOF tilt function, computing rotation matrix fR
@@ -102,6 +118,16 @@ void fNEDAnglesDegFromRotationMatrix(
     float *pfRhoDeg,            ///< output: For NED, the compass heading Rho equals the yaw angle Psi
     float *pfChiDeg             ///< output: the tilt angle from vertical Chi (0 <= Chi <= 180 deg)
 );
+/// batch version of fNEDAnglesDegFromRotationMatrix() for iCount matrices. Each output array holds iCount angles.
+void fNEDAnglesDegFromRotationMatrixBatch(
+    float R[][3][3],            ///< rotation matrices input
+    uint32_t iCount,            ///< number of matrices
+    float fPhiDeg[],            ///< output: roll angles
+    float fTheDeg[],            ///< output: pitch angles
+    float fPsiDeg[],            ///< output: yaw (compass) angles
+    float fRhoDeg[],            ///< output: compass headings
+    float fChiDeg[]             ///< output: tilt angles from vertical
+);
 /// extract the Android angles in degrees from the Android rotation matrix
 void fAndroidAnglesDegFromRotationMatrix(
     float R[][3],               ///< rotation matrix input
@@ -130,6 +156,18 @@ void fRotationMatrixFromQuaternion(
     float R[][3],               ///< Rotation matrix (output)
     const Quaternion *pq        ///< Quaternion (input)
 );
+/// batch version of fQuaternionFromRotationMatrix() for iCount matrices
+void fQuaternionFromRotationMatrixBatch(
+    const RotationMatrixArrays *pR, ///< Rotation matrices, iCount entries per array (input)
+    uint32_t iCount,            ///< number of matrices
+    const QuaternionArrays *pq  ///< Quaternions, iCount entries per array (output)
+);
+/// batch version of fRotationMatrixFromQuaternion() for iCount quaternions
+void fRotationMatrixFromQuaternionBatch(
+    const RotationMatrixArrays *pR, ///< Rotation matrices, iCount entries per array (output)
+    const Quaternion pq[],      ///< Quaternions (input)
+    uint32_t iCount             ///< number of quaternions
+);
 /// function compute the quaternion product qB * qC
 void qAeqBxC(
     Quaternion *pqA, 
@@ -14,6 +14,22 @@
 #include "precisionAccelerometer.h"
 #include "calibration_storage.h"
 
+#if F_USING_ACCEL
+// working set of the solvers in the shared scratch arena. the 10 element solver uses 10x10
+// fmatA and fmatB (eigenvectors) and a 10x1 fvecA, the 4 element solver a 4x1 fvecB
+#define ACCEL_SOLVER_DIM          10
+#define ACCEL_SOLVER_VECB_DIM     4
+typedef struct AccelScratchNeed {
+    float fmatA[ACCEL_SOLVER_DIM][ACCEL_SOLVER_DIM];
+    float fmatB[ACCEL_SOLVER_DIM][ACCEL_SOLVER_DIM];
+    float fvecA[ACCEL_SOLVER_DIM];
+    float fvecB[ACCEL_SOLVER_VECB_DIM];
+} AccelScratchNeed;
+CAL_SCRATCH_CHECK(ACCEL_SOLVER_DIM <= CAL_SCRATCH_DIM, AccelSolverFitsScratchMatrices);
+CAL_SCRATCH_CHECK(ACCEL_SOLVER_VECB_DIM <= CAL_SCRATCH_VECB_DIM, AccelSolverFitsScratchVecB);
+CAL_SCRATCH_CHECK(sizeof(AccelScratchNeed) <= sizeof(CalibrationScratch), AccelSolverFitsCalibrationScratch);
+#endif
+
 // function resets the accelerometer buffer and accelerometer calibration
 void fInitializeAccelCalibration(AccelCalibration *pthisAccelCal,
                                  AccelBuffer *pthisAccelBuffer,
@@ -169,6 +185,10 @@ void fRunAccelCalibration(AccelCalibration *pthisAccelCal,
         if (pthisAccelBuffer->iStoreFlags & (1 << i)) iMeasurements++;
     }
 
+    // claim the scratch arena shared with the magnetic calibration. any time sliced
+    // magnetic calibration in progress sees this and restarts
+    pthisAccelCal->pScratch->iOwner = CAL_SCRATCH_ACCEL;
+
     // perform the highest quality calibration possible given this number
     if (iMeasurements >= 9)
     {
@@ -185,6 +205,7 @@ void fRunAccelCalibration(AccelCalibration *pthisAccelCal,
         // perform the 4 element calibration
         fComputeAccelCalibration4(pthisAccelBuffer, pthisAccelCal, pthisAccel);
     }
+    pthisAccelCal->pScratch->iOwner = CAL_SCRATCH_FREE;
 
     // calculate the rotation correction matrix to rotate calibrated measurement 0 to flat
     if (pthisAccelBuffer->iStoreFlags & 1)
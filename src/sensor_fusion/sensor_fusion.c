@@ -14,6 +14,7 @@
 #include "sensor_fusion.h"
 
 #include "control.h"
+#include "flight_recorder.h"
 #include "fusion.h"
 #include "hal_i2c.h"
 #include "hal_timer.h"
@@ -57,6 +58,8 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
                              StatusSubsystem *pStatusSubsystem,
                              ControlSubsystem *pControlSubsystem)
 {
+    FusionTuning tuning;
+
     sfg->iFlags = // all of the following defines are either 0x0000 or a 1-bit value (2, 4, 8 ...) and are defined in build.h
                 F_USING_ACCEL           |
                 F_USING_MAG             |
@@ -74,10 +77,19 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
 
     sfg->pControlSubsystem = pControlSubsystem;
     sfg->pStatusSubsystem = pStatusSubsystem;
+    sfg->pFlightRecorder = NULL;              // not recording
     sfg->loopcounter = 0;                     // counter incrementing each iteration of sensor fusion (typically 25Hz)
     sfg->systick_I2C = 0;                     // systick counter to benchmark I2C reads
     sfg->systick_Spare = 0;                   // systick counter for counts spare waiting for timing interrupt
     sfg->iPerturbation = 0;                   // no perturbation to be applied
+    sfg->iTestProgress = 0;                   // no perturbation test running
+    fInitializeFusionTuning(&tuning);         // build time filter constants
+    fSetFusionTuning(sfg, &tuning);
+    fSetWarmStartInterval(sfg, WARMSTART_SAVE_SECS * FUSION_HZ);
+#if F_9DOF_GBY_KALMAN
+    sfg->SV_9DOF_GBY_KALMAN.iWarmStartPending = false;
+    sfg->SV_9DOF_GBY_KALMAN.iWarmStartAllowed = true;   // later resets start without the saved state
+#endif
     sfg->installSensor = installSensor;       // function for installing a new sensor into the structures
     sfg->initializeFusionEngine = initializeFusionEngine;   // initializes fusion variables
     sfg->readSensors = readSensors;           // function for reading a sensor
@@ -91,6 +103,19 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
     sfg->updateStatus = updateStatus;         // function to promote queued status change
     sfg->testStatus = testStatus;             // function for unit testing the status subsystem
     sfg->pSensors = NULL;                     // pointer to linked list of physical sensors
+    sfg->pAccelInstances = NULL;              // no additional (redundant) sensors yet
+    sfg->pMagInstances = NULL;
+    sfg->pGyroInstances = NULL;
+    sfg->iVoteMode = F_SENSOR_VOTE;           // how redundant sensors are combined
+#if F_USING_ACCEL
+    initSensorVote(&sfg->AccelVote, VOTE_MAX_DEV_ACCEL_G);
+#endif
+#if F_USING_MAG
+    initSensorVote(&sfg->MagVote, VOTE_MAX_DEV_MAG_UT);
+#endif
+#if F_USING_GYRO
+    initSensorVote(&sfg->GyroVote, VOTE_MAX_DEV_GYRO_DPS);
+#endif
 //  put error value into whoAmI as initial value
 #if F_USING_ACCEL
     sfg->Accel.iWhoAmI = 0;
@@ -104,6 +129,28 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
 #if F_USING_PRESSURE
     sfg->Pressure.iWhoAmI = 0;
 #endif
+
+    // point the calibration solvers at the shared scratch arena
+#if F_USING_ACCEL || F_USING_MAG
+    sfg->CalScratch.iOwner = CAL_SCRATCH_FREE;
+#endif
+#if F_USING_ACCEL
+    sfg->AccelCal.pScratch = &sfg->CalScratch;
+    sfg->AccelCal.fmatA = sfg->CalScratch.fmatA;
+    sfg->AccelCal.fmatB = sfg->CalScratch.fmatB;
+    sfg->AccelCal.fvecA = sfg->CalScratch.fvecA;
+    sfg->AccelCal.fvecB = sfg->CalScratch.fvecB;
+#endif
+#if F_USING_MAG
+    sfg->MagCal.pScratch = &sfg->CalScratch;
+    sfg->MagCal.fmatA = sfg->CalScratch.fmatA;
+    sfg->MagCal.fmatB = sfg->CalScratch.fmatB;
+    sfg->MagCal.fvecA = sfg->CalScratch.fvecA;
+    sfg->MagCal.fvecB = sfg->CalScratch.fvecB;
+    sfg->MagCal.fAutoSaveImprovementpc = MAGCAL_AUTOSAVE_IMPROVEMENT_PC;
+    sfg->MagCal.iAutoSaveIntervalLoops = MAGCAL_AUTOSAVE_INTERVAL_SECS * FUSION_HZ;
+    sfg->MagCal.iSavePending = false;
+#endif
 } // end initSensorFusionGlobals()
 
 /// installSensor is used to instantiate a physical sensor driver into the
@@ -135,6 +182,22 @@ int8_t installSensor(
                                                 // loading them into the sensor fusion input structures.
         pSensor->addr = addr;                   // I2C address if applicable
         pSensor->schedule = schedule;
+        // read() fills the primary logical sensors unless redirected to an additional instance
+#if F_USING_ACCEL
+        pSensor->pAccel = &(sfg->Accel);
+#else
+        pSensor->pAccel = NULL;
+#endif
+#if F_USING_MAG
+        pSensor->pMag = &(sfg->Mag);
+#else
+        pSensor->pMag = NULL;
+#endif
+#if F_USING_GYRO
+        pSensor->pGyro = &(sfg->Gyro);
+#else
+        pSensor->pGyro = NULL;
+#endif
         // Now add the new sensor at the head of the linked list
         pSensor->next = sfg->pSensors;
         sfg->pSensors = pSensor;
@@ -146,6 +209,43 @@ int8_t installSensor(
     }
 } // end installSensor()
 
+/// installSensorInstance adds an additional accelerometer, magnetometer or gyroscope to
+/// the end of its list, so instance numbers don't change as more are added.
+uint8_t installSensorInstance(SensorFusionGlobals *sfg, sensor_instance_t iType, void *pInstance)
+{
+    uint8_t iInstance = 1;                      // sfg->Accel, Mag or Gyro is instance 0
+
+    switch (iType)
+    {
+        case SENSOR_INSTANCE_ACCEL:
+        {
+            struct AccelInstance **ppNext = &(sfg->pAccelInstances);
+            for (; *ppNext != NULL; ppNext = &((*ppNext)->next)) iInstance++;
+            *ppNext = (struct AccelInstance *) pInstance;
+            (*ppNext)->next = NULL;
+            break;
+        }
+        case SENSOR_INSTANCE_MAG:
+        {
+            struct MagInstance **ppNext = &(sfg->pMagInstances);
+            for (; *ppNext != NULL; ppNext = &((*ppNext)->next)) iInstance++;
+            *ppNext = (struct MagInstance *) pInstance;
+            (*ppNext)->next = NULL;
+            break;
+        }
+        case SENSOR_INSTANCE_GYRO:
+        default:
+        {
+            struct GyroInstance **ppNext = &(sfg->pGyroInstances);
+            for (; *ppNext != NULL; ppNext = &((*ppNext)->next)) iInstance++;
+            *ppNext = (struct GyroInstance *) pInstance;
+            (*ppNext)->next = NULL;
+            break;
+        }
+    }
+    return (iInstance);
+} // end installSensorInstance()
+
 // The initializeSensors function traverses the linked list of physical sensor
 // types and calls the initialization function for each one.
 int8_t initializeSensors(SensorFusionGlobals *sfg)
@@ -164,116 +264,334 @@ int8_t initializeSensors(SensorFusionGlobals *sfg)
 // process<Sensor>Data routines do post processing for HAL and averaging.  They
 // are called from the readSensors() function below.
 #if F_USING_ACCEL
-void processAccelData(SensorFusionGlobals *sfg)
+// HAL, averaging and calibration of one accelerometer
+void processAccel(SensorFusionGlobals *sfg, struct AccelSensor *pAccel, AccelCalibration *pAccelCal)
 {
     int32_t iSum[3];		        // channel sums
-    int16_t i, j;			        // counters
-    if (sfg->Accel.iFIFOExceeded > 0) {
+    int16_t j;			        // channel counter
+    if (pAccel->iFIFOExceeded > 0) {
       sfg->setStatus(sfg, SOFT_FAULT);
     }
 
-    ApplyAccelHAL(&(sfg->Accel));     // This function is board-dependent
+    ApplyAccelHAL(pAccel);            // This function is board-dependent
 
     // calculate the average HAL-corrected measurement
-    for (j = CHX; j <= CHZ; j++) iSum[j] = 0;
-    for (i = 0; i < sfg->Accel.iFIFOCount; i++)
-        for (j = CHX; j <= CHZ; j++) iSum[j] += sfg->Accel.iGsFIFO[i][j];
-    if (sfg->Accel.iFIFOCount > 0)
+    for (j = CHX; j <= CHZ; j++) iSum[j] = iSumFifoChannel(pAccel->iGsFIFO[j], pAccel->iFIFOCount);
+    if (pAccel->iFIFOCount > 0)
     {
         for (j = CHX; j <= CHZ; j++)
         {
-            sfg->Accel.iGs[j] = (int16_t)(iSum[j] / (int32_t) sfg->Accel.iFIFOCount);
-            sfg->Accel.fGs[j] = (float)sfg->Accel.iGs[j] * sfg->Accel.fgPerCount;
+            pAccel->iGs[j] = (int16_t)(iSum[j] / (int32_t) pAccel->iFIFOCount);
+            pAccel->fGs[j] = (float)pAccel->iGs[j] * pAccel->fgPerCount;
         }
     }
 
     // apply precision accelerometer calibration (offset V, inverse gain invW and rotation correction R^T)
     // to map fGs onto fGc (g), iGc (counts)
-    fInvertAccelCal(&(sfg->Accel), &(sfg->AccelCal));
+    fInvertAccelCal(pAccel, pAccelCal);
+    return;
+} // end processAccel()
+
+// replace the calibrated reading of the primary accelerometer with the vote of all
+// accelerometers that delivered samples this fusion cycle
+void voteAccelData(SensorFusionGlobals *sfg)
+{
+    float fIn[MAX_VOTING_SENSORS][3];       // calibrated readings (g)
+    uint8_t iIndex[MAX_VOTING_SENSORS];     // instance number of each reading
+    uint8_t iCount = 0;                     // number of readings
+    uint8_t iInstance;                      // instance counter
+    int16_t j;                              // channel counter
+    struct AccelSensor *pAccel;
+    struct AccelInstance *pInstance = sfg->pAccelInstances;
+
+    for (iInstance = 0; iInstance < MAX_VOTING_SENSORS; iInstance++)
+    {
+        if (iInstance == 0) pAccel = &(sfg->Accel);
+        else if (pInstance != NULL) { pAccel = &(pInstance->Accel); pInstance = pInstance->next; }
+        else break;
+        if (pAccel->isEnabled && (pAccel->iFIFOCount > 0))
+        {
+            for (j = CHX; j <= CHZ; j++) fIn[iCount][j] = pAccel->fGc[j];
+            iIndex[iCount++] = iInstance;
+        }
+    }
+
+    sfg->AccelVote.iCount = iCount;
+    sfg->AccelVote.iUsed = fCombineReadings(sfg->Accel.fGc, fIn, iIndex, iCount, sfg->iVoteMode, &sfg->AccelVote);
+    for (j = CHX; j <= CHZ; j++) sfg->Accel.iGc[j] = (int16_t) (sfg->Accel.fGc[j] * sfg->Accel.iCountsPerg);
+} // end voteAccelData()
+
+void processAccelData(SensorFusionGlobals *sfg)
+{
+    struct AccelInstance *pInstance;
+
+    if (sfg->Accel.isEnabled)
+    {
+        processAccel(sfg, &(sfg->Accel), &(sfg->AccelCal));
+
+        // update the precision accelerometer data buffer. The precision calibration
+        // procedure is run on the primary accelerometer only.
+        fUpdateAccelBuffer(&(sfg->AccelCal),
+                           &(sfg->AccelBuffer),
+                           &(sfg->Accel),
+                           &(sfg->pControlSubsystem->AccelCalPacketOn));
+    }
 
-    // update the precision accelerometer data buffer
-    fUpdateAccelBuffer(&(sfg->AccelCal),
-                       &(sfg->AccelBuffer),
-                       &(sfg->Accel),
-                       &(sfg->pControlSubsystem->AccelCalPacketOn));
+    if (sfg->pAccelInstances == NULL) return;
+    for (pInstance = sfg->pAccelInstances; pInstance != NULL; pInstance = pInstance->next)
+    {
+        if (pInstance->Accel.isEnabled) processAccel(sfg, &(pInstance->Accel), &(pInstance->AccelCal));
+    }
+    if (sfg->iVoteMode != SENSOR_VOTE_PRIMARY) voteAccelData(sfg);
     return;
 } // end processAccelData()
 #endif
 
 #if F_USING_MAG
-void processMagData(SensorFusionGlobals *sfg)
+// HAL, averaging and one time slice of the magnetic calibration of one magnetometer
+void processMag(SensorFusionGlobals *sfg, struct MagSensor *pMag, struct MagCalibration *pMagCal,
+                struct MagBuffer *pMagBuffer)
 {
     int32_t iSum[3];		        // channel sums
-    int16_t i, j;			        // counters
+    int16_t j;			        // channel counter
 
-    if (sfg->Mag.iFIFOExceeded > 0) {
+    if (pMag->iFIFOExceeded > 0) {
       sfg->setStatus(sfg, SOFT_FAULT);
     }
 
-    ApplyMagHAL(&(sfg->Mag));         // This function is board-dependent
+    ApplyMagHAL(pMag);                // This function is board-dependent
 
     // calculate the average HAL-corrected measurement
-    for (j = CHX; j <= CHZ; j++) iSum[j] = 0;
-    for (i = 0; i < sfg->Mag.iFIFOCount; i++)
-	for (j = CHX; j <= CHZ; j++) iSum[j] += sfg->Mag.iBsFIFO[i][j];
-    if (sfg->Mag.iFIFOCount > 0)
+    for (j = CHX; j <= CHZ; j++) iSum[j] = iSumFifoChannel(pMag->iBsFIFO[j], pMag->iFIFOCount);
+    if (pMag->iFIFOCount > 0)
     {
       for (j = CHX; j <= CHZ; j++)
       {
-          sfg->Mag.iBs[j] = (int16_t)(iSum[j] / (int32_t) sfg->Mag.iFIFOCount);
-          sfg->Mag.fBs[j] = (float)sfg->Mag.iBs[j] * sfg->Mag.fuTPerCount;
+          pMag->iBs[j] = (int16_t)(iSum[j] / (int32_t) pMag->iFIFOCount);
+          pMag->fBs[j] = (float)pMag->iBs[j] * pMag->fuTPerCount;
       }
     }
 
     // remove hard and soft iron terms from fBs (uT) to get calibrated data fBc (uT), iBc (counts) and
     // update magnetic buffer avoiding a write while a magnetic calibration is in progress.
     // run one iteration of the time sliced magnetic calibration
-    fInvertMagCal(&(sfg->Mag), &(sfg->MagCal));
-    if (!sfg->MagCal.iMagBufferReadOnly)
-        iUpdateMagBuffer(&(sfg->MagBuffer), &(sfg->Mag), sfg->loopcounter);
-    fRunMagCalibration(&(sfg->MagCal), &(sfg->MagBuffer), &(sfg->Mag),
-                           sfg->loopcounter);
+    fInvertMagCal(pMag, pMagCal);
+    if (!pMagCal->iMagBufferReadOnly)
+        iUpdateMagBuffer(pMagBuffer, pMag, sfg->loopcounter);
+    fRunMagCalibration(pMagCal, pMagBuffer, pMag, sfg->loopcounter);
 
+    return;
+} // end processMag()
+
+// replace the calibrated reading of the primary magnetometer with the vote of all
+// magnetometers that delivered samples this fusion cycle. The fusion algorithms take the
+// calibration validity and geomagnetic field strength from the primary's sfg->MagCal, so
+// only magnetometers in the same calibration state as the primary are voted on: the
+// calibrated ones once the primary has a valid calibration, the uncalibrated ones before.
+void voteMagData(SensorFusionGlobals *sfg)
+{
+    float fIn[MAX_VOTING_SENSORS][3];       // calibrated readings (uT)
+    uint8_t iIndex[MAX_VOTING_SENSORS];     // instance number of each reading
+    int8_t iPrimaryCalibrated;              // true if the primary has a valid calibration
+    uint8_t iCount = 0;                     // number of readings
+    uint8_t iInstance;                      // instance counter
+    int16_t j;                              // channel counter
+    struct MagSensor *pMag;
+    struct MagCalibration *pMagCal;
+    struct MagInstance *pInstance = sfg->pMagInstances;
+
+    iPrimaryCalibrated = (sfg->MagCal.iValidMagCal != 0);
+    for (iInstance = 0; iInstance < MAX_VOTING_SENSORS; iInstance++)
+    {
+        if (iInstance == 0) { pMag = &(sfg->Mag); pMagCal = &(sfg->MagCal); }
+        else if (pInstance != NULL)
+        {
+            pMag = &(pInstance->Mag);
+            pMagCal = &(pInstance->MagCal);
+            pInstance = pInstance->next;
+        }
+        else break;
+        if (pMag->isEnabled && (pMag->iFIFOCount > 0) &&
+            ((pMagCal->iValidMagCal != 0) == iPrimaryCalibrated))
+        {
+            for (j = CHX; j <= CHZ; j++) fIn[iCount][j] = pMag->fBc[j];
+            iIndex[iCount++] = iInstance;
+        }
+    }
+
+    sfg->MagVote.iCount = iCount;
+    sfg->MagVote.iUsed = fCombineReadings(sfg->Mag.fBc, fIn, iIndex, iCount, sfg->iVoteMode, &sfg->MagVote);
+    for (j = CHX; j <= CHZ; j++) sfg->Mag.iBc[j] = (int16_t) (sfg->Mag.fBc[j] * sfg->Mag.fCountsPeruT);
+} // end voteMagData()
+
+void processMagData(SensorFusionGlobals *sfg)
+{
+    struct MagInstance *pInstance;
+
+    if (sfg->Mag.isEnabled) processMag(sfg, &(sfg->Mag), &(sfg->MagCal), &(sfg->MagBuffer));
+
+    if (sfg->pMagInstances == NULL) return;
+    for (pInstance = sfg->pMagInstances; pInstance != NULL; pInstance = pInstance->next)
+    {
+        if (pInstance->Mag.isEnabled)
+            processMag(sfg, &(pInstance->Mag), &(pInstance->MagCal), &(pInstance->MagBuffer));
+    }
+    if (sfg->iVoteMode != SENSOR_VOTE_PRIMARY) voteMagData(sfg);
     return;
 } // end processMagData()
 #endif
 
 #if F_USING_GYRO
-void processGyroData(SensorFusionGlobals *sfg)
+// HAL and averaging of one gyroscope
+void processGyro(SensorFusionGlobals *sfg, struct GyroSensor *pGyro)
 {
     int32_t iSum[3];		        // channel sums
-    int16_t i, j;			        // counters
-    if (sfg->Gyro.iFIFOExceeded > 0) {
+    int16_t j;			        // channel counter
+    if (pGyro->iFIFOExceeded > 0) {
       sfg->setStatus(sfg, SOFT_FAULT);
     }
 
-    ApplyGyroHAL(&(sfg->Gyro));       // This function is board-dependent
+    ApplyGyroHAL(pGyro);              // This function is board-dependent
 
     // calculate the average HAL-corrected measurement.  This is used for offset
     // initialization, display purposes and in the 3-axis gyro-only algorithm.
     // The Kalman filters both do the full incremental rotation integration
     // right in the filters themselves.
-    for (j = CHX; j <= CHZ; j++) iSum[j] = 0;
-    for (i = 0; i < sfg->Gyro.iFIFOCount; i++)
-        for (j = CHX; j <= CHZ; j++)
-          iSum[j] += sfg->Gyro.iYsFIFO[i][j];
-    if (sfg->Gyro.iFIFOCount > 0)
+    for (j = CHX; j <= CHZ; j++) iSum[j] = iSumFifoChannel(pGyro->iYsFIFO[j], pGyro->iFIFOCount);
+    if (pGyro->iFIFOCount > 0)
     {
         for (j = CHX; j <= CHZ; j++)
         {
-            sfg->Gyro.iYs[j] = (int16_t)(iSum[j] / (int32_t) sfg->Gyro.iFIFOCount);
-            sfg->Gyro.fYs[j] = (float)sfg->Gyro.iYs[j] * sfg->Gyro.fDegPerSecPerCount;
+            pGyro->iYs[j] = (int16_t)(iSum[j] / (int32_t) pGyro->iFIFOCount);
+            pGyro->fYs[j] = (float)pGyro->iYs[j] * pGyro->fDegPerSecPerCount;
         }
     }
     return;
+} // end processGyro()
+
+// replace the primary gyroscope reading with the vote of all gyroscopes that delivered
+// samples this fusion cycle. The Kalman filters integrate the individual FIFO samples,
+// so the FIFO of the first gyroscope used (normally the primary) is carried into
+// sfg->Gyro with every sample shifted by the difference between the vote and that
+// gyroscope's own average. The rotation integrated over the cycle then follows the vote.
+// Samples of another gyroscope are converted to the counts of the primary, whose
+// scale is left unchanged.
+void voteGyroData(SensorFusionGlobals *sfg)
+{
+    float fIn[MAX_VOTING_SENSORS][3];       // averaged readings (deg/s)
+    float fOut[3];                          // combined reading (deg/s)
+    uint8_t iIndex[MAX_VOTING_SENSORS];     // instance number of each reading
+    struct GyroSensor *pGyros[MAX_VOTING_SENSORS];  // gyroscope of each reading
+    uint8_t iCount = 0;                     // number of readings
+    uint8_t iInstance;                      // instance counter
+    uint8_t i;                              // reading counter
+    int16_t j;                              // channel counter
+    float fShift[3];                        // shift of each FIFO sample (deg/s)
+    float fScale;                           // primary counts per carrier count
+    int32_t itmp;
+    struct GyroSensor *pGyro;
+    struct GyroSensor *pCarrier;            // gyroscope whose FIFO is carried into sfg->Gyro
+    struct GyroInstance *pInstance = sfg->pGyroInstances;
+
+    for (iInstance = 0; iInstance < MAX_VOTING_SENSORS; iInstance++)
+    {
+        if (iInstance == 0) pGyro = &(sfg->Gyro);
+        else if (pInstance != NULL) { pGyro = &(pInstance->Gyro); pInstance = pInstance->next; }
+        else break;
+        if (pGyro->isEnabled && (pGyro->iFIFOCount > 0))
+        {
+            for (j = CHX; j <= CHZ; j++) fIn[iCount][j] = pGyro->fYs[j];
+            pGyros[iCount] = pGyro;
+            iIndex[iCount++] = iInstance;
+        }
+    }
+
+    sfg->GyroVote.iCount = iCount;
+    sfg->GyroVote.iUsed = fCombineReadings(fOut, fIn, iIndex, iCount, sfg->iVoteMode, &sfg->GyroVote);
+    if (!sfg->GyroVote.iUsed) return;
+
+    // the first gyroscope used carries its FIFO
+    for (i = 0; !(sfg->GyroVote.iUsed & (1U << iIndex[i])); i++);
+    pCarrier = pGyros[i];
+    for (j = CHX; j <= CHZ; j++) fShift[j] = fOut[j] - pCarrier->fYs[j];
+
+    // a primary that was never set up has no scale, so takes over that of the carrier
+    if (sfg->Gyro.fDegPerSecPerCount <= 0.0F)
+    {
+        sfg->Gyro.fDegPerSecPerCount = pCarrier->fDegPerSecPerCount;
+        sfg->Gyro.iCountsPerDegPerSec = pCarrier->iCountsPerDegPerSec;
+    }
+    // the primary is an outlier or has failed, so carries the samples of another gyroscope
+    if (pCarrier != &(sfg->Gyro)) sfg->Gyro.iFIFOCount = pCarrier->iFIFOCount;
+    fScale = pCarrier->fDegPerSecPerCount / sfg->Gyro.fDegPerSecPerCount;
+    for (j = CHX; j <= CHZ; j++)
+    {
+        for (i = 0; i < pCarrier->iFIFOCount; i++)
+        {
+            itmp = (int32_t) lroundf((float) pCarrier->iYsFIFO[j][i] * fScale +
+                                     fShift[j] / sfg->Gyro.fDegPerSecPerCount);
+            if (itmp > 32767) itmp = 32767;
+            else if (itmp < -32767) itmp = -32767;
+            sfg->Gyro.iYsFIFO[j][i] = (int16_t) itmp;
+        }
+        sfg->Gyro.fYs[j] = fOut[j];
+        sfg->Gyro.iYs[j] = (int16_t) lroundf(fOut[j] / sfg->Gyro.fDegPerSecPerCount);
+    }
+} // end voteGyroData()
+
+void processGyroData(SensorFusionGlobals *sfg)
+{
+    struct GyroInstance *pInstance;
+
+    if (sfg->Gyro.isEnabled) processGyro(sfg, &(sfg->Gyro));
+
+    if (sfg->pGyroInstances == NULL) return;
+    for (pInstance = sfg->pGyroInstances; pInstance != NULL; pInstance = pInstance->next)
+    {
+        if (pInstance->Gyro.isEnabled) processGyro(sfg, &(pInstance->Gyro));
+    }
+    if (sfg->iVoteMode != SENSOR_VOTE_PRIMARY) voteGyroData(sfg);
+    return;
 } // end processGyroData()
 #endif
 
+// isSensorTypeAvailable returns true if, while voting, every sensor type in use
+// still has at least one working sensor
+int8_t isSensorTypeAvailable(SensorFusionGlobals *sfg)
+{
+#if F_USING_ACCEL
+    struct AccelInstance *pAccelInstance = sfg->pAccelInstances;
+    int8_t iAccel = sfg->Accel.isEnabled;
+    for (; pAccelInstance != NULL; pAccelInstance = pAccelInstance->next)
+        iAccel |= pAccelInstance->Accel.isEnabled;
+    if (!iAccel) return false;
+#endif
+#if F_USING_MAG
+    struct MagInstance *pMagInstance = sfg->pMagInstances;
+    int8_t iMag = sfg->Mag.isEnabled;
+    for (; pMagInstance != NULL; pMagInstance = pMagInstance->next)
+        iMag |= pMagInstance->Mag.isEnabled;
+    if (!iMag) return false;
+#endif
+#if F_USING_GYRO
+    struct GyroInstance *pGyroInstance = sfg->pGyroInstances;
+    int8_t iGyro = sfg->Gyro.isEnabled;
+    for (; pGyroInstance != NULL; pGyroInstance = pGyroInstance->next)
+        iGyro |= pGyroInstance->Gyro.isEnabled;
+    if (!iGyro) return false;
+#endif
+    return true;
+} // end isSensorTypeAvailable()
+
 /// readSensors traverses the linked list of physical sensors, calling the
 /// individual read functions one by one.
 /// This function is normally invoked via the "sfg." global pointer.
 /// If a sensor is flagged as uninitialized, an attempt is made to initialize it.
-/// If a sensor does not respond, it is marked as unintialized.
+/// If a sensor does not respond, it is marked as unintialized. While redundant
+/// sensors are being voted on, its logical sensors of a redundant type are also
+/// disabled, leaving them out of the vote until it is initialized again, and a
+/// failure only changes the status to SOFT_FAULT if it leaves a sensor type
+/// with no working sensor.
 int8_t readSensors(
     SensorFusionGlobals *sfg,   ///< pointer to global sensor fusion data structure
     uint8_t read_loop_counter  ///< current loop counter (used for multirate processing)
@@ -294,6 +612,13 @@ int8_t readSensors(
                     //sensor reported error, so mark it uninitialized.
                     //If it becomes reinitialized next loop, init function will set flag back to sensor type
                     pSensor->isInitialized = F_USING_NONE; 
+                    //while voting, also leave its readings out of the vote until then.
+                    //A sensor with no redundant partner stays enabled, as it always has.
+                    if (sfg->iVoteMode != SENSOR_VOTE_PRIMARY) {
+                        if (pSensor->pAccel && sfg->pAccelInstances) pSensor->pAccel->isEnabled = false;
+                        if (pSensor->pMag && sfg->pMagInstances) pSensor->pMag->isEnabled = false;
+                        if (pSensor->pGyro && sfg->pGyroInstances) pSensor->pGyro->isEnabled = false;
+                    }
                 }
                 if (status == SENSOR_ERROR_NONE) status = s; // will return 1st error flag, but try all sensors
             }
@@ -307,7 +632,11 @@ int8_t readSensors(
             }
         }
     }
-    if (status == SENSOR_ERROR_NONE) {
+    // while voting, a failed redundant sensor is simply left out of the vote
+    if ((status == SENSOR_ERROR_NONE) ||
+        ((sfg->iVoteMode != SENSOR_VOTE_PRIMARY) &&
+         (sfg->pAccelInstances || sfg->pMagInstances || sfg->pGyroInstances) &&
+         isSensorTypeAvailable(sfg))) {
         //change (or keep) status to NORMAL on next regular status update
         sfg->queueStatus(sfg, NORMAL);
     } else {
@@ -323,16 +652,19 @@ int8_t readSensors(
 /// and calibration functions.
 /// This function is normally invoked via the "sfg." global pointer.
 void conditionSensorReadings(SensorFusionGlobals *sfg) {
+    // the raw FIFO contents, before the HAL and calibrations are applied in place
+    if (sfg->pFlightRecorder) FlightRecordSamples(sfg->pFlightRecorder, sfg);
+
 #if F_USING_ACCEL
-    if (sfg->Accel.isEnabled) processAccelData(sfg);
+    if (sfg->Accel.isEnabled || sfg->pAccelInstances) processAccelData(sfg);
 #endif
 
 #if F_USING_MAG
-    if (sfg->Mag.isEnabled) processMagData(sfg);
+    if (sfg->Mag.isEnabled || sfg->pMagInstances) processMagData(sfg);
 #endif
 
 #if F_USING_GYRO
-    if (sfg->Gyro.isEnabled) processGyroData(sfg);
+    if (sfg->Gyro.isEnabled || sfg->pGyroInstances) processGyroData(sfg);
 #endif
     return;
 } // end conditionSensorReadings()
@@ -386,16 +718,34 @@ void clearFIFOs(SensorFusionGlobals *sfg) {
   // to continue to use these values when we've shut higher power consumption
   // sensors down during periods of no activity.
 #if F_USING_ACCEL
+    struct AccelInstance *pAccelInstance;
     sfg->Accel.iFIFOCount=0;
     sfg->Accel.iFIFOExceeded = false;
+    for (pAccelInstance = sfg->pAccelInstances; pAccelInstance != NULL; pAccelInstance = pAccelInstance->next)
+    {
+        pAccelInstance->Accel.iFIFOCount = 0;
+        pAccelInstance->Accel.iFIFOExceeded = false;
+    }
 #endif
 #if F_USING_MAG
+    struct MagInstance *pMagInstance;
     sfg->Mag.iFIFOCount=0;
     sfg->Mag.iFIFOExceeded = false;
+    for (pMagInstance = sfg->pMagInstances; pMagInstance != NULL; pMagInstance = pMagInstance->next)
+    {
+        pMagInstance->Mag.iFIFOCount = 0;
+        pMagInstance->Mag.iFIFOExceeded = false;
+    }
 #endif
 #if F_USING_GYRO
+    struct GyroInstance *pGyroInstance;
     sfg->Gyro.iFIFOCount=0;
     sfg->Gyro.iFIFOExceeded = false;
+    for (pGyroInstance = sfg->pGyroInstances; pGyroInstance != NULL; pGyroInstance = pGyroInstance->next)
+    {
+        pGyroInstance->Gyro.iFIFOCount = 0;
+        pGyroInstance->Gyro.iFIFOExceeded = false;
+    }
 #endif
 } // end clearFIFOs()
 
@@ -483,6 +833,7 @@ void runFusion(SensorFusionGlobals *sfg)
                  pSV_6DOF_GB_BASIC, pSV_6DOF_GY_KALMAN,
                  pSV_9DOF_GBY_KALMAN, pAccel, pMag, pGyro,
                  pPressure, pMagCal);
+    if (sfg->pFlightRecorder) FlightRecordOutputs(sfg->pFlightRecorder, sfg);
     clearFIFOs(sfg);
 } // end runFusion()
 
@@ -528,11 +879,42 @@ void initializeFusionEngine(SensorFusionGlobals *sfg, int pin_i2c_sda, int pin_i
     // initialize the magnetic calibration and magnetometer data buffer
 #if F_USING_MAG
     fInitializeMagCalibration(&sfg->MagCal, &sfg->MagBuffer);
+
+    // the stored calibration belongs to the primary magnetometer, so additional ones start
+    // uncalibrated, each with its own scratch arena for its time sliced solvers
+    struct MagInstance *pMagInstance;
+    for (pMagInstance = sfg->pMagInstances; pMagInstance != NULL; pMagInstance = pMagInstance->next)
+    {
+        pMagInstance->CalScratch.iOwner = CAL_SCRATCH_FREE;
+        pMagInstance->MagCal.pScratch = &pMagInstance->CalScratch;
+        pMagInstance->MagCal.fmatA = pMagInstance->CalScratch.fmatA;
+        pMagInstance->MagCal.fmatB = pMagInstance->CalScratch.fmatB;
+        pMagInstance->MagCal.fvecA = pMagInstance->CalScratch.fvecA;
+        pMagInstance->MagCal.fvecB = pMagInstance->CalScratch.fvecB;
+        pMagInstance->MagCal.fAutoSaveImprovementpc = 0.0F;   // never saved
+        pMagInstance->MagCal.iSavePending = false;
+        fInitializeMagCalibration(&pMagInstance->MagCal, &pMagInstance->MagBuffer);
+        fSetMagCalibrationDefault(&pMagInstance->MagCal);
+    }
 #endif
 
     // initialize the precision accelerometer calibration and accelerometer data buffer
 #if F_USING_ACCEL
     fInitializeAccelCalibration(&sfg->AccelCal, &sfg->AccelBuffer, &sfg->pControlSubsystem->AccelCalPacketOn );
+
+    // additional accelerometers start with the null precision calibration
+    struct AccelInstance *pAccelInstance;
+    for (pAccelInstance = sfg->pAccelInstances; pAccelInstance != NULL; pAccelInstance = pAccelInstance->next)
+    {
+        pAccelInstance->AccelCal.pScratch = &sfg->CalScratch;
+        pAccelInstance->AccelCal.fmatA = sfg->CalScratch.fmatA;
+        pAccelInstance->AccelCal.fmatB = sfg->CalScratch.fmatB;
+        pAccelInstance->AccelCal.fvecA = sfg->CalScratch.fvecA;
+        pAccelInstance->AccelCal.fvecB = sfg->CalScratch.fvecB;
+        pAccelInstance->AccelCal.fV[CHX] = pAccelInstance->AccelCal.fV[CHY] = pAccelInstance->AccelCal.fV[CHZ] = 0.0F;
+        f3x3matrixAeqI(pAccelInstance->AccelCal.finvW);
+        f3x3matrixAeqI(pAccelInstance->AccelCal.fR0);
+    }
 #endif
 
     clearFIFOs(sfg);
@@ -564,12 +946,15 @@ void addToFifo(union FifoSensor *sensor, uint16_t maxFifoSize, int16_t sample[3]
   // structure to index here.
 
   // example usage: if (status==SENSOR_ERROR_NONE) addToFifo((FifoSensor*) &(sfg->Mag), MAG_FIFO_SIZE, sample);
+  // The FIFO is stored one channel after another, so channel j of entry n
+  // is at offset j * maxFifoSize + n from the start of the FIFO.
     uint8_t fifoCount = sensor->Accel.iFIFOCount;
+    int16_t *fifo = &(sensor->Accel.iGsFIFO[0][0]);
     if (fifoCount < maxFifoSize) {
         // we have room for the new sample
-        sensor->Accel.iGsFIFO[fifoCount][CHX] = sample[CHX];
-        sensor->Accel.iGsFIFO[fifoCount][CHY] = sample[CHY];
-        sensor->Accel.iGsFIFO[fifoCount][CHZ] = sample[CHZ];
+        fifo[CHX * maxFifoSize + fifoCount] = sample[CHX];
+        fifo[CHY * maxFifoSize + fifoCount] = sample[CHY];
+        fifo[CHZ * maxFifoSize + fifoCount] = sample[CHZ];
         sensor->Accel.iFIFOCount += 1;
         sensor->Accel.iFIFOExceeded = 0;
     } else {
@@ -578,3 +963,22 @@ void addToFifo(union FifoSensor *sensor, uint16_t maxFifoSize, int16_t sample[3]
     }
 } // end addToFifo()
 
+// sum the first iCount entries of one FIFO channel. The channel is contiguous,
+// so the compiler can vectorize this loop.
+int32_t iSumFifoChannel(const int16_t *pChannel, uint8_t iCount)
+{
+    int32_t iSum = 0;
+    uint8_t i;
+
+    for (i = 0; i < iCount; i++) iSum += pChannel[i];
+    return iSum;
+} // end iSumFifoChannel()
+
+// convert the first iCount entries of one FIFO channel to float, fDest[i] = pChannel[i] * fScale - fOffset
+void fScaleFifoChannel(float *fDest, const int16_t *pChannel, uint8_t iCount, float fScale, float fOffset)
+{
+    uint8_t i;
+
+    for (i = 0; i < iCount; i++) fDest[i] = (float) pChannel[i] * fScale - fOffset;
+} // end fScaleFifoChannel()
+
@@ -37,6 +37,7 @@ extern "C" {
 #include "matrix.h"  					// Matrix math
 #include "orientation.h"                // Functions for manipulating orientations
 #include "precisionAccelerometer.h"     // Accel calibration functions/structures
+#include "sensor_voting.h"              // Combining redundant sensor readings
 
 /// the quaternion type to be transmitted
 typedef enum quaternion {
@@ -56,6 +57,10 @@ typedef enum quaternion {
 #define CHZ 2   ///< Used to access Z-channel entries in various data data structures
 ///@}
 
+/// Alignment of the per-channel software FIFO arrays, so the averaging and
+/// scaling loops over one channel can be vectorized
+#define FIFO_ALIGNED __attribute__((aligned(8)))
+
 // booleans
 #ifndef true
 #define true 1  ///< Boolean TRUE
@@ -100,6 +105,7 @@ struct SensorFusionGlobals;                     ///< Top level structure has poi
 struct StatusSubsystem;                         ///< Application-specific status subsystem
 struct PhysicalSensor;                          ///< We'll have one of these for each physical sensor (FXOS8700 = 1 physical sensor)
 struct ControlSubsystem;                        ///< Application-specific serial communications system
+struct FlightRecorder;                          ///< Optional recorder of raw readings and outputs, see flight_recorder.h
 
 typedef enum {                                  ///  These are the state definitions for the status subsystem
 	OFF,                                    ///< Application hasn't started
@@ -158,6 +164,9 @@ struct PhysicalSensor {
         uint16_t isInitialized;                 ///< Bitfields to indicate sensor is active (use SensorBitFields from build.h)
 	struct PhysicalSensor *next;		///< pointer to next sensor in this linked list
         uint8_t schedule;                      ///< Parameter to control sensor sampling rate
+	struct AccelSensor *pAccel;		///< accelerometer storage filled by read(), &sfg->Accel unless redundant
+	struct MagSensor *pMag;			///< magnetometer storage filled by read(), &sfg->Mag unless redundant
+	struct GyroSensor *pGyro;		///< gyroscope storage filled by read(), &sfg->Gyro unless redundant
 	initializeSensor_t *initialize;  	///< pointer to function to initialize sensor using the supplied drivers
 	readSensor_t *read;			///< pointer to function to read sensor using the supplied drivers
 };
@@ -192,7 +201,7 @@ struct AccelSensor
 	bool  isEnabled;                        ///< true if the device is sampling
 	uint8_t iFIFOCount;			///< number of measurements read from FIFO
     uint16_t iFIFOExceeded;                 ///< Number of samples received in excess of software FIFO size
-	int16_t iGsFIFO[ACCEL_FIFO_SIZE][3];	///< FIFO measurements (counts)
+	int16_t iGsFIFO[3][ACCEL_FIFO_SIZE] FIFO_ALIGNED;	///< FIFO measurements (counts), one array per channel
         // End of common fields which can be referenced via FifoSensor union type
 	float fGs[3];			        ///< averaged measurement (g)
 	float fGc[3];				///< averaged precision calibrated measurement (g)
@@ -214,7 +223,7 @@ struct MagSensor
         bool  isEnabled;                        ///< true if the device is sampling
 	uint8_t iFIFOCount;			///< number of measurements read from FIFO
         uint16_t iFIFOExceeded;                 ///< Number of samples received in excess of software FIFO size
-	int16_t iBsFIFO[MAG_FIFO_SIZE][3];	///< FIFO measurements (counts)
+	int16_t iBsFIFO[3][MAG_FIFO_SIZE] FIFO_ALIGNED;	///< FIFO measurements (counts), one array per channel
         // End of common fields which can be referenced via FifoSensor union type
 	float fBs[3];				///< averaged un-calibrated measurement (uT)
 	float fBc[3];				///< averaged calibrated measurement (uT)
@@ -244,7 +253,7 @@ struct GyroSensor
         bool  isEnabled;                        ///< true if the device is sampling
 	uint8_t iFIFOCount;			///< number of measurements read from FIFO
         uint16_t iFIFOExceeded;                 ///< Number of samples received in excess of software FIFO size
-	int16_t iYsFIFO[GYRO_FIFO_SIZE][3];	///< FIFO measurements (counts)
+	int16_t iYsFIFO[3][GYRO_FIFO_SIZE] FIFO_ALIGNED;	///< FIFO measurements (counts), one array per channel
         // End of common fields which can be referenced via FifoSensor union type
 	float fYs[3];				///< averaged measurement (deg/s)
 	float fDegPerSecPerCount;		///< deg/s per count
@@ -261,6 +270,48 @@ union FifoSensor  {
     struct AccelSensor Accel;
 };
 
+/// @name Redundant Sensor Instances
+/// sfg->Accel, sfg->Mag and sfg->Gyro hold the first sensor of each type, which is the
+/// one fed to the fusion algorithms. Each further sensor of the same type (e.g. on a
+/// redundant IMU board) gets one of these structures, with its own software FIFO and
+/// calibration, linked into a list in SensorFusionGlobals by installSensorInstance().
+/// The physical sensor feeding it points its pAccel, pMag or pGyro at the embedded
+/// logical sensor. conditionSensorReadings() processes every instance each fusion cycle.
+///@{
+/// Additional accelerometer and its precision calibration
+struct AccelInstance
+{
+	struct AccelSensor Accel;		///< accelerometer storage
+	AccelCalibration AccelCal;		///< precision calibration applied to this accelerometer
+	struct AccelInstance *next;		///< next additional accelerometer, NULL at end of list
+};
+
+/// Additional magnetometer and its hard/soft iron calibration. The calibration is time
+/// sliced, so each magnetometer has its own solver scratch arena.
+struct MagInstance
+{
+	struct MagSensor Mag;			///< magnetometer storage
+	struct MagCalibration MagCal;		///< magnetic calibration of this magnetometer
+	struct MagBuffer MagBuffer;		///< constellation points for MagCal
+	CalibrationScratch CalScratch;		///< solver scratch used only by MagCal
+	struct MagInstance *next;		///< next additional magnetometer, NULL at end of list
+};
+
+/// Additional gyroscope. Its offset is estimated by the Kalman filter, so no calibration is stored.
+struct GyroInstance
+{
+	struct GyroSensor Gyro;			///< gyroscope storage
+	struct GyroInstance *next;		///< next additional gyroscope, NULL at end of list
+};
+
+/// Selects the list installSensorInstance() adds to
+typedef enum {
+	SENSOR_INSTANCE_ACCEL,			///< struct AccelInstance
+	SENSOR_INSTANCE_MAG,			///< struct MagInstance
+	SENSOR_INSTANCE_GYRO			///< struct GyroInstance
+} sensor_instance_t;
+///@}
+
 /// The SV_1DOF_P_BASIC structure contains state information for a pressure sensor/altimeter.
 struct SV_1DOF_P_BASIC
 {
@@ -268,6 +319,7 @@ struct SV_1DOF_P_BASIC
 	float fLPT;				///< low pass filtered temperature (C)
 	float fdeltat;				///< fusion time interval (s)
 	float flpf;				///< low pass filter coefficient
+	float fLPFSecs;				///< low pass filter time constant (s), see FusionTuning
 	int32_t systick;			///< systick timer
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
@@ -291,6 +343,7 @@ struct SV_3DOF_G_BASIC
 	Quaternion fq;				///< unfiltered orientation quaternion
 	float fdeltat;				///< fusion time interval (s)
 	float flpf;				///< low pass filter coefficient
+	float fLPFSecs;				///< low pass filter time constant (s), see FusionTuning
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
 
@@ -313,6 +366,7 @@ struct SV_3DOF_B_BASIC
 	Quaternion fq;				///< unfiltered orientation quaternion
 	float fdeltat;				///< fusion time interval (s)
 	float flpf;				///< low pass filter coefficient
+	float fLPFSecs;				///< low pass filter time constant (s), see FusionTuning
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
 
@@ -356,6 +410,7 @@ struct SV_6DOF_GB_BASIC
 	float fLPDelta;				///< low pass filtered inclination angle (deg)
 	float fdeltat;				///< fusion time interval (s)
 	float flpf;				///< low pass filter coefficient
+	float fLPFSecs;				///< low pass filter time constant (s), see FusionTuning
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
 
@@ -390,9 +445,25 @@ struct SV_6DOF_GY_KALMAN
 	float fAlphaQwbOver6;			///< (PI / 180 * fdeltat) * Qwb / 6
 	float fQwbOver3;			///< Qwb / 3
 	float fMaxGyroOffsetChange;		///< maximum permissible gyro offset change per iteration (deg/s)
+	float fQvY;				///< gyro sensor noise variance (deg/s)^2, see FusionTuning
+	float fQvG;				///< minimum accelerometer noise variance g^2
+	float fQwb;				///< gyro offset random walk (deg/s)^2
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
 
+/// State of the 9DOF Kalman filter kept in the calibration store, from which the filter
+/// restarts after a power up (a warm start) rather than converging again from scratch.
+/// The error vectors set the leading diagonal of Qw on the first iteration.
+struct WarmStart9DOF
+{
+	float fbPl[3];				///< gyro offset (deg/s)
+	float fqgErrPl[3];			///< gravity vector tilt orientation quaternion error (dimensionless)
+	float fqmErrPl[3];			///< geomagnetic vector tilt orientation quaternion error (dimensionless)
+	float fbErrPl[3];			///< gyro offset error (deg/s)
+	Quaternion fqPl;			///< a posteriori orientation quaternion
+	float fDeltaPl;				///< a posteriori inclination angle (deg)
+};
+
 /// SV_9DOF_GBY_KALMAN is the 9DOF Kalman filter accelerometer, magnetometer and gyroscope state vector structure.
 struct SV_9DOF_GBY_KALMAN
 {
@@ -431,6 +502,15 @@ struct SV_9DOF_GBY_KALMAN
 	float fAlphaQwbOver6;			///< (PI / 180 * fdeltat) * Qwb / 6
 	float fQwbOver3;			///< Qwb / 3
 	float fMaxGyroOffsetChange;		///< maximum permissible gyro offset change per iteration (deg/s)
+	float fQvY;				///< gyro sensor noise variance (deg/s)^2, see FusionTuning
+	float fQvG;				///< minimum accelerometer noise variance g^2
+	float fQvB;				///< minimum magnetometer noise variance uT^2
+	float fQwb;				///< gyro offset random walk (deg/s)^2
+	int32_t iWarmStartLoops;		///< fusion cycles between saves of the warm start state, 0 disables
+	int32_t iWarmStartCountdown;		///< fusion cycles until the warm start state is next queued for saving
+	struct WarmStart9DOF WarmStart;		///< warm start state to be saved
+	volatile int8_t iWarmStartPending;	///< flag denoting WarmStart awaits writing by SavePendingCalibrationsToNVM()
+	int8_t iWarmStartAllowed;		///< flag denoting the next initialization is the first since power up, so may warm start
 	int8_t iFirstAccelMagLock;		///< denotes that 9DOF orientation has locked to 6DOF eCompass
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
@@ -467,12 +547,21 @@ typedef struct SensorFusionGlobals
         /// provide the same interfaces defined in control.h and status.h.
 	struct ControlSubsystem *pControlSubsystem;
 	struct StatusSubsystem *pStatusSubsystem;
+	struct FlightRecorder *pFlightRecorder;	///< NULL unless recording, see flight_recorder.h
         ///@}
         ///@{
         /// @name MiscFields
         uint32_t iFlags;                        ///< a bit-field of sensors and algorithms used
 	struct PhysicalSensor *pSensors;    	        ///< a linked list of physical sensors
+	struct AccelInstance *pAccelInstances;	///< linked list of additional accelerometers, NULL if only one
+	struct MagInstance *pMagInstances;	///< linked list of additional magnetometers, NULL if only one
+	struct GyroInstance *pGyroInstances;	///< linked list of additional gyroscopes, NULL if only one
+	uint8_t iVoteMode;			///< SENSOR_VOTE_* used to combine redundant sensors
 	volatile uint8_t iPerturbation;	        ///< test perturbation to be applied
+	volatile uint16_t iTestProgress;	///< ApplyPerturbation() test status, 0 if no test is running
+	volatile uint16_t iTestDelay;		///< fusion cycles since the perturbation was applied
+	volatile float fTestThreshold;		///< residual angle (deg) that signals return to the starting pose
+	Quaternion fqTestStart;			///< conjugate of the orientation when the test started
 	// Book-keeping variables
 	int32_t loopcounter;			///< counter incrementing each iteration of sensor fusion (typically 25Hz)
 	int32_t systick_I2C;			///< systick counter to benchmark I2C reads
@@ -496,8 +585,18 @@ typedef struct SensorFusionGlobals
 	struct MagCalibration MagCal;                  ///< mag cal storage
 	struct MagBuffer MagBuffer;                    ///< mag cal constellation points
 #endif
+#if     F_USING_ACCEL
+	SensorVote AccelVote;                   ///< combining of redundant accelerometers, instance 0 is Accel
+#endif
+#if     F_USING_MAG
+	SensorVote MagVote;                     ///< combining of redundant magnetometers, instance 0 is Mag
+#endif
+#if     F_USING_ACCEL || F_USING_MAG
+	CalibrationScratch CalScratch;          ///< solver scratch arena shared by AccelCal and MagCal
+#endif
 #if     F_USING_GYRO
 	struct GyroSensor 	Gyro;                   ///< gyro storage
+	SensorVote GyroVote;                    ///< combining of redundant gyroscopes, instance 0 is Gyro
 #endif
     struct TempSensor Temp;					//temperature storage
 
@@ -552,11 +651,22 @@ void initSensorFusionGlobals(
     struct ControlSubsystem *pControlSubsystem          ///< Control subsystem pointer
 );
 installSensor_t installSensor;
+/// \brief Adds an additional logical sensor to the end of its list in sfg
+///
+/// pInstance points to a struct AccelInstance, MagInstance or GyroInstance according to
+/// iType, allocated by the caller and kept for the life of sfg. It is initialized by
+/// initializeFusionEngine(). Returns the instance number, counting sfg->Accel etc. as 0.
+uint8_t installSensorInstance(
+    SensorFusionGlobals *sfg,                           ///< Global data structure pointer
+    sensor_instance_t iType,                            ///< which type of logical sensor pInstance is
+    void *pInstance                                     ///< the instance to add
+);
 initializeFusionEngine_t initializeFusionEngine ;
 /// conditionSensorReadings() transforms raw software FIFO readings into forms that
 /// can be consumed by the sensor fusion engine.  This include sample averaging
 /// and (in the case of the gyro) integrations, applying hardware abstraction layers,
-/// and calibration functions.
+/// and calibration functions. Where redundant sensors are installed, their readings
+/// are then combined into sfg->Accel, sfg->Mag and sfg->Gyro according to sfg->iVoteMode.
 /// This function is normally involved via the "sfg." global pointer.
 void conditionSensorReadings(
     SensorFusionGlobals *sfg                            ///< Global data structure pointer
@@ -597,6 +707,23 @@ void addToFifo(
     int16_t sample[3]                                   ///< the sample to add
 );
 
+/// \brief Sum of the first iCount entries of one software FIFO channel
+int32_t iSumFifoChannel(
+    const int16_t *pChannel,                            ///< FIFO channel, e.g. sfg->Gyro.iYsFIFO[CHX]
+    uint8_t iCount                                      ///< number of entries to sum
+);
+
+/// \brief Convert the first iCount entries of one software FIFO channel to float
+///
+/// fDest[i] = pChannel[i] * fScale - fOffset
+void fScaleFifoChannel(
+    float *fDest,                                       ///< destination, at least iCount entries
+    const int16_t *pChannel,                            ///< FIFO channel, e.g. sfg->Gyro.iYsFIFO[CHX]
+    uint8_t iCount,                                     ///< number of entries to convert
+    float fScale,                                       ///< units per count
+    float fOffset                                       ///< offset subtracted after scaling
+);
+
 // The following functions are defined in hal_axis_remap.c
 // Please note that these are board-dependent - they account for 
 //various orientations of sensor ICs on the sensor PCB.
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file sensor_voting.c
+    \brief Median voting and outlier-rejecting mean of redundant sensor readings.
+    See sensor_voting.h for details.
+*/
+
+#include <stdint.h>
+
+#include "sensor_voting.h"
+
+// median of iCount values. fVal[] is sorted in place
+static float fMedian(float fVal[], uint8_t iCount)
+{
+    float ftmp;
+    int8_t i, j;
+
+    // insertion sort, there are at most MAX_VOTING_SENSORS values
+    for (i = 1; i < (int8_t) iCount; i++)
+    {
+        ftmp = fVal[i];
+        for (j = i - 1; (j >= 0) && (fVal[j] > ftmp); j--) fVal[j + 1] = fVal[j];
+        fVal[j + 1] = ftmp;
+    }
+    if (iCount & 1) return fVal[iCount / 2];
+    return 0.5F * (fVal[iCount / 2 - 1] + fVal[iCount / 2]);
+} // end fMedian()
+
+void initSensorVote(SensorVote *pVote, float fMaxDeviation)
+{
+    uint8_t i;
+
+    for (i = 0; i < MAX_VOTING_SENSORS; i++) pVote->fWeight[i] = 1.0F;
+    pVote->fMaxDeviation = fMaxDeviation;
+    pVote->iUsed = 0;
+    pVote->iCount = 0;
+} // end initSensorVote()
+
+uint8_t fCombineReadings(float fOut[3], float fIn[][3], const uint8_t iIndex[], uint8_t iCount,
+                         uint8_t iMode, const SensorVote *pVote)
+{
+    float fMed[3];                          // per-axis median
+    float fAxis[MAX_VOTING_SENSORS];        // one axis of every reading, sorted by fMedian()
+    float fSum[3];                          // weighted sum of the accepted readings
+    float fSumWeight;                       // sum of the weights of the accepted readings
+    float fDevSq;                           // squared distance of a reading from the median
+    float fMaxDevSq;                        // square of the outlier threshold
+    float ftmp;
+    uint8_t iUsed;                          // bit mask of accepted readings, by instance
+    uint8_t iBest;                          // reading of the highest weight
+    uint8_t i, j;
+
+    if (iCount == 0) return 0;
+    if (iCount > MAX_VOTING_SENSORS) iCount = MAX_VOTING_SENSORS;
+
+    for (j = 0; j < 3; j++)
+    {
+        for (i = 0; i < iCount; i++) fAxis[i] = fIn[i][j];
+        fMed[j] = fMedian(fAxis, iCount);
+    }
+
+    // reject readings too far from the median, and sum the rest
+    fMaxDevSq = pVote->fMaxDeviation * pVote->fMaxDeviation;
+    fSum[0] = fSum[1] = fSum[2] = 0.0F;
+    fSumWeight = 0.0F;
+    iUsed = 0;
+    for (i = 0; i < iCount; i++)
+    {
+        fDevSq = 0.0F;
+        for (j = 0; j < 3; j++)
+        {
+            ftmp = fIn[i][j] - fMed[j];
+            fDevSq += ftmp * ftmp;
+        }
+        if ((fDevSq <= fMaxDevSq) && (pVote->fWeight[iIndex[i]] > 0.0F))
+        {
+            iUsed |= (uint8_t) (1U << iIndex[i]);
+            for (j = 0; j < 3; j++) fSum[j] += pVote->fWeight[iIndex[i]] * fIn[i][j];
+            fSumWeight += pVote->fWeight[iIndex[i]];
+        }
+    }
+
+    // nothing agrees with the median (e.g. two readings that differ), so fall back to the reading
+    // with the highest weight, the first of equals. Readings of weight 0 are never used.
+    if (fSumWeight <= 0.0F)
+    {
+        iBest = 0;
+        for (i = 1; i < iCount; i++)
+            if (pVote->fWeight[iIndex[i]] > pVote->fWeight[iIndex[iBest]]) iBest = i;
+        if (pVote->fWeight[iIndex[iBest]] <= 0.0F) return 0;
+        for (j = 0; j < 3; j++) fOut[j] = fIn[iBest][j];
+        return (uint8_t) (1U << iIndex[iBest]);
+    }
+
+    if (iMode == SENSOR_VOTE_MEDIAN)
+    {
+        for (j = 0; j < 3; j++) fOut[j] = fMed[j];
+    }
+    else
+    {
+        for (j = 0; j < 3; j++) fOut[j] = fSum[j] / fSumWeight;
+    }
+    return iUsed;
+} // end fCombineReadings()
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SENSOR_VOTING_H
+#define SENSOR_VOTING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file sensor_voting.h
+    \brief Combines the readings of redundant 3-axis sensors into one
+
+    With several accelerometers, magnetometers or gyroscopes installed (see
+    installSensorInstance()), conditionSensorReadings() passes the readings of
+    each type to fCombineReadings(), and the result replaces the reading of the
+    primary sensor that the fusion algorithms consume.
+
+    Each reading is compared with the per-axis median of all readings. One
+    further than fMaxDeviation from the median is an outlier and is left out.
+    SENSOR_VOTE_MEAN then takes the weighted mean of the rest, which lowers the
+    noise of N similar sensors by about sqrt(N). SENSOR_VOTE_MEDIAN returns
+    the median itself, which tolerates up to half the sensors failing at the
+    cost of less noise reduction.
+
+    Two readings that disagree cannot be voted on, since each is as far from
+    the median as the other. In that case the reading with the highest weight
+    is used, the first of equal weights.
+*/
+
+#include <stdint.h>
+
+/// @name Voting modes
+///@{
+#define SENSOR_VOTE_PRIMARY     0   ///< fuse the first sensor of each type only
+#define SENSOR_VOTE_MEAN        1   ///< weighted mean of the readings that agree with the median
+#define SENSOR_VOTE_MEDIAN      2   ///< per-axis median of all readings
+///@}
+
+#define MAX_VOTING_SENSORS      8   ///< most sensors of one type combined. Further ones are ignored
+
+/// Voting configuration and the outcome of the last fusion cycle, one per sensor type
+typedef struct SensorVote {
+    float fWeight[MAX_VOTING_SENSORS];  ///< relative weight of each instance in SENSOR_VOTE_MEAN, 0 to ignore
+    float fMaxDeviation;                ///< distance from the median beyond which a reading is an outlier
+    uint8_t iUsed;                      ///< bit n set if instance n contributed in the last fusion cycle
+    uint8_t iCount;                     ///< number of readings available in the last fusion cycle
+} SensorVote;
+
+/// Initialize a SensorVote with equal weights
+void initSensorVote(
+    SensorVote *pVote,                  ///< structure to initialize
+    float fMaxDeviation                 ///< outlier threshold, in the units of the readings
+);
+
+/// \brief Combine iCount 3-axis readings
+///
+/// Returns a bit mask of the readings used to form fOut: bit n for instance iIndex[] = n.
+/// Returns 0 and leaves fOut unchanged if iCount is 0 or every reading has weight 0.
+uint8_t fCombineReadings(
+    float fOut[3],                      ///< combined reading
+    float fIn[][3],                     ///< readings to combine
+    const uint8_t iIndex[],             ///< instance number of each reading, for fWeight[] and the result mask
+    uint8_t iCount,                     ///< number of readings, at most MAX_VOTING_SENSORS
+    uint8_t iMode,                      ///< SENSOR_VOTE_MEAN or SENSOR_VOTE_MEDIAN
+    const SensorVote *pVote             ///< weights and outlier threshold
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_VOTING_H
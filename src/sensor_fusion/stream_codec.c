@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file stream_codec.c
+    \brief Keyframe + quantized delta encoder and reference decoder.
+    See stream_codec.h for the frame layout.
+*/
+
+#include <stdint.h>
+
+#include "stream_codec.h"
+
+// initialize an encoder. The first frame encoded afterwards is a keyframe.
+void StreamEncoderInit(StreamEncoder *pEnc, uint8_t iQuantShift, uint8_t iKeyframeInterval)
+{
+    pEnc->iSequence = 0;
+    pEnc->iFramesSinceKey = 0;
+    pEnc->iKeyframeInterval = iKeyframeInterval;
+    pEnc->iQuantShift = iQuantShift & 0x0F;
+    pEnc->iChannels = 0;
+} // end StreamEncoderInit()
+
+// encode iChannels values into pDest, which must hold STREAM_MAX_FRAME_BYTES.
+// returns the number of bytes written, or 0 if iChannels is out of range.
+uint16_t StreamEncodeFrame(StreamEncoder *pEnc, const int16_t iValues[], uint8_t iChannels, uint8_t *pDest)
+{
+    int16_t iQuant[STREAM_MAX_CHANNELS];    // quantized values of this frame
+    int32_t idelta;                         // change since previous frame
+    int32_t imaxdelta;                      // largest absolute change over all channels
+    uint16_t iIndex;                        // output byte counter
+    uint8_t mode;                           // STREAM_MODE_* selected for this frame
+    uint8_t i;                              // loop counter
+
+    if ((iChannels == 0) || (iChannels > STREAM_MAX_CHANNELS)) return 0;
+
+    // quantize and find the largest change since the previous frame
+    imaxdelta = 0;
+    for (i = 0; i < iChannels; i++)
+    {
+        iQuant[i] = (int16_t) (iValues[i] >> pEnc->iQuantShift);
+        idelta = (int32_t) iQuant[i] - (int32_t) pEnc->iPrev[i];
+        if (idelta < 0) idelta = -idelta;
+        if (idelta > imaxdelta) imaxdelta = idelta;
+    }
+
+    // choose the smallest representation that holds every delta
+    if ((pEnc->iChannels != iChannels) || (pEnc->iFramesSinceKey >= pEnc->iKeyframeInterval) ||
+        (imaxdelta > 127))
+        mode = STREAM_MODE_KEYFRAME;
+    else if (imaxdelta > 7)
+        mode = STREAM_MODE_DELTA8;
+    else
+        mode = STREAM_MODE_DELTA4;
+
+    // [2-0]: frame header
+    iIndex = 0;
+    pDest[iIndex++] = (uint8_t) ((mode << 6) | iChannels);
+    pDest[iIndex++] = pEnc->iSequence++;
+    pDest[iIndex++] = pEnc->iQuantShift;
+
+    // [3..]: channel data
+    switch (mode)
+    {
+        case STREAM_MODE_KEYFRAME:
+            for (i = 0; i < iChannels; i++)
+            {
+                pDest[iIndex++] = (uint8_t) (iQuant[i] & 0xFF);
+                pDest[iIndex++] = (uint8_t) ((uint16_t) iQuant[i] >> 8);
+            }
+            pEnc->iFramesSinceKey = 0;
+            break;
+
+        case STREAM_MODE_DELTA8:
+            for (i = 0; i < iChannels; i++)
+                pDest[iIndex++] = (uint8_t) (int8_t) (iQuant[i] - pEnc->iPrev[i]);
+            pEnc->iFramesSinceKey++;
+            break;
+
+        case STREAM_MODE_DELTA4:
+        default:
+            for (i = 0; i < iChannels; i += 2)
+            {
+                pDest[iIndex] = (uint8_t) ((iQuant[i] - pEnc->iPrev[i]) & 0x0F);
+                if ((i + 1) < iChannels)
+                    pDest[iIndex] |= (uint8_t) (((iQuant[i + 1] - pEnc->iPrev[i + 1]) & 0x0F) << 4);
+                iIndex++;
+            }
+            pEnc->iFramesSinceKey++;
+            break;
+    }
+
+    // the decoder reconstructs exactly the quantized values, so track those
+    for (i = 0; i < iChannels; i++) pEnc->iPrev[i] = iQuant[i];
+    pEnc->iChannels = iChannels;
+
+    return iIndex;
+} // end StreamEncodeFrame()
+
+// initialize a decoder. Delta frames are rejected until a keyframe arrives.
+void StreamDecoderInit(StreamDecoder *pDec)
+{
+    pDec->iSequence = 0;
+    pDec->iChannels = 0;
+} // end StreamDecoderInit()
+
+// decode one frame of iLength bytes from pSrc into iValues[], which must hold
+// STREAM_MAX_CHANNELS entries. Returns the number of channels decoded, or -1
+// if the frame is malformed or a frame was lost since the last keyframe.
+// After a -1 the decoder waits for the next keyframe.
+int8_t StreamDecodeFrame(StreamDecoder *pDec, const uint8_t *pSrc, uint16_t iLength, int16_t iValues[])
+{
+    uint8_t mode;           // STREAM_MODE_* of this frame
+    uint8_t iChannels;      // channels in this frame
+    uint8_t iShift;         // quantization shift
+    uint8_t i;              // loop counter
+    int8_t  idelta;         // decoded delta
+    const uint8_t *pData;   // start of channel data
+
+    if (iLength < 3) return -1;
+    mode = pSrc[0] >> 6;
+    iChannels = pSrc[0] & 0x3F;
+    iShift = pSrc[2] & 0x0F;
+    pData = &pSrc[3];
+    if ((iChannels == 0) || (iChannels > STREAM_MAX_CHANNELS)) return -1;
+
+    if (mode == STREAM_MODE_KEYFRAME)
+    {
+        if (iLength < (uint16_t) (3 + 2 * iChannels)) return -1;
+        for (i = 0; i < iChannels; i++)
+            pDec->iPrev[i] = (int16_t) ((uint16_t) pData[2 * i] | ((uint16_t) pData[2 * i + 1] << 8));
+    }
+    else
+    {
+        // deltas are only meaningful if no frame was lost since the last keyframe
+        if ((pDec->iChannels != iChannels) || (pSrc[1] != pDec->iSequence))
+        {
+            pDec->iChannels = 0;
+            return -1;
+        }
+        if (mode == STREAM_MODE_DELTA8)
+        {
+            if (iLength < (uint16_t) (3 + iChannels)) return -1;
+            for (i = 0; i < iChannels; i++)
+                pDec->iPrev[i] += (int8_t) pData[i];
+        }
+        else if (mode == STREAM_MODE_DELTA4)
+        {
+            if (iLength < (uint16_t) (3 + (iChannels + 1) / 2)) return -1;
+            for (i = 0; i < iChannels; i++)
+            {
+                idelta = (int8_t) ((i & 1) ? (pData[i / 2] >> 4) : (pData[i / 2] & 0x0F));
+                if (idelta & 0x08) idelta -= 16;    // sign extend the nibble
+                pDec->iPrev[i] += idelta;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    pDec->iSequence = (uint8_t) (pSrc[1] + 1);
+    pDec->iChannels = iChannels;
+    for (i = 0; i < iChannels; i++)
+        iValues[i] = (int16_t) ((uint16_t) pDec->iPrev[i] << iShift);
+
+    return (int8_t) iChannels;
+} // end StreamDecodeFrame()
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file stream_codec.h
+    \brief Keyframe + quantized delta encoder for slowly changing data channels
+
+    A frame carries up to STREAM_MAX_CHANNELS int16_t channels. Each value is
+    first quantized by dropping iQuantShift low-order bits. A keyframe sends the
+    quantized values in full; other frames send the change since the previous
+    frame as packed 4-bit or 8-bit deltas, whichever is the smallest that fits
+    every channel. A keyframe is forced every iKeyframeInterval frames, and
+    whenever a delta does not fit in 8 bits, so that a receiver that lost a frame
+    resynchronizes within a bounded time.
+
+    Frame layout (before Toolbox byte stuffing):
+    [0]: bits 7-6 frame mode (STREAM_MODE_*), bits 5-0 number of channels
+    [1]: frame sequence number, used by the decoder to detect lost frames
+    [2]: bits 3-0 quantization shift
+    [3..]: channel data, little endian int16_t for keyframes, int8_t for 8-bit
+           deltas, or two 4-bit two's complement deltas per byte (channel 2k in
+           the low nibble) for 4-bit deltas
+
+    The decoder has no dependencies on the Arduino environment, so this file
+    also builds on a host to decode a recorded or live stream.
+*/
+
+#include <stdint.h>
+
+#define STREAM_MAX_CHANNELS         16  ///< max number of int16_t channels per frame
+#define STREAM_MAX_FRAME_BYTES      (3 + 2 * STREAM_MAX_CHANNELS)  ///< size of a full keyframe
+#define STREAM_KEYFRAME_INTERVAL    40  ///< default frames between forced keyframes (1 sec at 40Hz)
+
+/// @name Stream frame modes
+///@{
+#define STREAM_MODE_KEYFRAME    0   ///< full int16_t values
+#define STREAM_MODE_DELTA8      1   ///< int8_t deltas from previous frame
+#define STREAM_MODE_DELTA4      2   ///< packed 4-bit deltas from previous frame
+///@}
+
+/// Encoder state, one per transmitted stream
+typedef struct StreamEncoder {
+    int16_t iPrev[STREAM_MAX_CHANNELS]; ///< quantized values sent in the previous frame
+    uint8_t iSequence;                  ///< sequence number of next frame
+    uint8_t iFramesSinceKey;            ///< frames sent since the last keyframe
+    uint8_t iKeyframeInterval;          ///< force a keyframe after this many frames
+    uint8_t iQuantShift;                ///< number of low order bits dropped from each value (0-15)
+    uint8_t iChannels;                  ///< channel count of previous frame. 0 forces a keyframe
+} StreamEncoder;
+
+/// Decoder state, one per received stream
+typedef struct StreamDecoder {
+    int16_t iPrev[STREAM_MAX_CHANNELS]; ///< quantized values reconstructed from the previous frame
+    uint8_t iSequence;                  ///< sequence number expected in the next frame
+    uint8_t iChannels;                  ///< channel count of previous frame. 0 until a keyframe arrives
+} StreamDecoder;
+
+void StreamEncoderInit(StreamEncoder *pEnc, uint8_t iQuantShift, uint8_t iKeyframeInterval);
+uint16_t StreamEncodeFrame(StreamEncoder *pEnc, const int16_t iValues[], uint8_t iChannels, uint8_t *pDest);
+void StreamDecoderInit(StreamDecoder *pDec);
+int8_t StreamDecodeFrame(StreamDecoder *pDec, const uint8_t *pSrc, uint16_t iLength, int16_t iValues[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_CODEC_H
@@ -29,8 +29,12 @@
 #include <stdint.h>
 
 #include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/approximations.h"
+#include "sensor_fusion/calibration_storage.h"
 #include "sensor_fusion/control.h"
 #include "sensor_fusion/driver_sensors.h"
+#include "sensor_fusion/flight_recorder.h"
+#include "sensor_fusion/fusion.h"
 #include "sensor_fusion/status.h"
 
 const float kDegToRads = PI / 180.0;   ///< To convert Degrees to Radians, multiply by this constant.
@@ -46,13 +50,6 @@ SensorFusion::SensorFusion() {
   sfg_ = new SensorFusionGlobals();
   control_subsystem_ = new ControlSubsystem;
   status_subsystem_ = new StatusSubsystem;
-  sensors_ = new PhysicalSensor
-      [MAX_NUM_SENSORS];  // this implementation uses up to 4 sensors
-                          // (accel/mag; gyro; baro/thermo)
-                          // TODO - can use std::vector as per
-                          // https://stackoverflow.com/questions/14114686/create-an-array-of-structure-using-new
-                          // which will allow adding arbitrary # of sensors.
-
   InitializeInputOutputSubsystem();
   InitializeStatusSubsystem();
   InitializeSensorFusionGlobals();
@@ -61,68 +58,209 @@ SensorFusion::SensorFusion() {
 
 /**
  * @brief Install Sensor in linked list
- * The max length of the list is checked, and if there is room, the 
- * given sensor is inserted at the head of the list.
+ * The given sensor is inserted at the head of the list. There is no
+ * limit on the number of sensors other than available memory.
  * An accelerometer and magnetometer may be combined in one IC - if
  * that is the case then only one call is required to install, 
  * provided the associated *_Init() and *_Read() function reads both
  * the accel & magnetometer data.  The Init() and Read() functions 
  * of each sensor are defined in driver_*.* files.
+ * The first accelerometer, magnetometer and gyroscope installed feed
+ * the fusion algorithms. Each further one of the same type, e.g. on a
+ * redundant IMU board, gets its own FIFO and calibration (see
+ * AccelInstance etc. in sensor_fusion.h) and is read and calibrated
+ * alongside the first.
  * @param sensor_i2c_addr is the I2C bus address of the sensor IC
  * @param sensor_type indicates the type of sensor (e.g. magnetometer)
  * @return True if sensor installed successfully, else False
  */
 bool SensorFusion::InstallSensor(uint8_t sensor_i2c_addr,
                                    SensorType sensor_type) {
+  PhysicalSensor *sensor;
+  initializeSensor_t *initialize;
+  readSensor_t *read;
+  uint8_t schedule;
 
-    if( num_sensors_installed_ >= MAX_NUM_SENSORS ) {
-        //already have max number of sensors installed
-      return false;
-    }
-    switch (sensor_type) {
+  switch (sensor_type) {
     case SensorType::kAccelerometer:
-      sfg_->installSensor(sfg_, &sensors_[num_sensors_installed_],
-                          sensor_i2c_addr, kLoopsPerAccelRead, NULL,
-                          FXOS8700_Accel_Init, FXOS8700_Accel_Read);
-      ++num_sensors_installed_;
+      initialize = FXOS8700_Accel_Init;
+      read = FXOS8700_Accel_Read;
+      schedule = kLoopsPerAccelRead;
       break;
     case SensorType::kMagnetometer:
-      sfg_->installSensor(sfg_, &sensors_[num_sensors_installed_],
-                          sensor_i2c_addr, kLoopsPerMagRead, NULL,
-                          FXOS8700_Mag_Init, FXOS8700_Mag_Read);
-      ++num_sensors_installed_;
+      initialize = FXOS8700_Mag_Init;
+      read = FXOS8700_Mag_Read;
+      schedule = kLoopsPerMagRead;
       break;
     case SensorType::kMagnetometerAccelerometer:
-      sfg_->installSensor(sfg_, &sensors_[num_sensors_installed_],
-                          sensor_i2c_addr, kLoopsPerAccelRead, NULL,
-                          FXOS8700_Init, FXOS8700_Read);
-      ++num_sensors_installed_;
+      initialize = FXOS8700_Init;
+      read = FXOS8700_Read;
+      schedule = kLoopsPerAccelRead;
       break;
     case SensorType::kGyroscope:
-      sfg_->installSensor(sfg_, &sensors_[num_sensors_installed_],
-                          sensor_i2c_addr, kLoopsPerGyroRead, NULL,
-                          FXAS21002_Init, FXAS21002_Read);
-      ++num_sensors_installed_;
+      initialize = FXAS21002_Init;
+      read = FXAS21002_Read;
+      schedule = kLoopsPerGyroRead;
       break;
     case SensorType::kThermometer:
       // use the thermometer built into FXOS8700. Not precise nor calibrated,
       // but OK.
-      sfg_->installSensor(sfg_, &sensors_[num_sensors_installed_],
-                          sensor_i2c_addr, kLoopsPerThermRead, NULL,
-                          FXOS8700_Therm_Init, FXOS8700_Therm_Read);
-      ++num_sensors_installed_;
+      initialize = FXOS8700_Therm_Init;
+      read = FXOS8700_Therm_Read;
+      schedule = kLoopsPerThermRead;
       break;
     case SensorType::kBarometer:
       // TODO define some access functions for this
       // TODO add barometer sensor
-      break;
+      return true;
     default:
       // unrecognized sensor type
-      break;
+      return true;
+  }
+
+  sensor = new PhysicalSensor();
+  if (0 != sfg_->installSensor(sfg_, sensor, sensor_i2c_addr, schedule, NULL,
+                               initialize, read)) {
+    delete sensor;
+    return false;
+  }
+  sensors_.push_back(sensor);
+
+  // point the driver at the logical sensor(s) it fills, so that a second
+  // board's readings don't land in the first board's FIFOs
+  sensor->pAccel = NULL;
+  sensor->pMag = NULL;
+  sensor->pGyro = NULL;
+  if ((sensor_type == SensorType::kAccelerometer) ||
+      (sensor_type == SensorType::kMagnetometerAccelerometer)) {
+    sensor->pAccel = AddAccelerometer();
+  }
+  if ((sensor_type == SensorType::kMagnetometer) ||
+      (sensor_type == SensorType::kMagnetometerAccelerometer)) {
+    sensor->pMag = AddMagnetometer();
+  }
+  if (sensor_type == SensorType::kGyroscope) {
+    sensor->pGyro = AddGyroscope();
   }
   return true;
 }  // end InstallSensor()
 
+/**
+ * @brief Number of sensors of one type installed with InstallSensor().
+ * A kMagnetometerAccelerometer counts as both a magnetometer and an
+ * accelerometer.
+ * @param sensor_type kAccelerometer, kMagnetometer or kGyroscope
+ * @return Number installed, 0 for other sensor types
+ */
+uint8_t SensorFusion::GetNumSensors(SensorType sensor_type) {
+  switch (sensor_type) {
+    case SensorType::kAccelerometer:
+      return num_accel_installed_;
+    case SensorType::kMagnetometer:
+      return num_mag_installed_;
+    case SensorType::kGyroscope:
+      return num_gyro_installed_;
+    default:
+      return 0;
+  }
+}  // end GetNumSensors()
+
+/**
+ * @brief Choose how redundant sensors of one type are combined.
+ * Only matters when more than one sensor of a type is installed.
+ * @param mode SENSOR_VOTE_PRIMARY, SENSOR_VOTE_MEAN or SENSOR_VOTE_MEDIAN,
+ * see sensor_voting.h. The default is F_SENSOR_VOTE in build.h.
+ */
+void SensorFusion::SetSensorVoteMode(uint8_t mode) {
+  sfg_->iVoteMode = mode;
+  // until the next fusion cycle with the new mode
+#if F_USING_ACCEL
+  sfg_->AccelVote.iUsed = 0;
+#endif
+#if F_USING_MAG
+  sfg_->MagVote.iUsed = 0;
+#endif
+#if F_USING_GYRO
+  sfg_->GyroVote.iUsed = 0;
+#endif
+}  // end SetSensorVoteMode()
+
+/**
+ * @brief Number of sensors of one type combined in the last fusion cycle.
+ * Sensors that failed, delivered no samples, or were rejected as outliers
+ * are not counted. Returns 0 if only one sensor of the type is installed
+ * or voting is off.
+ * @param sensor_type kAccelerometer, kMagnetometer or kGyroscope
+ */
+uint8_t SensorFusion::GetNumSensorsVoted(SensorType sensor_type) {
+  const SensorVote *vote;
+  uint8_t count = 0;
+  switch (sensor_type) {
+#if F_USING_ACCEL
+    case SensorType::kAccelerometer:
+      vote = &(sfg_->AccelVote);
+      break;
+#endif
+#if F_USING_MAG
+    case SensorType::kMagnetometer:
+      vote = &(sfg_->MagVote);
+      break;
+#endif
+#if F_USING_GYRO
+    case SensorType::kGyroscope:
+      vote = &(sfg_->GyroVote);
+      break;
+#endif
+    default:
+      return 0;
+  }
+  for (uint8_t used = vote->iUsed; used; used >>= 1) count += used & 1;
+  return count;
+}  // end GetNumSensorsVoted()
+
+/**
+ * @brief Storage for the next accelerometer installed.
+ * The first is sfg_->Accel, later ones are added to the redundant
+ * sensor registry. Instances are never freed, as they stay linked
+ * into sfg_ for the life of the object.
+ */
+struct AccelSensor *SensorFusion::AddAccelerometer(void) {
+  if (num_accel_installed_++ == 0) {
+    return &(sfg_->Accel);
+  }
+  AccelInstance *instance = new AccelInstance();
+  installSensorInstance(sfg_, SENSOR_INSTANCE_ACCEL, instance);
+  return &(instance->Accel);
+}  // end AddAccelerometer()
+
+/**
+ * @brief Storage for the next magnetometer installed.
+ * The first is sfg_->Mag, later ones are added to the redundant
+ * sensor registry.
+ */
+struct MagSensor *SensorFusion::AddMagnetometer(void) {
+  if (num_mag_installed_++ == 0) {
+    return &(sfg_->Mag);
+  }
+  MagInstance *instance = new MagInstance();
+  installSensorInstance(sfg_, SENSOR_INSTANCE_MAG, instance);
+  return &(instance->Mag);
+}  // end AddMagnetometer()
+
+/**
+ * @brief Storage for the next gyroscope installed.
+ * The first is sfg_->Gyro, later ones are added to the redundant
+ * sensor registry.
+ */
+struct GyroSensor *SensorFusion::AddGyroscope(void) {
+  if (num_gyro_installed_++ == 0) {
+    return &(sfg_->Gyro);
+  }
+  GyroInstance *instance = new GyroInstance();
+  installSensorInstance(sfg_, SENSOR_INSTANCE_GYRO, instance);
+  return &(instance->Gyro);
+}  // end AddGyroscope()
+
 /**
  * Initialize the Control subsystem, which receives external commands and sends
  * data packets.
@@ -272,11 +410,38 @@ void SensorFusion::InjectCommand(const char *command) {
   sfg_->pControlSubsystem->injectCommand(sfg_, (uint8_t *)command, 4);
 }  // end InjectCommand()
 
+/**
+ * @brief Add an application-specific command to the control subsystem.
+ *
+ * Once registered, the command is recognized on the serial and WiFi
+ * input paths and by InjectCommand() in the same way as the built-in
+ * commands, and calls handler(sfg, arg) each time it is received.
+ * Up to MAX_USER_COMMANDS (see control.h) may be registered. Commands
+ * belong to this SensorFusion object only.
+ *
+ * @param command four-character command. Shorter commands must be padded
+ * with spaces, as in "AB  ".
+ * @param handler function to process the command
+ * @param arg value passed to the handler, allowing one handler to serve
+ * several commands
+ * @param arg_min smallest value a binary command frame may pass in place of arg
+ * @param arg_max largest value a binary command frame may pass in place of arg.
+ * By default it is below arg_min, so binary frames cannot change arg.
+ * @return True if registered, False if the command already exists or
+ * there is no room for more commands.
+ */
+bool SensorFusion::RegisterCommand(const char *command,
+                                   commandHandler_t *handler, int32_t arg,
+                                   int32_t arg_min, int32_t arg_max) {
+  return ::RegisterCommand(control_subsystem_, command, handler, arg, arg_min,
+                           arg_max);
+}  // end RegisterCommand()
+
 /**
  * @brief Save current magnetic calibration to non-volatile memory.
  *
  * Passes to the fusion control subsystem the command to save
- * the current magnetic calibration parameters to EEPROM. This
+ * the current magnetic calibration parameters to flash. This
  * calibration will then be loaded each time the system restarts.
  * 
  * One can pass this command directly using InjectCommand(), but
@@ -286,13 +451,311 @@ void SensorFusion::InjectCommand(const char *command) {
  * routine in the background, and if a superior set of calibration
  * parameters are calculated based on recent magnetic measurements,
  * then these new parameters replace the current ones in RAM.
- * However, it is only via this command that the parameters can be
- * caused to persist beyond the next system reset.
+ * Clearly better parameters are also saved automatically, see
+ * SetMagneticCalibrationAutoSave(); this command saves the current
+ * parameters whether or not they are better.
  */
 void SensorFusion::SaveMagneticCalibration(void) {
   InjectCommand("SVMC");
 }  // end SaveMagneticCalibration()
 
+/**
+ * @brief Set when improved magnetic calibrations are saved automatically.
+ *
+ * A calibration accepted by the background routine is saved to flash
+ * when it comes from a more sophisticated solver than the stored one,
+ * or when its fit error is at least improvement_pc below that of the
+ * stored one. Saves are at least interval_s apart to limit flash wear;
+ * an improvement found sooner is saved once the interval has passed.
+ * The flash write itself is done by ServiceCalibrationStore().
+ * @param improvement_pc fit error improvement (%) that triggers a save, 0 disables
+ * @param interval_s minimum time between automatic saves
+ */
+void SensorFusion::SetMagneticCalibrationAutoSave(float improvement_pc,
+                                                  float interval_s) {
+  sfg_->MagCal.fAutoSaveImprovementpc = improvement_pc;
+  sfg_->MagCal.iAutoSaveIntervalLoops = (int32_t)(interval_s * FUSION_HZ);
+}  // end SetMagneticCalibrationAutoSave()
+
+/**
+ * @brief Set how often the Kalman filter state is saved for a warm start.
+ *
+ * The gyro offset, the error estimates setting the filter's Qw
+ * covariance and the orientation are saved to flash every interval_s
+ * once the orientation has locked to the eCompass. After a power up the
+ * filter continues from them rather than converging again from scratch,
+ * if they pass checks of their ranges. Later resets, such as those from
+ * SetFusionTuning(), start without them. The saved orientation is used
+ * only if the unit has not turned by more than WARMSTART_MAX_ANGLE_DEG
+ * (fusion.h) while off.
+ * The flash write itself is done by ServiceCalibrationStore().
+ * @param interval_s time between saves, 0 for no periodic saves
+ */
+void SensorFusion::SetWarmStartInterval(float interval_s) {
+  fSetWarmStartInterval(sfg_, (int32_t)(interval_s * FUSION_HZ));
+}  // end SetWarmStartInterval()
+
+/**
+ * @brief Save the Kalman filter state for a warm start on the next cycle.
+ *
+ * Useful just before the unit powers itself down. The state is written by
+ * the next ServiceCalibrationStore() after RunFusion().
+ */
+void SensorFusion::SaveWarmStart(void) {
+  fRequestWarmStartSave(sfg_);
+}  // end SaveWarmStart()
+
+/**
+ * @brief Write calibrations queued for saving by the fusion cycle to flash.
+ *
+ * Call from loop() after RunFusion(). The calibration store and the
+ * queued copies are not locked, so the call must be made by the task
+ * that runs RunFusion(), never from another task.
+ * A flash write takes tens of ms, so RunFusion() only copies an improved
+ * magnetic calibration or the warm start state of the Kalman filter to
+ * RAM and leaves the write to this call.
+ */
+void SensorFusion::ServiceCalibrationStore(void) {
+  SavePendingCalibrationsToNVM(sfg_);
+}  // end ServiceCalibrationStore()
+
+/**
+ * @brief Read the filter constants currently used by the fusion algorithms.
+ * @param tuning receives the low pass filter time constants and Kalman
+ * noise variances. Fields of algorithms not enabled in build.h hold
+ * their defaults from fusion.h.
+ */
+void SensorFusion::GetFusionTuning(FusionTuning *tuning) {
+  fGetFusionTuning(sfg_, tuning);
+}  // end GetFusionTuning()
+
+/**
+ * @brief Replace the filter constants used by the fusion algorithms.
+ *
+ * The defaults come from fusion.h. Start from GetFusionTuning() and
+ * change only the fields of interest. The fusion algorithms restart
+ * on their next cycle so the new constants take effect, which is the
+ * same as the reset command: the orientation re-converges over the
+ * following few seconds. The magnetic calibration is kept; the gyro
+ * offset restarts from the stored calibration or the current reading.
+ * @param tuning new low pass filter time constants and Kalman noise variances
+ */
+void SensorFusion::SetFusionTuning(const FusionTuning *tuning) {
+  fSetFusionTuning(sfg_, tuning);
+}  // end SetFusionTuning()
+
+/**
+ * @brief Start recording raw sensor readings and fusion outputs to flash.
+ *
+ * Each fusion cycle, the raw FIFO contents of the primary sensors, the
+ * orientation and any status change are copied to about 8 kB of RAM
+ * blocks, which ServiceFlightRecorder() writes to a LittleFS partition.
+ * The files can be replayed on a PC, see flight_recorder.h. Needs
+ * F_FLIGHT_RECORDER set in build.h and a file system partition.
+ * @param directory LittleFS directory for the log files
+ * @return true if recording started
+ */
+bool SensorFusion::BeginFlightRecorder(const char *directory) {
+  if (flight_recorder_) return true;
+  flight_recorder_ = new FlightRecorder;
+  initFlightRecorder(flight_recorder_);
+  if (!FlightRecorderBeginStorage(flight_recorder_, directory)) {
+    delete flight_recorder_;
+    flight_recorder_ = NULL;
+    return false;
+  }
+  FlightRecorderEnable(flight_recorder_, true);
+  sfg_->pFlightRecorder = flight_recorder_;
+  return true;
+}  // end BeginFlightRecorder()
+
+/**
+ * @brief Write the recorded data of the last few fusion cycles to flash.
+ *
+ * Call from loop() after RunFusion(), or at any time from another task.
+ * Flash writes take a few ms, so the fusion cycle itself only copies data
+ * to RAM. If this is not called often enough the RAM blocks fill up and
+ * cycles are dropped from the log, which is noted in the log.
+ */
+void SensorFusion::ServiceFlightRecorder(void) {
+  if (flight_recorder_) FlightRecorderService(flight_recorder_);
+}  // end ServiceFlightRecorder()
+
+/**
+ * @brief Stop recording, writing out everything recorded so far.
+ * Call from the task that runs RunFusion().
+ */
+void SensorFusion::StopFlightRecorder(void) {
+  if (!flight_recorder_) return;
+  sfg_->pFlightRecorder = NULL;  // between cycles, so no cycle reaches it from here on
+  FlightRecorderCompleteDetached(flight_recorder_);
+  FlightRecorderEndStorage(flight_recorder_);
+  delete flight_recorder_;
+  flight_recorder_ = NULL;
+}  // end StopFlightRecorder()
+
+/**
+ * @brief Select change-triggered output of the Toolbox packets.
+ *
+ * When enabled, ProduceToolboxOutput() only sends packets when the
+ * orientation has rotated by more than angle_deg, or any axis of the
+ * angular velocity has changed by more than rate_deg_per_s, since the
+ * last packet sent. A packet is always sent at least every heartbeat_s
+ * seconds so the receiver knows the unit is alive. When disabled, packets
+ * are sent at the fixed rate set by MAXPACKETRATEHZ in build.h.
+ *
+ * Commands "EVT+" and "EVT-" toggle the same mode using the most
+ * recently set thresholds.
+ *
+ * @param enable true for change-triggered output, false for fixed rate
+ * @param angle_deg orientation change that triggers a packet
+ * @param rate_deg_per_s angular velocity change that triggers a packet
+ * @param heartbeat_s maximum interval between packets
+ */
+void SensorFusion::SetEventOutput(bool enable, float angle_deg,
+                                  float rate_deg_per_s, float heartbeat_s) {
+  float heartbeat_cycles = heartbeat_s * FUSION_HZ;
+  if (heartbeat_cycles > 0xFFFF) {
+    heartbeat_cycles = 0xFFFF;
+  }
+  control_subsystem_->fEventAngleDeg = angle_deg;
+  control_subsystem_->fEventRateDegPerSec = rate_deg_per_s;
+  control_subsystem_->iEventHeartbeat = (uint16_t)heartbeat_cycles;
+  control_subsystem_->iEventCycles = control_subsystem_->iEventHeartbeat;
+  control_subsystem_->EventPacketOn = enable;
+}  // end SetEventOutput()
+
+/**
+ * @brief Print the RAM used by each of the major library structures.
+ *
+ * Sizes are reported for the structures as compiled with the current
+ * build.h settings, so this shows the effect of changing buffer sizes
+ * such as MAXMEASUREMENTS or MAX_BATCH_SAMPLES.
+ * @param out Where to print the report, e.g. &Serial.
+ */
+void SensorFusion::PrintMemoryFootprint(Print *out) {
+  out->printf("SensorFusionGlobals     %6u\n", (unsigned)sizeof(SensorFusionGlobals));
+#if F_USING_ACCEL
+  out->printf("  AccelSensor           %6u\n", (unsigned)sizeof(struct AccelSensor));
+  out->printf("  AccelCalibration      %6u\n", (unsigned)sizeof(AccelCalibration));
+  out->printf("  AccelBuffer           %6u\n", (unsigned)sizeof(AccelBuffer));
+#endif
+#if F_USING_MAG
+  out->printf("  MagSensor             %6u\n", (unsigned)sizeof(struct MagSensor));
+  out->printf("  MagCalibration        %6u\n", (unsigned)sizeof(struct MagCalibration));
+  out->printf("  MagBuffer             %6u\n", (unsigned)sizeof(struct MagBuffer));
+#endif
+#if F_USING_ACCEL || F_USING_MAG
+  out->printf("  CalibrationScratch    %6u\n", (unsigned)sizeof(CalibrationScratch));
+#endif
+#if F_USING_GYRO
+  out->printf("  GyroSensor            %6u\n", (unsigned)sizeof(struct GyroSensor));
+#endif
+#if F_9DOF_GBY_KALMAN
+  out->printf("  SV_9DOF_GBY_KALMAN    %6u\n", (unsigned)sizeof(struct SV_9DOF_GBY_KALMAN));
+#endif
+  // each redundant sensor installed beyond the first of its type adds one of these
+  if (num_accel_installed_ > 1) {
+    out->printf("AccelInstance     %u x %6u\n", (unsigned)(num_accel_installed_ - 1),
+                (unsigned)sizeof(struct AccelInstance));
+  }
+  if (num_mag_installed_ > 1) {
+    out->printf("MagInstance       %u x %6u\n", (unsigned)(num_mag_installed_ - 1),
+                (unsigned)sizeof(struct MagInstance));
+  }
+  if (num_gyro_installed_ > 1) {
+    out->printf("GyroInstance      %u x %6u\n", (unsigned)(num_gyro_installed_ - 1),
+                (unsigned)sizeof(struct GyroInstance));
+  }
+  out->printf("ControlSubsystem        %6u\n", (unsigned)sizeof(ControlSubsystem));
+  out->printf("StatusSubsystem         %6u\n", (unsigned)sizeof(StatusSubsystem));
+  out->printf("output buffer           %6u\n", (unsigned)MAX_LEN_SERIAL_OUTPUT_BUF);
+}  // end PrintMemoryFootprint()
+
+/// One tier of trig approximations compared by PrintTrigBenchmark()
+struct TrigTier {
+  const char *name;
+  float (*asin_deg)(float);
+  float (*acos_deg)(float);
+  float (*atan_deg)(float);
+  float (*atan2_deg)(float, float);
+};
+
+// libm single precision functions in degrees, timed alongside the approximations
+static float LibmAsinDeg(float x) { return asinf(x) * (180.0F / PI); }
+static float LibmAcosDeg(float x) { return acosf(x) * (180.0F / PI); }
+static float LibmAtanDeg(float x) { return atanf(x) * (180.0F / PI); }
+static float LibmAtan2Deg(float y, float x) { return atan2f(y, x) * (180.0F / PI); }
+
+/**
+ * @brief Print the accuracy and speed of each trig approximation tier.
+ *
+ * For fasin_deg(), facos_deg(), fatan_deg() and fatan2_deg() in the fast,
+ * standard and precise tiers, and for libm, prints the maximum error (deg)
+ * against double precision libm over the whole input range and the time
+ * per call (ns). Use it to choose F_TRIG_TIER in build.h for a target.
+ * Takes around a second on an ESP8266, so run it before starting the fusion.
+ * @param out Where to print the report, e.g. &Serial.
+ */
+void SensorFusion::PrintTrigBenchmark(Print *out) {
+  const TrigTier tiers[] = {
+      {"fast", fasin_deg_fast, facos_deg_fast, fatan_deg_fast, fatan2_deg_fast},
+      {"standard", fasin_deg, facos_deg, fatan_deg, fatan2_deg},
+      {"precise", fasin_deg_precise, facos_deg_precise, fatan_deg_precise,
+       fatan2_deg_precise},
+      {"libm", LibmAsinDeg, LibmAcosDeg, LibmAtanDeg, LibmAtan2Deg}};
+  const int kSamples = 2001;  // odd, so both ends of each range are included
+  const double kRadToDeg = 180.0 / M_PI;
+  volatile float sink;  // keeps the timed calls from being optimized away
+
+  out->printf("tier       asin err    ns  acos err    ns  atan err    ns atan2 err    ns\n");
+  for (const TrigTier &tier : tiers) {
+    float max_err[4] = {0.0F, 0.0F, 0.0F, 0.0F};
+    unsigned long elapsed_us[4];
+    // error sweep: asin and acos over -1 to 1, atan over -89 to 89 deg, atan2 around the circle
+    for (int i = 0; i < kSamples; i++) {
+      float frac = (2.0F * i) / (kSamples - 1) - 1.0F;  // -1 to 1
+      float t = tanf(frac * 89.0F * kDegToRads);
+      float y = sinf(frac * 180.0F * kDegToRads);
+      float x = cosf(frac * 180.0F * kDegToRads);
+      float err[4];
+      err[0] = fabs(tier.asin_deg(frac) - asin(frac) * kRadToDeg);
+      err[1] = fabs(tier.acos_deg(frac) - acos(frac) * kRadToDeg);
+      err[2] = fabs(tier.atan_deg(t) - atan(t) * kRadToDeg);
+      err[3] = fabs(tier.atan2_deg(y, x) - atan2(y, x) * kRadToDeg);
+      if (err[3] > 180.0F) {
+        err[3] = fabs(360.0F - err[3]);  // +180 and -180 deg are the same angle
+      }
+      for (int j = 0; j < 4; j++) {
+        if (err[j] > max_err[j]) {
+          max_err[j] = err[j];
+        }
+      }
+    }
+    // timing: the input generation is the same for every tier
+    const float step = 2.0F / kSamples;
+    unsigned long start = micros();
+    for (float x = -1.0F; x < 1.0F; x += step) sink = tier.asin_deg(x);
+    elapsed_us[0] = micros() - start;
+    start = micros();
+    for (float x = -1.0F; x < 1.0F; x += step) sink = tier.acos_deg(x);
+    elapsed_us[1] = micros() - start;
+    start = micros();
+    for (float x = -1.0F; x < 1.0F; x += step) sink = tier.atan_deg(20.0F * x);
+    elapsed_us[2] = micros() - start;
+    start = micros();
+    for (float x = -1.0F; x < 1.0F; x += step) sink = tier.atan2_deg(x, 1.0F - x * x);
+    elapsed_us[3] = micros() - start;
+
+    out->printf("%-8s", tier.name);
+    for (int j = 0; j < 4; j++) {
+      out->printf(" %9.2e %5lu", max_err[j], elapsed_us[j] * 1000UL / kSamples);
+    }
+    out->printf("\n");
+  }
+  (void)sink;
+}  // end PrintTrigBenchmark()
+
 /**
  * @brief @return Boolean indicating whether orientation data are valid
  */
@@ -520,7 +983,7 @@ float SensorFusion::GetMagneticFitErrorTrial(void) {
  * This function returns the measure of the goodness of fit of the
  * currently-used calibration parameter set. Units are in % and a
  * value less than 3.5% is considered good. If no calibration is
- * available on startup (i.e. none saved in EEPROM) then a value
+ * available on startup (i.e. none saved in flash) then a value
  * of 0 is returned briefly during program startup, indicating 
  * that insufficient data are available to calculate a fit. 
  */
@@ -16,10 +16,13 @@
 
 #include <Stream.h>
 
+#include <vector>
+
 #include "board.h"
 #include "build.h"
 #include "sensor_fusion/sensor_fusion.h"
 #include "sensor_fusion/control.h"
+#include "sensor_fusion/fusion.h"
 #include "sensor_fusion/status.h"
 
 /**
@@ -35,8 +38,6 @@ enum class SensorType {
   kThermometer
 };
 
-#define MAX_NUM_SENSORS  4    //TODO can replace with vector for arbitrary num sensors
-
 /**
  *  Class that wraps the various mostly-C-style functions of the
  *  sensor fusion code into easier to use methods. Not all the
@@ -47,6 +48,9 @@ class SensorFusion {
  public:
   SensorFusion();
   bool InstallSensor(uint8_t sensor_i2c_addr, SensorType sensor_type);
+  uint8_t GetNumSensors(SensorType sensor_type);
+  void SetSensorVoteMode(uint8_t mode);
+  uint8_t GetNumSensorsVoted(SensorType sensor_type);
   bool InitializeInputOutputSubsystem(const Stream *serial_port = NULL,
                                       const void *tcp_client = NULL);
   void Begin(int pin_i2c_sda = -1, int pin_i2c_scl = -1);
@@ -57,7 +61,26 @@ class SensorFusion {
   bool SendArbitraryData(const char *buffer, uint16_t data_length);
   void ProcessCommands(void);
   void InjectCommand(const char *command);
+  bool RegisterCommand(const char *command, commandHandler_t *handler,
+                       int32_t arg = 0, int32_t arg_min = 1,
+                       int32_t arg_max = 0);
   void SaveMagneticCalibration(void);
+  void SetMagneticCalibrationAutoSave(
+      float improvement_pc = MAGCAL_AUTOSAVE_IMPROVEMENT_PC,
+      float interval_s = MAGCAL_AUTOSAVE_INTERVAL_SECS);
+  void SetWarmStartInterval(float interval_s = WARMSTART_SAVE_SECS);
+  void SaveWarmStart(void);
+  void ServiceCalibrationStore(void);
+  void GetFusionTuning(FusionTuning *tuning);
+  void SetFusionTuning(const FusionTuning *tuning);
+  bool BeginFlightRecorder(const char *directory = "/flightrec");
+  void ServiceFlightRecorder(void);
+  void StopFlightRecorder(void);
+  void SetEventOutput(bool enable, float angle_deg = EVENT_ANGLE_DEG,
+                      float rate_deg_per_s = EVENT_RATE_DEGPERSEC,
+                      float heartbeat_s = EVENT_HEARTBEAT_SECS);
+  void PrintMemoryFootprint(Print *out);
+  void PrintTrigBenchmark(Print *out);
   bool IsDataValid(void);
   int GetSystemStatus(void);
   float GetHeadingDegrees(void);
@@ -93,14 +116,21 @@ class SensorFusion {
  private:
   void InitializeStatusSubsystem(void);
   void InitializeSensorFusionGlobals(void);
+  struct AccelSensor *AddAccelerometer(void);
+  struct MagSensor *AddMagnetometer(void);
+  struct GyroSensor *AddGyroscope(void);
 
   SensorFusionGlobals *sfg_;  ///< Primary sensor fusion data structure
   ControlSubsystem
       *control_subsystem_;             ///< command and data streaming structure
   StatusSubsystem *status_subsystem_;  ///< visual status indicator structure
-  PhysicalSensor *sensors_;            ///< linked list of up to 4 sensors
-  uint8_t num_sensors_installed_ =
-      0;  ///< tracks how many sensors have been added to list
+  std::vector<PhysicalSensor *>
+      sensors_;  ///< every sensor installed, also linked into sfg_->pSensors
+  uint8_t num_accel_installed_ = 0;  ///< accelerometers installed, see AddAccelerometer()
+  uint8_t num_mag_installed_ = 0;    ///< magnetometers installed, see AddMagnetometer()
+  uint8_t num_gyro_installed_ = 0;   ///< gyroscopes installed, see AddGyroscope()
+  struct FlightRecorder *flight_recorder_ =
+      NULL;  ///< RAM blocks of the flight recorder, NULL when not recording
 
   /**
    * Constants of the form kLoopsPer_____ set the relationship between